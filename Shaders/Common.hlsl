@@ -72,11 +72,19 @@ cbuffer cbPass : register(b2)
 	Light gLights[MaxLights];
 };
 
+// gPaletteFormat values, ePaletteFormat on the CPU
+#define PALETTE_AFFINE_3X4 0
+#define PALETTE_DUAL_QUATERNION 1
+
 cbuffer cbPlayer : register(b3)
 {
 	float4x4 gChaWorld;
 	float4x4 gChaTexTransform;
-	float4x4 gBoneTransforms[96];
+	uint gPaletteFormat;
+	float gPaletteScale;
+	float2 cbPerCharacterPad1;
+	// Three rows per bone, or a rotation and a dual quaternion
+	float4 gBonePalette[96 * 3];
 };
 
 cbuffer cbMonster : register(b4)
@@ -99,3 +107,90 @@ cbuffer cbMonsterUI : register(b6)
 	float4x4 gMonsterUIWorld;
 	float4x4 gMonsterUITexTransform;
 };
+
+// The vertex QTangent is a quaternion that rotates the x axis to the tangent
+// and the z axis to the normal. The sign of w is the bitangent handedness.
+void DecodeQTangent(float4 q, out float3 normal, out float4 tangent)
+{
+	q = normalize(q);
+
+	normal = float3(
+		2.0f * (q.x * q.z + q.w * q.y),
+		2.0f * (q.y * q.z - q.w * q.x),
+		1.0f - 2.0f * (q.x * q.x + q.y * q.y));
+
+	tangent.xyz = float3(
+		1.0f - 2.0f * (q.y * q.y + q.z * q.z),
+		2.0f * (q.x * q.y + q.w * q.z),
+		2.0f * (q.x * q.z - q.w * q.y));
+	tangent.w = q.w < 0.0f ? -1.0f : 1.0f;
+}
+
+// Rotates v by the unit quaternion q.
+float3 QuaternionRotate(float4 q, float3 v)
+{
+	return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// Blends the palette entries of up to four bones and skins a vertex with them.
+// Dual quaternions are blended linearly after being brought to the hemisphere
+// of the first bone, and normalized.
+void SkinVertex(float3 posL, float3 normalL, float3 tangentL, float weights[4], uint4 boneIndices,
+	out float3 skinnedPosL, out float3 skinnedNormalL, out float3 skinnedTangentL)
+{
+	if (gPaletteFormat == PALETTE_DUAL_QUATERNION)
+	{
+		float4 pivot = gBonePalette[boneIndices[0] * 2];
+		float4 real = float4(0.0f, 0.0f, 0.0f, 0.0f);
+		float4 dual = float4(0.0f, 0.0f, 0.0f, 0.0f);
+		for (int i = 0; i < 4; ++i)
+		{
+			float4 boneReal = gBonePalette[boneIndices[i] * 2];
+			float weight = dot(boneReal, pivot) < 0.0f ? -weights[i] : weights[i];
+			real += weight * boneReal;
+			dual += weight * gBonePalette[boneIndices[i] * 2 + 1];
+		}
+
+		float invLength = 1.0f / length(real);
+		real *= invLength;
+		dual *= invLength;
+
+		// t = 2 * dual * conjugate(real)
+		float3 translation = 2.0f * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+		skinnedPosL = QuaternionRotate(real, posL * gPaletteScale) + translation;
+		skinnedNormalL = QuaternionRotate(real, normalL);
+		skinnedTangentL = QuaternionRotate(real, tangentL);
+	}
+	else
+	{
+		float3x4 blended = (float3x4)0.0f;
+		for (int i = 0; i < 4; ++i)
+		{
+			uint row = boneIndices[i] * 3;
+			blended += weights[i] * float3x4(gBonePalette[row], gBonePalette[row + 1], gBonePalette[row + 2]);
+		}
+
+		// Assume no nonuniform scaling when transforming normals, so 
+		// that we do not have to use the inverse-transpose.
+		skinnedPosL = mul(blended, float4(posL, 1.0f));
+		skinnedNormalL = mul((float3x3)blended, normalL);
+		skinnedTangentL = mul((float3x3)blended, tangentL);
+	}
+}
+
+// Transforms a normal map sample to world space.
+float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, float4 tangentW)
+{
+	// Uncompress each component from [0,1] to [-1,1].
+	float3 normalT = 2.0f * normalMapSample - 1.0f;
+
+	// Build orthonormal basis.
+	float3 N = unitNormalW;
+	float3 T = normalize(tangentW.xyz - dot(tangentW.xyz, N) * N);
+	float3 B = tangentW.w * cross(N, T);
+
+	float3x3 TBN = float3x3(T, B, N);
+
+	// Transform from tangent space to world space.
+	return mul(normalT, TBN);
+}
@@ -7,7 +7,7 @@
 struct VertexIn
 {
 	float3 PosL    : POSITION;
-	float3 NormalL : NORMAL;
+	float4 QTangentL : TANGENT;
 	float2 TexC    : TEXCOORD;
 #ifdef SKINNED
 	float3 BoneWeights : WEIGHTS;
@@ -20,6 +20,7 @@ struct VertexOut
 	float4 PosH    : SV_POSITION;
 	float3 PosW    : POSITION;
 	float3 NormalW : NORMAL;
+	float4 TangentW : TANGENT;
 	float2 TexC    : TEXCOORD;
 #ifdef SKINNED
 	uint4 BoneIndices : BONEINDICES;
@@ -30,6 +31,10 @@ VertexOut VS(VertexIn vin)
 {
 	VertexOut vout = (VertexOut)0.0f;
 
+	float3 normalL;
+	float4 tangentL;
+	DecodeQTangent(vin.QTangentL, normalL, tangentL);
+
 #ifdef SKINNED
 	float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
 	weights[0] = vin.BoneWeights.x;
@@ -37,25 +42,22 @@ VertexOut VS(VertexIn vin)
 	weights[2] = vin.BoneWeights.z;
 	weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
 
-	float3 posL = float3(0.0f, 0.0f, 0.0f);
-	float3 normalL = float3(0.0f, 0.0f, 0.0f);
-	for (int i = 0; i < 4; ++i)
-	{
-		// Assume no nonuniform scaling when transforming normals, so 
-		// that we do not have to use the inverse-transpose.
-		posL += weights[i] * mul(float4(vin.PosL, 1.0f), gBoneTransforms[vin.BoneIndices[i]]).xyz;
-		normalL += weights[i] * mul(vin.NormalL, (float3x3)gBoneTransforms[vin.BoneIndices[i]]);
-	}
+	float3 posL;
+	float3 skinnedNormalL;
+	float3 skinnedTangentL;
+	SkinVertex(vin.PosL, normalL, tangentL.xyz, weights, vin.BoneIndices, posL, skinnedNormalL, skinnedTangentL);
 
 	vin.PosL = posL;
-	vin.NormalL = normalL;
+	normalL = skinnedNormalL;
+	tangentL.xyz = skinnedTangentL;
 
 	vout.BoneIndices = vin.BoneIndices;
 
 	float4 posW = mul(float4(vin.PosL, 1.0f), gChaWorld);
 	vout.PosW = posW.xyz;
 
-	vout.NormalW = mul(vin.NormalL, (float3x3)gChaWorld);
+	vout.NormalW = mul(normalL, (float3x3)gChaWorld);
+	vout.TangentW = float4(mul(tangentL.xyz, (float3x3)gChaWorld), tangentL.w);
 
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gChaTexTransform);
 #elif UI
@@ -64,7 +66,8 @@ VertexOut VS(VertexIn vin)
 	vout.PosW = posW.xyz;
 
 	// Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-	vout.NormalW = mul(vin.NormalL, (float3x3)gUIWorld);
+	vout.NormalW = mul(normalL, (float3x3)gUIWorld);
+	vout.TangentW = float4(mul(tangentL.xyz, (float3x3)gUIWorld), tangentL.w);
 
 	// Output vertex attributes for interpolation across triangle.
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gUITexTransform);
@@ -74,7 +77,8 @@ VertexOut VS(VertexIn vin)
 	vout.PosW = posW.xyz;
 
 	// Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-	vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+	vout.NormalW = mul(normalL, (float3x3)gWorld);
+	vout.TangentW = float4(mul(tangentL.xyz, (float3x3)gWorld), tangentL.w);
 
 	// Output vertex attributes for interpolation across triangle.
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
@@ -93,17 +97,11 @@ float4 PS(VertexOut pin) : SV_Target
 	float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
 	//float4 diffuseAlbedo = float4(pin.Binormal, 0.0f) * 2.0f;
 	//float4 diffuseAlbedo = gNormalMap.Sample(gsamAnisotropicWrap, pin.TexC);
-	float4 normalMap = gNormalMap.Sample(gsamAnisotropicWrap, pin.TexC);
-	// 0.0f ~ 1.0f -> -1.0f ~ 1.0f
+	float4 normalMapSample = gNormalMap.Sample(gsamAnisotropicWrap, pin.TexC);
 
-	normalMap = (normalMap * 2.0f) - 1.0f;
-	
-	
-	
-	//float3 normal = normalMap.xyz * pin.NormalW;
-	float3 normal = mul(pin.NormalW, normalMap.xyz);
-	pin.NormalW = normalize(normal);
-	//pin.NormalW = normalize(pin.NormalW);
+	// Interpolating normal can unnormalize it, so renormalize it.
+	pin.NormalW = normalize(pin.NormalW);
+	pin.NormalW = normalize(NormalSampleToWorldSpace(normalMapSample.rgb, pin.NormalW, pin.TangentW));
 
 	float3 toEyeW = gEyePosW - pin.PosW;
 	float distanceToEye = length(toEyeW);
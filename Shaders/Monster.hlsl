@@ -7,7 +7,7 @@
 struct VertexIn
 {
 	float3 PosL    : POSITION;
-	float3 NormalL : NORMAL;
+	float4 QTangentL : TANGENT;
 	float2 TexC    : TEXCOORD;
 	float3 BoneWeights : WEIGHTS;
 	uint4 BoneIndices  : BONEINDICES;
@@ -26,6 +26,10 @@ VertexOut VS(VertexIn vin)
 {
 	VertexOut vout = (VertexOut)0.0f;
 
+	float3 normalL;
+	float4 tangentL;
+	DecodeQTangent(vin.QTangentL, normalL, tangentL);
+
 	float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
 	weights[0] = vin.BoneWeights.x;
 	weights[1] = vin.BoneWeights.y;
@@ -33,22 +37,22 @@ VertexOut VS(VertexIn vin)
 	weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
 
 	float3 posL = float3(0.0f, 0.0f, 0.0f);
-	float3 normalL = float3(0.0f, 0.0f, 0.0f);
+	float3 skinnedNormalL = float3(0.0f, 0.0f, 0.0f);
 	for (int i = 0; i < 4; ++i)
 	{
 		posL += weights[i] * mul(float4(vin.PosL, 1.0f), gMonsterBoneTransforms[vin.BoneIndices[i]]).xyz;
-		normalL += weights[i] * mul(vin.NormalL, (float3x3)gMonsterBoneTransforms[vin.BoneIndices[i]]);
+		skinnedNormalL += weights[i] * mul(normalL, (float3x3)gMonsterBoneTransforms[vin.BoneIndices[i]]);
 	}
 
 	vin.PosL = posL;
-	vin.NormalL = normalL;
+	normalL = skinnedNormalL;
 
 	vout.BoneIndices = vin.BoneIndices;
 
 	float4 posW = mul(float4(vin.PosL, 1.0f), gMonsterWorld);
 	vout.PosW = posW.xyz;
 
-	vout.NormalW = mul(vin.NormalL, (float3x3)gMonsterWorld);
+	vout.NormalW = mul(normalL, (float3x3)gMonsterWorld);
 
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gMonsterTexTransform);
 
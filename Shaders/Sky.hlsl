@@ -8,7 +8,7 @@
 struct VertexIn
 {
 	float3 PosL    : POSITION;
-	float3 NormalL : NORMAL;
+	float4 QTangentL : TANGENT;
 	float2 TexC    : TEXCOORD;
 };
 
@@ -7,7 +7,7 @@
 struct VertexIn
 {
 	float3 PosL    : POSITION;
-	float3 NormalL : NORMAL;
+	float4 QTangentL : TANGENT;
 	float2 TexC    : TEXCOORD;
 	float Row : ROW;
 
@@ -26,12 +26,16 @@ VertexOut VS(VertexIn vin)
 {
 	VertexOut vout = (VertexOut)0.0f;
 
+	float3 normalL;
+	float4 tangentL;
+	DecodeQTangent(vin.QTangentL, normalL, tangentL);
+
 #ifdef MONSTER
 	// Transform to world space.
 	float4 posW = mul(float4(vin.PosL, 1.0f), gMonsterUIWorld);
 	vout.PosW = posW.xyz;
 	// Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-	vout.NormalW = mul(vin.NormalL, (float3x3)gMonsterUIWorld);
+	vout.NormalW = mul(normalL, (float3x3)gMonsterUIWorld);
 
 	// Output vertex attributes for interpolation across triangle.
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gMonsterUITexTransform);
@@ -41,7 +45,7 @@ VertexOut VS(VertexIn vin)
 
 	float4 posW = mul(float4(vin.PosL, 1.0f), gUIWorld);
 	vout.PosW = posW.xyz;
-	vout.NormalW = mul(vin.NormalL, (float3x3)gUIWorld);
+	vout.NormalW = mul(normalL, (float3x3)gUIWorld);
 
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gUITexTransform);
 #endif
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "JobSystem.h"
+#include "SpscQueue.h"
+#include "RenderItem.h"
+
+// Animation LOD of the characters at least MinDistance away from the eye
+struct AnimationLodTier
+{
+	float MinDistance;
+	UINT UpdateInterval;
+	UINT BoneLod;
+	// Baked palettes of the instances that have them, see SkinnedModelInstance::Baked
+	bool UseBaked;
+};
+
+///<summary>
+/// Collects the skinned instances to animate this frame and updates them
+/// in parallel. An instance only writes its own time, key cursors, final
+/// transforms and bounds, and reads the shared skeleton and state machine,
+/// so the batches need no locking.
+/// Add picks the animation LOD tier of an instance from its distance.
+/// With a frustum given to Begin, Add also culls the instance placed by its
+/// world matrices: a culled instance only advances its clock and keeps its
+/// last presented pose. One coming back into view is evaluated and presented
+/// by Add itself, so its first visible frame is not the stale pose. Add
+/// also loads the evicted clips a visible instance plays, see ClipResidency.
+///
+/// Run evaluates the poses and presents them before it returns. Once the
+/// pipeline is started, Submit hands them to the animation thread instead
+/// and returns at once, so the poses of the next frame are evaluated while
+/// the caller records this one. Present waits for them and copies them to
+/// the presented transforms the renderer reads. The instances belong to the
+/// animation thread from Submit to Present and must not be touched then,
+/// nor the SkinnedData they share: its clips only change while no frame is
+/// in flight, which ClipResidency asserts with IsInFlight.
+///</summary>
+class AnimationStage
+{
+public:
+	AnimationStage();
+	~AnimationStage();
+
+	AnimationStage(const AnimationStage& rhs) = delete;
+	AnimationStage& operator=(const AnimationStage& rhs) = delete;
+
+	// The frustum is copied, null culls nothing
+	void Begin(const DirectX::BoundingFrustum* frustum = nullptr);
+	void Add(SkinnedModelInstance* instance, float distance = 0.0f,
+		const DirectX::XMMATRIX* worlds = nullptr, UINT worldCount = 0);
+	void Run(JobSystem& jobs, float dt);
+
+	// The animation thread is the only caller of jobs.ParallelFor until StopPipeline
+	void StartPipeline(JobSystem& jobs);
+	void StopPipeline();
+	bool IsPipelined() const { return mPipelineThread.joinable(); }
+	// Starts the evaluation of the collected instances, after the last one is presented.
+	// Needs StartPipeline.
+	void Submit(float dt);
+	// Waits for the submitted poses and presents them, nothing to do when none is in flight
+	void Present();
+	// True from Submit to Present, while the animation thread reads the instances
+	bool IsInFlight() const { return mIsInFlight; }
+
+	UINT GetInstanceCount() const { return (UINT)mInstances.size(); }
+
+	static UINT GetLodTierCount();
+	static const AnimationLodTier& GetLodTier(UINT tier);
+	static UINT SelectLodTier(float distance);
+
+private:
+	struct FrameRequest
+	{
+		float DeltaTime;
+		bool Stop;
+	};
+
+	void Evaluate(JobSystem& jobs, float dt);
+	void PresentPoses();
+	static void PresentPose(SkinnedModelInstance& instance);
+	void PipelineMain();
+
+private:
+	std::vector<SkinnedModelInstance*> mInstances;
+	DirectX::BoundingFrustum mFrustum;
+	bool mHasFrustum = false;
+
+	// Main thread to animation thread, and back when the poses are done.
+	// One frame is in flight at most.
+	SpscQueue<FrameRequest, 2> mRequests;
+	SpscQueue<UINT64, 2> mResults;
+	bool mIsInFlight = false;
+
+	JobSystem* mPipelineJobs = nullptr;
+	std::thread mPipelineThread;
+	// The animation thread sleeps here while no request is queued
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+};
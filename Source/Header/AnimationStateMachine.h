@@ -0,0 +1,74 @@
+#pragma once
+
+#include "SkinnedData.h"
+
+enum class eClipList
+{
+	Idle,
+	StartWalking,
+	Walking,
+	StopWalking,
+	Kick,
+	FlyingKick
+};
+
+///<summary>
+/// Description of one state, only read by AnimationStateMachine::Compile.
+///</summary>
+struct AnimationStateDesc
+{
+	std::string ClipName;
+	// Group reported to gameplay, a request into another group restarts the clip
+	eClipList Group;
+	bool Loop;
+	// Requests are ignored once a final state is entered, e.g. Death
+	bool Final;
+};
+
+///<summary>
+/// Clip playback driven by tables compiled once from a list of states.
+/// Compile resolves the clip names to handles, caches the clip lengths and
+/// fills a transition table indexed by the current and requested state.
+/// After that every query takes state indices, so the per frame update does
+/// no string work. The machine is immutable and shared by the instances.
+///</summary>
+class AnimationStateMachine
+{
+public:
+	struct Transition
+	{
+		bool Allowed;
+		// TimePos goes back to the start of the clip
+		bool Restart;
+	};
+
+public:
+	AnimationStateMachine();
+	~AnimationStateMachine();
+
+	// The state index is the position in states. Returns false when a clip is not loaded.
+	bool Compile(const SkinnedData& skinnedData, const std::vector<AnimationStateDesc>& states);
+
+	// Load time only, -1 when no state plays the clip
+	int FindState(const std::string& clipName) const;
+
+	UINT GetStateCount() const { return mStateCount; }
+	const Transition& GetTransition(int from, int to) const { return mTransitions[from * mStateCount + to]; }
+
+	ClipHandle GetClip(int state) const { return mClips[state]; }
+	float GetClipEndTime(int state) const { return mClipEndTimes[state]; }
+	eClipList GetGroup(int state) const { return mGroups[state]; }
+	bool IsLooping(int state) const { return mLoops[state] != 0; }
+
+private:
+	UINT mStateCount = 0;
+
+	std::vector<std::string> mStateNames;
+	std::vector<ClipHandle> mClips;
+	std::vector<float> mClipEndTimes;
+	std::vector<eClipList> mGroups;
+	std::vector<BYTE> mLoops;
+
+	// mStateCount x mStateCount, row is the current state
+	std::vector<Transition> mTransitions;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "SkinnedData.h"
+
+// Frames per second of the baked clips, the far tier hides the half frame of lag
+const float kBakeFrameRate = 30.0f;
+
+///<summary>
+/// Palettes of a clip sampled at a fixed rate, with the bounds of every frame.
+///</summary>
+struct BakedClip
+{
+	float StartTime = 0.0f;
+	float FrameRate = 0.0f;
+	UINT FrameCount = 0;
+	// Frame f, bone b at Rows[(f * bones + b) * 3], the transposed final transform without its last row
+	std::vector<DirectX::XMFLOAT4> Rows;
+	std::vector<DirectX::BoundingBox> Bounds;
+};
+
+///<summary>
+/// Palette table of a rig baked offline from its clips, shared read only by
+/// the far instances of a crowd. Playing a baked clip only copies the frame
+/// nearest to the time, so its cost does not depend on the skeleton
+/// hierarchy or the keys. Cached next to the clips in .bake files by
+/// FbxLoader.
+///</summary>
+class BakedAnimation
+{
+public:
+	BakedAnimation();
+	~BakedAnimation();
+
+	// Samples the clip every 1 / frameRate seconds, the last frame at the clip end
+	void Bake(const SkinnedData& skinnedData, ClipHandle clip, float frameRate);
+	// Every clip of the skeleton
+	void Bake(const SkinnedData& skinnedData, float frameRate);
+	void SetClip(ClipHandle clip, UINT boneCount, BakedClip bakedClip);
+
+	// nullptr when the clip is not baked
+	const BakedClip* GetClip(ClipHandle clip) const;
+	UINT GetBoneCount() const { return mBoneCount; }
+	// Frame nearest to timePos, false when the clip is not baked
+	bool GetFinalTransforms(ClipHandle clip, float timePos,
+		std::vector<DirectX::XMFLOAT4X4>& outTransforms, DirectX::BoundingBox& outBounds) const;
+
+	// Bytes of the rows and bounds of the clip
+	size_t GetMemorySize(ClipHandle clip) const;
+	// Largest palette difference from the live evaluation, sampled between the frames
+	float MeasureError(const SkinnedData& skinnedData, ClipHandle clip) const;
+
+private:
+	UINT mBoneCount = 0;
+	// By the clip handles of the skeleton, FrameCount 0 when not baked
+	std::vector<BakedClip> mClips;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include "d3dUtil.h"
+
+struct CharacterVertex;
+class SkinnedData;
+
+///<summary>
+/// Headless benchmarks, started with -benchmark on the command line.
+/// No window or device is created; the results go to the debug output
+/// and to Benchmark.txt in the working directory.
+/// Run returns 1 when a check failed or a section could not load its
+/// assets, 0 otherwise.
+/// The sections of a subsystem share a file, BenchmarkMesh.cpp for the
+/// mesh ones; Benchmark.cpp holds the runner and what the sections share.
+///</summary>
+class Benchmark
+{
+public:
+	Benchmark();
+	~Benchmark();
+
+	int Run();
+
+private:
+	// BenchmarkMesh.cpp
+	void RunLodSelection();
+	void RunTangentFrames();
+
+	// BenchmarkSkinning.cpp
+	void RunSkinnedBounds();
+	void RunMorphTargets();
+	void RunCpuSkinning();
+	void RunPaletteFormats();
+	void RunFinalTransforms();
+
+	// BenchmarkClips.cpp
+	void RunKeyframeLookup();
+	void RunPoseEvaluation();
+	void RunSharedAssets();
+	void RunBakedPalettes();
+	void RunRetargeting();
+	void RunConstantTracks();
+	void RunClipResidency();
+
+	// BenchmarkCrowd.cpp
+	void RunClipHandles();
+	void RunParallelAnimation();
+	void RunPoseCache();
+	void RunAnimationLod();
+	void RunLayeredPose();
+	void RunCrossfade();
+	void RunAnimationPipeline();
+	void RunCulledAnimation();
+
+	// BenchmarkLocomotion.cpp
+	void RunMotionMatching();
+	void RunRootMotion();
+
+	// The player rig with every clip, returns the names of the loaded clips
+	bool LoadPlayer(std::vector<CharacterVertex>& vertices, SkinnedData& skinnedData, std::vector<std::string>& clips);
+	bool LoadMonster(UINT monster, std::vector<CharacterVertex>& vertices, SkinnedData& skinnedData, std::vector<std::string>& clips);
+
+	void Print(const std::wstring& text);
+	// A section that could not run, counted as a failed check
+	void PrintFailure(const std::wstring& text);
+	// "PASS" or "FAIL" for the report, counting the failures
+	std::wstring Verdict(bool pass);
+
+	static double ElapsedMs(
+		const std::chrono::high_resolution_clock::time_point& start,
+		const std::chrono::high_resolution_clock::time_point& end);
+	// Largest difference of any component of two arrays of the same size
+	static float MaxDifference(const std::vector<DirectX::XMFLOAT3>& a, const std::vector<DirectX::XMFLOAT3>& b);
+	static float MaxDifference(const std::vector<DirectX::XMFLOAT4X4>& a, const std::vector<DirectX::XMFLOAT4X4>& b);
+
+private:
+	std::wofstream mReport;
+	UINT mFailureCount = 0;
+};
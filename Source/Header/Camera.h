@@ -23,6 +23,8 @@ public:
 	DirectX::XMVECTOR GetEyeRight() const;
 	DirectX::XMMATRIX GetView() const;
 	DirectX::XMMATRIX GetProj() const;
+	// View frustum in world space, for culling
+	void GetWorldFrustum(DirectX::BoundingFrustum& outFrustum) const;
 
 	void SetEyePosition(DirectX::XMVECTOR inEyePosition);
 	void SetEyeLook(DirectX::XMVECTOR inEyeLook);
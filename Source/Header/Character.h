@@ -16,13 +16,15 @@ public:
 	virtual void Damage(int damage, DirectX::XMVECTOR Position, DirectX::XMVECTOR Look) = 0;
 	const DirectX::BoundingBox& GetBoundingBox() const { return mInitBoundsBox; }
 	MeshGeometry* GetMeshGeometry() const { return  mGeometry.get(); }
+	// Draw argument names of the submeshes, the bone names followed by the empty submeshes
+	const std::vector<std::string>& GetSubmeshNames() const { return mSubmeshNames; }
 
 	virtual void BuildGeometry(
 		ID3D12Device * device, 
 		ID3D12GraphicsCommandList* cmdList, 
 		const std::vector<CharacterVertex>& inVertices,
 		const std::vector<std::uint32_t>& inIndices, 
-		const SkinnedData& inSkinInfo, std::string geoName);
+		std::shared_ptr<const SkinnedData> inSkinInfo, std::string geoName);
 	virtual void BuildRenderItem(Materials& mMaterials, std::string matrialPrefix) = 0;
 	
 	virtual void UpdateCharacterShadows(const Light& mMainLight) = 0;
@@ -33,4 +35,5 @@ public:
 private:
 	DirectX::BoundingBox mInitBoundsBox;
 	std::unique_ptr<MeshGeometry> mGeometry;
+	std::vector<std::string> mSubmeshNames;
 };
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include "SkinnedData.h"
+
+class AnimationStage;
+
+// Reads the keys of a clip as they were first set, before any cook step.
+// Prefetches call it on a thread of their own, so it shares no state with the caller.
+typedef std::function<bool(AnimationClip&)> ClipLoader;
+
+///<summary>
+/// Keeps the keys of the clips of a rig resident under a memory budget.
+/// A registered clip keeps its handle, times, bounds and root motion in
+/// SkinnedData, but its keys and SIMD layout are evicted when the budget
+/// runs out, least recently used first, and loaded again on the next use.
+/// Require loads an evicted clip on the calling thread, the stall the
+/// counters report; Prefetch loads it ahead of use on a thread of its own.
+/// The clips only change in Update and Require, on the main thread while no
+/// pose of the rig is evaluated, so the animation jobs never see them move.
+/// With the stage that evaluates the poses set, both assert no frame of it
+/// is in flight.
+///</summary>
+class ClipResidency
+{
+public:
+	// budgetBytes of keys and SIMD layouts, 0 keeps every clip
+	ClipResidency(std::shared_ptr<SkinnedData> skinnedData, size_t budgetBytes);
+	// Waits for the prefetches still loading
+	~ClipResidency();
+
+	ClipResidency(const ClipResidency& rhs) = delete;
+	ClipResidency& operator=(const ClipResidency& rhs) = delete;
+
+	// The clip is set and cooked already, from now on it may be evicted
+	void Register(ClipHandle clip, ClipLoader loader);
+	void SetBudget(size_t budgetBytes) { mBudget = budgetBytes; }
+	size_t GetBudget() const { return mBudget; }
+	// The stage the poses of the rig are evaluated by, null checks nothing
+	void SetStage(const AnimationStage* stage) { mStage = stage; }
+
+	// Once a frame, before the poses are collected: installs the finished prefetches and,
+	// while the resident clips are over the budget, evicts those not used last frame
+	void Update();
+	// The clip is resident on return, loaded here on a miss, and marked used this frame.
+	// False when it could not be loaded; the clips never registered are always resident.
+	bool Require(ClipHandle clip);
+	// Starts loading an evicted clip, installed by the next Update or Require
+	void Prefetch(ClipHandle clip);
+
+	// Bytes of the registered clips held now
+	size_t GetResidentBytes() const { return mResidentBytes; }
+	UINT64 GetHits() const { return mHits; }
+	UINT64 GetMisses() const { return mMisses; }
+	// Misses that waited for a load, and the seconds they waited
+	UINT64 GetStalls() const { return mStalls; }
+	double GetStallTime() const { return mStallTime; }
+	UINT64 GetLoads() const { return mLoads; }
+	UINT64 GetEvictions() const { return mEvictions; }
+	void ResetCounters();
+
+private:
+	struct ClipSlot
+	{
+		ClipLoader Loader;
+		// Frame of the last Require, 0 before the first, see Update
+		UINT64 LastUsed = 0;
+		size_t ResidentBytes = 0;
+		// Valid while a prefetch loads the clip
+		std::future<AnimationClip> Pending;
+	};
+
+	bool IsRegistered(ClipHandle clip) const;
+	// No pose of the rig is evaluated while the clips change
+	bool IsIdle() const;
+	bool Install(ClipHandle clip, AnimationClip animation);
+	void Evict(ClipHandle clip);
+
+private:
+	std::shared_ptr<SkinnedData> mSkinnedData;
+	size_t mBudget;
+	const AnimationStage* mStage = nullptr;
+
+	// By handle, no loader for the clips not registered
+	std::vector<ClipSlot> mClips;
+	UINT64 mFrame = 1;
+	size_t mResidentBytes = 0;
+
+	UINT64 mHits = 0;
+	UINT64 mMisses = 0;
+	UINT64 mStalls = 0;
+	double mStallTime = 0.0;
+	UINT64 mLoads = 0;
+	UINT64 mEvictions = 0;
+};
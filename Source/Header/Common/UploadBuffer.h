@@ -55,6 +55,12 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // The first byteSize bytes only, for elements whose tail the shader does not read
+    void CopyData(int elementIndex, const T& data, UINT byteSize)
+    {
+        memcpy(&mMappedData[elementIndex*mElementByteSize], &data, byteSize);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -144,6 +144,31 @@ public:
     int LineNumber = -1;
 };
 
+// One level of detail of a submesh.  Coarser levels index the same vertices as
+// the full resolution mesh and are appended after it in the index buffer.
+// GeometricError is the object space distance the level may deviate from the
+// original surface, so the renderer can pick a level by its projected size.
+struct SubmeshLod
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	float GeometricError = 0.0f;
+};
+
+// A blend shape stored as sparse deltas from the base mesh, only for the vertices
+// it moves.  The deltas are quantized relative to the largest delta component of
+// the shape, 16 bits for positions and 8 bits for normals.
+struct MorphTarget
+{
+	std::string Name;
+	float PositionScale = 0.0f;
+	float NormalScale = 0.0f;
+
+	std::vector<uint32_t> Indices;
+	std::vector<DirectX::PackedVector::XMSHORTN4> PositionDeltas;
+	std::vector<DirectX::PackedVector::XMBYTEN4> NormalDeltas;
+};
+
 // Defines a subrange of geometry in a MeshGeometry.  This is for when multiple
 // geometries are stored in one vertex and index buffer.  It provides the offsets
 // and data needed to draw a subset of geometry stores in the vertex and index 
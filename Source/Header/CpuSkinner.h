@@ -0,0 +1,57 @@
+#pragma once
+
+#include "d3dUtil.h"
+
+struct CharacterVertex;
+class JobSystem;
+
+///<summary>
+/// Skins the positions and normals of a character mesh on the CPU, the way
+/// the SKINNED vertex shader does, for collision meshes, ray picks and
+/// headless checks. Set sorts the vertices by their number of influences so
+/// every run of vertices goes through a kernel unrolled for that count. The
+/// kernel blends the palette rows of the influences and transforms the vertex
+/// once with the blended matrix.
+/// The outputs are indexed like the vertices given to Set.
+///</summary>
+class CpuSkinner
+{
+public:
+	CpuSkinner();
+	~CpuSkinner();
+
+	void Set(const std::vector<CharacterVertex>& vertices);
+
+	// finalTransforms as uploaded to the shader. Without jobs it runs on the calling thread.
+	void Skin(
+		const std::vector<DirectX::XMFLOAT4X4>& finalTransforms,
+		std::vector<DirectX::XMFLOAT3>& outPositions,
+		std::vector<DirectX::XMFLOAT3>& outNormals,
+		JobSystem* jobs = nullptr);
+
+	UINT GetVertexCount() const { return (UINT)mVertices.size(); }
+	// Vertices with influences bones, 1 to 4
+	UINT GetInfluenceCount(UINT influences) const { return mGroupStart[influences] - mGroupStart[influences - 1]; }
+
+private:
+	struct SourceVertex
+	{
+		DirectX::XMFLOAT3 Pos;
+		DirectX::XMFLOAT3 Normal;
+		float Weights[4];
+		BYTE Bones[4];
+		// Position in the mesh and in the outputs
+		UINT Index;
+	};
+
+	void SkinRange(UINT begin, UINT end, DirectX::XMFLOAT3* outPositions, DirectX::XMFLOAT3* outNormals) const;
+
+private:
+	// Sorted by influence count, the influences by weight
+	std::vector<SourceVertex> mVertices;
+	// mVertices[mGroupStart[n - 1], mGroupStart[n]) have n influences
+	UINT mGroupStart[5];
+
+	// Skinning matrices of the current Skin, the palette transposed back
+	std::vector<DirectX::XMFLOAT4X4> mPalette;
+};
@@ -2,6 +2,7 @@
 
 #include <fbxsdk.h>
 #include "SkinnedData.h"
+#include "BakedAnimation.h"
 
 struct BoneIndexAndWeight
 {
@@ -44,13 +45,15 @@ public:
 		SkinnedData& outSkinnedData,
 		const std::string& ClipName,
 		std::vector<Material>& outMaterial,
-		std::string fileName);
+		std::string fileName,
+		std::vector<MorphTarget>* outMorphTargets = nullptr);
 	// Animation 
 	HRESULT LoadFBX(
 		std::vector<Vertex>& outVertexVector, 
 		std::vector<uint32_t>& outIndexVector, 
 		std::vector<Material>& outMaterial,
-		std::string fileName);
+		std::string fileName,
+		std::vector<SubmeshLod>* outLods = nullptr);
 	// Animation 
 	HRESULT LoadFBX(
 		SkinnedData& outSkinnedData, 
@@ -64,14 +67,25 @@ public:
 		std::string fileName,
 		std::vector<Vertex>& outVertexVector,
 		std::vector<uint32_t>& outIndexVector,
-		std::vector<Material>* outMaterial = nullptr);
+		std::vector<Material>* outMaterial = nullptr,
+		std::vector<SubmeshLod>* outLods = nullptr);
 	bool LoadMesh(
 		std::string fileName, 
 		std::vector<CharacterVertex>& outVertexVector, 
 		std::vector<uint32_t>& outIndexVector, 
-		std::vector<Material>* outMaterial = nullptr);
+		std::vector<Material>* outMaterial = nullptr,
+		std::vector<MorphTarget>* outMorphTargets = nullptr);
 
 	bool LoadAnimation(SkinnedData & outSkinnedData, const std::string & clipName, std::string fileName);
+	// The keys of the .anim file alone, nothing is set
+	bool LoadAnimation(AnimationClip& outAnimation, const std::string& clipName, std::string fileName);
+	// False when the .bake file is missing or was baked at another rate or for another bone count
+	bool LoadBakedAnimation(
+		BakedAnimation& outBaked,
+		const SkinnedData& skinnedData,
+		const std::string& clipName,
+		std::string fileName,
+		float frameRate);
 
 
 	void GetSkeletonHierarchy(
@@ -91,12 +105,19 @@ public:
 		fbxsdk::FbxMesh * pMesh,
 		std::vector<CharacterVertex> & outVertexVector,
 		std::vector<uint32_t> & outIndexVector, 
-		SkinnedData* outSkinnedData);
+		SkinnedData* outSkinnedData,
+		std::vector<MorphTarget>& outMorphTargets);
 	void GetVerticesAndIndice(
 		fbxsdk::FbxMesh * pMesh,
 		std::vector<Vertex>& outVertexVector, 
 		std::vector<uint32_t>& outIndexVector);
 
+	// Blend shape channels as sparse deltas of the vertices.
+	// vertexPolygonVertices gives the polygon vertex each vertex was made from.
+	void GetMorphTargets(
+		fbxsdk::FbxMesh * pMesh,
+		const std::vector<int>& vertexPolygonVertices,
+		std::vector<MorphTarget>& outMorphTargets);
 
 	void GetMaterials(fbxsdk::FbxNode * pNode, std::vector<Material>& outMaterial);
 
@@ -116,8 +137,13 @@ public:
 		const AnimationClip& animation,
 		std::string fileName, 
 		const std::string& clipName);
-	void ExportMesh(std::vector<Vertex>& outVertexVector, std::vector<uint32_t>& outIndexVector, std::vector<Material>& outMaterial, std::string fileName);
-	void ExportMesh(std::vector<CharacterVertex>& outVertexVector, std::vector<uint32_t>& outIndexVector, std::vector<Material>& outMaterial, std::string fileName);
+	void ExportBakedAnimation(
+		const BakedAnimation& baked,
+		const SkinnedData& skinnedData,
+		std::string fileName,
+		const std::string& clipName);
+	void ExportMesh(std::vector<Vertex>& outVertexVector, std::vector<uint32_t>& outIndexVector, std::vector<Material>& outMaterial, std::string fileName, const std::vector<SubmeshLod>* lods = nullptr);
+	void ExportMesh(std::vector<CharacterVertex>& outVertexVector, std::vector<uint32_t>& outIndexVector, std::vector<Material>& outMaterial, std::string fileName, const std::vector<MorphTarget>* morphTargets = nullptr);
 
 	void clear();
 
@@ -129,4 +155,7 @@ private:
 	std::vector<int> mBoneHierarchy;
 	std::vector<DirectX::XMFLOAT4X4> mBoneOffsets;
 	std::unordered_map<std::string, AnimationClip> mAnimations;
+
+	// Set by LoadMesh when the cache held plain normals and has to be exported again
+	bool mMeshUpgraded = false;
 };
\ No newline at end of file
@@ -37,7 +37,13 @@ struct ObjectConstants
 };
 struct CharacterConstants : ObjectConstants
 {
-	DirectX::XMFLOAT4X4 BoneTransforms[96];
+	// ePaletteFormat of the skeleton, see SkinnedData::PackPalette
+	UINT PaletteFormat = 0;
+	float PaletteScale = 1.0f;
+	DirectX::XMFLOAT2 cbPerCharacterPad1 = { 0.0f, 0.0f };
+	// 96 bones of three rows, or of two with dual quaternions.
+	// Only the rows of the skeleton are uploaded.
+	DirectX::XMFLOAT4 BonePalette[96 * 3];
 };
 struct UIConstants : ObjectConstants
 {
@@ -48,7 +54,8 @@ struct UIConstants : ObjectConstants
 struct Vertex
 {
     DirectX::XMFLOAT3 Pos;
-	DirectX::XMFLOAT3 Normal;
+	// Normal and tangent frame as a quaternion, the sign of w is the bitangent handedness
+	DirectX::PackedVector::XMSHORTN4 QTangent;
 	DirectX::XMFLOAT2 TexC;
 
 	bool operator==(const Vertex& other) const
@@ -56,7 +63,7 @@ struct Vertex
 		if (Pos.x != other.Pos.x || Pos.y != other.Pos.y || Pos.z != other.Pos.z)
 			return false;
 
-		if (Normal.x != other.Normal.x || Normal.y != other.Normal.y || Normal.z != other.Normal.z)
+		if (QTangent.x != other.QTangent.x || QTangent.y != other.QTangent.y || QTangent.z != other.QTangent.z || QTangent.w != other.QTangent.w)
 			return false;
 
 		if (TexC.x != other.TexC.x || TexC.y != other.TexC.y)
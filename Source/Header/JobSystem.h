@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "d3dUtil.h"
+
+///<summary>
+/// Fixed pool of worker threads with one job queue per thread.
+/// ParallelFor cuts a range into batches and deals them round robin over
+/// the queues. A thread takes the newest job of its own queue and, once that
+/// is empty, steals the oldest job of another queue, so uneven batches even
+/// out. The calling thread works on queue 0 until the whole range is done.
+/// ParallelFor is meant to be called from one thread at a time, not from a job.
+///</summary>
+class JobSystem
+{
+public:
+	// threadCount counts the calling thread, 0 uses every hardware thread
+	JobSystem(UINT threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem& rhs) = delete;
+	JobSystem& operator=(const JobSystem& rhs) = delete;
+
+	// function(begin, end) for batches of at most batchSize, returns when all are done
+	void ParallelFor(UINT count, UINT batchSize, const std::function<void(UINT, UINT)>& function);
+
+	UINT GetThreadCount() const { return (UINT)mQueues.size(); }
+
+private:
+	struct Job
+	{
+		const std::function<void(UINT, UINT)>* Function;
+		UINT Begin;
+		UINT End;
+		std::atomic<UINT>* Remaining;
+	};
+
+	struct JobQueue
+	{
+		std::mutex Mutex;
+		std::deque<Job> Jobs;
+	};
+
+	void WorkerMain(UINT queueIndex);
+	// Own queue first, then the other queues from the next one on
+	bool PopJob(UINT queueIndex, Job& outJob);
+	void Execute(const Job& job);
+
+private:
+	std::vector<std::unique_ptr<JobQueue>> mQueues;
+	std::vector<std::thread> mWorkers;
+
+	// Jobs pushed and not yet taken, the workers sleep while it is zero
+	std::atomic<UINT> mQueuedJobs;
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+	bool mStop = false;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "SkinnedData.h"
+
+// Clip played over the base clip on the bones of a mask
+struct AnimationLayer
+{
+	ClipHandle Clip = kInvalidClip;
+	// Shared by the instances of the rig, the layer is skipped without one
+	std::shared_ptr<const BoneMask> Mask;
+	float TimePos = 0.0f;
+	// 0 skips the layer, 1 replaces the masked bones of the pose below
+	float Weight = 0.0f;
+	bool Loop = false;
+	std::vector<UINT> KeyCursors;
+};
+
+///<summary>
+/// Base clip with partial body layers blended over it, in order.
+/// The keys are in model space, so a layer takes the masked bones of the
+/// pose below and of its clip to parent space, blends them there and
+/// composes them back onto the pose below. An upper body layer thus stays
+/// attached to the hips of the base clip.
+/// A layer samples only the bones of its mask, a layer at zero weight is
+/// not sampled at all, and the pose buffers are sized by Initialize.
+/// A crossfade is a whole body layer under the others: the clip left
+/// behind, faded out as the base clip takes over.
+///</summary>
+class LayeredPose
+{
+public:
+	LayeredPose();
+	~LayeredPose();
+
+	void Initialize(UINT boneCount, UINT layerCount);
+
+	UINT GetLayerCount() const { return (UINT)mLayers.size(); }
+	AnimationLayer& GetLayer(UINT layer) { return mLayers[layer]; }
+	const AnimationLayer& GetLayer(UINT layer) const { return mLayers[layer]; }
+	// True while a layer or a crossfade changes the base pose
+	bool IsActive() const;
+	bool IsCrossfading() const { return mCrossfade.Weight > 0.0f; }
+	ClipHandle GetCrossfadeClip() const { return mCrossfade.Clip; }
+
+	// Blends from the clip playing at fromTime into the base clip over duration seconds.
+	// A crossfade started during another fades out the pose that one had reached.
+	void StartCrossfade(ClipHandle fromClip, float fromTime, bool loop, float duration);
+
+	// Moves the layer clocks, a finished layer that does not loop drops to zero weight
+	void Update(const SkinnedData& skinnedData, float dt);
+
+	void Evaluate(const SkinnedData& skinnedData, ClipHandle baseClip, float baseTime,
+		std::vector<UINT>* baseKeyCursors, std::vector<DirectX::XMFLOAT4X4>& finalTransforms);
+
+private:
+	// Blends the masked bones of a model space pose over mPose
+	void ApplyLayer(const SkinnedData& skinnedData, const std::vector<BoneTransform>& layerPose,
+		const BoneMask& mask, float weight);
+
+private:
+	std::vector<AnimationLayer> mLayers;
+
+	// Weight falls from 1 to 0 over the duration
+	AnimationLayer mCrossfade;
+	float mCrossfadeDuration = 0.0f;
+	float mCrossfadeElapsed = 0.0f;
+	// Set when the crossfade interrupted another, mFrozenPose then replaces its clip
+	bool mIsCrossfadeFrozen = false;
+
+	// Model space pose of the base clip and the layers applied so far
+	std::vector<BoneTransform> mPose;
+	// Model space pose of the layer clip
+	std::vector<BoneTransform> mLayerPose;
+	// Parent space transforms of the masked bones before the layer
+	std::vector<BoneTransform> mLocalPose;
+	std::vector<BoneTransform> mFrozenPose;
+};
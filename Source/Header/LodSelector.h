@@ -0,0 +1,56 @@
+#pragma once
+
+#include "d3dUtil.h"
+
+class Camera;
+struct RenderItem;
+
+///<summary>
+/// Picks a level of detail for every render item that carries a LOD chain.
+/// The items are kept in flat structure of arrays so the distances to the eye
+/// are computed four at a time. A level is used while its geometric error,
+/// projected on screen, stays under the pixel threshold. Switching to a coarser
+/// level needs some margin below the threshold so items do not pop back and
+/// forth at the boundary.
+///</summary>
+class LodSelector
+{
+public:
+	LodSelector();
+	~LodSelector();
+
+	void Clear();
+
+	// Items without LODs are ignored. Bounds are the world space bounds of the item.
+	void AddRenderItem(RenderItem* ritem, const DirectX::BoundingBox& bounds);
+
+	// Writes the chosen range to IndexCount/StartIndexLocation of every item.
+	// Returns the number of triangles of the selected levels.
+	UINT Select(const Camera& camera, float viewportHeight);
+
+	// Triangles of the finest levels, what would be drawn without selection
+	UINT GetFullDetailTriangles() const;
+	UINT GetSize() const;
+
+	void SetThreshold(float pixels) { mThreshold = pixels; }
+	void SetHysteresis(float ratio) { mHysteresis = ratio; }
+
+private:
+	// Center and radius of the bounding sphere, padded to a multiple of four
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mRadius;
+
+	// Levels of item i are mLods[mLodOffset[i]] .. mLods[mLodOffset[i] + mLodCount[i] - 1]
+	std::vector<SubmeshLod> mLods;
+	std::vector<UINT> mLodOffset;
+	std::vector<UINT> mLodCount;
+	std::vector<UINT> mLodIndex;
+
+	std::vector<RenderItem*> mRitems;
+	std::vector<float> mDistance;
+
+	float mThreshold;
+	float mHysteresis;
+};
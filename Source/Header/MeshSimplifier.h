@@ -0,0 +1,98 @@
+#pragma once
+
+#include "FrameResource.h"
+
+///<summary>
+/// Builds a level of detail chain for static meshes with quadric error edge collapse.
+/// Vertices are never moved or created, every collapse folds a vertex onto a
+/// neighbour, so all levels share the vertex buffer of the full resolution mesh.
+/// UV and normal seams are kept: a vertex on a seam may only slide along the seam
+/// and both sides of the seam collapse together.
+///</summary>
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(const std::vector<Vertex>& vertices);
+	~MeshSimplifier();
+
+	// Appends the coarser levels to indices and fills outLods with every level, finest first.
+	// Level 0 is the input itself with zero error.
+	void BuildLodChain(
+		std::vector<uint32_t>& indices,
+		std::vector<SubmeshLod>& outLods,
+		const std::string& meshName,
+		uint32_t maxLevels = 4);
+
+	// Collapses edges until at most targetIndexCount indices remain or nothing can be collapsed.
+	// Returns the geometric error (object space distance) of the result.
+	float Simplify(std::vector<uint32_t>& indices, size_t targetIndexCount);
+
+private:
+	enum eVertexKind
+	{
+		Manifold,	// interior vertex with a single wedge
+		Border,		// vertex on an open boundary of the mesh
+		Seam,		// vertex split in two wedges along a UV/normal seam
+		Locked		// corners and anything more complex, never collapsed
+	};
+
+	struct Quadric
+	{
+		double a00, a11, a22;
+		double a10, a20, a21;
+		double b0, b1, b2;
+		double c;
+		double w;
+	};
+
+	struct Collapse
+	{
+		uint32_t v0;
+		uint32_t v1;
+		bool bidirectional;
+		float error;
+	};
+
+	void BuildPositionRemap();
+	void ClassifyVertices(const std::vector<uint32_t>& indices);
+	void BuildQuadrics(const std::vector<uint32_t>& indices);
+	void BuildAdjacency(const std::vector<uint32_t>& indices);
+
+	void PickEdgeCollapses(const std::vector<uint32_t>& indices);
+	void RankEdgeCollapses();
+	size_t PerformEdgeCollapses(size_t triangleCollapseGoal);
+	void RemapEdgeLoops();
+	void RemapIndexBuffer(std::vector<uint32_t>& indices);
+
+	bool HasTriangleFlips(uint32_t r0, uint32_t r1) const;
+
+	static void QuadricFromPlane(Quadric& Q, double a, double b, double c, double d, double w);
+	static void QuadricAdd(Quadric& Q, const Quadric& R);
+	static double QuadricError(const Quadric& Q, const DirectX::XMFLOAT3& p);
+
+private:
+	const std::vector<Vertex>& mVertices;
+
+	// Vertex with the lowest index sharing the position, and the next vertex in the ring of wedges.
+	std::vector<uint32_t> mRemap;
+	std::vector<uint32_t> mWedge;
+	std::vector<uint8_t> mKind;
+
+	// Next and previous vertex along a border or seam edge.
+	std::vector<uint32_t> mLoop;
+	std::vector<uint32_t> mLoopBack;
+
+	std::vector<Quadric> mQuadrics;
+
+	// Triangles around each position, rebuilt every pass.
+	std::vector<uint32_t> mAdjacencyOffsets;
+	std::vector<uint32_t> mAdjacencyTriangles;
+	const std::vector<uint32_t>* mAdjacencyIndices;
+
+	std::vector<Collapse> mCollapses;
+	std::vector<uint32_t> mCollapseOrder;
+	std::vector<uint32_t> mCollapseRemap;
+	std::vector<uint8_t> mCollapseLocked;
+
+	float mResultError;
+};
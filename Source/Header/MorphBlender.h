@@ -0,0 +1,43 @@
+#pragma once
+
+#include "d3dUtil.h"
+
+///<summary>
+/// Applies weighted morph targets to the positions and normals of a mesh.
+/// Only the vertices moved by some target are written: they are reset to the
+/// base mesh, every target with a weight adds its dequantized deltas, and the
+/// normals are normalized again. Vertices no target touches keep what the
+/// output streams held, so the streams are filled with the base mesh once.
+///</summary>
+class MorphBlender
+{
+public:
+	MorphBlender();
+	~MorphBlender();
+
+	void Set(const std::vector<MorphTarget>& targets);
+
+	// One weight per target. Returns the number of deltas applied.
+	UINT Apply(
+		const float* weights,
+		const std::vector<DirectX::XMFLOAT3>& basePositions,
+		const std::vector<DirectX::XMFLOAT3>& baseNormals,
+		std::vector<DirectX::XMFLOAT3>& outPositions,
+		std::vector<DirectX::XMFLOAT3>& outNormals) const;
+
+	UINT GetTargetCount() const { return (UINT)mTargets.size(); }
+	UINT GetTouchedCount() const { return (UINT)mTouched.size(); }
+
+	// Quantizes the float deltas of a shape, indices in any order
+	static MorphTarget BuildTarget(
+		const std::string& name,
+		const std::vector<uint32_t>& indices,
+		const std::vector<DirectX::XMFLOAT3>& positionDeltas,
+		const std::vector<DirectX::XMFLOAT3>& normalDeltas);
+
+private:
+	std::vector<MorphTarget> mTargets;
+
+	// Vertices moved by at least one target, sorted
+	std::vector<uint32_t> mTouched;
+};
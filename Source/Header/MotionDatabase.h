@@ -0,0 +1,92 @@
+#pragma once
+
+#include "AnimationStateMachine.h"
+
+// Points of the future trajectory, see MotionFeatures
+const UINT kTrajectoryPointCount = 3;
+const UINT kInvalidMotionFrame = (UINT)-1;
+
+///<summary>
+/// What the search compares between two frames, in the model space of the
+/// clips: meters, y up and the character facing +z.
+///</summary>
+struct MotionFeatures
+{
+	// Relative to the hips projected on the ground
+	DirectX::XMFLOAT3 LeftFoot;
+	DirectX::XMFLOAT3 RightFoot;
+	// Meters per second, with the ground speed of the clips played in place
+	DirectX::XMFLOAT3 HipVelocity;
+	// Ground position of the hips, x and z, 1/3, 2/3 and 1 second ahead
+	DirectX::XMFLOAT2 Trajectory[kTrajectoryPointCount];
+};
+
+// A time of a state of the state machine the database was built from
+struct MotionFrame
+{
+	int State;
+	float TimePos;
+};
+
+///<summary>
+/// Motion matching database of the locomotion states of a rig. Every clip
+/// is sampled at a fixed rate and each frame keeps its feet, hip velocity
+/// and future trajectory. The clips are played in place, so the ground
+/// speed is the slide of the foot nearest the ground.
+/// Search returns the frame nearest to a query, usually the pose playing
+/// now with the trajectory the controller wants. The features are scaled
+/// per group so the units do not weigh, and stored four frames to a SIMD
+/// register, so the brute force search takes a few microseconds for the
+/// few hundred frames of a locomotion set.
+///</summary>
+class MotionDatabase
+{
+public:
+	static const UINT kFeatureCount = sizeof(MotionFeatures) / sizeof(float);
+
+	MotionDatabase();
+	~MotionDatabase();
+
+	// Samples the clips of the states every 1 / sampleRate seconds.
+	// False when the skeleton has no hips or feet, or a state has no clip.
+	bool Build(const SkinnedData& skinnedData, const AnimationStateMachine& stateMachine,
+		const std::vector<int>& states, float sampleRate = 30.0f);
+
+	UINT GetFrameCount() const { return (UINT)mFrames.size(); }
+	const MotionFrame& GetFrame(UINT frame) const { return mFrames[frame]; }
+	const MotionFeatures& GetFeatures(UINT frame) const { return mFrameFeatures[frame]; }
+	// Frame nearest to TimePos of the state, kInvalidMotionFrame when the state is not in the database
+	UINT FindFrame(int state, float timePos) const;
+	// Mean ground velocity of the frames of the state, x and z
+	DirectX::XMFLOAT2 GetGroundVelocity(int state) const;
+
+	// The trajectory of a character keeping a ground velocity
+	static void SetTrajectory(const DirectX::XMFLOAT2& velocity, MotionFeatures& features);
+	// Features as the search compares them, kFeatureCount floats
+	void Normalize(const MotionFeatures& features, float* outFeatures) const;
+	// Frame whose features are nearest to the query, with the squared distance in outCost
+	UINT Search(const MotionFeatures& query, float* outCost = nullptr) const;
+
+	size_t GetMemorySize() const;
+
+private:
+	void BuildSearchBlocks();
+
+private:
+	std::vector<MotionFrame> mFrames;
+	std::vector<MotionFeatures> mFrameFeatures;
+
+	// By state index, no frames for the states left out
+	std::vector<UINT> mStateFirstFrames;
+	std::vector<UINT> mStateFrameCounts;
+	std::vector<float> mStateFrameTimes;
+	std::vector<bool> mStateLoops;
+	std::vector<DirectX::XMFLOAT2> mGroundVelocities;
+
+	// Normalized feature is (feature - mean) * scale
+	float mMeans[kFeatureCount] = {};
+	float mScales[kFeatureCount] = {};
+	// Normalized features of frames 4b to 4b + 3, feature f in mBlocks[b * kFeatureCount + f].
+	// The lanes past the last frame never match.
+	std::vector<DirectX::XMFLOAT4> mBlocks;
+};
@@ -4,6 +4,9 @@
 #include "PlayerUI.h"
 #include "Character.h"
 
+class AnimationStage;
+class MotionDatabase;
+
 enum class ePlayerMoveList
 {
 	Walk,
@@ -13,6 +16,22 @@ enum class ePlayerMoveList
 	Death
 };
 
+// Animation states of the player, in the order of the state table in Player.cpp
+enum class ePlayerClip : int
+{
+	Idle,
+	Walking,
+	Run,
+	WalkingBackward,
+	Kick,
+	Kick2,
+	FlyingKick,
+	Hook,
+	HitReaction,
+	Death,
+	Count
+};
+
 class Player : public Character
 {
 public:
@@ -26,7 +45,7 @@ public:
 	virtual int GetHealth(int i = 0) const override;
 	virtual CharacterInfo& GetCharacterInfo(int cIndex = 0);
 	virtual void Damage(int damage, DirectX::XMVECTOR Position, DirectX::XMVECTOR Look) override;
-	void Attack(Character* inMonster, std::string clipName);
+	void Attack(Character* inMonster, ePlayerClip clip);
 
 public:
 	bool isClipEnd();
@@ -36,9 +55,20 @@ public:
 
 	UINT GetAllRitemsSize() const;
 	const std::vector<RenderItem*> GetRenderItem(RenderLayer Type) const;
+	// The character and its shadow are out of view this frame, neither is uploaded nor drawn
+	bool IsCulled() const;
 
-	void SetClipName(const std::string & inClipName);
+	void SetClip(ePlayerClip clip);
 	void SetClipTime(float time);
+	// Idle, Walking, Run and WalkingBackward by motion matching: the clip and time
+	// nearest to the pose playing with the trajectory of the gait.
+	// Out of those clips, e.g. in a kick, it is SetClip(gait).
+	void RequestLocomotion(ePlayerClip gait, float dt);
+	bool IsInLocomotion() const;
+	// Played instead of the clips in the far animation LOD tier
+	void SetBakedAnimation(std::shared_ptr<const BakedAnimation> baked);
+	// Keeps the clips of the rig under a memory budget, updated by CollectAnimation
+	void SetClipResidency(std::shared_ptr<ClipResidency> residency);
 
 public:
 	virtual void BuildGeometry(
@@ -46,12 +76,15 @@ public:
 		ID3D12GraphicsCommandList * cmdList,
 		const std::vector<CharacterVertex>& inVertices,
 		const std::vector<std::uint32_t>& inIndices,
-		const SkinnedData & inSkinInfo, std::string geoName);
+		std::shared_ptr<const SkinnedData> inSkinInfo, std::string geoName);
 	virtual void BuildRenderItem(
 		Materials & mMaterials,
 		std::string matrialPrefix) override;
 
 
+	// Queues the animation update of this frame, before UpdateCharacterCBs
+	void CollectAnimation(AnimationStage& stage);
+
 	void UpdateCharacterCBs(
 		FrameResource* mCurrFrameResource,
 		const Light& mMainLight,
@@ -61,13 +94,18 @@ public:
 	virtual void UpdateCharacterShadows(const Light & mMainLight);
 
 	void UpdatePlayerPosition(ePlayerMoveList move, float velocity);
+	// Moves the player by the root motion its clips played since the last call
+	void ApplyRootMotion();
 
 	void UpdateTransformationMatrix();
 	
 private:
 	CharacterInfo mPlayerInfo;
-	SkinnedData mSkinnedInfo;
 	std::unique_ptr<SkinnedModelInstance> mSkinnedModelInst;
+	std::shared_ptr<const MotionDatabase> mMotionDatabase;
+	std::shared_ptr<ClipResidency> mClipResidency;
+	ePlayerClip mLocomotionGait = ePlayerClip::Idle;
+	float mMotionSearchTime = 0.0f;
 
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 	std::vector<RenderItem*> mRitems[(int)RenderLayer::Count];
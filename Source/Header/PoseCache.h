@@ -0,0 +1,92 @@
+#pragma once
+
+#include <mutex>
+#include "SkinnedData.h"
+
+///<summary>
+/// Palettes shared by the instances that play the same clip of the same
+/// skeleton at nearly the same time. The time is quantized to frames of
+/// timeStep and the palette is evaluated at the start of the frame, so every
+/// instance inside the window gets the same pose whichever computed it.
+/// The cache holds at most capacity palettes; the least recently used one is
+/// replaced when it is full. Safe to use from the animation jobs.
+///</summary>
+class PoseCache
+{
+public:
+	PoseCache(UINT capacity = 256, float timeStep = 1.0f / 60.0f);
+	~PoseCache();
+
+	// Frame index of a time, the palette of frame f is sampled at f * timeStep
+	int GetFrame(float timePos) const { return (int)(timePos / mTimeStep); }
+	float GetFrameTime(int frame) const { return frame * mTimeStep; }
+
+	// Copies the cached palette and bounds, false on a miss
+	bool Find(const SkinnedData* skeleton, ClipHandle clip, int frame,
+		std::vector<DirectX::XMFLOAT4X4>& outTransforms, DirectX::BoundingBox& outBounds);
+	void Store(const SkinnedData* skeleton, ClipHandle clip, int frame,
+		const std::vector<DirectX::XMFLOAT4X4>& transforms, const DirectX::BoundingBox& bounds);
+
+	void Clear();
+	void ResetCounters();
+
+	UINT64 GetHits() const { return mHits; }
+	UINT64 GetMisses() const { return mMisses; }
+	UINT64 GetEvictions() const { return mEvictions; }
+	UINT GetSize() const { return (UINT)mSlots.size(); }
+	// Bytes held by the palettes
+	size_t GetMemorySize() const;
+
+private:
+	struct Key
+	{
+		const SkinnedData* Skeleton;
+		ClipHandle Clip;
+		int Frame;
+
+		bool operator==(const Key& rhs) const
+		{
+			return Skeleton == rhs.Skeleton && Clip == rhs.Clip && Frame == rhs.Frame;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			size_t h = std::hash<const void*>()(key.Skeleton);
+			h ^= std::hash<int>()(key.Clip) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(key.Frame) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	struct Entry
+	{
+		Key CacheKey;
+		std::vector<DirectX::XMFLOAT4X4> Transforms;
+		DirectX::BoundingBox Bounds;
+		// Neighbours in the use order, kNone at the ends
+		UINT Prev;
+		UINT Next;
+	};
+
+	void Unlink(UINT slot);
+	void LinkFront(UINT slot);
+
+private:
+	UINT mCapacity;
+	float mTimeStep;
+
+	std::vector<Entry> mEntries;
+	std::unordered_map<Key, UINT, KeyHash> mSlots;
+	// Most recently used first
+	UINT mHead;
+	UINT mTail;
+
+	UINT64 mHits = 0;
+	UINT64 mMisses = 0;
+	UINT64 mEvictions = 0;
+
+	std::mutex mMutex;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "SkinnedData.h"
+
+///<summary>
+/// Structure of arrays copy of an animation clip, evaluated four bones at a time.
+/// The animated bones are grouped by four. For every key a group stores each
+/// channel (translation xyz, rotation xyzw, scale xyz) as four floats, one per
+/// bone, so one channel of the group loads into one SIMD register.
+/// Translation and scale are lerped. Rotations use a normalized lerp, and the
+/// lanes whose keys are too far apart for it fall back to a slerp.
+/// The constant and identity tracks of a compacted clip are not laid out, their
+/// bones are written from a transform computed once. The scale channel is left
+/// out too when no animated key scales.
+/// Only clips whose animated tracks share their key times can be laid out this way.
+///</summary>
+class PoseEvaluator
+{
+public:
+	PoseEvaluator();
+	~PoseEvaluator();
+
+	// Returns false when the animated tracks do not share their key times, or there are none.
+	// elideStatic false lays out every track and channel, for comparison.
+	bool Build(const AnimationClip& clip, bool elideStatic = true);
+
+	// Same transforms as AnimationClip::Interpolate, keyCursor as in BoneAnimation.
+	// groupMask, one byte per group of four bones, skips the groups set to 0.
+	// With scaledOffsets, one per bone, the palettes are written instead, see SkinnedData::StorePalette.
+	void Evaluate(float t, std::vector<DirectX::XMFLOAT4X4>& boneTransforms, UINT& keyCursor,
+		const BYTE* groupMask = nullptr, const DirectX::XMFLOAT4X4* scaledOffsets = nullptr) const;
+	// Same as AnimationClip::Sample
+	void Sample(float t, std::vector<BoneTransform>& bonePose, UINT& keyCursor,
+		const BYTE* groupMask = nullptr) const;
+
+	UINT GetBoneCount() const { return mBoneCount; }
+	UINT GetAnimatedCount() const { return mAnimatedCount; }
+	bool HasScale() const { return mChannelCount > kScaleFreeChannelCount; }
+	// Bytes of the laid out keys and the static transforms
+	size_t GetMemorySize() const;
+
+private:
+	// Key interval holding t and the blend factor inside it
+	UINT FindInterval(float t, UINT& keyCursor, float& outLerpPercent) const;
+
+	// Channels of a group without the scale
+	static const UINT kScaleFreeChannelCount = 7;
+
+private:
+	UINT mBoneCount = 0;
+	UINT mAnimatedCount = 0;
+	UINT mGroupCount = 0;
+	UINT mChannelCount = 0;
+	UINT mFloatsPerGroup = 0;
+
+	// Bone of every lane of the groups, mBoneCount in the padding lanes
+	std::vector<UINT> mGroupBones;
+
+	// Bones of the constant and identity tracks and their transforms
+	std::vector<UINT> mStaticBones;
+	std::vector<BoneTransform> mStaticPose;
+	std::vector<DirectX::XMFLOAT4X4> mStaticTransforms;
+
+	// Key times shared by every track, the transforms of these keys are unused
+	BoneAnimation mKeyTimes;
+
+	// Key after key, group after group, channel after channel, four bones each
+	std::vector<float> mKeys;
+};
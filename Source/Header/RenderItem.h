@@ -1,17 +1,12 @@
 #pragma once
 
-#include "SkinnedData.h"
+#include "AnimationStateMachine.h"
+#include "PoseCache.h"
+#include "LayeredPose.h"
+#include "BakedAnimation.h"
+#include "SkeletonRetarget.h"
 #include "CharacterMovement.h"
-
-enum class eClipList
-{
-	Idle,
-	StartWalking,
-	Walking,
-	StopWalking,
-	Kick,
-	FlyingKick
-};
+#include "ClipResidency.h"
 
 enum class eUIList : int
 {
@@ -41,49 +36,78 @@ enum class RenderLayer : int
 
 struct SkinnedModelInstance
 {
-	SkinnedData* SkinnedInfo = nullptr;
+	// Shared by every instance of the rig and read by the animation thread.
+	// Only its ClipResidency writes it, while no frame is in flight, see AnimationStage.
+	std::shared_ptr<const SkinnedData> SkinnedInfo;
+	std::shared_ptr<const AnimationStateMachine> StateMachine;
 	std::vector<DirectX::XMFLOAT4X4> FinalTransforms;
+	// Model space bounds of the current pose
+	DirectX::BoundingBox Bounds;
+	// Copies of the last finished pose the renderer reads, written by
+	// AnimationStage while the next pose may be evaluated into FinalTransforms
+	std::vector<DirectX::XMFLOAT4X4> PresentedTransforms;
+	DirectX::BoundingBox PresentedBounds;
+	// Key found by the last sample of every bone, where the next search starts
+	std::vector<UINT> KeyCursors;
 	float TimePos = 0.0f;
-	eClipList mState;
-	
-	void UpdateSkinnedAnimation(std::string ClipName, float dt)
-	{
-		TimePos += dt;
-
-		// Loop animation
-		if (TimePos > SkinnedInfo->GetClipEndTime(ClipName))
-		{
-			if (ClipName == "Idle" || ClipName == "Walking")
-			{
-				TimePos = 0.0f;
-			}
-		}
-
-		eClipList state = eClipList::Idle;
-		if (ClipName == "Idle")
-		{
-			state = eClipList::Idle;
-		}
-		else if (ClipName == "StartWalking")
-			state = eClipList::StartWalking;
-		else if (ClipName == "Walking" || ClipName == "WalkingBackward" || ClipName == "run" || ClipName == "playerWalking")
-			state = eClipList::Walking;
-		else if (ClipName == "StopWalking")
-			state = eClipList::StopWalking;
-		else if (ClipName == "Kick")
-			state = eClipList::Kick;
-		else if (ClipName == "FlyingKick")
-			state = eClipList::FlyingKick;
-
-		if (state != mState)
-		{
-			TimePos = 0.0f;
-			mState = state;
-		}
-
-		// Compute the final transforms for this time position.
-		SkinnedInfo->GetFinalTransforms(ClipName, TimePos, FinalTransforms);
-	}
+	// Ground motion of the clips played since the owner last took it, model space x and z.
+	// Only the clips with a root motion track move it, see SkinnedData::ExtractRootMotion.
+	DirectX::XMFLOAT2 RootMotion = DirectX::XMFLOAT2(0.0f, 0.0f);
+	// Index of the playing state in StateMachine
+	int State = 0;
+	// Opt in, shared with the instances of the crowd and not owned
+	PoseCache* Cache = nullptr;
+	// Opt in, shared with the instances of the rig and not owned. Used on the main thread only.
+	ClipResidency* Residency = nullptr;
+	// Opt in palette table of the rig, played instead of the clips while UseBaked
+	std::shared_ptr<const BakedAnimation> Baked;
+	// Opt in, plays the clips of another rig on SkinnedInfo.
+	// StateMachine is then compiled against Retarget->GetSource().
+	std::shared_ptr<const SkeletonRetarget> Retarget;
+	RetargetPose RetargetBuffers;
+	// Partial body clips over the state clip, sized by Layers.Initialize
+	LayeredPose Layers;
+	// Seconds a state change blends from the clip left, 0 switches at once.
+	// Needs Layers to be initialized.
+	float CrossfadeDuration = 0.0f;
+
+	// Animation LOD: the pose is evaluated every UpdateInterval frames with
+	// the bones of BoneLod, and the palettes in between are blended.
+	UINT UpdateInterval = 1;
+	UINT BoneLod = 0;
+	UINT FramesToUpdate = 0;
+	bool UseBaked = false;
+	bool HasPose = false;
+	std::vector<DirectX::XMFLOAT4X4> PrevTransforms;
+	std::vector<DirectX::XMFLOAT4X4> NextTransforms;
+	DirectX::BoundingBox NextBounds;
+
+	// Culling, see UpdateVisibility. A culled instance only advances its clock,
+	// a partly visible one evaluates VisibleBones and leaves the others stale.
+	bool IsCulled = false;
+	bool IsPartial = false;
+	::BoneLod VisibleBones;
+	std::vector<UINT> PrevVisibleBones;
+
+	void RequestState(int state);
+
+	void SetLod(UINT updateInterval, UINT boneLod, bool useBaked = false);
+
+	// Culls the instance placed by each of the world matrices, a null frustum shows it all.
+	// The bones it did not evaluate are stale, so gaining any restarts the pose.
+	void UpdateVisibility(const DirectX::BoundingFrustum* frustum, const DirectX::XMMATRIX* worlds, UINT worldCount);
+
+	// Loads the evicted clips the pose is about to play, on the main thread before it is
+	// evaluated. False when the state clip could not be loaded; a layer that could not is stopped.
+	bool RequireClips();
+
+	bool IsClipEnd() const;
+
+	// Advances the clock and the root motion, then evaluates or blends the pose
+	void UpdateSkinnedAnimation(float dt);
+
+	// Pose of clip at t from the retarget, the layers, the baked palettes, the cache or the clip itself
+	void EvaluatePose(ClipHandle clip, float t, std::vector<DirectX::XMFLOAT4X4>& outTransforms, DirectX::BoundingBox& outBounds);
 };
 
 struct CharacterInfo
@@ -133,4 +157,9 @@ struct RenderItem
 	UINT IndexCount = 0;
 	UINT StartIndexLocation = 0;
 	int BaseVertexLocation = 0;
+
+	// Level of detail chain, finest first, for the items a LodSelector picks levels for.
+	// The selected level is copied to IndexCount and StartIndexLocation.
+	std::vector<SubmeshLod> Lods;
+	UINT LodIndex = 0;
 };
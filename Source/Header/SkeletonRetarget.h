@@ -0,0 +1,66 @@
+#pragma once
+
+#include "SkinnedData.h"
+
+// Per instance buffers of a retargeted pose, sized on first use
+struct RetargetPose
+{
+	// Model space pose of the source skeleton
+	std::vector<BoneTransform> Source;
+	// Model space pose of the target skeleton
+	std::vector<BoneTransform> Target;
+	// Rotation of every target bone away from its bind pose
+	std::vector<DirectX::XMFLOAT4> Deltas;
+};
+
+///<summary>
+/// Plays the clips of a source skeleton on a target skeleton, so one set of
+/// clips drives every rig with the same bone names. The bones are matched
+/// by name without the namespace prefix, "Mutant:Hips" is "Hips".
+/// A matched bone turns away from the target bind pose as its source bone
+/// turns away from the source bind pose; a bone without a match follows its
+/// parent rigidly. The joints keep the bone lengths of the target and the
+/// root translation is scaled by the ratio of the hip heights.
+/// The bind pose corrections are computed once by Build, the parents of
+/// the target must come before their children as the loader orders them.
+///</summary>
+class SkeletonRetarget
+{
+public:
+	SkeletonRetarget();
+	~SkeletonRetarget();
+
+	// False when the root of the target has no source bone
+	bool Build(std::shared_ptr<const SkinnedData> source, std::shared_ptr<const SkinnedData> target);
+
+	const SkinnedData& GetSource() const { return *mSource; }
+	const SkinnedData& GetTarget() const { return *mTarget; }
+	// Target bones with a source bone
+	UINT GetMatchedCount() const;
+	// Bytes of the remap table and the bind pose corrections
+	size_t GetMemorySize() const;
+
+	// Model space pose of the target for a clip of the source, left in pose.Target
+	void GetModelPose(ClipHandle clip, float timePos, RetargetPose& pose,
+		std::vector<UINT>* keyCursors = nullptr) const;
+	// Palette of the target for a clip of the source
+	void GetFinalTransforms(ClipHandle clip, float timePos, RetargetPose& pose,
+		std::vector<DirectX::XMFLOAT4X4>& finalTransforms, std::vector<UINT>* keyCursors = nullptr) const;
+
+private:
+	std::shared_ptr<const SkinnedData> mSource;
+	std::shared_ptr<const SkinnedData> mTarget;
+
+	// By target bone
+	// Source bone, -1 when there is none
+	std::vector<int> mSourceBones;
+	// Inverse bind rotation of the source bone
+	std::vector<DirectX::XMFLOAT4> mSourceBindInverse;
+	std::vector<DirectX::XMFLOAT4> mTargetBind;
+	std::vector<DirectX::XMFLOAT3> mTargetScale;
+	// Bind pose joint from the parent joint, the root bind joint for the root
+	std::vector<DirectX::XMFLOAT3> mBindOffsets;
+
+	DirectX::XMFLOAT3 mSourceRootBind;
+	float mRootScale = 1.0f;
+};
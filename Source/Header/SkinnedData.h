@@ -31,12 +31,40 @@ struct Keyframe
 	}
 };
 
+///<summary>
+/// Translation, scale and rotation of a bone, the form poses are blended in.
+///</summary>
+struct BoneTransform
+{
+	DirectX::XMFLOAT3 Translation;
+	DirectX::XMFLOAT3 Scale;
+	DirectX::XMFLOAT4 RotationQuat;
+};
+
+// How the keys of a bone track change, see BoneAnimation::Compact
+enum class eTrackKind : int
+{
+	Animated = 0,
+	// Every key is the same, the track keeps one
+	Constant = 1,
+	// Every key is the identity, or the zero filled track of a bone without a cluster; no key is kept
+	Identity = 2,
+};
+
 ///<summary>
 /// A BoneAnimation is defined by a list of keyframes.  For time
 /// values inbetween two keyframes, we interpolate between the
 /// two nearest keyframes that bound the time.  
 ///
-/// We assume an animation always has two keyframes.
+/// We assume an animated track always has two keyframes.
+///
+/// The keys bounding the time are found by direct indexing when the
+/// track is uniformly sampled.  Otherwise the search starts from a key
+/// cursor, the key found by the previous sample, which is at or just
+/// before the answer during playback; seeks fall back to a binary search.
+///
+/// Tracks that never change are compacted at load: they keep a single key
+/// or none, are never searched, and give the same transform at any time.
 ///</summary>
 struct BoneAnimation
 {
@@ -44,8 +72,43 @@ struct BoneAnimation
 	float GetEndTime()const;
 
 	void Interpolate(float t, DirectX::XMFLOAT4X4 & M) const;
+	void Interpolate(float t, DirectX::XMFLOAT4X4 & M, UINT& keyCursor) const;
+	// Interpolated transform before it is turned into a matrix
+	void Sample(float t, BoneTransform& out, UINT& keyCursor) const;
+
+	// Index of the key starting the interval that holds t.
+	// keyCursor is the previous answer and receives the new one.
+	UINT FindKey(float t, UINT& keyCursor) const;
+
+	// Sets SampleInterval, call after the keyframes change
+	void UpdateSampling();
+	// Sets Kind and drops the keys a constant or identity track does not need
+	void Compact();
 
 	std::vector<Keyframe> Keyframes;
+	eTrackKind Kind = eTrackKind::Animated;
+
+	// Time between keys of a uniformly sampled track, 0 otherwise
+	float SampleInterval = 0.0f;
+};
+
+///<summary>
+/// Ground motion of a clip, taken out of its root bone by
+/// SkinnedData::ExtractRootMotion. Displacements from the clip start at the
+/// key times of the root, x and z in the model space of the palettes. They
+/// hold the horizontal travel of the root, zeroed in the pose, and for clips
+/// played in place the distance the planted foot slides back.
+///</summary>
+struct RootMotionTrack
+{
+	// Displacement at t, linear between the keys and held past the ends
+	DirectX::XMFLOAT2 Sample(float t) const;
+	// Motion from one time to the next, a time before the first is a loop over the clip end
+	DirectX::XMFLOAT2 GetDelta(float from, float to) const;
+	size_t GetMemorySize() const;
+
+	std::vector<float> Times;
+	std::vector<DirectX::XMFLOAT2> Displacements;
 };
 
 ///<summary>
@@ -58,27 +121,108 @@ struct AnimationClip
 	float GetClipStartTime()const;
 	float GetClipEndTime()const;
 
-	void Interpolate(float t, std::vector<DirectX::XMFLOAT4X4>& boneTransforms) const;
+	// keyCursors holds one key cursor per bone, see BoneAnimation.
+	// bones limits the evaluation to the listed bones.
+	void Interpolate(float t, std::vector<DirectX::XMFLOAT4X4>& boneTransforms,
+		std::vector<UINT>* keyCursors = nullptr, const std::vector<UINT>* bones = nullptr) const;
+	void Sample(float t, std::vector<BoneTransform>& bonePose,
+		std::vector<UINT>* keyCursors = nullptr, const std::vector<UINT>* bones = nullptr) const;
+	void UpdateSampling();
+	void Compact();
+	// Moves the horizontal motion of the root, bone 0, to outTrack. The lowest contact
+	// bone near the ground is taken as planted. Constant tracks get a key per root key;
+	// false, and the clip left as it is, when the animated tracks do not share the root's key times.
+	bool ExtractRootMotion(const std::vector<UINT>& contactBones, RootMotionTrack& outTrack);
+	// Keys held by all the tracks
+	UINT GetKeyCount() const;
 
 	std::vector<BoneAnimation> BoneAnimations;
 };
 
+class PoseEvaluator;
+
+///<summary>
+/// Reduced skeleton for distant characters. The bones left out copy the
+/// palette of their nearest evaluated ancestor, so they follow it rigidly
+/// as they sit in the bind pose.
+///</summary>
+struct BoneLod
+{
+	// Bone whose palette each bone uses, the bone itself when it is evaluated
+	std::vector<int> Source;
+	// Evaluated bones in increasing order
+	std::vector<UINT> Bones;
+	// One byte per group of four bones, 1 when one of them is evaluated
+	std::vector<BYTE> GroupMask;
+};
+
+///<summary>
+/// Bones driven by a partial body layer: a bone and all of its descendants.
+///</summary>
+struct BoneMask
+{
+	// Driven bones in increasing order, so parents come before their children
+	std::vector<UINT> Bones;
+	// Bones sampled from the layer clip, the driven bones and the parent of the first
+	std::vector<UINT> SampledBones;
+	// One byte per group of four bones, 1 when one of them is sampled
+	std::vector<BYTE> GroupMask;
+};
+
+// Index of a clip in its SkinnedData, resolved from the clip name at load time
+typedef int ClipHandle;
+const ClipHandle kInvalidClip = -1;
+
+// The clips are authored in centimeters, the palettes and root motion are in meters
+const float kModelScale = 0.01f;
+
+// Layout of the palette uploaded to the skinned shaders, the values match gPaletteFormat
+enum class ePaletteFormat : int
+{
+	// Three float4 rows per bone, the transposed final transform without its (0, 0, 0, 1) row
+	Affine3x4 = 0,
+	// Rotation and dual quaternion per bone, the uniform model scale is applied apart
+	DualQuaternion = 1,
+};
+
+///<summary>
+/// Skeleton and clips of a rig, filled by the loader and then shared as a
+/// std::shared_ptr<const SkinnedData> by every instance of the rig.
+/// The per instance playback state lives in SkinnedModelInstance.
+/// The one writer after loading is the rig's ClipResidency, which evicts and
+/// reloads clip keys on the main thread while no AnimationStage frame is in
+/// flight; the instances and the animation jobs only ever read.
+///</summary>
 class SkinnedData
 {
 public:
 	UINT BoneCount()const;
 
 	float GetClipStartTime(const std::string& clipName)const;
+	float GetClipStartTime(ClipHandle clip)const;
 	float GetClipEndTime(const std::string& clipName)const;
+	float GetClipEndTime(ClipHandle clip)const;
+	// kInvalidClip when the clip is not loaded
+	ClipHandle GetClipHandle(const std::string& clipName)const;
+	// The handles are 0 to GetClipCount() - 1
+	UINT GetClipCount()const { return (UINT)mClips.size(); }
 	std::string GetAnimationName(int num) const;
-	std::vector<int> GetBoneHierarchy() const;
-	std::vector<DirectX::XMFLOAT4X4> GetBoneOffsets() const;
-	AnimationClip GetAnimation(std::string clipName) const;
-	std::vector<int> GetSubmeshOffset() const;
+	const std::vector<int>& GetBoneHierarchy() const;
+	const std::vector<DirectX::XMFLOAT4X4>& GetBoneOffsets() const;
+	const AnimationClip& GetAnimation(const std::string& clipName) const;
+	const AnimationClip& GetAnimation(ClipHandle clip) const;
+	const std::vector<int>& GetSubmeshOffset() const;
 	DirectX::XMFLOAT4X4 getBoneOffsets(int num) const;
-	std::vector<std::string> GetBoneName() const;
+	const std::vector<std::string>& GetBoneName() const;
+	const std::vector<DirectX::BoundingBox>& GetBoneBounds() const;
+	// 0 is the full skeleton, 1 leaves out the leaf and finger bones
+	UINT GetBoneLodCount() const { return (UINT)mBoneLods.size(); }
+	const BoneLod& GetBoneLod(UINT lod) const { return mBoneLods[lod]; }
+	// Mask of the named bone and its descendants, false when there is no such bone
+	bool BuildBoneMask(const std::string& rootBoneName, BoneMask& outMask) const;
 
-	void Set(
+	// False, and nothing set, when a parent does not come before its children
+	bool Set(
 		std::vector<int>& boneHierarchy,
 		std::vector<DirectX::XMFLOAT4X4>& boneOffsets,
 		std::unordered_map<std::string, AnimationClip>* animations = nullptr);
@@ -86,15 +230,93 @@ public:
 	void SetAnimationName(const std::string& clipName);
 	void SetBoneName(std::string boneName);
 	void SetSubmeshOffset(int num);
+	// Bone space box of the vertices each bone influences, negative extents when it has none
+	void SetBoneBounds(const std::vector<DirectX::BoundingBox>& boneBounds);
+	// Cook step once the clip is set: its ground motion goes to a RootMotionTrack and the
+	// root stays in place in the pose. The contact bones, e.g. the feet, give the ground
+	// motion of a clip played in place. False when the clip is left as it was.
+	bool ExtractRootMotion(ClipHandle clip, const std::vector<std::string>& contactBoneNames);
+	// nullptr when the clip has no root motion
+	const RootMotionTrack* GetRootMotion(ClipHandle clip)const;
+
+	// Residency, see ClipResidency. An evicted clip keeps its handle, times, bounds and
+	// root motion but drops its keys; it is restored before it is evaluated again.
+	bool IsClipResident(ClipHandle clip)const { return !mClips[clip].BoneAnimations.empty(); }
+	// Bytes of the keys and of the SIMD layout of a resident clip
+	size_t GetClipMemorySize(ClipHandle clip)const;
+	void EvictClip(ClipHandle clip);
+	// The keys of an evicted clip loaded again, cooked as they were when the clip was set
+	void RestoreClip(ClipHandle clip, AnimationClip animation);
 
 	void clear();
 
 	// In a real project, you'd want to cache the result if there was a chance
 	// that you were calling this several times with the same clipName at 
 	// the same timePos.
+	// keyCursors is the per bone key cursor state of the caller, kept between
+	// calls so forward playback does not search the keys again.
 	void GetFinalTransforms(const std::string& clipName, float timePos,
+		std::vector<DirectX::XMFLOAT4X4>& finalTransforms,
+		std::vector<UINT>* keyCursors = nullptr)const;
+	// Per frame path, no lookup by name and no allocation once keyCursors is sized.
+	// boneLod evaluates the bones of that LOD only, see BoneLod.
+	void GetFinalTransforms(ClipHandle clip, float timePos,
+		std::vector<DirectX::XMFLOAT4X4>& finalTransforms,
+		std::vector<UINT>* keyCursors = nullptr, UINT boneLod = 0)const;
+	// Evaluates the bones of a set built by GetVisibleBones, the others keep their palette
+	void GetFinalTransforms(ClipHandle clip, float timePos,
+		std::vector<DirectX::XMFLOAT4X4>& finalTransforms,
+		std::vector<UINT>* keyCursors, const BoneLod& bones)const;
+	// Palette of a model space pose, see GetModelPose
+	void GetFinalTransforms(const std::vector<BoneTransform>& modelPose,
 		std::vector<DirectX::XMFLOAT4X4>& finalTransforms)const;
 
+	// Model space transforms of the clip before the bone offsets, as stored in the keys.
+	// mask limits the sampling to the bones of mask->SampledBones.
+	void GetModelPose(ClipHandle clip, float timePos, std::vector<BoneTransform>& modelPose,
+		std::vector<UINT>* keyCursors = nullptr, const BoneMask* mask = nullptr)const;
+
+	// Model space box of the skinned mesh posed by the final transforms.
+	// Every bone box is moved by its palette matrix and the results are merged.
+	void GetAnimatedBounds(const std::vector<DirectX::XMFLOAT4X4>& finalTransforms,
+		DirectX::BoundingBox& outBounds)const;
+	void GetBindPoseBounds(DirectX::BoundingBox& outBounds)const;
+	// Model space box of every pose of the clip, the default box without bone bounds
+	const DirectX::BoundingBox& GetClipBounds(ClipHandle clip)const { return mClipBounds[clip]; }
+
+	// Culls the clip against a frustum, with the model placed by each of the world matrices.
+	// DISJOINT when no pose of the clip reaches the frustum and CONTAINS when every bone is
+	// inside it or the skeleton has no bone bounds. INTERSECTS fills outBones with the bones
+	// of boneLod whose box can reach it, copied from their source as the LOD does.
+	DirectX::ContainmentType GetVisibleBones(ClipHandle clip, UINT boneLod,
+		const DirectX::BoundingFrustum& frustum, const DirectX::XMMATRIX* worlds, UINT worldCount,
+		BoneLod& outBones)const;
+
+	// Dual quaternions need rigid bone offsets and keys without scale,
+	// otherwise the skeleton keeps Affine3x4 and false is returned
+	bool SetPaletteFormat(ePaletteFormat format);
+	ePaletteFormat GetPaletteFormat() const { return mPaletteFormat; }
+	// Scale of the bind pose vertices before a dual quaternion palette, 1 for Affine3x4
+	float GetPaletteScale() const;
+	UINT GetPaletteRowsPerBone() const;
+	// Final transforms to the uploaded palette, returns the float4 rows written
+	UINT PackPalette(const std::vector<DirectX::XMFLOAT4X4>& finalTransforms, DirectX::XMFLOAT4* outRows)const;
+	// Uploaded palette back to final transforms, the CPU side of the shader decode
+	void UnpackPalette(const DirectX::XMFLOAT4* rows, UINT boneCount,
+		std::vector<DirectX::XMFLOAT4X4>& outFinalTransforms)const;
+
+	// Palette of a bone from its offset prescaled by the model scale and its model space transform
+	static void StorePalette(const DirectX::XMFLOAT4X4& scaledOffset, DirectX::FXMMATRIX toRoot,
+		DirectX::XMFLOAT4X4& outPalette);
+
+private:
+	void SetClip(ClipHandle clip, AnimationClip animation);
+	void BuildPoseEvaluator(ClipHandle clip);
+	void BuildBoneLods();
+	void BuildClipBounds();
+	void BuildClipBounds(ClipHandle clip);
+	void EvaluateFinalTransforms(ClipHandle clip, float timePos, std::vector<DirectX::XMFLOAT4X4>& finalTransforms,
+		std::vector<UINT>* keyCursors, const BoneLod* lod)const;
 
 private:
 	std::vector<std::string> mBoneName;
@@ -103,9 +325,33 @@ private:
 	std::vector<int> mBoneHierarchy;
 
 	std::vector<DirectX::XMFLOAT4X4> mBoneOffsets;
+	// Bone offsets times the model scale, see StorePalette
+	std::vector<DirectX::XMFLOAT4X4> mScaledOffsets;
+
+	std::vector<DirectX::BoundingBox> mBoneBounds;
+	// Inverse bone offsets, bone space back to the bind pose model space
+	std::vector<DirectX::XMFLOAT4X4> mBoneToModel;
+
+	std::vector<BoneLod> mBoneLods;
 
 	std::vector<std::string> mAnimationName;
-	std::unordered_map<std::string, AnimationClip> mAnimations;
+	// Clips by handle, the times cached for the per frame checks and the evicted clips
+	std::vector<AnimationClip> mClips;
+	std::vector<float> mClipStartTimes;
+	std::vector<float> mClipEndTimes;
+	std::unordered_map<std::string, ClipHandle> mClipHandles;
+	// Structure of arrays copies of the clips the SIMD evaluator can lay out, null otherwise
+	std::vector<std::shared_ptr<PoseEvaluator>> mPoseEvaluators;
+	// Model space boxes swept by the clips, per bone and merged.
+	// Negative extents for the bones without vertices.
+	std::vector<std::vector<DirectX::BoundingBox>> mClipBoneBounds;
+	std::vector<DirectX::BoundingBox> mClipBounds;
+	// Empty tracks for the clips without root motion
+	std::vector<RootMotionTrack> mRootMotions;
+	// Contact bones the root motion was extracted with, to extract it again from a restored clip
+	std::vector<std::vector<UINT>> mRootMotionContacts;
 
 	std::vector<int> mSubmeshOffset;
+
+	ePaletteFormat mPaletteFormat = ePaletteFormat::Affine3x4;
 };
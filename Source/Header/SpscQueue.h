@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include "d3dUtil.h"
+
+///<summary>
+/// Fixed size ring of Capacity items between one producer thread and one
+/// consumer thread, without locks. Each side writes only its own index
+/// and publishes it with a release store, so an item is complete before
+/// the other side can see it.
+///</summary>
+template<typename T, UINT Capacity>
+class SpscQueue
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	// Producer side, false when the ring is full
+	bool TryPush(const T& item)
+	{
+		UINT tail = mTail.load(std::memory_order_relaxed);
+		if (tail - mHead.load(std::memory_order_acquire) == Capacity)
+			return false;
+
+		mItems[tail % Capacity] = item;
+		mTail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, false when the ring is empty
+	bool TryPop(T& outItem)
+	{
+		UINT head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire))
+			return false;
+
+		outItem = mItems[head % Capacity];
+		mHead.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T mItems[Capacity];
+
+	// Free running counters, the difference is the item count
+	std::atomic<UINT> mHead{ 0 };
+	std::atomic<UINT> mTail{ 0 };
+};
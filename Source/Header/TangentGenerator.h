@@ -0,0 +1,67 @@
+#pragma once
+
+#include "d3dUtil.h"
+
+///<summary>
+/// Per-vertex tangent frames with the weighting rules of MikkTSpace: face
+/// tangents are projected onto the vertex normal and weighted by the corner
+/// angle, measured between the edges projected on the tangent plane. The
+/// handedness is taken from the sign of the UV area, and a vertex shared by
+/// faces of both handedness (mirrored UVs) is split in two.
+/// It is not mikktspace.c itself: corners are grouped by vertex and
+/// handedness rather than by connected fan, and degenerate faces are left
+/// out rather than patched, so frames may differ on non-manifold vertices.
+/// The tangent w holds the handedness: bitangent = w * cross(normal, tangent).
+///
+/// The frame is packed with the normal into one 8 byte quaternion (QTangent).
+/// The quaternion keeps w positive and is negated for a mirrored frame, so the
+/// handedness is the sign of w.
+///</summary>
+class TangentGenerator
+{
+public:
+	// threadCount 0 uses every hardware thread
+	TangentGenerator(UINT threadCount = 0);
+	~TangentGenerator();
+
+	// Split vertices are appended: vertex positions.size() + i copies outSplitSource[i].
+	// The indices of the corners that moved are rewritten.
+	void Generate(
+		const std::vector<DirectX::XMFLOAT3>& positions,
+		const std::vector<DirectX::XMFLOAT3>& normals,
+		const std::vector<DirectX::XMFLOAT2>& texC,
+		std::vector<uint32_t>& indices,
+		std::vector<DirectX::XMFLOAT4>& outTangents,
+		std::vector<uint32_t>& outSplitSource);
+
+	// Straightforward single threaded version of Generate, the reference for validation.
+	static void GenerateReference(
+		const std::vector<DirectX::XMFLOAT3>& positions,
+		const std::vector<DirectX::XMFLOAT3>& normals,
+		const std::vector<DirectX::XMFLOAT2>& texC,
+		std::vector<uint32_t>& indices,
+		std::vector<DirectX::XMFLOAT4>& outTangents,
+		std::vector<uint32_t>& outSplitSource);
+
+	static DirectX::PackedVector::XMSHORTN4 PackQTangent(const DirectX::XMFLOAT3& normal, const DirectX::XMFLOAT4& tangent);
+	static void UnpackQTangent(const DirectX::PackedVector::XMSHORTN4& qTangent, DirectX::XMFLOAT3& outNormal, DirectX::XMFLOAT4& outTangent);
+
+private:
+	template <typename Function>
+	void ParallelFor(size_t count, Function function);
+
+private:
+	UINT mThreadCount;
+
+	// Angle weighted tangent of every triangle corner, the weight is negative when mirrored
+	std::vector<DirectX::XMFLOAT3> mCornerTangents;
+	std::vector<float> mCornerWeights;
+
+	// Corners around each vertex
+	std::vector<uint32_t> mCornerOffsets;
+	std::vector<uint32_t> mCorners;
+
+	// Tangent of the lighter side of a split vertex
+	std::vector<DirectX::XMFLOAT3> mMinorTangents;
+	std::vector<uint8_t> mSplit;
+};
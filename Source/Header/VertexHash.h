@@ -1,6 +1,28 @@
 #pragma once
 #include "FrameResource.h"
 
+// Vertex as it comes out of the FBX, before the tangent frame is built
+struct ImportVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+
+	bool operator==(const ImportVertex& other) const
+	{
+		if (Pos.x != other.Pos.x || Pos.y != other.Pos.y || Pos.z != other.Pos.z)
+			return false;
+
+		if (Normal.x != other.Normal.x || Normal.y != other.Normal.y || Normal.z != other.Normal.z)
+			return false;
+
+		if (TexC.x != other.TexC.x || TexC.y != other.TexC.y)
+			return false;
+
+		return true;
+	}
+};
+
 namespace std {
 	template <>
 	struct hash<DirectX::XMFLOAT2>
@@ -45,10 +67,30 @@ namespace std {
 			using std::size_t;
 			using std::hash;
 
+			uint64_t qTangent =
+				(uint64_t)(uint16_t)k.QTangent.x |
+				((uint64_t)(uint16_t)k.QTangent.y << 16) |
+				((uint64_t)(uint16_t)k.QTangent.z << 32) |
+				((uint64_t)(uint16_t)k.QTangent.w << 48);
+
 			// Compute individual hash values for first,
 			// second and third and combine them using XOR
 			// and bit shifting:
 
+			return ((hash<DirectX::XMFLOAT3>()(k.Pos)
+				^ (hash<uint64_t>()(qTangent) << 1)) >> 1)
+				^ (hash<DirectX::XMFLOAT2>()(k.TexC) << 1);
+		}
+	};
+
+	template <>
+	struct hash<ImportVertex>
+	{
+		std::size_t operator()(const ImportVertex& k) const
+		{
+			using std::size_t;
+			using std::hash;
+
 			return ((hash<DirectX::XMFLOAT3>()(k.Pos)
 				^ (hash<DirectX::XMFLOAT3>()(k.Normal) << 1)) >> 1)
 				^ (hash<DirectX::XMFLOAT2>()(k.TexC) << 1);
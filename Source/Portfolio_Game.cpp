@@ -23,6 +23,11 @@
 #include "Materials.h"
 #include "TextureLoader.h"
 #include "Utility.h"
+#include "MeshSimplifier.h"
+#include "LodSelector.h"
+#include "TangentGenerator.h"
+#include "Benchmark.h"
+#include "AnimationStage.h"
 
 #include "Portfolio_Game.h"
 
@@ -34,6 +39,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	// Headless benchmarks, no window is created
+	if (strstr(cmdLine, "-benchmark") != nullptr)
+	{
+		Benchmark benchmark;
+		return benchmark.Run();
+	}
+
 	try
 	{
 		PortfolioGameApp theApp(hInstance);
@@ -61,6 +73,9 @@ PortfolioGameApp::PortfolioGameApp(HINSTANCE hInstance)
 
 PortfolioGameApp::~PortfolioGameApp()
 {
+	// The animation thread may still be evaluating the player
+	mAnimationStage.StopPipeline();
+
 	if (md3dDevice != nullptr)
 		FlushCommandQueue();
 }
@@ -100,6 +115,8 @@ bool PortfolioGameApp::Initialize()
 	// Wait until initialization is complete.
 	FlushCommandQueue();
 
+	mAnimationStage.StartPipeline(mJobSystem);
+
 	return true;
 }
 
@@ -114,6 +131,9 @@ void PortfolioGameApp::OnResize()
 
 void PortfolioGameApp::Update(const GameTimer& gt)
 {
+	// Poses submitted last frame, the characters can be changed from here
+	mAnimationStage.Present();
+
 	OnKeyboardInput(gt);
 
 	// Cycle through the circular frame resource array.
@@ -130,6 +150,8 @@ void PortfolioGameApp::Update(const GameTimer& gt)
 		CloseHandle(eventHandle);
 	}
 
+	mLodSelector.Select(mPlayer.mCamera, (float)mClientHeight);
+
 	UpdateObjectCBs(gt);
 	UpdateCharacterCBs(gt);
 	UpdateMainPassCB(gt);
@@ -195,22 +217,25 @@ void PortfolioGameApp::Draw(const GameTimer& gt)
 
 
 
-	// Character
-	if (!mFbxWireframe)
+	// Character and shadow, neither uploaded when both are out of view
+	if (!mPlayer.IsCulled())
 	{
-		mCommandList->SetPipelineState(mPSOs["Player"].Get());
-	}
-	else
-	{
-		mCommandList->SetPipelineState(mPSOs["Player_wireframe"].Get());
-	}
-	DrawRenderItems(mCommandList.Get(), mPlayer.GetRenderItem(RenderLayer::Character));
+		if (!mFbxWireframe)
+		{
+			mCommandList->SetPipelineState(mPSOs["Player"].Get());
+		}
+		else
+		{
+			mCommandList->SetPipelineState(mPSOs["Player_wireframe"].Get());
+		}
+		DrawRenderItems(mCommandList.Get(), mPlayer.GetRenderItem(RenderLayer::Character));
 
 
-	// Shadow
-	mCommandList->OMSetStencilRef(0);
-	mCommandList->SetPipelineState(mPSOs["Player_shadow"].Get());
-	DrawRenderItems(mCommandList.Get(), mPlayer.GetRenderItem(RenderLayer::Shadow));
+		// Shadow
+		mCommandList->OMSetStencilRef(0);
+		mCommandList->SetPipelineState(mPSOs["Player_shadow"].Get());
+		DrawRenderItems(mCommandList.Get(), mPlayer.GetRenderItem(RenderLayer::Shadow));
+	}
 
 
 	// Indicate a state transition on the resource usage.
@@ -305,11 +330,11 @@ void PortfolioGameApp::OnKeyboardInput(const GameTimer& gt)
 		{
 			if (GetAsyncKeyState(VK_LSHIFT))
 			{
-				mPlayer.SetClipName("run");
+				mPlayer.RequestLocomotion(ePlayerClip::Run, dt);
 			}
 			else
 			{
-				mPlayer.SetClipName("playerWalking");
+				mPlayer.RequestLocomotion(ePlayerClip::Walking, dt);
 			}
 
 			if (mPlayer.GetCurrentClip() == eClipList::Walking)
@@ -327,7 +352,7 @@ void PortfolioGameApp::OnKeyboardInput(const GameTimer& gt)
 	{
 		if (!mCameraDetach)
 		{
-			mPlayer.SetClipName("WalkingBackward");
+			mPlayer.RequestLocomotion(ePlayerClip::WalkingBackward, dt);
 
 			if (mPlayer.GetCurrentClip() == eClipList::Walking)
 			{
@@ -369,8 +394,11 @@ void PortfolioGameApp::OnKeyboardInput(const GameTimer& gt)
 	}
 	else
 	{
-		if (mPlayer.isClipEnd())
-			mPlayer.SetClipName("Idle");
+		// Stopping is matched like a gait, the other clips go back to Idle when they end
+		if (mPlayer.IsInLocomotion())
+			mPlayer.RequestLocomotion(ePlayerClip::Idle, dt);
+		else if (mPlayer.isClipEnd())
+			mPlayer.SetClip(ePlayerClip::Idle);
 	}
 
 	if (GetAsyncKeyState('A') & 0x8000)
@@ -388,6 +416,8 @@ void PortfolioGameApp::OnKeyboardInput(const GameTimer& gt)
 			mPlayer.mCamera.WalkSideway(10.0f * dt);
 	}
 
+	// The locomotion clips carry the player, the animation of the last frame is presented
+	mPlayer.ApplyRootMotion();
 	mPlayer.UpdateTransformationMatrix();
 
 	// Update Remaining Time
@@ -498,6 +528,15 @@ void PortfolioGameApp::UpdateCharacterCBs(const GameTimer & gt)
 		}
 	}
 
+	// The poses of the next frame are evaluated on the animation thread while
+	// this one is recorded with the poses presented at the start of Update.
+	// The characters out of view only advance their clocks.
+	BoundingFrustum frustum;
+	mPlayer.mCamera.GetWorldFrustum(frustum);
+	mAnimationStage.Begin(&frustum);
+	mPlayer.CollectAnimation(mAnimationStage);
+	mAnimationStage.Submit(gt.DeltaTime());
+
 	mPlayer.UpdateCharacterCBs(mCurrFrameResource, mMainLight, DelayTime, gt);
 }
 
@@ -701,25 +740,25 @@ void PortfolioGameApp::BuildShadersAndInputLayout()
 	mInputLayout =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		{ "TANGENT", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 	};
 
 	mSkinnedInputLayout =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "WEIGHTS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "BONEINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 44, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		{ "TANGENT", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "WEIGHTS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 28, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "BONEINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 40, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 	};
 
 	mUIInputLayout =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "ROW", 0, DXGI_FORMAT_R32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "ROW", 0, DXGI_FORMAT_R32_FLOAT, 0, 28, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
 }
 
@@ -951,48 +990,68 @@ void PortfolioGameApp::BuildShapeGeometry()
 
 	std::vector<Vertex> vertices(totalVertexCount);
 
+	// The generated shapes are right handed, bitangent = cross(normal, tangent)
+	auto packQTangent = [](const GeometryGenerator::Vertex& v)
+	{
+		return TangentGenerator::PackQTangent(v.Normal, XMFLOAT4(v.TangentU.x, v.TangentU.y, v.TangentU.z, 1.0f));
+	};
+
 	UINT k = 0;
 	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
 	{
 		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Normal = box.Vertices[i].Normal;
+		vertices[k].QTangent = packQTangent(box.Vertices[i]);
 		vertices[k].TexC = box.Vertices[i].TexC;
 	}
 
 	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
 	{
 		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = grid.Vertices[i].Normal;
+		vertices[k].QTangent = packQTangent(grid.Vertices[i]);
 		vertices[k].TexC = grid.Vertices[i].TexC;
 	}
 
 	for (size_t i = 0; i < hpBar.Vertices.size(); ++i, ++k)
 	{
 		vertices[k].Pos = hpBar.Vertices[i].Position;
-		vertices[k].Normal = hpBar.Vertices[i].Normal;
+		vertices[k].QTangent = packQTangent(hpBar.Vertices[i]);
 		vertices[k].TexC = hpBar.Vertices[i].TexC;
 	}
 
 	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
 	{
 		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
+		vertices[k].QTangent = packQTangent(sphere.Vertices[i]);
 		vertices[k].TexC = sphere.Vertices[i].TexC;
 	}
 
 	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
 	{
 		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
+		vertices[k].QTangent = packQTangent(cylinder.Vertices[i]);
 		vertices[k].TexC = cylinder.Vertices[i].TexC;
 	}
 
+	// The cylinder carries a LOD chain, its coarser levels follow level 0 in the index buffer
+	std::vector<Vertex> cylinderVertices(vertices.begin() + cylinderVertexOffset, vertices.end());
+	std::vector<std::uint32_t> cylinderIndices(cylinder.Indices32);
+	MeshSimplifier simplifier(cylinderVertices);
+	simplifier.BuildLodChain(cylinderIndices, mCylinderLods, "cylinder");
+	for (auto& e : mCylinderLods)
+	{
+		e.StartIndexLocation += cylinderIndexOffset;
+	}
+	BoundingBox::CreateFromPoints(cylinderSubmesh.Bounds, cylinderVertices.size(), &cylinderVertices[0].Pos, sizeof(Vertex));
+
 	std::vector<std::uint16_t> indices;
 	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
 	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
 	indices.insert(indices.end(), std::begin(hpBar.GetIndices16()), std::end(hpBar.GetIndices16()));
 	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
+	for (std::uint32_t i : cylinderIndices)
+	{
+		indices.push_back((std::uint16_t)i);
+	}
 
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
@@ -1234,6 +1293,21 @@ void PortfolioGameApp::BuildRenderItems()
 	mRitems[(int)RenderLayer::Opaque].push_back(boxRitem.get());
 	mAllRitems.push_back(std::move(boxRitem));
 
+	auto columnRitem = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&columnRitem->World, XMMatrixTranslation(-5.0f, 1.5f, 5.0f));
+	XMStoreFloat4x4(&columnRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
+	columnRitem->ObjCBIndex = ++objCBIndex;
+	columnRitem->Geo = mGeometries["shapeGeo"].get();
+	columnRitem->Mat = mMaterials.Get("bricks0");
+	columnRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	columnRitem->IndexCount = columnRitem->Geo->DrawArgs["cylinder"].IndexCount;
+	columnRitem->StartIndexLocation = columnRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
+	columnRitem->BaseVertexLocation = columnRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+	columnRitem->Geo->DrawArgs["cylinder"].Bounds.Transform(columnRitem->Bounds, XMLoadFloat4x4(&columnRitem->World));
+	columnRitem->Lods = mCylinderLods;
+	mRitems[(int)RenderLayer::Opaque].push_back(columnRitem.get());
+	mAllRitems.push_back(std::move(columnRitem));
+
 	auto skyRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&skyRitem->World, XMMatrixScaling(5000.0f, 5000.0f, 5000.0f));
 	skyRitem->TexTransform = MathHelper::Identity4x4();
@@ -1251,6 +1325,13 @@ void PortfolioGameApp::BuildRenderItems()
 	mPlayer.BuildRenderItem(mMaterials, "playerMat0");
 	mPlayer.mUI.BuildRenderItem(mGeometries, mMaterials);
 
+	// Items with a LOD chain get their level picked every frame
+	mLodSelector.Clear();
+	for (auto& e : mAllRitems)
+	{
+		mLodSelector.AddRenderItem(e.get(), e->Bounds);
+	}
+
 }
 
 ///
@@ -126,4 +126,11 @@ private:
 	Textures mTexSkyCube;
 	Materials mMaterials;
 
+	// Levels of the cylinder mesh, finest first, and the selector picking them
+	std::vector<SubmeshLod> mCylinderLods;
+	LodSelector mLodSelector;
+
+	JobSystem mJobSystem;
+	AnimationStage mAnimationStage;
+
 };
\ No newline at end of file
@@ -96,6 +96,15 @@ XMMATRIX Camera::GetProj() const
 {
 	return XMLoadFloat4x4(&mProj);
 }
+void Camera::GetWorldFrustum(BoundingFrustum& outFrustum) const
+{
+	BoundingFrustum viewFrustum;
+	BoundingFrustum::CreateFromMatrix(viewFrustum, GetProj());
+
+	XMMATRIX view = GetView();
+	XMVECTOR determinant = XMMatrixDeterminant(view);
+	viewFrustum.Transform(outFrustum, XMMatrixInverse(&determinant, view));
+}
 
 void Camera::SetEyePosition(DirectX::XMVECTOR inEyePosition)
 {
@@ -0,0 +1,192 @@
+#include "AnimationStage.h"
+
+namespace
+{
+	// A 65 bone pose takes a few microseconds, smaller batches cost more in queueing
+	const UINT kInstancesPerJob = 4;
+
+	// Nearest first
+	const AnimationLodTier kLodTiers[] =
+	{
+		{ 0.0f, 1, 0, false },
+		{ 150.0f, 2, 1, false },
+		{ 300.0f, 4, 1, false },
+		{ 450.0f, 1, 0, true },
+	};
+}
+
+AnimationStage::AnimationStage()
+{
+}
+
+AnimationStage::~AnimationStage()
+{
+	StopPipeline();
+}
+
+void AnimationStage::Begin(const DirectX::BoundingFrustum* frustum)
+{
+	// Keeps the capacity, no allocation once the crowd size is reached
+	assert(!mIsInFlight);
+	mInstances.clear();
+
+	mHasFrustum = frustum != nullptr;
+	if (mHasFrustum)
+		mFrustum = *frustum;
+}
+
+void AnimationStage::Add(SkinnedModelInstance* instance, float distance, const DirectX::XMMATRIX* worlds, UINT worldCount)
+{
+	assert(!mIsInFlight);
+	const AnimationLodTier& tier = kLodTiers[SelectLodTier(distance)];
+	instance->SetLod(tier.UpdateInterval, tier.BoneLod, tier.UseBaked);
+
+	bool wasCulled = instance->IsCulled;
+	instance->UpdateVisibility(mHasFrustum ? &mFrustum : nullptr, worlds, worldCount);
+
+	// No pose is in flight, so the clips can be loaded; a culled pose needs none.
+	// A clip that could not be loaded holds the pose as culling does.
+	if (!instance->IsCulled && !instance->RequireClips())
+	{
+		instance->IsCulled = true;
+		instance->HasPose = false;
+		instance->FramesToUpdate = 0;
+	}
+
+	if (wasCulled && !instance->IsCulled)
+	{
+		// The pose at the clock kept while culled, the next evaluation comes a frame late
+		instance->UpdateSkinnedAnimation(0.0f);
+		PresentPose(*instance);
+	}
+
+	mInstances.push_back(instance);
+}
+
+void AnimationStage::Run(JobSystem& jobs, float dt)
+{
+	Evaluate(jobs, dt);
+	PresentPoses();
+}
+
+void AnimationStage::StartPipeline(JobSystem& jobs)
+{
+	if (IsPipelined())
+		return;
+
+	mPipelineJobs = &jobs;
+	mPipelineThread = std::thread(&AnimationStage::PipelineMain, this);
+}
+
+void AnimationStage::StopPipeline()
+{
+	if (!IsPipelined())
+		return;
+
+	Present();
+
+	mRequests.TryPush({ 0.0f, true });
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+	}
+	mWake.notify_one();
+
+	mPipelineThread.join();
+	mPipelineJobs = nullptr;
+}
+
+void AnimationStage::Submit(float dt)
+{
+	assert(IsPipelined());
+
+	Present();
+
+	mRequests.TryPush({ dt, false });
+	mIsInFlight = true;
+
+	// Taking the lock orders the push before the wait of the animation thread
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+	}
+	mWake.notify_one();
+}
+
+void AnimationStage::Present()
+{
+	if (!mIsInFlight)
+		return;
+
+	// The poses are usually done by now, recording the frame took longer
+	UINT64 frame;
+	while (!mResults.TryPop(frame))
+		std::this_thread::yield();
+
+	mIsInFlight = false;
+	PresentPoses();
+}
+
+void AnimationStage::Evaluate(JobSystem& jobs, float dt)
+{
+	jobs.ParallelFor((UINT)mInstances.size(), kInstancesPerJob, [this, dt](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; ++i)
+		{
+			mInstances[i]->UpdateSkinnedAnimation(dt);
+		}
+	});
+}
+
+void AnimationStage::PresentPoses()
+{
+	for (auto& e : mInstances)
+	{
+		// Nothing was evaluated, the last visible pose stays
+		if (!e->IsCulled)
+			PresentPose(*e);
+	}
+}
+
+void AnimationStage::PresentPose(SkinnedModelInstance& instance)
+{
+	instance.PresentedTransforms.resize(instance.FinalTransforms.size());
+	std::copy(instance.FinalTransforms.begin(), instance.FinalTransforms.end(), instance.PresentedTransforms.begin());
+	instance.PresentedBounds = instance.Bounds;
+}
+
+void AnimationStage::PipelineMain()
+{
+	UINT64 frame = 0;
+	FrameRequest request;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mWakeMutex);
+			mWake.wait(lock, [this, &request] { return mRequests.TryPop(request); });
+		}
+		if (request.Stop)
+			return;
+
+		Evaluate(*mPipelineJobs, request.DeltaTime);
+
+		// Cannot be full, the main thread waits for each frame before the next
+		mResults.TryPush(++frame);
+	}
+}
+
+UINT AnimationStage::GetLodTierCount()
+{
+	return _countof(kLodTiers);
+}
+
+const AnimationLodTier& AnimationStage::GetLodTier(UINT tier)
+{
+	return kLodTiers[tier];
+}
+
+UINT AnimationStage::SelectLodTier(float distance)
+{
+	UINT tier = 0;
+	while (tier + 1 < _countof(kLodTiers) && distance >= kLodTiers[tier + 1].MinDistance)
+		++tier;
+	return tier;
+}
@@ -0,0 +1,64 @@
+#include "AnimationStateMachine.h"
+
+AnimationStateMachine::AnimationStateMachine()
+{
+}
+
+AnimationStateMachine::~AnimationStateMachine()
+{
+}
+
+bool AnimationStateMachine::Compile(const SkinnedData& skinnedData, const std::vector<AnimationStateDesc>& states)
+{
+	mStateCount = (UINT)states.size();
+
+	mStateNames.resize(mStateCount);
+	mClips.resize(mStateCount);
+	mClipEndTimes.resize(mStateCount);
+	mGroups.resize(mStateCount);
+	mLoops.resize(mStateCount);
+
+	bool isComplete = true;
+	for (UINT i = 0; i < mStateCount; ++i)
+	{
+		mStateNames[i] = states[i].ClipName;
+		mClips[i] = skinnedData.GetClipHandle(states[i].ClipName);
+		mGroups[i] = states[i].Group;
+		mLoops[i] = states[i].Loop ? 1 : 0;
+
+		if (mClips[i] == kInvalidClip)
+		{
+			std::wstring text = L"Animation state without a clip : " +
+				std::wstring(states[i].ClipName.begin(), states[i].ClipName.end()) + L"\n";
+			::OutputDebugString(text.c_str());
+
+			mClipEndTimes[i] = 0.0f;
+			isComplete = false;
+			continue;
+		}
+		mClipEndTimes[i] = skinnedData.GetClipEndTime(mClips[i]);
+	}
+
+	mTransitions.resize(mStateCount * mStateCount);
+	for (UINT from = 0; from < mStateCount; ++from)
+	{
+		for (UINT to = 0; to < mStateCount; ++to)
+		{
+			Transition& transition = mTransitions[from * mStateCount + to];
+			transition.Allowed = !states[from].Final || from == to;
+			transition.Restart = transition.Allowed && states[from].Group != states[to].Group;
+		}
+	}
+
+	return isComplete;
+}
+
+int AnimationStateMachine::FindState(const std::string& clipName) const
+{
+	for (UINT i = 0; i < mStateCount; ++i)
+	{
+		if (mStateNames[i] == clipName)
+			return (int)i;
+	}
+	return -1;
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include "BakedAnimation.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Times measured per frame interval, the largest error is between two frames
+	const UINT kErrorSamplesPerFrame = 4;
+}
+
+BakedAnimation::BakedAnimation()
+{
+}
+
+BakedAnimation::~BakedAnimation()
+{
+}
+
+void BakedAnimation::Bake(const SkinnedData& skinnedData, ClipHandle clip, float frameRate)
+{
+	const AnimationClip& animation = skinnedData.GetAnimation(clip);
+	UINT boneCount = skinnedData.BoneCount();
+
+	BakedClip baked;
+	baked.StartTime = animation.GetClipStartTime();
+	baked.FrameRate = frameRate;
+	float duration = skinnedData.GetClipEndTime(clip) - baked.StartTime;
+	baked.FrameCount = (UINT)ceilf(duration * frameRate) + 1;
+	baked.Rows.resize(baked.FrameCount * boneCount * 3);
+	baked.Bounds.resize(baked.FrameCount);
+
+	// Frames in order, so the key cursors only move forward
+	std::vector<XMFLOAT4X4> finalTransforms(boneCount);
+	std::vector<UINT> keyCursors;
+	for (UINT f = 0; f < baked.FrameCount; ++f)
+	{
+		float t = baked.StartTime + (std::min)(f / frameRate, duration);
+		skinnedData.GetFinalTransforms(clip, t, finalTransforms, &keyCursors);
+		skinnedData.GetAnimatedBounds(finalTransforms, baked.Bounds[f]);
+
+		XMFLOAT4* rows = &baked.Rows[f * boneCount * 3];
+		for (UINT i = 0; i < boneCount; ++i)
+		{
+			rows[i * 3 + 0] = XMFLOAT4(finalTransforms[i].m[0]);
+			rows[i * 3 + 1] = XMFLOAT4(finalTransforms[i].m[1]);
+			rows[i * 3 + 2] = XMFLOAT4(finalTransforms[i].m[2]);
+		}
+	}
+
+	SetClip(clip, boneCount, std::move(baked));
+}
+
+void BakedAnimation::Bake(const SkinnedData& skinnedData, float frameRate)
+{
+	for (ClipHandle clip = 0; clip < (ClipHandle)skinnedData.GetClipCount(); ++clip)
+	{
+		Bake(skinnedData, clip, frameRate);
+	}
+}
+
+void BakedAnimation::SetClip(ClipHandle clip, UINT boneCount, BakedClip bakedClip)
+{
+	mBoneCount = boneCount;
+	if ((size_t)clip >= mClips.size())
+		mClips.resize(clip + 1);
+	mClips[clip] = std::move(bakedClip);
+}
+
+const BakedClip* BakedAnimation::GetClip(ClipHandle clip) const
+{
+	if (clip < 0 || (size_t)clip >= mClips.size() || mClips[clip].FrameCount == 0)
+		return nullptr;
+	return &mClips[clip];
+}
+
+bool BakedAnimation::GetFinalTransforms(ClipHandle clip, float timePos,
+	std::vector<XMFLOAT4X4>& outTransforms, BoundingBox& outBounds) const
+{
+	const BakedClip* baked = GetClip(clip);
+	if (baked == nullptr)
+		return false;
+
+	int frame = (int)((timePos - baked->StartTime) * baked->FrameRate + 0.5f);
+	frame = MathHelper::Clamp(frame, 0, (int)baked->FrameCount - 1);
+
+	const XMFLOAT4* rows = &baked->Rows[frame * mBoneCount * 3];
+	UINT boneCount = (std::min)(mBoneCount, (UINT)outTransforms.size());
+	for (UINT i = 0; i < boneCount; ++i)
+	{
+		XMMATRIX M(XMLoadFloat4(&rows[i * 3 + 0]), XMLoadFloat4(&rows[i * 3 + 1]), XMLoadFloat4(&rows[i * 3 + 2]), g_XMIdentityR3);
+		XMStoreFloat4x4(&outTransforms[i], M);
+	}
+	outBounds = baked->Bounds[frame];
+	return true;
+}
+
+size_t BakedAnimation::GetMemorySize(ClipHandle clip) const
+{
+	const BakedClip* baked = GetClip(clip);
+	if (baked == nullptr)
+		return 0;
+	return baked->Rows.size() * sizeof(XMFLOAT4) + baked->Bounds.size() * sizeof(BoundingBox);
+}
+
+float BakedAnimation::MeasureError(const SkinnedData& skinnedData, ClipHandle clip) const
+{
+	const BakedClip* baked = GetClip(clip);
+	if (baked == nullptr)
+		return 0.0f;
+
+	std::vector<XMFLOAT4X4> live(mBoneCount), lookedUp(mBoneCount);
+	std::vector<UINT> keyCursors;
+	BoundingBox bounds;
+	float endTime = skinnedData.GetClipEndTime(clip);
+	float error = 0.0f;
+	for (UINT s = 0; s < baked->FrameCount * kErrorSamplesPerFrame; ++s)
+	{
+		float t = (std::min)(baked->StartTime + s / (baked->FrameRate * kErrorSamplesPerFrame), endTime);
+		skinnedData.GetFinalTransforms(clip, t, live, &keyCursors);
+		GetFinalTransforms(clip, t, lookedUp, bounds);
+
+		for (UINT i = 0; i < mBoneCount; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				for (int k = 0; k < 4; ++k)
+				{
+					error = (std::max)(error, fabsf(live[i].m[j][k] - lookedUp[i].m[j][k]));
+				}
+			}
+		}
+	}
+	return error;
+}
@@ -16,7 +16,7 @@ void Character::BuildGeometry(
 	ID3D12GraphicsCommandList* cmdList,
 	const std::vector<CharacterVertex>& inVertices,
 	const std::vector<std::uint32_t>& inIndices,
-	const SkinnedData& inSkinInfo,
+	std::shared_ptr<const SkinnedData> inSkinInfo,
 	std::string geoName)
 {
 	if (inVertices.size() == 0)
@@ -49,8 +49,9 @@ void Character::BuildGeometry(
 	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	auto vSubmeshOffset = inSkinInfo.GetSubmeshOffset();
-	auto vBoneName = inSkinInfo.GetBoneName();
+	const auto& vSubmeshOffset = inSkinInfo->GetSubmeshOffset();
+	const auto& vBoneName = inSkinInfo->GetBoneName();
+	mSubmeshNames = vBoneName;
 
 	const int numOfSubmesh = 65;
 	UINT SubmeshOffsetIndex = 0;
@@ -65,7 +66,7 @@ void Character::BuildGeometry(
 
 			std::string SubmeshName = vBoneName[0] + std::to_string(i);
 			geo->DrawArgs[SubmeshName] = FbxSubmesh;
-			const_cast<SkinnedData&>(inSkinInfo).SetBoneName(SubmeshName);
+			mSubmeshNames.push_back(SubmeshName);
 			continue;
 		}
 
@@ -82,14 +83,9 @@ void Character::BuildGeometry(
 		SubmeshOffsetIndex += CurrSubmeshOffsetIndex;
 	}
 
+	// Same space as the animated bounds, after the palette scale
 	BoundingBox box;
-	BoundingBox::CreateFromPoints(
-		box,
-		inVertices.size(),
-		&inVertices[0].Pos,
-		sizeof(CharacterVertex));
-	box.Extents = { 3.0f, 1.0f, 3.0f };
-	box.Center.y = 3.0f;
+	inSkinInfo->GetBindPoseBounds(box);
 
 	mInitBoundsBox = box;
 
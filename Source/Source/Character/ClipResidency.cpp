@@ -0,0 +1,169 @@
+#include <chrono>
+#include "ClipResidency.h"
+#include "AnimationStage.h"
+
+namespace
+{
+	// The loader result, an empty clip when it failed
+	AnimationClip LoadClip(const ClipLoader& loader)
+	{
+		AnimationClip animation;
+		if (!loader(animation))
+			animation = AnimationClip();
+		return animation;
+	}
+}
+
+ClipResidency::ClipResidency(std::shared_ptr<SkinnedData> skinnedData, size_t budgetBytes)
+	: mSkinnedData(skinnedData),
+	mBudget(budgetBytes)
+{
+}
+
+ClipResidency::~ClipResidency()
+{
+}
+
+void ClipResidency::Register(ClipHandle clip, ClipLoader loader)
+{
+	if (clip == kInvalidClip || loader == nullptr)
+		return;
+	if ((size_t)clip >= mClips.size())
+		mClips.resize(clip + 1);
+
+	ClipSlot& slot = mClips[clip];
+	mResidentBytes -= slot.ResidentBytes;
+	slot.Loader = loader;
+	slot.LastUsed = 0;
+	slot.ResidentBytes = mSkinnedData->IsClipResident(clip) ? mSkinnedData->GetClipMemorySize(clip) : 0;
+	mResidentBytes += slot.ResidentBytes;
+}
+
+void ClipResidency::Update()
+{
+	assert(IsIdle());
+	for (ClipHandle clip = 0; clip < (ClipHandle)mClips.size(); ++clip)
+	{
+		ClipSlot& slot = mClips[clip];
+		if (slot.Pending.valid() && slot.Pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			Install(clip, slot.Pending.get());
+	}
+
+	++mFrame;
+	if (mBudget == 0)
+		return;
+
+	// The clips of the poses evaluated last frame stay, the budget is exceeded rather than thrashed.
+	// Of the clips left as long, the largest goes first.
+	while (mResidentBytes > mBudget)
+	{
+		ClipHandle victim = kInvalidClip;
+		for (ClipHandle clip = 0; clip < (ClipHandle)mClips.size(); ++clip)
+		{
+			const ClipSlot& slot = mClips[clip];
+			if (slot.ResidentBytes == 0 || slot.LastUsed + 1 >= mFrame)
+				continue;
+			const ClipSlot* oldest = victim != kInvalidClip ? &mClips[victim] : nullptr;
+			if (oldest == nullptr || slot.LastUsed < oldest->LastUsed ||
+				(slot.LastUsed == oldest->LastUsed && slot.ResidentBytes > oldest->ResidentBytes))
+				victim = clip;
+		}
+		if (victim == kInvalidClip)
+			break;
+		Evict(victim);
+	}
+}
+
+bool ClipResidency::Require(ClipHandle clip)
+{
+	assert(IsIdle());
+	if (!IsRegistered(clip))
+		return true;
+
+	ClipSlot& slot = mClips[clip];
+	slot.LastUsed = mFrame;
+	if (mSkinnedData->IsClipResident(clip))
+	{
+		++mHits;
+		return true;
+	}
+	++mMisses;
+
+	// A finished prefetch costs nothing, one still loading is waited for
+	auto start = std::chrono::high_resolution_clock::now();
+	bool isStalled = true;
+	AnimationClip animation;
+	if (slot.Pending.valid())
+	{
+		isStalled = slot.Pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+		animation = slot.Pending.get();
+	}
+	else
+	{
+		animation = LoadClip(slot.Loader);
+	}
+
+	if (isStalled)
+	{
+		auto end = std::chrono::high_resolution_clock::now();
+		++mStalls;
+		mStallTime += std::chrono::duration<double>(end - start).count();
+	}
+	return Install(clip, std::move(animation));
+}
+
+void ClipResidency::Prefetch(ClipHandle clip)
+{
+	if (!IsRegistered(clip) || mSkinnedData->IsClipResident(clip))
+		return;
+
+	ClipSlot& slot = mClips[clip];
+	if (slot.Pending.valid())
+		return;
+
+	ClipLoader loader = slot.Loader;
+	slot.Pending = std::async(std::launch::async, [loader]() { return LoadClip(loader); });
+}
+
+void ClipResidency::ResetCounters()
+{
+	mHits = 0;
+	mMisses = 0;
+	mStalls = 0;
+	mStallTime = 0.0;
+	mLoads = 0;
+	mEvictions = 0;
+}
+
+bool ClipResidency::IsRegistered(ClipHandle clip) const
+{
+	return clip != kInvalidClip && (size_t)clip < mClips.size() && mClips[clip].Loader != nullptr;
+}
+
+bool ClipResidency::IsIdle() const
+{
+	return mStage == nullptr || !mStage->IsInFlight();
+}
+
+bool ClipResidency::Install(ClipHandle clip, AnimationClip animation)
+{
+	if (animation.BoneAnimations.empty())
+		return false;
+
+	ClipSlot& slot = mClips[clip];
+	mSkinnedData->RestoreClip(clip, std::move(animation));
+	slot.LastUsed = mFrame;
+	slot.ResidentBytes = mSkinnedData->GetClipMemorySize(clip);
+	mResidentBytes += slot.ResidentBytes;
+	++mLoads;
+	return true;
+}
+
+void ClipResidency::Evict(ClipHandle clip)
+{
+	ClipSlot& slot = mClips[clip];
+	mSkinnedData->EvictClip(clip);
+	mResidentBytes -= slot.ResidentBytes;
+	slot.ResidentBytes = 0;
+	++mEvictions;
+}
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include "CpuSkinner.h"
+#include "FrameResource.h"
+#include "JobSystem.h"
+#include "TangentGenerator.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// The implicit fourth weight is 1 - x - y - z, anything below is rounding noise
+	const float kMinWeight = 1e-6f;
+
+	// Large enough to amortize the queueing, 16 batches cover the player mesh
+	const UINT kVerticesPerJob = 512;
+
+	XMVECTOR LoadRow(const XMFLOAT4X4& M, UINT row)
+	{
+		return XMLoadFloat4((const XMFLOAT4*)M.m[row]);
+	}
+
+	// The blended matrix of Influences bones, one position and normal transform per vertex
+	template <UINT Influences, typename Vertex>
+	void SkinVertices(const Vertex* vertices, UINT count, const XMFLOAT4X4* palette,
+		XMFLOAT3* outPositions, XMFLOAT3* outNormals)
+	{
+		for (UINT i = 0; i < count; ++i)
+		{
+			const Vertex& v = vertices[i];
+
+			const XMFLOAT4X4& M0 = palette[v.Bones[0]];
+			XMVECTOR w = XMVectorReplicate(v.Weights[0]);
+			XMVECTOR r0 = XMVectorMultiply(w, LoadRow(M0, 0));
+			XMVECTOR r1 = XMVectorMultiply(w, LoadRow(M0, 1));
+			XMVECTOR r2 = XMVectorMultiply(w, LoadRow(M0, 2));
+			XMVECTOR r3 = XMVectorMultiply(w, LoadRow(M0, 3));
+			for (UINT j = 1; j < Influences; ++j)
+			{
+				const XMFLOAT4X4& M = palette[v.Bones[j]];
+				w = XMVectorReplicate(v.Weights[j]);
+				r0 = XMVectorMultiplyAdd(w, LoadRow(M, 0), r0);
+				r1 = XMVectorMultiplyAdd(w, LoadRow(M, 1), r1);
+				r2 = XMVectorMultiplyAdd(w, LoadRow(M, 2), r2);
+				r3 = XMVectorMultiplyAdd(w, LoadRow(M, 3), r3);
+			}
+
+			XMVECTOR pos = XMLoadFloat3(&v.Pos);
+			XMVECTOR skinnedPos = XMVectorMultiplyAdd(XMVectorSplatX(pos), r0, r3);
+			skinnedPos = XMVectorMultiplyAdd(XMVectorSplatY(pos), r1, skinnedPos);
+			skinnedPos = XMVectorMultiplyAdd(XMVectorSplatZ(pos), r2, skinnedPos);
+
+			XMVECTOR normal = XMLoadFloat3(&v.Normal);
+			XMVECTOR skinnedNormal = XMVectorMultiply(XMVectorSplatX(normal), r0);
+			skinnedNormal = XMVectorMultiplyAdd(XMVectorSplatY(normal), r1, skinnedNormal);
+			skinnedNormal = XMVectorMultiplyAdd(XMVectorSplatZ(normal), r2, skinnedNormal);
+
+			XMStoreFloat3(&outPositions[v.Index], skinnedPos);
+			XMStoreFloat3(&outNormals[v.Index], XMVector3Normalize(skinnedNormal));
+		}
+	}
+}
+
+CpuSkinner::CpuSkinner()
+{
+	std::fill(std::begin(mGroupStart), std::end(mGroupStart), 0);
+}
+
+CpuSkinner::~CpuSkinner()
+{
+}
+
+void CpuSkinner::Set(const std::vector<CharacterVertex>& vertices)
+{
+	std::vector<SourceVertex> unsorted(vertices.size());
+	std::vector<UINT> influenceCounts(vertices.size());
+	for (UINT i = 0; i < (UINT)vertices.size(); ++i)
+	{
+		const CharacterVertex& v = vertices[i];
+		SourceVertex& e = unsorted[i];
+		e.Pos = v.Pos;
+		e.Index = i;
+
+		XMFLOAT4 tangent;
+		TangentGenerator::UnpackQTangent(v.QTangent, e.Normal, tangent);
+
+		float weights[4] = { v.BoneWeights.x, v.BoneWeights.y, v.BoneWeights.z, 0.0f };
+		weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+
+		UINT order[4] = { 0, 1, 2, 3 };
+		std::sort(std::begin(order), std::end(order), [&weights](UINT a, UINT b) { return weights[a] > weights[b]; });
+
+		// A vertex keeps its heaviest bone even when every weight is noise
+		UINT influences = 1;
+		while (influences < 4 && weights[order[influences]] > kMinWeight)
+			++influences;
+
+		for (UINT j = 0; j < 4; ++j)
+		{
+			e.Weights[j] = j < influences ? weights[order[j]] : 0.0f;
+			e.Bones[j] = j < influences ? v.BoneIndices[order[j]] : 0;
+		}
+		influenceCounts[i] = influences;
+	}
+
+	// Counting sort, the vertices of a group keep the mesh order
+	std::fill(std::begin(mGroupStart), std::end(mGroupStart), 0);
+	for (UINT influences : influenceCounts)
+	{
+		++mGroupStart[influences];
+	}
+	for (UINT n = 1; n <= 4; ++n)
+	{
+		mGroupStart[n] += mGroupStart[n - 1];
+	}
+
+	UINT cursor[4] = { mGroupStart[0], mGroupStart[1], mGroupStart[2], mGroupStart[3] };
+	mVertices.resize(vertices.size());
+	for (UINT i = 0; i < (UINT)vertices.size(); ++i)
+	{
+		mVertices[cursor[influenceCounts[i] - 1]++] = unsorted[i];
+	}
+}
+
+void CpuSkinner::Skin(
+	const std::vector<XMFLOAT4X4>& finalTransforms,
+	std::vector<XMFLOAT3>& outPositions,
+	std::vector<XMFLOAT3>& outNormals,
+	JobSystem* jobs)
+{
+	// The shader reads the uploaded palette transposed
+	mPalette.resize(finalTransforms.size());
+	for (size_t i = 0; i < finalTransforms.size(); ++i)
+	{
+		XMStoreFloat4x4(&mPalette[i], XMMatrixTranspose(XMLoadFloat4x4(&finalTransforms[i])));
+	}
+
+	outPositions.resize(mVertices.size());
+	outNormals.resize(mVertices.size());
+	XMFLOAT3* positions = outPositions.data();
+	XMFLOAT3* normals = outNormals.data();
+
+	if (jobs == nullptr)
+	{
+		SkinRange(0, (UINT)mVertices.size(), positions, normals);
+		return;
+	}
+
+	jobs->ParallelFor((UINT)mVertices.size(), kVerticesPerJob, [this, positions, normals](UINT begin, UINT end)
+	{
+		SkinRange(begin, end, positions, normals);
+	});
+}
+
+void CpuSkinner::SkinRange(UINT begin, UINT end, XMFLOAT3* outPositions, XMFLOAT3* outNormals) const
+{
+	// A batch may span the end of one group and the start of the next
+	for (UINT n = 1; n <= 4; ++n)
+	{
+		UINT first = (std::max)(begin, mGroupStart[n - 1]);
+		UINT last = (std::min)(end, mGroupStart[n]);
+		if (first >= last)
+			continue;
+
+		const SourceVertex* vertices = &mVertices[first];
+		switch (n)
+		{
+		case 1: SkinVertices<1>(vertices, last - first, mPalette.data(), outPositions, outNormals); break;
+		case 2: SkinVertices<2>(vertices, last - first, mPalette.data(), outPositions, outNormals); break;
+		case 3: SkinVertices<3>(vertices, last - first, mPalette.data(), outPositions, outNormals); break;
+		case 4: SkinVertices<4>(vertices, last - first, mPalette.data(), outPositions, outNormals); break;
+		}
+	}
+}
@@ -0,0 +1,223 @@
+#include "LayeredPose.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Layers that do not loop blend in and out over this time
+	const float kLayerFadeTime = 0.2f;
+
+	void ToParentSpace(const BoneTransform& bone, const BoneTransform& parent, BoneTransform& out)
+	{
+		XMVECTOR parentQ = XMLoadFloat4(&parent.RotationQuat);
+		XMVECTOR parentS = XMLoadFloat3(&parent.Scale);
+		XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&bone.Translation), XMLoadFloat3(&parent.Translation));
+
+		XMStoreFloat3(&out.Translation, XMVectorDivide(XMVector3InverseRotate(offset, parentQ), parentS));
+		XMStoreFloat3(&out.Scale, XMVectorDivide(XMLoadFloat3(&bone.Scale), parentS));
+		XMStoreFloat4(&out.RotationQuat, XMQuaternionMultiply(XMLoadFloat4(&bone.RotationQuat), XMQuaternionConjugate(parentQ)));
+	}
+
+	void ToModelSpace(const BoneTransform& bone, const BoneTransform& parent, BoneTransform& out)
+	{
+		XMVECTOR parentQ = XMLoadFloat4(&parent.RotationQuat);
+		XMVECTOR parentS = XMLoadFloat3(&parent.Scale);
+		XMVECTOR offset = XMVector3Rotate(XMVectorMultiply(XMLoadFloat3(&bone.Translation), parentS), parentQ);
+
+		XMStoreFloat3(&out.Translation, XMVectorAdd(offset, XMLoadFloat3(&parent.Translation)));
+		XMStoreFloat3(&out.Scale, XMVectorMultiply(XMLoadFloat3(&bone.Scale), parentS));
+		XMStoreFloat4(&out.RotationQuat, XMQuaternionMultiply(XMLoadFloat4(&bone.RotationQuat), parentQ));
+	}
+
+	void Blend(const BoneTransform& a, const BoneTransform& b, float weight, BoneTransform& out)
+	{
+		XMStoreFloat3(&out.Translation, XMVectorLerp(XMLoadFloat3(&a.Translation), XMLoadFloat3(&b.Translation), weight));
+		XMStoreFloat3(&out.Scale, XMVectorLerp(XMLoadFloat3(&a.Scale), XMLoadFloat3(&b.Scale), weight));
+		XMStoreFloat4(&out.RotationQuat, XMQuaternionSlerp(XMLoadFloat4(&a.RotationQuat), XMLoadFloat4(&b.RotationQuat), weight));
+	}
+
+	float GetBlendWeight(const AnimationLayer& layer, const SkinnedData& skinnedData)
+	{
+		if (layer.Clip == kInvalidClip || layer.Mask == nullptr)
+			return 0.0f;
+		if (layer.Loop)
+			return layer.Weight;
+
+		float fadeIn = layer.TimePos / kLayerFadeTime;
+		float fadeOut = (skinnedData.GetClipEndTime(layer.Clip) - layer.TimePos) / kLayerFadeTime;
+		return layer.Weight * MathHelper::Clamp((std::min)(fadeIn, fadeOut), 0.0f, 1.0f);
+	}
+}
+
+LayeredPose::LayeredPose()
+{
+}
+
+LayeredPose::~LayeredPose()
+{
+}
+
+void LayeredPose::Initialize(UINT boneCount, UINT layerCount)
+{
+	mLayers.resize(layerCount);
+	for (auto& e : mLayers)
+	{
+		e.KeyCursors.assign(boneCount, 0);
+	}
+
+	mPose.resize(boneCount);
+	mLayerPose.resize(boneCount);
+	mLocalPose.resize(boneCount);
+	mFrozenPose.resize(boneCount);
+
+	// A crossfade blends every bone, bones in increasing order have their parents first
+	auto wholeBody = std::make_shared<BoneMask>();
+	for (UINT i = 0; i < boneCount; ++i)
+	{
+		wholeBody->Bones.push_back(i);
+	}
+	wholeBody->SampledBones = wholeBody->Bones;
+	wholeBody->GroupMask.assign((boneCount + 3) / 4, 1);
+
+	mCrossfade = AnimationLayer();
+	mCrossfade.Mask = wholeBody;
+	mCrossfade.KeyCursors.assign(boneCount, 0);
+	mCrossfadeDuration = 0.0f;
+	mCrossfadeElapsed = 0.0f;
+	mIsCrossfadeFrozen = false;
+}
+
+bool LayeredPose::IsActive() const
+{
+	if (IsCrossfading())
+		return true;
+
+	for (auto& e : mLayers)
+	{
+		if (e.Weight > 0.0f && e.Clip != kInvalidClip && e.Mask != nullptr)
+			return true;
+	}
+	return false;
+}
+
+void LayeredPose::Update(const SkinnedData& skinnedData, float dt)
+{
+	if (IsCrossfading())
+	{
+		mCrossfadeElapsed += dt;
+		mCrossfade.Weight = 1.0f - mCrossfadeElapsed / mCrossfadeDuration;
+
+		// The clip left behind keeps playing, or holds its last key
+		float endTime = skinnedData.GetClipEndTime(mCrossfade.Clip);
+		mCrossfade.TimePos += dt;
+		if (mCrossfade.TimePos > endTime)
+			mCrossfade.TimePos = mCrossfade.Loop ? 0.0f : endTime;
+	}
+
+	for (auto& e : mLayers)
+	{
+		if (e.Weight <= 0.0f || e.Clip == kInvalidClip)
+			continue;
+
+		e.TimePos += dt;
+
+		float endTime = skinnedData.GetClipEndTime(e.Clip);
+		if (e.TimePos > endTime)
+		{
+			if (e.Loop)
+				e.TimePos = 0.0f;
+			else
+				e.Weight = 0.0f;
+		}
+	}
+}
+
+void LayeredPose::StartCrossfade(ClipHandle fromClip, float fromTime, bool loop, float duration)
+{
+	// Without buffers or time there is nothing to blend
+	if (mPose.empty() || fromClip == kInvalidClip || duration <= 0.0f)
+		return;
+
+	// An interrupted crossfade fades out from the blended pose it reached
+	mIsCrossfadeFrozen = IsCrossfading();
+	if (mIsCrossfadeFrozen)
+		std::copy(mPose.begin(), mPose.end(), mFrozenPose.begin());
+
+	mCrossfade.Clip = fromClip;
+	mCrossfade.TimePos = fromTime;
+	mCrossfade.Loop = loop;
+	mCrossfade.Weight = 1.0f;
+	std::fill(mCrossfade.KeyCursors.begin(), mCrossfade.KeyCursors.end(), 0);
+
+	mCrossfadeDuration = duration;
+	mCrossfadeElapsed = 0.0f;
+}
+
+void LayeredPose::Evaluate(const SkinnedData& skinnedData, ClipHandle baseClip, float baseTime,
+	std::vector<UINT>* baseKeyCursors, std::vector<XMFLOAT4X4>& finalTransforms)
+{
+	skinnedData.GetModelPose(baseClip, baseTime, mPose, baseKeyCursors);
+
+	// The clip left behind fades out under the layers
+	if (IsCrossfading())
+	{
+		const BoneMask& wholeBody = *mCrossfade.Mask;
+		if (mIsCrossfadeFrozen)
+		{
+			ApplyLayer(skinnedData, mFrozenPose, wholeBody, mCrossfade.Weight);
+		}
+		else
+		{
+			skinnedData.GetModelPose(mCrossfade.Clip, mCrossfade.TimePos, mLayerPose, &mCrossfade.KeyCursors, &wholeBody);
+			ApplyLayer(skinnedData, mLayerPose, wholeBody, mCrossfade.Weight);
+		}
+	}
+
+	for (auto& layer : mLayers)
+	{
+		float weight = GetBlendWeight(layer, skinnedData);
+		if (weight <= 0.0f)
+			continue;
+
+		skinnedData.GetModelPose(layer.Clip, layer.TimePos, mLayerPose, &layer.KeyCursors, layer.Mask.get());
+		ApplyLayer(skinnedData, mLayerPose, *layer.Mask, weight);
+	}
+
+	skinnedData.GetFinalTransforms(mPose, finalTransforms);
+}
+
+void LayeredPose::ApplyLayer(const SkinnedData& skinnedData, const std::vector<BoneTransform>& layerPose,
+	const BoneMask& mask, float weight)
+{
+	const auto& hierarchy = skinnedData.GetBoneHierarchy();
+
+	// The pose below, taken before its parents move
+	if (weight < 1.0f)
+	{
+		for (UINT i : mask.Bones)
+		{
+			int parent = hierarchy[i];
+			if (parent < 0)
+				mLocalPose[i] = mPose[i];
+			else
+				ToParentSpace(mPose[i], mPose[parent], mLocalPose[i]);
+		}
+	}
+
+	// Parents first, so every bone is composed onto its final parent
+	for (UINT i : mask.Bones)
+	{
+		int parent = hierarchy[i];
+
+		BoneTransform local = layerPose[i];
+		if (parent >= 0)
+			ToParentSpace(layerPose[i], layerPose[parent], local);
+		if (weight < 1.0f)
+			Blend(mLocalPose[i], local, weight, local);
+
+		if (parent < 0)
+			mPose[i] = local;
+		else
+			ToModelSpace(local, mPose[parent], mPose[i]);
+	}
+}
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include "MorphBlender.h"
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	// Weights this small do not move a vertex visibly
+	const float kMinWeight = 1e-4f;
+
+	float MaxComponent(const std::vector<XMFLOAT3>& deltas)
+	{
+		XMVECTOR maxDelta = XMVectorZero();
+		for (auto& e : deltas)
+		{
+			maxDelta = XMVectorMax(maxDelta, XMVectorAbs(XMLoadFloat3(&e)));
+		}
+		return (std::max)(XMVectorGetX(maxDelta), (std::max)(XMVectorGetY(maxDelta), XMVectorGetZ(maxDelta)));
+	}
+}
+
+MorphBlender::MorphBlender()
+{
+}
+
+MorphBlender::~MorphBlender()
+{
+}
+
+void MorphBlender::Set(const std::vector<MorphTarget>& targets)
+{
+	mTargets = targets;
+
+	mTouched.clear();
+	for (auto& target : mTargets)
+	{
+		mTouched.insert(mTouched.end(), target.Indices.begin(), target.Indices.end());
+	}
+	std::sort(mTouched.begin(), mTouched.end());
+	mTouched.erase(std::unique(mTouched.begin(), mTouched.end()), mTouched.end());
+}
+
+UINT MorphBlender::Apply(
+	const float* weights,
+	const std::vector<XMFLOAT3>& basePositions,
+	const std::vector<XMFLOAT3>& baseNormals,
+	std::vector<XMFLOAT3>& outPositions,
+	std::vector<XMFLOAT3>& outNormals) const
+{
+	for (auto i : mTouched)
+	{
+		outPositions[i] = basePositions[i];
+		outNormals[i] = baseNormals[i];
+	}
+
+	UINT applied = 0;
+	for (size_t t = 0; t < mTargets.size(); ++t)
+	{
+		if (fabsf(weights[t]) < kMinWeight)
+			continue;
+
+		const MorphTarget& target = mTargets[t];
+		const uint32_t* indices = target.Indices.data();
+		const XMSHORTN4* positionDeltas = target.PositionDeltas.data();
+		const XMBYTEN4* normalDeltas = target.NormalDeltas.data();
+		const size_t count = target.Indices.size();
+
+		// Dequantization folded into the weight
+		XMVECTOR positionWeight = XMVectorReplicate(weights[t] * target.PositionScale);
+		XMVECTOR normalWeight = XMVectorReplicate(weights[t] * target.NormalScale);
+
+		for (size_t k = 0; k < count; ++k)
+		{
+			XMFLOAT3& position = outPositions[indices[k]];
+			XMFLOAT3& normal = outNormals[indices[k]];
+
+			XMVECTOR p = XMVectorMultiplyAdd(XMLoadShortN4(&positionDeltas[k]), positionWeight, XMLoadFloat3(&position));
+			XMVECTOR n = XMVectorMultiplyAdd(XMLoadByteN4(&normalDeltas[k]), normalWeight, XMLoadFloat3(&normal));
+
+			XMStoreFloat3(&position, p);
+			XMStoreFloat3(&normal, n);
+		}
+		applied += (UINT)count;
+	}
+
+	for (auto i : mTouched)
+	{
+		XMStoreFloat3(&outNormals[i], XMVector3Normalize(XMLoadFloat3(&outNormals[i])));
+	}
+
+	return applied;
+}
+
+MorphTarget MorphBlender::BuildTarget(
+	const std::string& name,
+	const std::vector<uint32_t>& indices,
+	const std::vector<XMFLOAT3>& positionDeltas,
+	const std::vector<XMFLOAT3>& normalDeltas)
+{
+	MorphTarget target;
+	target.Name = name;
+
+	// Sorted indices keep the scattered writes moving forward through memory
+	std::vector<size_t> order(indices.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&indices](size_t a, size_t b) { return indices[a] < indices[b]; });
+
+	target.PositionScale = MaxComponent(positionDeltas);
+	target.NormalScale = MaxComponent(normalDeltas);
+
+	XMVECTOR positionScale = XMVectorReplicate(target.PositionScale > 0.0f ? 1.0f / target.PositionScale : 0.0f);
+	XMVECTOR normalScale = XMVectorReplicate(target.NormalScale > 0.0f ? 1.0f / target.NormalScale : 0.0f);
+
+	target.Indices.reserve(indices.size());
+	target.PositionDeltas.resize(indices.size());
+	target.NormalDeltas.resize(indices.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		size_t source = order[i];
+		target.Indices.push_back(indices[source]);
+		XMStoreShortN4(&target.PositionDeltas[i], XMVectorMultiply(XMLoadFloat3(&positionDeltas[source]), positionScale));
+		XMStoreByteN4(&target.NormalDeltas[i], XMVectorMultiply(XMLoadFloat3(&normalDeltas[source]), normalScale));
+	}
+
+	return target;
+}
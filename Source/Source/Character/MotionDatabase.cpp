@@ -0,0 +1,304 @@
+#include "MotionDatabase.h"
+
+using namespace DirectX;
+
+namespace
+{
+	const float kTrajectoryTimes[kTrajectoryPointCount] = { 1.0f / 3.0f, 2.0f / 3.0f, 1.0f };
+	// Never nearer than a frame, squared over every feature it stays finite
+	const float kPaddingFeature = 1.0e15f;
+
+	// The features of a group share one scale and the weight trades the groups off.
+	// The trajectory weighs the most, below that a walk wins a stop on its hip velocity.
+	struct FeatureGroup
+	{
+		UINT First;
+		UINT Count;
+		float Weight;
+	};
+	const FeatureGroup kFeatureGroups[] =
+	{
+		{ offsetof(MotionFeatures, LeftFoot) / sizeof(float), 6, 1.0f },
+		{ offsetof(MotionFeatures, HipVelocity) / sizeof(float), 3, 1.0f },
+		{ offsetof(MotionFeatures, Trajectory) / sizeof(float), 2 * kTrajectoryPointCount, 3.0f },
+	};
+
+	static_assert(sizeof(MotionFeatures) == MotionDatabase::kFeatureCount * sizeof(float),
+		"MotionFeatures is read as an array of floats");
+
+	// "Mutant:LeftFoot" and "LeftFoot" are the same bone
+	int FindBone(const std::vector<std::string>& boneNames, const std::string& name)
+	{
+		for (UINT i = 0; i < boneNames.size(); ++i)
+		{
+			size_t colon = boneNames[i].rfind(':');
+			size_t first = colon == std::string::npos ? 0 : colon + 1;
+			if (boneNames[i].compare(first, std::string::npos, name) == 0)
+				return (int)i;
+		}
+		return -1;
+	}
+
+	XMVECTOR GetJoint(const std::vector<BoneTransform>& modelPose, int bone)
+	{
+		return XMVectorScale(XMLoadFloat3(&modelPose[bone].Translation), kModelScale);
+	}
+}
+
+MotionDatabase::MotionDatabase()
+{
+}
+
+MotionDatabase::~MotionDatabase()
+{
+}
+
+bool MotionDatabase::Build(const SkinnedData& skinnedData, const AnimationStateMachine& stateMachine,
+	const std::vector<int>& states, float sampleRate)
+{
+	const auto& boneNames = skinnedData.GetBoneName();
+	int hips = FindBone(boneNames, "Hips");
+	int leftFoot = FindBone(boneNames, "LeftFoot");
+	int rightFoot = FindBone(boneNames, "RightFoot");
+	if (hips < 0 || leftFoot < 0 || rightFoot < 0)
+		return false;
+
+	UINT stateCount = stateMachine.GetStateCount();
+	mFrames.clear();
+	mFrameFeatures.clear();
+	mStateFirstFrames.assign(stateCount, 0);
+	mStateFrameCounts.assign(stateCount, 0);
+	mStateFrameTimes.assign(stateCount, 0.0f);
+	mStateLoops.assign(stateCount, false);
+	mGroundVelocities.assign(stateCount, XMFLOAT2(0.0f, 0.0f));
+
+	std::vector<BoneTransform> modelPose(skinnedData.BoneCount());
+	std::vector<UINT> keyCursors;
+	std::vector<XMFLOAT3> hipJoints, leftJoints, rightJoints;
+	std::vector<XMFLOAT2> groundVelocities;
+	for (int state : states)
+	{
+		ClipHandle clip = stateMachine.GetClip(state);
+		if (clip == kInvalidClip)
+			return false;
+
+		// A looping clip ends where it starts, so its last sample is the first one
+		float duration = stateMachine.GetClipEndTime(state);
+		bool isLooping = stateMachine.IsLooping(state);
+		UINT intervalCount = (std::max)(1u, (UINT)(duration * sampleRate + 0.5f));
+		UINT frameCount = isLooping ? intervalCount : intervalCount + 1;
+		float frameTime = duration / intervalCount;
+
+		hipJoints.resize(frameCount);
+		leftJoints.resize(frameCount);
+		rightJoints.resize(frameCount);
+		keyCursors.clear();
+		for (UINT i = 0; i < frameCount; ++i)
+		{
+			skinnedData.GetModelPose(clip, i * frameTime, modelPose, &keyCursors);
+			XMStoreFloat3(&hipJoints[i], GetJoint(modelPose, hips));
+			XMStoreFloat3(&leftJoints[i], GetJoint(modelPose, leftFoot));
+			XMStoreFloat3(&rightJoints[i], GetJoint(modelPose, rightFoot));
+		}
+
+		// Central differences, wrapped around a looping clip
+		auto getSample = [&](int i)
+		{
+			if (isLooping)
+				return (UINT)((i + (int)frameCount) % (int)frameCount);
+			return (UINT)(std::min)((std::max)(i, 0), (int)frameCount - 1);
+		};
+		auto getVelocity = [&](const std::vector<XMFLOAT3>& joints, UINT i)
+		{
+			UINT prev = getSample((int)i - 1);
+			UINT next = getSample((int)i + 1);
+			float span = (isLooping ? 2.0f : (float)(next - prev)) * frameTime;
+			return XMVectorScale(XMVectorSubtract(XMLoadFloat3(&joints[next]), XMLoadFloat3(&joints[prev])), 1.0f / span);
+		};
+
+		// Played in place, the foot on the ground slides back at the speed the character would go
+		groundVelocities.resize(frameCount);
+		XMVECTOR meanVelocity = XMVectorZero();
+		for (UINT i = 0; i < frameCount; ++i)
+		{
+			bool isLeftPlanted = leftJoints[i].y < rightJoints[i].y;
+			XMVECTOR footVelocity = getVelocity(isLeftPlanted ? leftJoints : rightJoints, i);
+			groundVelocities[i] = XMFLOAT2(-XMVectorGetX(footVelocity), -XMVectorGetZ(footVelocity));
+			meanVelocity = XMVectorAdd(meanVelocity, XMLoadFloat2(&groundVelocities[i]));
+		}
+		XMStoreFloat2(&mGroundVelocities[state], XMVectorScale(meanVelocity, 1.0f / frameCount));
+
+		mStateFirstFrames[state] = (UINT)mFrames.size();
+		mStateFrameCounts[state] = frameCount;
+		mStateFrameTimes[state] = frameTime;
+		mStateLoops[state] = isLooping;
+		for (UINT i = 0; i < frameCount; ++i)
+		{
+			MotionFeatures features;
+			XMVECTOR ground = XMVectorSet(hipJoints[i].x, 0.0f, hipJoints[i].z, 0.0f);
+			XMStoreFloat3(&features.LeftFoot, XMVectorSubtract(XMLoadFloat3(&leftJoints[i]), ground));
+			XMStoreFloat3(&features.RightFoot, XMVectorSubtract(XMLoadFloat3(&rightJoints[i]), ground));
+
+			const XMFLOAT2& groundVelocity = groundVelocities[i];
+			XMVECTOR hipVelocity = XMVectorAdd(getVelocity(hipJoints, i), XMVectorSet(groundVelocity.x, 0.0f, groundVelocity.y, 0.0f));
+			XMStoreFloat3(&features.HipVelocity, hipVelocity);
+
+			// The ground velocities of the frames ahead summed over each horizon
+			XMVECTOR position = XMVectorZero();
+			UINT step = 0;
+			for (UINT j = 0; j < kTrajectoryPointCount; ++j)
+			{
+				UINT stepCount = (UINT)(kTrajectoryTimes[j] / frameTime + 0.5f);
+				for (; step < stepCount; ++step)
+				{
+					XMVECTOR velocity = XMLoadFloat2(&groundVelocities[getSample((int)(i + step))]);
+					position = XMVectorMultiplyAdd(velocity, XMVectorReplicate(frameTime), position);
+				}
+				XMStoreFloat2(&features.Trajectory[j], position);
+			}
+
+			mFrames.push_back({ state, i * frameTime });
+			mFrameFeatures.push_back(features);
+		}
+	}
+
+	BuildSearchBlocks();
+	return true;
+}
+
+void MotionDatabase::BuildSearchBlocks()
+{
+	UINT frameCount = (UINT)mFrameFeatures.size();
+	for (UINT f = 0; f < kFeatureCount; ++f)
+	{
+		float sum = 0.0f;
+		for (const auto& features : mFrameFeatures)
+			sum += reinterpret_cast<const float*>(&features)[f];
+		mMeans[f] = frameCount > 0 ? sum / frameCount : 0.0f;
+	}
+
+	// Mean variance of the features of the group, so a group of small values is not drowned
+	for (const auto& group : kFeatureGroups)
+	{
+		float variance = 0.0f;
+		for (const auto& features : mFrameFeatures)
+		{
+			for (UINT f = group.First; f < group.First + group.Count; ++f)
+			{
+				float d = reinterpret_cast<const float*>(&features)[f] - mMeans[f];
+				variance += d * d;
+			}
+		}
+		float deviation = frameCount > 0 ? sqrtf(variance / (frameCount * group.Count)) : 0.0f;
+		float scale = deviation > 1.0e-6f ? group.Weight / deviation : group.Weight;
+		for (UINT f = group.First; f < group.First + group.Count; ++f)
+			mScales[f] = scale;
+	}
+
+	UINT blockCount = (frameCount + 3) / 4;
+	mBlocks.assign(blockCount * kFeatureCount, XMFLOAT4(kPaddingFeature, kPaddingFeature, kPaddingFeature, kPaddingFeature));
+	float normalized[kFeatureCount];
+	for (UINT i = 0; i < frameCount; ++i)
+	{
+		Normalize(mFrameFeatures[i], normalized);
+		XMFLOAT4* block = &mBlocks[(i / 4) * kFeatureCount];
+		for (UINT f = 0; f < kFeatureCount; ++f)
+			(&block[f].x)[i % 4] = normalized[f];
+	}
+}
+
+UINT MotionDatabase::FindFrame(int state, float timePos) const
+{
+	if (state < 0 || state >= (int)mStateFrameCounts.size() || mStateFrameCounts[state] == 0)
+		return kInvalidMotionFrame;
+
+	UINT frameCount = mStateFrameCounts[state];
+	UINT frame = (UINT)((std::max)(timePos, 0.0f) / mStateFrameTimes[state] + 0.5f);
+	if (frame >= frameCount)
+		frame = mStateLoops[state] ? frame % frameCount : frameCount - 1;
+	return mStateFirstFrames[state] + frame;
+}
+
+XMFLOAT2 MotionDatabase::GetGroundVelocity(int state) const
+{
+	if (state < 0 || state >= (int)mGroundVelocities.size())
+		return XMFLOAT2(0.0f, 0.0f);
+	return mGroundVelocities[state];
+}
+
+void MotionDatabase::SetTrajectory(const XMFLOAT2& velocity, MotionFeatures& features)
+{
+	for (UINT j = 0; j < kTrajectoryPointCount; ++j)
+		features.Trajectory[j] = XMFLOAT2(velocity.x * kTrajectoryTimes[j], velocity.y * kTrajectoryTimes[j]);
+}
+
+void MotionDatabase::Normalize(const MotionFeatures& features, float* outFeatures) const
+{
+	const float* values = reinterpret_cast<const float*>(&features);
+	for (UINT f = 0; f < kFeatureCount; ++f)
+		outFeatures[f] = (values[f] - mMeans[f]) * mScales[f];
+}
+
+UINT MotionDatabase::Search(const MotionFeatures& query, float* outCost) const
+{
+	if (mFrames.empty())
+		return kInvalidMotionFrame;
+
+	float normalized[kFeatureCount];
+	Normalize(query, normalized);
+	XMVECTOR queryFeatures[kFeatureCount];
+	for (UINT f = 0; f < kFeatureCount; ++f)
+		queryFeatures[f] = XMVectorReplicate(normalized[f]);
+
+	// Best cost and frame of each lane, the frames are exact as floats
+	XMVECTOR bestCosts = XMVectorReplicate(FLT_MAX);
+	XMVECTOR bestFrames = XMVectorZero();
+	XMVECTOR frames = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	const XMVECTOR four = XMVectorReplicate(4.0f);
+	for (size_t b = 0; b < mBlocks.size(); b += kFeatureCount)
+	{
+		const XMFLOAT4* block = &mBlocks[b];
+		XMVECTOR cost = XMVectorZero();
+		for (UINT f = 0; f < kFeatureCount; ++f)
+		{
+			XMVECTOR d = XMVectorSubtract(XMLoadFloat4(&block[f]), queryFeatures[f]);
+			cost = XMVectorMultiplyAdd(d, d, cost);
+		}
+
+		XMVECTOR isBetter = XMVectorLess(cost, bestCosts);
+		bestCosts = XMVectorSelect(bestCosts, cost, isBetter);
+		bestFrames = XMVectorSelect(bestFrames, frames, isBetter);
+		frames = XMVectorAdd(frames, four);
+	}
+
+	// The cheapest lane, the first frame among equal costs
+	XMFLOAT4 costs, laneFrames;
+	XMStoreFloat4(&costs, bestCosts);
+	XMStoreFloat4(&laneFrames, bestFrames);
+	UINT best = kInvalidMotionFrame;
+	float bestCost = FLT_MAX;
+	for (UINT lane = 0; lane < 4; ++lane)
+	{
+		float cost = (&costs.x)[lane];
+		UINT frame = (UINT)(&laneFrames.x)[lane];
+		if (cost < bestCost || (cost == bestCost && frame < best))
+		{
+			bestCost = cost;
+			best = frame;
+		}
+	}
+
+	if (outCost != nullptr)
+		*outCost = bestCost;
+	return best;
+}
+
+size_t MotionDatabase::GetMemorySize() const
+{
+	return mFrames.capacity() * sizeof(MotionFrame) +
+		mFrameFeatures.capacity() * sizeof(MotionFeatures) +
+		mBlocks.capacity() * sizeof(XMFLOAT4) +
+		(mStateFirstFrames.capacity() + mStateFrameCounts.capacity()) * sizeof(UINT) +
+		mStateFrameTimes.capacity() * sizeof(float) +
+		mGroundVelocities.capacity() * sizeof(XMFLOAT2);
+}
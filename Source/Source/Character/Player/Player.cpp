@@ -1,8 +1,42 @@
 #include "GameTimer.h"
 #include "Player.h"
+#include "AnimationStage.h"
+#include "MotionDatabase.h"
 
 using namespace DirectX;
 
+namespace
+{
+	// Indexed by ePlayerClip
+	const AnimationStateDesc kPlayerStates[] =
+	{
+		{ "Idle", eClipList::Idle, true, false },
+		{ "playerWalking", eClipList::Walking, true, false },
+		{ "run", eClipList::Walking, true, false },
+		{ "WalkingBackward", eClipList::Walking, true, false },
+		{ "Kick", eClipList::Kick, false, false },
+		{ "Kick2", eClipList::Idle, false, false },
+		{ "FlyingKick", eClipList::FlyingKick, false, false },
+		{ "Hook", eClipList::Idle, false, false },
+		{ "HitReaction", eClipList::Idle, false, false },
+		{ "Death", eClipList::Idle, false, true },
+	};
+
+	// Attacks on the move play over this bone and its descendants
+	const std::string kUpperBodyBone = "Spine";
+	const UINT kUpperBodyLayer = 0;
+
+	// Time a clip change blends over
+	const float kCrossfadeDuration = 0.2f;
+
+	// The states RequestLocomotion picks from, and how often it searches while the gait holds
+	const int kLocomotionStates[] =
+	{
+		(int)ePlayerClip::Idle, (int)ePlayerClip::Walking, (int)ePlayerClip::Run, (int)ePlayerClip::WalkingBackward
+	};
+	const float kMotionSearchInterval = 0.1f;
+}
+
 Player::Player()
 	: Character(),
 	mPlayerInfo(),
@@ -38,31 +72,42 @@ void Player::Damage(int damage, XMVECTOR Position, XMVECTOR Look)
 	if (MathHelper::getDistance(mP, P) > 15.0f)
 		return;
 
-	if (mPlayerInfo.mHealth >= 0)
-	{
-		mSkinnedModelInst->TimePos = 0.0f;
-	}
-	else
-	{
+	if (mPlayerInfo.mHealth < 0)
 		return;
-	}
 
-	SetClipName("HitReaction");
+	// The clip left is faded out from where it stands
+	SetClip(ePlayerClip::HitReaction);
+	SetClipTime(0.0f);
 	mPlayerInfo.mHealth -= damage;
 
+	// The next hit may be the last, the death clip is loaded before it lands
+	if (mClipResidency != nullptr && mPlayerInfo.mHealth <= damage)
+		mClipResidency->Prefetch(mSkinnedModelInst->StateMachine->GetClip((int)ePlayerClip::Death));
+
 	mUI.SetDamageScale(static_cast<float>(mPlayerInfo.mHealth) / static_cast<float>(mFullHealth));
 }
 
-void Player::Attack(Character * inMonster, std::string clipName)
+void Player::Attack(Character * inMonster, ePlayerClip clip)
 {
-	SetClipName(clipName);
-	SetClipTime(0.0f);
+	// A hook thrown while walking leaves the legs to the walk
+	if (clip == ePlayerClip::Hook && GetCurrentClip() == eClipList::Walking)
+	{
+		AnimationLayer& upperBody = mSkinnedModelInst->Layers.GetLayer(kUpperBodyLayer);
+		upperBody.Clip = mSkinnedModelInst->StateMachine->GetClip((int)clip);
+		upperBody.TimePos = 0.0f;
+		upperBody.Weight = 1.0f;
+	}
+	else
+	{
+		SetClip(clip);
+		SetClipTime(0.0f);
+	}
 
-	if (clipName == "Hook")
+	if (clip == ePlayerClip::Hook)
 		mDamage = 10;
-	else if (clipName == "Kick")
+	else if (clip == ePlayerClip::Kick)
 		mDamage = 20;
-	else if (clipName == "Kick2")
+	else if (clip == ePlayerClip::Kick2)
 		mDamage = 30;
 
 	inMonster->Damage(
@@ -73,16 +118,12 @@ void Player::Attack(Character * inMonster, std::string clipName)
 
 bool Player::isClipEnd()
 {
-	auto clipEndTime = mSkinnedInfo.GetAnimation(mPlayerInfo.mClipName).GetClipEndTime();
-	auto curTimePos = mSkinnedModelInst->TimePos;
-	if (clipEndTime - curTimePos < 0.001f)
-		return true;
-	return false;
+	return mSkinnedModelInst->IsClipEnd();
 }
 
 eClipList Player::GetCurrentClip() const
 {
-	return mSkinnedModelInst->mState;
+	return mSkinnedModelInst->StateMachine->GetGroup(mSkinnedModelInst->State);
 }
 
 XMMATRIX Player::GetWorldTransformMatrix() const
@@ -105,13 +146,15 @@ const std::vector<RenderItem*> Player::GetRenderItem(RenderLayer Type) const
 	return mRitems[(int)Type];
 }
 
+bool Player::IsCulled() const
+{
+	return mSkinnedModelInst->IsCulled;
+}
+
 
-void Player::SetClipName(const std::string& inClipName)
+void Player::SetClip(ePlayerClip clip)
 {
-	if (mPlayerInfo.mClipName != "Death")
-	{
-		mPlayerInfo.mClipName = inClipName;
-	}
+	mSkinnedModelInst->RequestState((int)clip);
 }
 
 void Player::SetClipTime(float time)
@@ -119,26 +162,89 @@ void Player::SetClipTime(float time)
 	mSkinnedModelInst->TimePos = time;
 }
 
+void Player::RequestLocomotion(ePlayerClip gait, float dt)
+{
+	SkinnedModelInstance& instance = *mSkinnedModelInst;
+	UINT current = mMotionDatabase != nullptr ? mMotionDatabase->FindFrame(instance.State, instance.TimePos) : kInvalidMotionFrame;
+	if (current == kInvalidMotionFrame)
+	{
+		SetClip(gait);
+		return;
+	}
+
+	// The matched clip plays on between searches, a new gait searches at once
+	mMotionSearchTime -= dt;
+	if (gait == mLocomotionGait && mMotionSearchTime > 0.0f)
+		return;
+	mLocomotionGait = gait;
+	mMotionSearchTime = kMotionSearchInterval;
+
+	MotionFeatures query = mMotionDatabase->GetFeatures(current);
+	MotionDatabase::SetTrajectory(mMotionDatabase->GetGroundVelocity((int)gait), query);
+	const MotionFrame& best = mMotionDatabase->GetFrame(mMotionDatabase->Search(query));
+
+	// A jump within the playing clip would pop, the crossfade only covers a state change
+	if (best.State == instance.State)
+		return;
+	instance.RequestState(best.State);
+	if (instance.State == best.State)
+		instance.TimePos = best.TimePos;
+}
+
+bool Player::IsInLocomotion() const
+{
+	return mMotionDatabase != nullptr && mMotionDatabase->FindFrame(mSkinnedModelInst->State, 0.0f) != kInvalidMotionFrame;
+}
+
+void Player::SetBakedAnimation(std::shared_ptr<const BakedAnimation> baked)
+{
+	mSkinnedModelInst->Baked = baked;
+}
+
+void Player::SetClipResidency(std::shared_ptr<ClipResidency> residency)
+{
+	mClipResidency = residency;
+	mSkinnedModelInst->Residency = residency.get();
+}
+
 
 void Player::BuildGeometry(
 	ID3D12Device * device,
 	ID3D12GraphicsCommandList* cmdList,
 	const std::vector<CharacterVertex>& inVertices,
 	const std::vector<std::uint32_t>& inIndices,
-	const SkinnedData& inSkinInfo,
+	std::shared_ptr<const SkinnedData> inSkinInfo,
 	std::string geoName)
 {
-	mSkinnedInfo = inSkinInfo;
-
 	mSkinnedModelInst = std::make_unique<SkinnedModelInstance>();
-	mSkinnedModelInst->SkinnedInfo = &mSkinnedInfo;
-	mSkinnedModelInst->FinalTransforms.resize(mSkinnedInfo.BoneCount());
+	mSkinnedModelInst->SkinnedInfo = inSkinInfo;
+
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*inSkinInfo, std::vector<AnimationStateDesc>(std::begin(kPlayerStates), std::end(kPlayerStates)));
+	mSkinnedModelInst->StateMachine = stateMachine;
+	mSkinnedModelInst->State = (int)ePlayerClip::Idle;
+	mSkinnedModelInst->FinalTransforms.resize(inSkinInfo->BoneCount());
 	mSkinnedModelInst->TimePos = 0.0f;
 
+	auto motionDatabase = std::make_shared<MotionDatabase>();
+	if (motionDatabase->Build(*inSkinInfo, *stateMachine, std::vector<int>(std::begin(kLocomotionStates), std::end(kLocomotionStates))))
+		mMotionDatabase = motionDatabase;
+
+	auto upperBody = std::make_shared<BoneMask>();
+	mSkinnedModelInst->Layers.Initialize(inSkinInfo->BoneCount(), 1);
+	mSkinnedModelInst->CrossfadeDuration = kCrossfadeDuration;
+	if (inSkinInfo->BuildBoneMask(kUpperBodyBone, *upperBody))
+		mSkinnedModelInst->Layers.GetLayer(kUpperBodyLayer).Mask = upperBody;
+
+	// The first frame is drawn before any pose is presented
+	mSkinnedModelInst->UpdateSkinnedAnimation(0.0f);
+	mSkinnedModelInst->PresentedTransforms = mSkinnedModelInst->FinalTransforms;
+	mSkinnedModelInst->PresentedBounds = mSkinnedModelInst->Bounds;
+
 	Character::BuildGeometry(
 		device, cmdList,
 		inVertices, inIndices,
-		mSkinnedInfo, geoName);
+		inSkinInfo, geoName);
 }
 
 void Player::BuildRenderItem(
@@ -146,8 +252,8 @@ void Player::BuildRenderItem(
 	std::string matrialPrefix)
 {
 	int playerIndex = 0;
-	int boneCount = (UINT)mSkinnedInfo.BoneCount();
-	auto vBoneName = mSkinnedInfo.GetBoneName();
+	int boneCount = (UINT)mSkinnedModelInst->SkinnedInfo->BoneCount();
+	const auto& vBoneName = GetSubmeshNames();
 
 	// Character Mesh
 	for (int submeshIndex = 0; submeshIndex < boneCount - 1; ++submeshIndex)
@@ -182,60 +288,77 @@ void Player::BuildRenderItem(
 }
 
 
-void Player::UpdateCharacterCBs(
-	FrameResource* mCurrFrameResource,
-	const Light& mMainLight,
-	float* Delay,
-	const GameTimer & gt)
+void Player::CollectAnimation(AnimationStage& stage)
 {
-	if (mPlayerInfo.mHealth <= 0 && mPlayerInfo.mClipName != "Death")
+	// The poses of last frame are presented, the clips are free to change
+	if (mClipResidency != nullptr)
 	{
-		SetClipName("Death");
-		mSkinnedModelInst->TimePos = 0.0f;
+		mClipResidency->SetStage(&stage);
+		mClipResidency->Update();
 	}
-	mSkinnedModelInst->UpdateSkinnedAnimation(mPlayerInfo.mClipName, gt.DeltaTime());
 
-	auto currPlayerCB = mCurrFrameResource->PlayerCB.get();
-	for (auto& e : mRitems[(int)RenderLayer::Character])
+	if (mPlayerInfo.mHealth <= 0 && mSkinnedModelInst->State != (int)ePlayerClip::Death)
 	{
-
-		CharacterConstants skinnedConstants;
-
-		std::copy(
-			std::begin(mSkinnedModelInst->FinalTransforms),
-			std::end(mSkinnedModelInst->FinalTransforms),
-			&skinnedConstants.BoneTransforms[0]);
-
-		XMMATRIX world = XMLoadFloat4x4(&e->World) * GetWorldTransformMatrix();
-		XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
-
-		XMStoreFloat4x4(&skinnedConstants.World, XMMatrixTranspose(world));
-		XMStoreFloat4x4(&skinnedConstants.TexTransform, XMMatrixTranspose(texTransform));
-
-		currPlayerCB->CopyData(e->PlayerCBIndex, skinnedConstants);
+		SetClip(ePlayerClip::Death);
+		mSkinnedModelInst->TimePos = 0.0f;
 	}
+	float distance = MathHelper::getDistance(mPlayerInfo.mMovement.GetPlayerPosition(), mCamera.GetEyePosition());
 
-	//mInitBoundsBox.Transform(mPlayerInfo.mBoundingBox, GetWorldTransformMatrix());
-	GetBoundingBox().Transform(mPlayerInfo.mBoundingBox, GetWorldTransformMatrix());
-
-	UpdateCharacterShadows(mMainLight);
-	for (auto& e : mRitems[(int)RenderLayer::Shadow])
+	// Culled with the character and its shadow, placed as last frame
+	XMMATRIX worlds[] =
 	{
+		XMLoadFloat4x4(&mRitems[(int)RenderLayer::Character].front()->World) * GetWorldTransformMatrix(),
+		XMLoadFloat4x4(&mRitems[(int)RenderLayer::Shadow].front()->World),
+	};
+	stage.Add(mSkinnedModelInst.get(), distance, worlds, _countof(worlds));
+}
 
-		CharacterConstants skinnedConstants;
-
-		std::copy(
-			std::begin(mSkinnedModelInst->FinalTransforms),
-			std::end(mSkinnedModelInst->FinalTransforms),
-			&skinnedConstants.BoneTransforms[0]);
+void Player::UpdateCharacterCBs(
+	FrameResource* mCurrFrameResource,
+	const Light& mMainLight,
+	float* Delay,
+	const GameTimer & gt)
+{
 
-		XMMATRIX world = XMLoadFloat4x4(&e->World);
-		XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+	// Tight bounds of the current pose, placed like the character render items
+	XMMATRIX characterWorld = XMLoadFloat4x4(&mRitems[(int)RenderLayer::Character].front()->World) * GetWorldTransformMatrix();
+	mSkinnedModelInst->PresentedBounds.Transform(mPlayerInfo.mBoundingBox, characterWorld);
 
-		XMStoreFloat4x4(&skinnedConstants.World, XMMatrixTranspose(world));
-		XMStoreFloat4x4(&skinnedConstants.TexTransform, XMMatrixTranspose(texTransform));
+	UpdateCharacterShadows(mMainLight);
 
-		currPlayerCB->CopyData(e->PlayerCBIndex, skinnedConstants);
+	// Out of view the render items are not drawn, so nothing is packed or uploaded
+	if (!IsCulled())
+	{
+		// The palette is packed once for the character and shadow render items
+		CharacterConstants skinnedConstants;
+		const SkinnedData& skinnedInfo = *mSkinnedModelInst->SkinnedInfo;
+		skinnedConstants.PaletteFormat = (UINT)skinnedInfo.GetPaletteFormat();
+		skinnedConstants.PaletteScale = skinnedInfo.GetPaletteScale();
+		UINT paletteRows = skinnedInfo.PackPalette(mSkinnedModelInst->PresentedTransforms, skinnedConstants.BonePalette);
+		UINT constantsSize = (UINT)((BYTE*)&skinnedConstants.BonePalette[paletteRows] - (BYTE*)&skinnedConstants);
+
+		auto currPlayerCB = mCurrFrameResource->PlayerCB.get();
+		for (auto& e : mRitems[(int)RenderLayer::Character])
+		{
+			XMMATRIX world = XMLoadFloat4x4(&e->World) * GetWorldTransformMatrix();
+			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+
+			XMStoreFloat4x4(&skinnedConstants.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&skinnedConstants.TexTransform, XMMatrixTranspose(texTransform));
+
+			currPlayerCB->CopyData(e->PlayerCBIndex, skinnedConstants, constantsSize);
+		}
+
+		for (auto& e : mRitems[(int)RenderLayer::Shadow])
+		{
+			XMMATRIX world = XMLoadFloat4x4(&e->World);
+			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+
+			XMStoreFloat4x4(&skinnedConstants.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&skinnedConstants.TexTransform, XMMatrixTranspose(texTransform));
+
+			currPlayerCB->CopyData(e->PlayerCBIndex, skinnedConstants, constantsSize);
+		}
 	}
 
 	mCamera.UpdateViewMatrix();
@@ -300,6 +423,21 @@ void Player::UpdatePlayerPosition(ePlayerMoveList moveName, float velocity)
 	mTransformDirty = true;
 }
 
+void Player::ApplyRootMotion()
+{
+	XMFLOAT2& rootMotion = mSkinnedModelInst->RootMotion;
+	if (rootMotion.x == 0.0f && rootMotion.y == 0.0f)
+		return;
+
+	// The clips move in the model space of the character render item
+	XMMATRIX world = XMLoadFloat4x4(&mRitems[(int)RenderLayer::Character].front()->World) * GetWorldTransformMatrix();
+	XMVECTOR delta = XMVector3TransformNormal(XMVectorSet(rootMotion.x, 0.0f, rootMotion.y, 0.0f), world);
+	mPlayerInfo.mMovement.SetPlayerPosition(mPlayerInfo.mMovement.GetPlayerPosition() + delta);
+	rootMotion = XMFLOAT2(0.0f, 0.0f);
+
+	mTransformDirty = true;
+}
+
 void Player::UpdateTransformationMatrix()
 {
 	mPlayerInfo.mMovement.UpdateTransformationMatrix();
@@ -0,0 +1,131 @@
+#include "PoseCache.h"
+
+using namespace DirectX;
+
+namespace
+{
+	const UINT kNone = ~0u;
+}
+
+PoseCache::PoseCache(UINT capacity, float timeStep)
+	: mCapacity((std::max)(capacity, 1u)),
+	mTimeStep(timeStep),
+	mHead(kNone),
+	mTail(kNone)
+{
+	mEntries.reserve(mCapacity);
+	mSlots.reserve(mCapacity);
+}
+
+PoseCache::~PoseCache()
+{
+}
+
+bool PoseCache::Find(const SkinnedData* skeleton, ClipHandle clip, int frame,
+	std::vector<XMFLOAT4X4>& outTransforms, BoundingBox& outBounds)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto slot = mSlots.find({ skeleton, clip, frame });
+	if (slot == mSlots.end())
+	{
+		++mMisses;
+		return false;
+	}
+	++mHits;
+
+	Unlink(slot->second);
+	LinkFront(slot->second);
+
+	const Entry& entry = mEntries[slot->second];
+	std::copy(entry.Transforms.begin(), entry.Transforms.end(), outTransforms.begin());
+	outBounds = entry.Bounds;
+	return true;
+}
+
+void PoseCache::Store(const SkinnedData* skeleton, ClipHandle clip, int frame,
+	const std::vector<XMFLOAT4X4>& transforms, const BoundingBox& bounds)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Another job may have computed the same frame meanwhile
+	Key key = { skeleton, clip, frame };
+	if (mSlots.find(key) != mSlots.end())
+		return;
+
+	UINT slot;
+	if (mEntries.size() < mCapacity)
+	{
+		slot = (UINT)mEntries.size();
+		mEntries.emplace_back();
+	}
+	else
+	{
+		slot = mTail;
+		Unlink(slot);
+		mSlots.erase(mEntries[slot].CacheKey);
+		++mEvictions;
+	}
+
+	Entry& entry = mEntries[slot];
+	entry.CacheKey = key;
+	entry.Transforms.assign(transforms.begin(), transforms.end());
+	entry.Bounds = bounds;
+	LinkFront(slot);
+	mSlots[key] = slot;
+}
+
+void PoseCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mEntries.clear();
+	mSlots.clear();
+	mHead = kNone;
+	mTail = kNone;
+}
+
+void PoseCache::ResetCounters()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mHits = 0;
+	mMisses = 0;
+	mEvictions = 0;
+}
+
+size_t PoseCache::GetMemorySize() const
+{
+	size_t size = 0;
+	for (auto& e : mEntries)
+	{
+		size += e.Transforms.capacity() * sizeof(XMFLOAT4X4);
+	}
+	return size;
+}
+
+void PoseCache::Unlink(UINT slot)
+{
+	Entry& entry = mEntries[slot];
+	if (entry.Prev != kNone)
+		mEntries[entry.Prev].Next = entry.Next;
+	else
+		mHead = entry.Next;
+
+	if (entry.Next != kNone)
+		mEntries[entry.Next].Prev = entry.Prev;
+	else
+		mTail = entry.Prev;
+}
+
+void PoseCache::LinkFront(UINT slot)
+{
+	Entry& entry = mEntries[slot];
+	entry.Prev = kNone;
+	entry.Next = mHead;
+	if (mHead != kNone)
+		mEntries[mHead].Prev = slot;
+	mHead = slot;
+	if (mTail == kNone)
+		mTail = slot;
+}
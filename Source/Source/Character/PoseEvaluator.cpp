@@ -0,0 +1,466 @@
+#include "PoseEvaluator.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// The scale comes last so a clip without it stores only the channels before
+	enum Channel
+	{
+		TranslationX, TranslationY, TranslationZ,
+		RotationX, RotationY, RotationZ, RotationW,
+		ScaleX, ScaleY, ScaleZ,
+		ChannelCount
+	};
+
+	const UINT kLaneCount = 4;
+
+	// Below this cosine between two keys the normalized lerp drifts more
+	// than 1e-4 radians from the slerp
+	const float kNlerpMinDot = 0.99f;
+
+	XMVECTOR LoadChannel(const float* group, Channel channel)
+	{
+		return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(group + channel * kLaneCount));
+	}
+
+	void StoreLanes(float (&outLanes)[4][kLaneCount], FXMVECTOR x, FXMVECTOR y, FXMVECTOR z, GXMVECTOR w)
+	{
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(outLanes[0]), x);
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(outLanes[1]), y);
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(outLanes[2]), z);
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(outLanes[3]), w);
+	}
+
+	// Bone left out by a group mask
+	bool IsMasked(const BYTE* groupMask, UINT bone)
+	{
+		return groupMask != nullptr && groupMask[bone / kLaneCount] == 0;
+	}
+
+	// Group whose four bones are all left out by the mask. The padding lanes of the
+	// last group hold boneCount, past the end of the mask, and count as masked.
+	bool IsGroupMasked(const BYTE* groupMask, const UINT* bones, UINT boneCount)
+	{
+		if (groupMask == nullptr)
+			return false;
+		for (UINT k = 0; k < kLaneCount; ++k)
+		{
+			if (bones[k] < boneCount && !IsMasked(groupMask, bones[k]))
+				return false;
+		}
+		return true;
+	}
+
+	// Lerped translation and scale, normalized lerp or slerp of the rotations, of the four bones of a group.
+	// Without hasScale the keys hold no scale and the scale is one.
+	void InterpolateGroup(const float* key0, const float* key1, float lerpPercent, bool hasScale, XMVECTOR (&out)[ChannelCount])
+	{
+		const XMVECTOR f = XMVectorReplicate(lerpPercent);
+		const XMVECTOR zero = XMVectorZero();
+		const XMVECTOR one = XMVectorSplatOne();
+		const XMVECTOR nlerpMinDot = XMVectorReplicate(kNlerpMinDot);
+
+		out[TranslationX] = XMVectorLerpV(LoadChannel(key0, TranslationX), LoadChannel(key1, TranslationX), f);
+		out[TranslationY] = XMVectorLerpV(LoadChannel(key0, TranslationY), LoadChannel(key1, TranslationY), f);
+		out[TranslationZ] = XMVectorLerpV(LoadChannel(key0, TranslationZ), LoadChannel(key1, TranslationZ), f);
+		if (hasScale)
+		{
+			out[ScaleX] = XMVectorLerpV(LoadChannel(key0, ScaleX), LoadChannel(key1, ScaleX), f);
+			out[ScaleY] = XMVectorLerpV(LoadChannel(key0, ScaleY), LoadChannel(key1, ScaleY), f);
+			out[ScaleZ] = XMVectorLerpV(LoadChannel(key0, ScaleZ), LoadChannel(key1, ScaleZ), f);
+		}
+		else
+		{
+			out[ScaleX] = one;
+			out[ScaleY] = one;
+			out[ScaleZ] = one;
+		}
+
+		XMVECTOR q0x = LoadChannel(key0, RotationX);
+		XMVECTOR q0y = LoadChannel(key0, RotationY);
+		XMVECTOR q0z = LoadChannel(key0, RotationZ);
+		XMVECTOR q0w = LoadChannel(key0, RotationW);
+		XMVECTOR q1x = LoadChannel(key1, RotationX);
+		XMVECTOR q1y = LoadChannel(key1, RotationY);
+		XMVECTOR q1z = LoadChannel(key1, RotationZ);
+		XMVECTOR q1w = LoadChannel(key1, RotationW);
+
+		// Shortest path: flip the second key where the keys point away
+		XMVECTOR dot = XMVectorMultiply(q0x, q1x);
+		dot = XMVectorMultiplyAdd(q0y, q1y, dot);
+		dot = XMVectorMultiplyAdd(q0z, q1z, dot);
+		dot = XMVectorMultiplyAdd(q0w, q1w, dot);
+		XMVECTOR sign = XMVectorSelect(one, XMVectorNegate(one), XMVectorLess(dot, zero));
+
+		XMVECTOR qx = XMVectorLerpV(q0x, XMVectorMultiply(q1x, sign), f);
+		XMVECTOR qy = XMVectorLerpV(q0y, XMVectorMultiply(q1y, sign), f);
+		XMVECTOR qz = XMVectorLerpV(q0z, XMVectorMultiply(q1z, sign), f);
+		XMVECTOR qw = XMVectorLerpV(q0w, XMVectorMultiply(q1w, sign), f);
+
+		XMVECTOR lengthSq = XMVectorMultiply(qx, qx);
+		lengthSq = XMVectorMultiplyAdd(qy, qy, lengthSq);
+		lengthSq = XMVectorMultiplyAdd(qz, qz, lengthSq);
+		lengthSq = XMVectorMultiplyAdd(qw, qw, lengthSq);
+		XMVECTOR invLength = XMVectorReciprocalSqrt(lengthSq);
+		qx = XMVectorMultiply(qx, invLength);
+		qy = XMVectorMultiply(qy, invLength);
+		qz = XMVectorMultiply(qz, invLength);
+		qw = XMVectorMultiply(qw, invLength);
+
+		XMVECTOR slerpLanes = XMVectorLess(XMVectorAbs(dot), nlerpMinDot);
+		if (!XMVector4EqualInt(slerpLanes, XMVectorFalseInt()))
+		{
+			// Component after component, one float per lane
+			float q[4][kLaneCount], q0[4][kLaneCount], q1[4][kLaneCount];
+			StoreLanes(q, qx, qy, qz, qw);
+			StoreLanes(q0, q0x, q0y, q0z, q0w);
+			StoreLanes(q1, q1x, q1y, q1z, q1w);
+
+			XMUINT4 mask;
+			XMStoreUInt4(&mask, slerpLanes);
+			const uint32_t laneMask[] = { mask.x, mask.y, mask.z, mask.w };
+			for (UINT lane = 0; lane < kLaneCount; ++lane)
+			{
+				if (laneMask[lane] == 0)
+					continue;
+
+				XMVECTOR a = XMVectorSet(q0[0][lane], q0[1][lane], q0[2][lane], q0[3][lane]);
+				XMVECTOR b = XMVectorSet(q1[0][lane], q1[1][lane], q1[2][lane], q1[3][lane]);
+				XMFLOAT4 slerp;
+				XMStoreFloat4(&slerp, XMQuaternionSlerp(a, b, lerpPercent));
+				q[0][lane] = slerp.x;
+				q[1][lane] = slerp.y;
+				q[2][lane] = slerp.z;
+				q[3][lane] = slerp.w;
+			}
+
+			qx = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(q[0]));
+			qy = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(q[1]));
+			qz = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(q[2]));
+			qw = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(q[3]));
+		}
+
+		out[RotationX] = qx;
+		out[RotationY] = qy;
+		out[RotationZ] = qz;
+		out[RotationW] = qw;
+	}
+}
+
+PoseEvaluator::PoseEvaluator()
+{
+}
+
+PoseEvaluator::~PoseEvaluator()
+{
+}
+
+bool PoseEvaluator::Build(const AnimationClip& clip, bool elideStatic)
+{
+	mBoneCount = 0;
+	mAnimatedCount = 0;
+	mGroupCount = 0;
+	mChannelCount = 0;
+	mFloatsPerGroup = 0;
+	mKeyTimes.Keyframes.clear();
+	mKeys.clear();
+	mGroupBones.clear();
+	mStaticBones.clear();
+	mStaticPose.clear();
+	mStaticTransforms.clear();
+
+	if (clip.BoneAnimations.empty())
+		return false;
+
+	const BoneAnimation* reference = nullptr;
+	for (auto& e : clip.BoneAnimations)
+	{
+		if (e.Kind == eTrackKind::Animated)
+		{
+			reference = &e;
+			break;
+		}
+	}
+	if (reference == nullptr || reference->Keyframes.size() < 2)
+		return false;
+
+	const auto& referenceKeys = reference->Keyframes;
+	bool hasScale = !elideStatic;
+	for (auto& e : clip.BoneAnimations)
+	{
+		if (e.Kind != eTrackKind::Animated)
+			continue;
+
+		if (e.Keyframes.size() != referenceKeys.size())
+			return false;
+
+		for (size_t k = 0; k < referenceKeys.size(); ++k)
+		{
+			const Keyframe& key = e.Keyframes[k];
+			if (key.TimePos != referenceKeys[k].TimePos)
+				return false;
+
+			// Exact, a scale of one multiplies away
+			if (key.Scale.x != 1.0f || key.Scale.y != 1.0f || key.Scale.z != 1.0f)
+				hasScale = true;
+		}
+	}
+
+	mKeyTimes.Keyframes.resize(referenceKeys.size());
+	for (size_t k = 0; k < referenceKeys.size(); ++k)
+	{
+		mKeyTimes.Keyframes[k].TimePos = referenceKeys[k].TimePos;
+	}
+	mKeyTimes.UpdateSampling();
+
+	mBoneCount = (UINT)clip.BoneAnimations.size();
+
+	// Transform of every compacted track, at any time
+	std::vector<BoneTransform> trackPose(mBoneCount);
+	std::vector<UINT> animatedBones;
+	const XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	for (UINT i = 0; i < mBoneCount; ++i)
+	{
+		const BoneAnimation& track = clip.BoneAnimations[i];
+		if (track.Kind == eTrackKind::Animated)
+		{
+			animatedBones.push_back(i);
+			continue;
+		}
+
+		UINT keyCursor = 0;
+		track.Sample(0.0f, trackPose[i], keyCursor);
+		if (!elideStatic)
+		{
+			animatedBones.push_back(i);
+			continue;
+		}
+
+		XMVECTOR S = XMLoadFloat3(&trackPose[i].Scale);
+		XMVECTOR P = XMLoadFloat3(&trackPose[i].Translation);
+		XMVECTOR Q = XMLoadFloat4(&trackPose[i].RotationQuat);
+		XMFLOAT4X4 M;
+		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+
+		mStaticBones.push_back(i);
+		mStaticPose.push_back(trackPose[i]);
+		mStaticTransforms.push_back(M);
+	}
+
+	mAnimatedCount = (UINT)animatedBones.size();
+	mGroupCount = (mAnimatedCount + kLaneCount - 1) / kLaneCount;
+	mChannelCount = hasScale ? (UINT)ChannelCount : kScaleFreeChannelCount;
+	mFloatsPerGroup = mChannelCount * kLaneCount;
+
+	mGroupBones.assign(mGroupCount * kLaneCount, mBoneCount);
+	std::copy(animatedBones.begin(), animatedBones.end(), mGroupBones.begin());
+
+	// Padding lanes hold the identity
+	const UINT keyCount = (UINT)referenceKeys.size();
+	mKeys.assign(keyCount * mGroupCount * mFloatsPerGroup, 0.0f);
+	for (UINT k = 0; k < keyCount; ++k)
+	{
+		for (UINT g = 0; g < mGroupCount; ++g)
+		{
+			float* group = &mKeys[(k * mGroupCount + g) * mFloatsPerGroup];
+			for (UINT lane = 0; lane < kLaneCount; ++lane)
+			{
+				group[RotationW * kLaneCount + lane] = 1.0f;
+				if (hasScale)
+				{
+					group[ScaleX * kLaneCount + lane] = 1.0f;
+					group[ScaleY * kLaneCount + lane] = 1.0f;
+					group[ScaleZ * kLaneCount + lane] = 1.0f;
+				}
+
+				UINT bone = mGroupBones[g * kLaneCount + lane];
+				if (bone >= mBoneCount)
+					continue;
+
+				const BoneAnimation& track = clip.BoneAnimations[bone];
+				BoneTransform key = trackPose[bone];
+				if (track.Kind == eTrackKind::Animated)
+				{
+					key.Translation = track.Keyframes[k].Translation;
+					key.Scale = track.Keyframes[k].Scale;
+					key.RotationQuat = track.Keyframes[k].RotationQuat;
+				}
+
+				group[TranslationX * kLaneCount + lane] = key.Translation.x;
+				group[TranslationY * kLaneCount + lane] = key.Translation.y;
+				group[TranslationZ * kLaneCount + lane] = key.Translation.z;
+				group[RotationX * kLaneCount + lane] = key.RotationQuat.x;
+				group[RotationY * kLaneCount + lane] = key.RotationQuat.y;
+				group[RotationZ * kLaneCount + lane] = key.RotationQuat.z;
+				group[RotationW * kLaneCount + lane] = key.RotationQuat.w;
+				if (hasScale)
+				{
+					group[ScaleX * kLaneCount + lane] = key.Scale.x;
+					group[ScaleY * kLaneCount + lane] = key.Scale.y;
+					group[ScaleZ * kLaneCount + lane] = key.Scale.z;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+size_t PoseEvaluator::GetMemorySize() const
+{
+	return mKeys.capacity() * sizeof(float) +
+		(mGroupBones.capacity() + mStaticBones.capacity()) * sizeof(UINT) +
+		mStaticPose.capacity() * sizeof(BoneTransform) +
+		mStaticTransforms.capacity() * sizeof(XMFLOAT4X4) +
+		mKeyTimes.Keyframes.capacity() * sizeof(Keyframe);
+}
+
+void PoseEvaluator::Evaluate(float t, std::vector<XMFLOAT4X4>& boneTransforms, UINT& keyCursor, const BYTE* groupMask,
+	const XMFLOAT4X4* scaledOffsets) const
+{
+	float lerpPercent;
+	UINT i = FindInterval(t, keyCursor, lerpPercent);
+
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR one = XMVectorSplatOne();
+	const bool hasScale = HasScale();
+
+	for (UINT g = 0; g < mGroupCount; ++g)
+	{
+		const UINT* bones = &mGroupBones[g * kLaneCount];
+		if (IsGroupMasked(groupMask, bones, mBoneCount))
+			continue;
+
+		const float* key0 = &mKeys[(i * mGroupCount + g) * mFloatsPerGroup];
+		const float* key1 = key0 + mGroupCount * mFloatsPerGroup;
+
+		XMVECTOR c[ChannelCount];
+		InterpolateGroup(key0, key1, lerpPercent, hasScale, c);
+
+		// Rotation matrix of four quaternions, same layout as XMMatrixRotationQuaternion
+		XMVECTOR x2 = XMVectorAdd(c[RotationX], c[RotationX]);
+		XMVECTOR y2 = XMVectorAdd(c[RotationY], c[RotationY]);
+		XMVECTOR z2 = XMVectorAdd(c[RotationZ], c[RotationZ]);
+		XMVECTOR xx = XMVectorMultiply(c[RotationX], x2);
+		XMVECTOR yy = XMVectorMultiply(c[RotationY], y2);
+		XMVECTOR zz = XMVectorMultiply(c[RotationZ], z2);
+		XMVECTOR xy = XMVectorMultiply(c[RotationX], y2);
+		XMVECTOR xz = XMVectorMultiply(c[RotationX], z2);
+		XMVECTOR yz = XMVectorMultiply(c[RotationY], z2);
+		XMVECTOR wx = XMVectorMultiply(c[RotationW], x2);
+		XMVECTOR wy = XMVectorMultiply(c[RotationW], y2);
+		XMVECTOR wz = XMVectorMultiply(c[RotationW], z2);
+
+		XMMATRIX row0(XMVectorSubtract(one, XMVectorAdd(yy, zz)), XMVectorAdd(xy, wz), XMVectorSubtract(xz, wy), zero);
+		XMMATRIX row1(XMVectorSubtract(xy, wz), XMVectorSubtract(one, XMVectorAdd(xx, zz)), XMVectorAdd(yz, wx), zero);
+		XMMATRIX row2(XMVectorAdd(xz, wy), XMVectorSubtract(yz, wx), XMVectorSubtract(one, XMVectorAdd(xx, yy)), zero);
+		XMMATRIX row3(c[TranslationX], c[TranslationY], c[TranslationZ], one);
+
+		// Rows scaled like XMMatrixAffineTransformation
+		if (hasScale)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				row0.r[k] = XMVectorMultiply(row0.r[k], c[ScaleX]);
+				row1.r[k] = XMVectorMultiply(row1.r[k], c[ScaleY]);
+				row2.r[k] = XMVectorMultiply(row2.r[k], c[ScaleZ]);
+			}
+		}
+
+		// From component registers into one row per bone
+		row0 = XMMatrixTranspose(row0);
+		row1 = XMMatrixTranspose(row1);
+		row2 = XMMatrixTranspose(row2);
+		row3 = XMMatrixTranspose(row3);
+
+		for (UINT lane = 0; lane < kLaneCount; ++lane)
+		{
+			UINT bone = bones[lane];
+			if (bone >= mBoneCount || IsMasked(groupMask, bone))
+				continue;
+
+			XMMATRIX M(row0.r[lane], row1.r[lane], row2.r[lane], row3.r[lane]);
+			if (scaledOffsets != nullptr)
+				SkinnedData::StorePalette(scaledOffsets[bone], M, boneTransforms[bone]);
+			else
+				XMStoreFloat4x4(&boneTransforms[bone], M);
+		}
+	}
+
+	for (UINT k = 0; k < mStaticBones.size(); ++k)
+	{
+		UINT bone = mStaticBones[k];
+		if (IsMasked(groupMask, bone))
+			continue;
+
+		if (scaledOffsets != nullptr)
+			SkinnedData::StorePalette(scaledOffsets[bone], XMLoadFloat4x4(&mStaticTransforms[k]), boneTransforms[bone]);
+		else
+			boneTransforms[bone] = mStaticTransforms[k];
+	}
+}
+
+void PoseEvaluator::Sample(float t, std::vector<BoneTransform>& bonePose, UINT& keyCursor, const BYTE* groupMask) const
+{
+	float lerpPercent;
+	UINT i = FindInterval(t, keyCursor, lerpPercent);
+
+	for (UINT g = 0; g < mGroupCount; ++g)
+	{
+		const UINT* bones = &mGroupBones[g * kLaneCount];
+		if (IsGroupMasked(groupMask, bones, mBoneCount))
+			continue;
+
+		const float* key0 = &mKeys[(i * mGroupCount + g) * mFloatsPerGroup];
+		const float* key1 = key0 + mGroupCount * mFloatsPerGroup;
+
+		XMVECTOR c[ChannelCount];
+		InterpolateGroup(key0, key1, lerpPercent, HasScale(), c);
+
+		float lanes[ChannelCount][kLaneCount];
+		for (UINT channel = 0; channel < ChannelCount; ++channel)
+		{
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(lanes[channel]), c[channel]);
+		}
+
+		for (UINT lane = 0; lane < kLaneCount; ++lane)
+		{
+			UINT boneIndex = bones[lane];
+			if (boneIndex >= mBoneCount || IsMasked(groupMask, boneIndex))
+				continue;
+
+			BoneTransform& bone = bonePose[boneIndex];
+			bone.Translation = XMFLOAT3(lanes[TranslationX][lane], lanes[TranslationY][lane], lanes[TranslationZ][lane]);
+			bone.Scale = XMFLOAT3(lanes[ScaleX][lane], lanes[ScaleY][lane], lanes[ScaleZ][lane]);
+			bone.RotationQuat = XMFLOAT4(lanes[RotationX][lane], lanes[RotationY][lane], lanes[RotationZ][lane], lanes[RotationW][lane]);
+		}
+	}
+
+	for (UINT k = 0; k < mStaticBones.size(); ++k)
+	{
+		UINT bone = mStaticBones[k];
+		if (!IsMasked(groupMask, bone))
+			bonePose[bone] = mStaticPose[k];
+	}
+}
+
+UINT PoseEvaluator::FindInterval(float t, UINT& keyCursor, float& outLerpPercent) const
+{
+	const auto& keys = mKeyTimes.Keyframes;
+
+	if (t <= keys.front().TimePos)
+	{
+		outLerpPercent = 0.0f;
+		return 0;
+	}
+	if (t >= keys.back().TimePos)
+	{
+		outLerpPercent = 1.0f;
+		return (UINT)keys.size() - 2;
+	}
+
+	UINT i = mKeyTimes.FindKey(t, keyCursor);
+	outLerpPercent = (t - keys[i].TimePos) / (keys[i + 1].TimePos - keys[i].TimePos);
+	return i;
+}
@@ -0,0 +1,164 @@
+#include "SkeletonRetarget.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// "Mutant:LeftArm" and "LeftArm" are the same bone
+	std::string GetBaseName(const std::string& boneName)
+	{
+		size_t colon = boneName.rfind(':');
+		return colon == std::string::npos ? boneName : boneName.substr(colon + 1);
+	}
+
+	// Scale, rotation and joint of a bone in the bind pose, in model space.
+	// False for the bones outside the skin, the loader leaves their offset zero.
+	bool GetBindPose(const SkinnedData& skinnedData, UINT bone, XMVECTOR& S, XMVECTOR& Q, XMVECTOR& P)
+	{
+		XMMATRIX offset = XMLoadFloat4x4(&skinnedData.GetBoneOffsets()[bone]);
+		XMVECTOR determinant = XMMatrixDeterminant(offset);
+		if (XMVectorGetX(determinant) == 0.0f)
+			return false;
+
+		XMMATRIX boneToModel = XMMatrixInverse(&determinant, offset);
+		return XMMatrixDecompose(&S, &Q, &P, boneToModel);
+	}
+}
+
+SkeletonRetarget::SkeletonRetarget()
+{
+}
+
+SkeletonRetarget::~SkeletonRetarget()
+{
+}
+
+bool SkeletonRetarget::Build(std::shared_ptr<const SkinnedData> source, std::shared_ptr<const SkinnedData> target)
+{
+	mSource = source;
+	mTarget = target;
+
+	std::unordered_map<std::string, int> sourceBones;
+	const auto& sourceNames = source->GetBoneName();
+	for (UINT i = 0; i < sourceNames.size(); ++i)
+	{
+		sourceBones[GetBaseName(sourceNames[i])] = (int)i;
+	}
+
+	UINT boneCount = target->BoneCount();
+	const auto& targetNames = target->GetBoneName();
+	const auto& hierarchy = target->GetBoneHierarchy();
+	mSourceBones.assign(boneCount, -1);
+	mSourceBindInverse.assign(boneCount, XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+	mTargetBind.resize(boneCount);
+	mTargetScale.resize(boneCount);
+	mBindOffsets.resize(boneCount);
+
+	std::vector<XMFLOAT3> targetJoints(boneCount);
+	for (UINT i = 0; i < boneCount; ++i)
+	{
+		int parent = hierarchy[i];
+		XMVECTOR S, Q, P;
+		bool hasBindPose = GetBindPose(*target, i, S, Q, P);
+		// A bone outside the skin sits on its parent joint, nothing is drawn with it
+		if (!hasBindPose)
+		{
+			S = XMVectorReplicate(1.0f);
+			Q = XMQuaternionIdentity();
+			P = parent < 0 ? XMVectorZero() : XMLoadFloat3(&targetJoints[parent]);
+		}
+		XMStoreFloat3(&mTargetScale[i], S);
+		XMStoreFloat4(&mTargetBind[i], Q);
+		XMStoreFloat3(&targetJoints[i], P);
+
+		XMVECTOR offset = parent < 0 ? P : XMVectorSubtract(P, XMLoadFloat3(&targetJoints[parent]));
+		XMStoreFloat3(&mBindOffsets[i], offset);
+
+		auto match = i < targetNames.size() ? sourceBones.find(GetBaseName(targetNames[i])) : sourceBones.end();
+		if (!hasBindPose || match == sourceBones.end() || !GetBindPose(*source, match->second, S, Q, P))
+			continue;
+
+		mSourceBones[i] = match->second;
+		XMStoreFloat4(&mSourceBindInverse[i], XMQuaternionConjugate(Q));
+	}
+
+	if (boneCount == 0 || mSourceBones[0] < 0)
+		return false;
+
+	// Hips above the origin, the length is the hip height whichever axis is up
+	XMVECTOR S, Q, P;
+	GetBindPose(*source, mSourceBones[0], S, Q, P);
+	XMStoreFloat3(&mSourceRootBind, P);
+	float sourceHeight = XMVectorGetX(XMVector3Length(P));
+	float targetHeight = XMVectorGetX(XMVector3Length(XMLoadFloat3(&targetJoints[0])));
+	mRootScale = sourceHeight > 0.0f ? targetHeight / sourceHeight : 1.0f;
+
+	return true;
+}
+
+UINT SkeletonRetarget::GetMatchedCount() const
+{
+	return (UINT)std::count_if(mSourceBones.begin(), mSourceBones.end(), [](int bone) { return bone >= 0; });
+}
+
+size_t SkeletonRetarget::GetMemorySize() const
+{
+	return mSourceBones.capacity() * sizeof(int) +
+		(mSourceBindInverse.capacity() + mTargetBind.capacity()) * sizeof(XMFLOAT4) +
+		(mTargetScale.capacity() + mBindOffsets.capacity()) * sizeof(XMFLOAT3);
+}
+
+void SkeletonRetarget::GetModelPose(ClipHandle clip, float timePos, RetargetPose& pose,
+	std::vector<UINT>* keyCursors) const
+{
+	UINT boneCount = (UINT)mSourceBones.size();
+	pose.Source.resize(mSource->BoneCount());
+	pose.Target.resize(boneCount);
+	pose.Deltas.resize(boneCount);
+
+	mSource->GetModelPose(clip, timePos, pose.Source, keyCursors);
+
+	const auto& hierarchy = mTarget->GetBoneHierarchy();
+	for (UINT i = 0; i < boneCount; ++i)
+	{
+		int parent = hierarchy[i];
+		int sourceBone = mSourceBones[i];
+
+		// Rotation away from the bind pose, the source bone's or the parent's
+		XMVECTOR delta;
+		if (sourceBone >= 0)
+			delta = XMQuaternionMultiply(XMLoadFloat4(&mSourceBindInverse[i]), XMLoadFloat4(&pose.Source[sourceBone].RotationQuat));
+		else
+			delta = parent < 0 ? XMQuaternionIdentity() : XMLoadFloat4(&pose.Deltas[parent]);
+		XMStoreFloat4(&pose.Deltas[i], delta);
+
+		BoneTransform& bone = pose.Target[i];
+		bone.Scale = mTargetScale[i];
+		XMStoreFloat4(&bone.RotationQuat, XMQuaternionMultiply(XMLoadFloat4(&mTargetBind[i]), delta));
+
+		// The bind pose bone turned by the parent, so the bone lengths stay those of the target
+		XMVECTOR joint;
+		if (parent < 0)
+		{
+			joint = XMLoadFloat3(&mBindOffsets[i]);
+			if (sourceBone >= 0)
+			{
+				XMVECTOR moved = XMVectorSubtract(XMLoadFloat3(&pose.Source[sourceBone].Translation), XMLoadFloat3(&mSourceRootBind));
+				joint = XMVectorMultiplyAdd(moved, XMVectorReplicate(mRootScale), joint);
+			}
+		}
+		else
+		{
+			XMVECTOR offset = XMVector3Rotate(XMLoadFloat3(&mBindOffsets[i]), XMLoadFloat4(&pose.Deltas[parent]));
+			joint = XMVectorAdd(XMLoadFloat3(&pose.Target[parent].Translation), offset);
+		}
+		XMStoreFloat3(&bone.Translation, joint);
+	}
+}
+
+void SkeletonRetarget::GetFinalTransforms(ClipHandle clip, float timePos, RetargetPose& pose,
+	std::vector<XMFLOAT4X4>& finalTransforms, std::vector<UINT>* keyCursors) const
+{
+	GetModelPose(clip, timePos, pose, keyCursors);
+	mTarget->GetFinalTransforms(pose.Target, finalTransforms);
+}
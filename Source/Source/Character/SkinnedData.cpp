@@ -1,7 +1,86 @@
+#include <algorithm>
 #include "SkinnedData.h"
+#include "PoseEvaluator.h"
 
 using namespace DirectX;
 
+namespace
+{
+	// A bone with this many children is a hand, its descendants are fingers
+	const UINT kHandChildCount = 4;
+
+	// Offset rows and key scales this close to unit length count as rigid
+	const float kRigidTolerance = 1e-3f;
+
+	// The one transform every identity track resolves to
+	const BoneTransform kIdentityBone =
+	{
+		{ 0.0f, 0.0f, 0.0f },
+		{ 1.0f, 1.0f, 1.0f },
+		{ 0.0f, 0.0f, 0.0f, 1.0f },
+	};
+
+	// Exact, compaction must not change a pose. The zero rotation of a bone
+	// without a cluster gives the same matrix as the identity rotation.
+	bool IsIdentityKey(const Keyframe& key)
+	{
+		return key.Translation.x == 0.0f && key.Translation.y == 0.0f && key.Translation.z == 0.0f &&
+			key.Scale.x == 1.0f && key.Scale.y == 1.0f && key.Scale.z == 1.0f &&
+			key.RotationQuat.x == 0.0f && key.RotationQuat.y == 0.0f && key.RotationQuat.z == 0.0f &&
+			(key.RotationQuat.w == 0.0f || key.RotationQuat.w == 1.0f);
+	}
+
+	// Poses sampled per second for the swept clip bounds
+	const float kBoundsSampleRate = 60.0f;
+
+	// A contact bone this close to the lowest it gets in the clip is on the ground, in centimeters
+	const float kContactHeight = 5.0f;
+
+	// Bounds of a bone box moved by M, the center moved by M
+	// and the extents projected on the absolute axes of M
+	void TransformBox(const BoundingBox& box, FXMMATRIX M, XMVECTOR& outMin, XMVECTOR& outMax)
+	{
+		XMVECTOR center = XMLoadFloat3(&box.Center);
+		XMVECTOR extents = XMLoadFloat3(&box.Extents);
+
+		XMVECTOR newCenter = XMVectorMultiplyAdd(XMVectorSplatX(center), M.r[0], M.r[3]);
+		newCenter = XMVectorMultiplyAdd(XMVectorSplatY(center), M.r[1], newCenter);
+		newCenter = XMVectorMultiplyAdd(XMVectorSplatZ(center), M.r[2], newCenter);
+
+		XMVECTOR newExtents = XMVectorMultiply(XMVectorSplatX(extents), XMVectorAbs(M.r[0]));
+		newExtents = XMVectorMultiplyAdd(XMVectorSplatY(extents), XMVectorAbs(M.r[1]), newExtents);
+		newExtents = XMVectorMultiplyAdd(XMVectorSplatZ(extents), XMVectorAbs(M.r[2]), newExtents);
+
+		outMin = XMVectorSubtract(newCenter, newExtents);
+		outMax = XMVectorAdd(newCenter, newExtents);
+	}
+
+	void StoreBox(FXMVECTOR vMin, FXMVECTOR vMax, BoundingBox& outBox)
+	{
+		XMStoreFloat3(&outBox.Center, XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f));
+		XMStoreFloat3(&outBox.Extents, XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f));
+	}
+
+	// Frustum planes in the model space of a world matrix, so the boxes are tested
+	// as they are. A plane keeps the points the world matrix takes to its side,
+	// also for the flattening shadow matrices that have no inverse.
+	void GetModelPlanes(const BoundingFrustum& frustum, FXMMATRIX world, XMVECTOR* outPlanes)
+	{
+		frustum.GetPlanes(&outPlanes[0], &outPlanes[1], &outPlanes[2], &outPlanes[3], &outPlanes[4], &outPlanes[5]);
+
+		XMMATRIX toModel = XMMatrixTranspose(world);
+		for (int i = 0; i < 6; ++i)
+		{
+			outPlanes[i] = XMVector4Transform(outPlanes[i], toModel);
+		}
+	}
+
+	ContainmentType ContainedBy(const BoundingBox& box, const XMVECTOR* planes)
+	{
+		return box.ContainedBy(planes[0], planes[1], planes[2], planes[3], planes[4], planes[5]);
+	}
+}
+
 Keyframe::Keyframe()
 	: TimePos(0.0f),
 	Translation(0.0f, 0.0f, 0.0f),
@@ -17,25 +96,27 @@ Keyframe::~Keyframe()
 float BoneAnimation::GetStartTime()const
 {
 	// Keyframes are sorted by time, so first keyframe gives start time.
-	return Keyframes.front().TimePos;
+	return Keyframes.empty() ? 0.0f : Keyframes.front().TimePos;
 }
 float BoneAnimation::GetEndTime()const
 {
 	// Keyframes are sorted by time, so last keyframe gives end time.
-	float f = Keyframes.back().TimePos;
+	float f = Keyframes.empty() ? 0.0f : Keyframes.back().TimePos;
 
 	return f;
 }
 float AnimationClip::GetClipStartTime()const
 {
 	// Find smallest start time over all bones in this clip.
+	// A compacted track has no time span of its own.
 	float t = MathHelper::Infinity;
 	for (UINT i = 0; i < BoneAnimations.size(); ++i)
 	{
-		t = MathHelper::Min(t, BoneAnimations[i].GetStartTime());
+		if (BoneAnimations[i].Kind == eTrackKind::Animated)
+			t = MathHelper::Min(t, BoneAnimations[i].GetStartTime());
 	}
 
-	return t;
+	return t == MathHelper::Infinity ? 0.0f : t;
 }
 float AnimationClip::GetClipEndTime()const
 {
@@ -43,20 +124,38 @@ float AnimationClip::GetClipEndTime()const
 	float t = 0.0f;
 	for (UINT i = 0; i < BoneAnimations.size(); ++i)
 	{
-		t = MathHelper::Max(t, BoneAnimations[i].GetEndTime());
+		if (BoneAnimations[i].Kind == eTrackKind::Animated)
+			t = MathHelper::Max(t, BoneAnimations[i].GetEndTime());
 	}
 
 	return t;
 }
 float SkinnedData::GetClipStartTime(const std::string& clipName)const
 {
-	auto clip = mAnimations.find(clipName);
-	return clip->second.GetClipStartTime();
+	ClipHandle clip = GetClipHandle(clipName);
+	assert(clip != kInvalidClip);
+	return clip != kInvalidClip ? mClipStartTimes[clip] : 0.0f;
+}
+float SkinnedData::GetClipStartTime(ClipHandle clip)const
+{
+	return mClipStartTimes[clip];
 }
 float SkinnedData::GetClipEndTime(const std::string& clipName)const
 {
-	auto clip = mAnimations.find(clipName);
-	return clip->second.GetClipEndTime();
+	ClipHandle clip = GetClipHandle(clipName);
+	assert(clip != kInvalidClip);
+	return clip != kInvalidClip ? mClipEndTimes[clip] : 0.0f;
+}
+float SkinnedData::GetClipEndTime(ClipHandle clip)const
+{
+	return mClipEndTimes[clip];
+}
+ClipHandle SkinnedData::GetClipHandle(const std::string& clipName)const
+{
+	auto clip = mClipHandles.find(clipName);
+	if (clip == mClipHandles.end())
+		return kInvalidClip;
+	return clip->second;
 }
 std::string SkinnedData::GetAnimationName(int num) const
 {
@@ -66,99 +165,516 @@ UINT SkinnedData::BoneCount()const
 {
 	return (UINT)mBoneHierarchy.size();
 }
-std::vector<std::string> SkinnedData::GetBoneName() const
+const std::vector<std::string>& SkinnedData::GetBoneName() const
 {
 	return mBoneName;
 }
-std::vector<int> SkinnedData::GetBoneHierarchy() const
+const std::vector<int>& SkinnedData::GetBoneHierarchy() const
 {
 	return mBoneHierarchy;
 }
-std::vector<DirectX::XMFLOAT4X4> SkinnedData::GetBoneOffsets() const
+const std::vector<DirectX::XMFLOAT4X4>& SkinnedData::GetBoneOffsets() const
 {
 	return mBoneOffsets;
 }
-AnimationClip SkinnedData::GetAnimation(std::string clipName) const
+const AnimationClip& SkinnedData::GetAnimation(const std::string& clipName) const
+{
+	// An unknown name gets a clip with no tracks
+	static const AnimationClip kEmptyClip;
+
+	ClipHandle clip = GetClipHandle(clipName);
+	assert(clip != kInvalidClip);
+	return clip != kInvalidClip ? mClips[clip] : kEmptyClip;
+}
+const AnimationClip& SkinnedData::GetAnimation(ClipHandle clip) const
 {
-	return mAnimations.find(clipName)->second;
+	return mClips[clip];
 }
-std::vector<int> SkinnedData::GetSubmeshOffset() const
+const std::vector<int>& SkinnedData::GetSubmeshOffset() const
 {
 	return mSubmeshOffset;
 }
+const std::vector<BoundingBox>& SkinnedData::GetBoneBounds() const
+{
+	return mBoneBounds;
+}
 
 void BoneAnimation::Interpolate(float t, XMFLOAT4X4& M) const
 {
-	if (t <= Keyframes.front().TimePos)
-	{
-		XMVECTOR S = XMLoadFloat3(&Keyframes.front().Scale);
-		XMVECTOR P = XMLoadFloat3(&Keyframes.front().Translation);
-		XMVECTOR Q = XMLoadFloat4(&Keyframes.front().RotationQuat);
+	UINT keyCursor = 0;
+	Interpolate(t, M, keyCursor);
+}
+void BoneAnimation::Interpolate(float t, XMFLOAT4X4& M, UINT& keyCursor) const
+{
+	BoneTransform bone;
+	Sample(t, bone, keyCursor);
+
+	XMVECTOR S = XMLoadFloat3(&bone.Scale);
+	XMVECTOR P = XMLoadFloat3(&bone.Translation);
+	XMVECTOR Q = XMLoadFloat4(&bone.RotationQuat);
 
-		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+	XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+}
+void BoneAnimation::Sample(float t, BoneTransform& out, UINT& keyCursor) const
+{
+	if (Kind == eTrackKind::Identity)
+	{
+		out = kIdentityBone;
+	}
+	else if (Kind == eTrackKind::Constant || t <= Keyframes.front().TimePos)
+	{
+		out.Translation = Keyframes.front().Translation;
+		out.Scale = Keyframes.front().Scale;
+		out.RotationQuat = Keyframes.front().RotationQuat;
 	}
 	else if (t >= Keyframes.back().TimePos)
 	{
-		XMVECTOR S = XMLoadFloat3(&Keyframes.back().Scale);
-		XMVECTOR P = XMLoadFloat3(&Keyframes.back().Translation);
-		XMVECTOR Q = XMLoadFloat4(&Keyframes.back().RotationQuat);
+		out.Translation = Keyframes.back().Translation;
+		out.Scale = Keyframes.back().Scale;
+		out.RotationQuat = Keyframes.back().RotationQuat;
+	}
+	else
+	{
+		UINT i = FindKey(t, keyCursor);
+
+		float lerpPercent = (t - Keyframes[i].TimePos) / (Keyframes[i + 1].TimePos - Keyframes[i].TimePos);
+
+		XMVECTOR s0 = XMLoadFloat3(&Keyframes[i].Scale);
+		XMVECTOR s1 = XMLoadFloat3(&Keyframes[i + 1].Scale);
+
+		XMVECTOR p0 = XMLoadFloat3(&Keyframes[i].Translation);
+		XMVECTOR p1 = XMLoadFloat3(&Keyframes[i + 1].Translation);
+
+		XMVECTOR q0 = XMLoadFloat4(&Keyframes[i].RotationQuat);
+		XMVECTOR q1 = XMLoadFloat4(&Keyframes[i + 1].RotationQuat);
 
-		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+		XMStoreFloat3(&out.Scale, XMVectorLerp(s0, s1, lerpPercent));
+		XMStoreFloat3(&out.Translation, XMVectorLerp(p0, p1, lerpPercent));
+		XMStoreFloat4(&out.RotationQuat, XMQuaternionSlerp(q0, q1, lerpPercent));
+	}
+}
+UINT BoneAnimation::FindKey(float t, UINT& keyCursor) const
+{
+	const UINT lastInterval = (UINT)Keyframes.size() - 2;
+
+	UINT i;
+	if (SampleInterval > 0.0f)
+	{
+		// Uniform keys: the interval comes straight from the time,
+		// rounding can leave it one off at the boundaries
+		i = (std::min)((UINT)((t - Keyframes.front().TimePos) / SampleInterval), lastInterval);
+		if (i > 0 && t < Keyframes[i].TimePos)
+			--i;
+		else if (i < lastInterval && t > Keyframes[i + 1].TimePos)
+			++i;
+	}
+	else if (keyCursor <= lastInterval && Keyframes[keyCursor].TimePos <= t &&
+		(keyCursor == lastInterval || t <= Keyframes[keyCursor + 2].TimePos))
+	{
+		// Playback moves at most one key per frame
+		i = t <= Keyframes[keyCursor + 1].TimePos ? keyCursor : keyCursor + 1;
 	}
 	else
 	{
-		for (UINT i = 0; i < Keyframes.size() - 1; ++i)
-		{
-			if (t >= Keyframes[i].TimePos && t <= Keyframes[i + 1].TimePos)
-			{
-				float lerpPercent = (t - Keyframes[i].TimePos) / (Keyframes[i + 1].TimePos - Keyframes[i].TimePos);
+		// Seek: the last key at or before t
+		auto key = std::upper_bound(Keyframes.begin(), Keyframes.end(), t,
+			[](float time, const Keyframe& k) { return time < k.TimePos; });
+		i = (std::min)((UINT)(key - Keyframes.begin()) - 1, lastInterval);
+	}
 
-				XMVECTOR s0 = XMLoadFloat3(&Keyframes[i].Scale);
-				XMVECTOR s1 = XMLoadFloat3(&Keyframes[i + 1].Scale);
+	keyCursor = i;
+	return i;
+}
+void BoneAnimation::UpdateSampling()
+{
+	SampleInterval = 0.0f;
+	if (Keyframes.size() < 2)
+		return;
 
-				XMVECTOR p0 = XMLoadFloat3(&Keyframes[i].Translation);
-				XMVECTOR p1 = XMLoadFloat3(&Keyframes[i + 1].Translation);
+	float interval = (Keyframes.back().TimePos - Keyframes.front().TimePos) / (Keyframes.size() - 1);
+	if (interval <= 0.0f)
+		return;
 
-				XMVECTOR q0 = XMLoadFloat4(&Keyframes[i].RotationQuat);
-				XMVECTOR q1 = XMLoadFloat4(&Keyframes[i + 1].RotationQuat);
+	for (UINT i = 0; i + 1 < Keyframes.size(); ++i)
+	{
+		float step = Keyframes[i + 1].TimePos - Keyframes[i].TimePos;
+		if (fabsf(step - interval) > 1e-3f * interval)
+			return;
+	}
+	SampleInterval = interval;
+}
+void BoneAnimation::Compact()
+{
+	if (Kind != eTrackKind::Animated)
+		return;
 
-				XMVECTOR S = XMVectorLerp(s0, s1, lerpPercent);
-				XMVECTOR P = XMVectorLerp(p0, p1, lerpPercent);
-				XMVECTOR Q = XMQuaternionSlerp(q0, q1, lerpPercent);
+	for (UINT i = 1; i < Keyframes.size(); ++i)
+	{
+		if (!(Keyframes[i] == Keyframes.front()))
+			return;
+	}
+
+	if (Keyframes.empty() || IsIdentityKey(Keyframes.front()))
+	{
+		Kind = eTrackKind::Identity;
+		Keyframes.clear();
+	}
+	else
+	{
+		Kind = eTrackKind::Constant;
+		Keyframes.resize(1);
+	}
+	Keyframes.shrink_to_fit();
+	SampleInterval = 0.0f;
+}
+void AnimationClip::Interpolate(float t, std::vector<XMFLOAT4X4>& boneTransforms, std::vector<UINT>* keyCursors,
+	const std::vector<UINT>* bones)const
+{
+	if (keyCursors != nullptr)
+		keyCursors->resize(BoneAnimations.size(), 0);
 
-				XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-				XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+	UINT boneCount = bones != nullptr ? (UINT)bones->size() : (UINT)BoneAnimations.size();
+	for (UINT k = 0; k < boneCount; ++k)
+	{
+		UINT i = bones != nullptr ? (*bones)[k] : k;
+		if (keyCursors == nullptr)
+			BoneAnimations[i].Interpolate(t, boneTransforms[i]);
+		else
+			BoneAnimations[i].Interpolate(t, boneTransforms[i], (*keyCursors)[i]);
+	}
+}
+void AnimationClip::Sample(float t, std::vector<BoneTransform>& bonePose, std::vector<UINT>* keyCursors,
+	const std::vector<UINT>* bones)const
+{
+	if (keyCursors != nullptr)
+		keyCursors->resize(BoneAnimations.size(), 0);
 
-				break;
+	UINT boneCount = bones != nullptr ? (UINT)bones->size() : (UINT)BoneAnimations.size();
+	for (UINT k = 0; k < boneCount; ++k)
+	{
+		UINT i = bones != nullptr ? (*bones)[k] : k;
+		UINT keyCursor = 0;
+		BoneAnimations[i].Sample(t, bonePose[i], keyCursors != nullptr ? (*keyCursors)[i] : keyCursor);
+	}
+}
+void AnimationClip::UpdateSampling()
+{
+	for (auto& e : BoneAnimations)
+	{
+		e.UpdateSampling();
+	}
+}
+void AnimationClip::Compact()
+{
+	for (auto& e : BoneAnimations)
+	{
+		e.Compact();
+	}
+}
+UINT AnimationClip::GetKeyCount() const
+{
+	UINT keyCount = 0;
+	for (const auto& e : BoneAnimations)
+	{
+		keyCount += (UINT)e.Keyframes.size();
+	}
+	return keyCount;
+}
+bool AnimationClip::ExtractRootMotion(const std::vector<UINT>& contactBones, RootMotionTrack& outTrack)
+{
+	outTrack.Times.clear();
+	outTrack.Displacements.clear();
+	if (BoneAnimations.empty() || BoneAnimations[0].Kind != eTrackKind::Animated || BoneAnimations[0].Keyframes.size() < 2)
+		return false;
+
+	// The root offset is taken out of every bone key by key
+	const std::vector<Keyframe>& rootKeys = BoneAnimations[0].Keyframes;
+	UINT keyCount = (UINT)rootKeys.size();
+	for (const auto& track : BoneAnimations)
+	{
+		if (track.Kind != eTrackKind::Animated)
+			continue;
+		if (track.Keyframes.size() != keyCount)
+			return false;
+		for (UINT k = 0; k < keyCount; ++k)
+		{
+			if (track.Keyframes[k].TimePos != rootKeys[k].TimePos)
+				return false;
+		}
+	}
+	for (UINT bone : contactBones)
+	{
+		if (bone >= BoneAnimations.size() || BoneAnimations[bone].Kind == eTrackKind::Identity)
+			return false;
+	}
+
+	// A constant track moves with the root once it is taken out
+	for (auto& track : BoneAnimations)
+	{
+		if (track.Kind != eTrackKind::Constant)
+			continue;
+		Keyframe key = track.Keyframes.front();
+		track.Keyframes.resize(keyCount);
+		for (UINT k = 0; k < keyCount; ++k)
+		{
+			track.Keyframes[k] = key;
+			track.Keyframes[k].TimePos = rootKeys[k].TimePos;
+		}
+		track.Kind = eTrackKind::Animated;
+	}
+
+	// Keys are model space with y up
+	float groundHeight = MathHelper::Infinity;
+	for (UINT bone : contactBones)
+	{
+		for (const auto& key : BoneAnimations[bone].Keyframes)
+			groundHeight = (std::min)(groundHeight, key.Translation.y);
+	}
+
+	outTrack.Times.resize(keyCount);
+	outTrack.Displacements.resize(keyCount);
+	std::vector<XMFLOAT2> rootOffsets(keyCount);
+	XMFLOAT2 slide(0.0f, 0.0f);
+	for (UINT k = 0; k < keyCount; ++k)
+	{
+		// Over each interval the lowest contact bone near the ground is planted,
+		// the character goes as far as it slides back
+		if (k > 0)
+		{
+			int planted = -1;
+			float plantedHeight = groundHeight + kContactHeight;
+			for (UINT bone : contactBones)
+			{
+				const auto& keys = BoneAnimations[bone].Keyframes;
+				float height = 0.5f * (keys[k - 1].Translation.y + keys[k].Translation.y);
+				if (height <= plantedHeight)
+				{
+					planted = (int)bone;
+					plantedHeight = height;
+				}
+			}
+			if (planted >= 0)
+			{
+				const auto& keys = BoneAnimations[planted].Keyframes;
+				slide.x -= keys[k].Translation.x - keys[k - 1].Translation.x;
+				slide.y -= keys[k].Translation.z - keys[k - 1].Translation.z;
 			}
 		}
+
+		rootOffsets[k] = XMFLOAT2(rootKeys[k].Translation.x - rootKeys[0].Translation.x, rootKeys[k].Translation.z - rootKeys[0].Translation.z);
+		outTrack.Times[k] = rootKeys[k].TimePos;
+		outTrack.Displacements[k] = XMFLOAT2((rootOffsets[k].x + slide.x) * kModelScale, (rootOffsets[k].y + slide.y) * kModelScale);
+	}
+
+	// The pose keeps the root above its first key, the track carries the rest
+	for (auto& track : BoneAnimations)
+	{
+		if (track.Kind != eTrackKind::Animated)
+			continue;
+		for (UINT k = 0; k < keyCount; ++k)
+		{
+			track.Keyframes[k].Translation.x -= rootOffsets[k].x;
+			track.Keyframes[k].Translation.z -= rootOffsets[k].y;
+		}
 	}
+	return true;
 }
-void AnimationClip::Interpolate(float t, std::vector<XMFLOAT4X4>& boneTransforms)const
+
+XMFLOAT2 RootMotionTrack::Sample(float t) const
 {
-	for (UINT i = 0; i < BoneAnimations.size(); ++i)
+	if (Times.empty())
+		return XMFLOAT2(0.0f, 0.0f);
+	if (t <= Times.front())
+		return Displacements.front();
+	if (t >= Times.back())
+		return Displacements.back();
+
+	UINT key = (UINT)(std::upper_bound(Times.begin(), Times.end(), t) - Times.begin()) - 1;
+	float s = (t - Times[key]) / (Times[key + 1] - Times[key]);
+	XMFLOAT2 displacement;
+	XMStoreFloat2(&displacement, XMVectorLerp(XMLoadFloat2(&Displacements[key]), XMLoadFloat2(&Displacements[key + 1]), s));
+	return displacement;
+}
+XMFLOAT2 RootMotionTrack::GetDelta(float from, float to) const
+{
+	XMFLOAT2 start = Sample(from);
+	XMFLOAT2 end = Sample(to);
+	XMFLOAT2 delta(end.x - start.x, end.y - start.y);
+	if (to < from && !Displacements.empty())
 	{
-		BoneAnimations[i].Interpolate(t, boneTransforms[i]);
+		delta.x += Displacements.back().x - Displacements.front().x;
+		delta.y += Displacements.back().y - Displacements.front().y;
 	}
+	return delta;
+}
+size_t RootMotionTrack::GetMemorySize() const
+{
+	return Times.capacity() * sizeof(float) + Displacements.capacity() * sizeof(XMFLOAT2);
 }
 
-void SkinnedData::Set(
+bool SkinnedData::Set(
 	std::vector<int>& boneHierarchy,
 	std::vector<XMFLOAT4X4>& boneOffsets,
 	std::unordered_map<std::string, AnimationClip>* animations)
 {
+	// The bone LODs, masks and retargeting visit the parents first in one pass
+	for (size_t i = 0; i < boneHierarchy.size(); ++i)
+	{
+		if (boneHierarchy[i] >= (int)i)
+			return false;
+	}
+
 	mBoneHierarchy = boneHierarchy;
 	mBoneOffsets = boneOffsets;
+
+	mBoneToModel.resize(mBoneOffsets.size());
+	mScaledOffsets.resize(mBoneOffsets.size());
+	for (size_t i = 0; i < mBoneOffsets.size(); ++i)
+	{
+		XMMATRIX offset = XMLoadFloat4x4(&mBoneOffsets[i]);
+		XMStoreFloat4x4(&mBoneToModel[i], XMMatrixInverse(nullptr, offset));
+		XMStoreFloat4x4(&mScaledOffsets[i], offset * kModelScale);
+	}
+
+	BuildBoneLods();
+
 	if (animations != nullptr)
 	{
-		mAnimations = (*animations);
+		mClips.clear();
+		mClipStartTimes.clear();
+		mClipEndTimes.clear();
+		mClipHandles.clear();
+		mPoseEvaluators.clear();
+		mClipBoneBounds.clear();
+		mClipBounds.clear();
+		mRootMotions.clear();
+		mRootMotionContacts.clear();
+		for (auto& e : *animations)
+		{
+			SetAnimation(e.second, e.first);
+		}
+	}
+	else
+	{
+		BuildClipBounds();
 	}
+	return true;
 }
 void SkinnedData::SetAnimation(AnimationClip inAnimation, std::string ClipName)
 {
-	mAnimations[ClipName] = inAnimation;
+	// A clip loaded again keeps its handle
+	ClipHandle clip = GetClipHandle(ClipName);
+	if (clip == kInvalidClip)
+	{
+		clip = (ClipHandle)mClips.size();
+		mClipHandles[ClipName] = clip;
+		mClips.emplace_back();
+		mClipStartTimes.push_back(0.0f);
+		mClipEndTimes.push_back(0.0f);
+		mPoseEvaluators.emplace_back();
+		mClipBoneBounds.emplace_back();
+		mClipBounds.emplace_back();
+		mRootMotions.emplace_back();
+		mRootMotionContacts.emplace_back();
+	}
+
+	SetClip(clip, std::move(inAnimation));
+	mRootMotions[clip] = RootMotionTrack();
+	mRootMotionContacts[clip].clear();
+}
+void SkinnedData::SetClip(ClipHandle clip, AnimationClip animation)
+{
+	animation.UpdateSampling();
+	animation.Compact();
+
+	mClips[clip] = std::move(animation);
+	mClipStartTimes[clip] = mClips[clip].GetClipStartTime();
+	mClipEndTimes[clip] = mClips[clip].GetClipEndTime();
+	BuildPoseEvaluator(clip);
+	BuildClipBounds(clip);
+}
+void SkinnedData::BuildPoseEvaluator(ClipHandle clip)
+{
+	auto evaluator = std::make_shared<PoseEvaluator>();
+	if (evaluator->Build(mClips[clip]))
+		mPoseEvaluators[clip] = evaluator;
+	else
+		mPoseEvaluators[clip] = nullptr;
+}
+void SkinnedData::BuildBoneLods()
+{
+	UINT numBones = (UINT)mBoneHierarchy.size();
+
+	std::vector<UINT> childCount(numBones, 0);
+	for (UINT i = 1; i < numBones; ++i)
+	{
+		childCount[mBoneHierarchy[i]]++;
+	}
+
+	// Parents precede their children, so one pass sees every ancestor first
+	std::vector<BYTE> isFinger(numBones, 0);
+	for (UINT i = 1; i < numBones; ++i)
+	{
+		int parent = mBoneHierarchy[i];
+		isFinger[i] = isFinger[parent] || childCount[parent] >= kHandChildCount;
+	}
+
+	mBoneLods.resize(2);
+	for (UINT lod = 0; lod < mBoneLods.size(); ++lod)
+	{
+		BoneLod& boneLod = mBoneLods[lod];
+		boneLod.Source.resize(numBones);
+		boneLod.Bones.clear();
+		boneLod.GroupMask.assign((numBones + 3) / 4, 0);
+
+		for (UINT i = 0; i < numBones; ++i)
+		{
+			bool isEvaluated = lod == 0 || i == 0 || (childCount[i] > 0 && !isFinger[i]);
+			if (isEvaluated)
+			{
+				boneLod.Source[i] = (int)i;
+				boneLod.Bones.push_back(i);
+				boneLod.GroupMask[i / 4] = 1;
+			}
+			else
+			{
+				boneLod.Source[i] = boneLod.Source[mBoneHierarchy[i]];
+			}
+		}
+	}
+}
+bool SkinnedData::BuildBoneMask(const std::string& rootBoneName, BoneMask& outMask) const
+{
+	auto root = std::find(mBoneName.begin(), mBoneName.end(), rootBoneName);
+	if (root == mBoneName.end())
+		return false;
+
+	UINT numBones = (UINT)mBoneHierarchy.size();
+	UINT rootBone = (UINT)(root - mBoneName.begin());
+
+	// Parents precede their children, so one pass finds the whole subtree
+	std::vector<BYTE> isMasked(numBones, 0);
+	outMask.Bones.clear();
+	for (UINT i = rootBone; i < numBones; ++i)
+	{
+		isMasked[i] = i == rootBone || (mBoneHierarchy[i] >= 0 && isMasked[mBoneHierarchy[i]]);
+		if (isMasked[i])
+			outMask.Bones.push_back(i);
+	}
+
+	// The parent places the root of the mask in the layer clip
+	outMask.SampledBones.clear();
+	if (mBoneHierarchy[rootBone] >= 0)
+		outMask.SampledBones.push_back(mBoneHierarchy[rootBone]);
+	outMask.SampledBones.insert(outMask.SampledBones.end(), outMask.Bones.begin(), outMask.Bones.end());
+
+	outMask.GroupMask.assign((numBones + 3) / 4, 0);
+	for (UINT i : outMask.SampledBones)
+	{
+		outMask.GroupMask[i / 4] = 1;
+	}
+	return true;
 }
 void SkinnedData::SetAnimationName(const std::string & clipName)
 {
@@ -170,15 +686,238 @@ void SkinnedData::SetSubmeshOffset(int num)
 {
 	mSubmeshOffset.push_back(num);
 }
+void SkinnedData::SetBoneBounds(const std::vector<BoundingBox>& boneBounds)
+{
+	mBoneBounds = boneBounds;
+	BuildClipBounds();
+}
+bool SkinnedData::ExtractRootMotion(ClipHandle clip, const std::vector<std::string>& contactBoneNames)
+{
+	if (clip == kInvalidClip || (size_t)clip >= mClips.size())
+		return false;
+
+	std::vector<UINT> contactBones;
+	for (auto& e : contactBoneNames)
+	{
+		auto bone = std::find(mBoneName.begin(), mBoneName.end(), e);
+		if (bone == mBoneName.end())
+			return false;
+		contactBones.push_back((UINT)(bone - mBoneName.begin()));
+	}
+
+	// Once only, the root of an extracted clip is already in place
+	if (GetRootMotion(clip) != nullptr)
+		return false;
+
+	// Extracted from a copy, so a clip that does not qualify is left as it was
+	AnimationClip animation = mClips[clip];
+	RootMotionTrack rootMotion;
+	if (!animation.ExtractRootMotion(contactBones, rootMotion))
+		return false;
+
+	SetClip(clip, std::move(animation));
+	mRootMotions[clip] = std::move(rootMotion);
+	mRootMotionContacts[clip] = contactBones;
+	return true;
+}
+const RootMotionTrack* SkinnedData::GetRootMotion(ClipHandle clip) const
+{
+	return mRootMotions[clip].Times.empty() ? nullptr : &mRootMotions[clip];
+}
+size_t SkinnedData::GetClipMemorySize(ClipHandle clip)const
+{
+	size_t size = 0;
+	for (auto& e : mClips[clip].BoneAnimations)
+		size += e.Keyframes.capacity() * sizeof(Keyframe);
+	size += mClips[clip].BoneAnimations.capacity() * sizeof(BoneAnimation);
+	if (mPoseEvaluators[clip] != nullptr)
+		size += mPoseEvaluators[clip]->GetMemorySize();
+	return size;
+}
+void SkinnedData::EvictClip(ClipHandle clip)
+{
+	mClips[clip] = AnimationClip();
+	mPoseEvaluators[clip] = nullptr;
+}
+void SkinnedData::RestoreClip(ClipHandle clip, AnimationClip animation)
+{
+	// The same steps as SetAnimation and ExtractRootMotion, so the times and bounds still hold
+	animation.UpdateSampling();
+	animation.Compact();
+	if (!mRootMotionContacts[clip].empty())
+	{
+		RootMotionTrack rootMotion;
+		animation.ExtractRootMotion(mRootMotionContacts[clip], rootMotion);
+		animation.UpdateSampling();
+		animation.Compact();
+	}
+
+	mClips[clip] = std::move(animation);
+	BuildPoseEvaluator(clip);
+}
+void SkinnedData::BuildClipBounds()
+{
+	for (ClipHandle clip = 0; clip < (ClipHandle)mClips.size(); ++clip)
+	{
+		BuildClipBounds(clip);
+	}
+}
+void SkinnedData::BuildClipBounds(ClipHandle clip)
+{
+	// An evicted clip keeps the bounds built from its keys
+	if (!IsClipResident(clip))
+		return;
+
+	UINT numBones = BoneCount();
+	mClipBoneBounds[clip].clear();
+	mClipBounds[clip] = BoundingBox();
+	// The loader may set the bounds before the skeleton, they are built once both are there
+	if (numBones == 0 || mBoneBounds.size() != numBones || mBoneToModel.size() != numBones)
+		return;
+
+	// The boxes of the poses sampled through the clip, padded by the farthest
+	// a box moves between two samples for the poses in between
+	float startTime = mClipStartTimes[clip];
+	float endTime = mClipEndTimes[clip];
+	UINT sampleCount = (UINT)ceilf((endTime - startTime) * kBoundsSampleRate) + 1;
+
+	std::vector<XMFLOAT4X4> palettes(numBones);
+	std::vector<XMFLOAT3> boneMin(numBones, XMFLOAT3(MathHelper::Infinity, MathHelper::Infinity, MathHelper::Infinity));
+	std::vector<XMFLOAT3> boneMax(numBones, XMFLOAT3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity));
+	std::vector<XMFLOAT3> prevCenters(numBones);
+	std::vector<float> padding(numBones, 0.0f);
+	for (UINT s = 0; s < sampleCount; ++s)
+	{
+		float timePos = (std::min)(startTime + s / kBoundsSampleRate, endTime);
+		GetFinalTransforms(clip, timePos, palettes);
+
+		for (UINT i = 0; i < numBones; ++i)
+		{
+			if (mBoneBounds[i].Extents.x < 0.0f)
+				continue;
+
+			XMMATRIX M = XMMatrixMultiply(XMLoadFloat4x4(&mBoneToModel[i]), XMMatrixTranspose(XMLoadFloat4x4(&palettes[i])));
+			XMVECTOR vMin, vMax;
+			TransformBox(mBoneBounds[i], M, vMin, vMax);
+			XMStoreFloat3(&boneMin[i], XMVectorMin(XMLoadFloat3(&boneMin[i]), vMin));
+			XMStoreFloat3(&boneMax[i], XMVectorMax(XMLoadFloat3(&boneMax[i]), vMax));
+
+			XMVECTOR center = XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f);
+			if (s > 0)
+			{
+				float moved = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, XMLoadFloat3(&prevCenters[i]))));
+				padding[i] = (std::max)(padding[i], moved);
+			}
+			XMStoreFloat3(&prevCenters[i], center);
+		}
+	}
+
+	auto& clipBoneBounds = mClipBoneBounds[clip];
+	clipBoneBounds.resize(numBones, BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(-1.0f, -1.0f, -1.0f)));
+	XMVECTOR clipMin = XMVectorReplicate(MathHelper::Infinity);
+	XMVECTOR clipMax = XMVectorReplicate(-MathHelper::Infinity);
+	for (UINT i = 0; i < numBones; ++i)
+	{
+		if (mBoneBounds[i].Extents.x < 0.0f)
+			continue;
+
+		XMVECTOR pad = XMVectorReplicate(padding[i]);
+		XMVECTOR vMin = XMVectorSubtract(XMLoadFloat3(&boneMin[i]), pad);
+		XMVECTOR vMax = XMVectorAdd(XMLoadFloat3(&boneMax[i]), pad);
+		StoreBox(vMin, vMax, clipBoneBounds[i]);
+		clipMin = XMVectorMin(clipMin, vMin);
+		clipMax = XMVectorMax(clipMax, vMax);
+	}
+
+	if (XMVector3LessOrEqual(clipMin, clipMax))
+		StoreBox(clipMin, clipMax, mClipBounds[clip]);
+	else
+		clipBoneBounds.clear();
+}
+DirectX::ContainmentType SkinnedData::GetVisibleBones(ClipHandle clip, UINT boneLod,
+	const BoundingFrustum& frustum, const XMMATRIX* worlds, UINT worldCount, BoneLod& outBones)const
+{
+	// Nothing to cull with
+	const auto& clipBoneBounds = mClipBoneBounds[clip];
+	if (clipBoneBounds.empty())
+		return CONTAINS;
+
+	// Most of a crowd is all in or all out, the whole clip decides
+	XMVECTOR planes[6];
+	ContainmentType containment = DISJOINT;
+	for (UINT w = 0; w < worldCount; ++w)
+	{
+		GetModelPlanes(frustum, worlds[w], planes);
+		containment = (std::max)(containment, ContainedBy(mClipBounds[clip], planes));
+	}
+	if (containment != INTERSECTS)
+		return containment;
+
+	// Source is -1 for the bones not seen yet
+	UINT numBones = BoneCount();
+	outBones.Source.assign(numBones, -1);
+	for (UINT w = 0; w < worldCount; ++w)
+	{
+		GetModelPlanes(frustum, worlds[w], planes);
+		for (UINT i = 0; i < numBones; ++i)
+		{
+			if (outBones.Source[i] < 0 && clipBoneBounds[i].Extents.x >= 0.0f &&
+				ContainedBy(clipBoneBounds[i], planes) != DISJOINT)
+				outBones.Source[i] = (int)i;
+		}
+	}
+
+	// A visible bone the LOD leaves out is copied from its evaluated ancestor
+	const BoneLod* lod = (boneLod > 0 && boneLod < mBoneLods.size()) ? &mBoneLods[boneLod] : nullptr;
+	outBones.Bones.clear();
+	for (UINT i = 0; i < numBones; ++i)
+	{
+		if (outBones.Source[i] < 0)
+		{
+			outBones.Source[i] = (int)i;
+			continue;
+		}
+
+		int source = lod != nullptr ? lod->Source[i] : (int)i;
+		outBones.Source[i] = source;
+		outBones.Bones.push_back((UINT)source);
+	}
+
+	// The sources come before their bones, a few of them repeated
+	std::sort(outBones.Bones.begin(), outBones.Bones.end());
+	outBones.Bones.erase(std::unique(outBones.Bones.begin(), outBones.Bones.end()), outBones.Bones.end());
+	if (outBones.Bones.empty())
+		return DISJOINT;
+
+	outBones.GroupMask.assign((numBones + 3) / 4, 0);
+	for (UINT bone : outBones.Bones)
+	{
+		outBones.GroupMask[bone / 4] = 1;
+	}
+	return INTERSECTS;
+}
 
 void SkinnedData::clear()
 {
 	mBoneName.clear();
 	mBoneHierarchy.clear();
 	mBoneOffsets.clear();
+	mScaledOffsets.clear();
+	mBoneBounds.clear();
+	mBoneToModel.clear();
+	mBoneLods.clear();
 	mAnimationName.clear();
-	mAnimations.clear();
+	mClips.clear();
+	mClipStartTimes.clear();
+	mClipEndTimes.clear();
+	mClipHandles.clear();
+	mPoseEvaluators.clear();
+	mClipBoneBounds.clear();
+	mClipBounds.clear();
+	mRootMotions.clear();
+	mRootMotionContacts.clear();
 	mSubmeshOffset.clear();
+	mPaletteFormat = ePaletteFormat::Affine3x4;
 }
 //
 //void printMatrix(const std::wstring& Name, const float& i, const DirectX::XMMATRIX &M)
@@ -201,57 +940,269 @@ void SkinnedData::clear()
 //	}
 //}
 
-void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos, std::vector<XMFLOAT4X4>& finalTransforms)const
+void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos, std::vector<XMFLOAT4X4>& finalTransforms, std::vector<UINT>* keyCursors)const
 {
-	UINT numBones = (UINT)mBoneOffsets.size();
-
-	std::vector<XMFLOAT4X4> toParentTransforms(numBones);
+	// An unknown name leaves the transforms as they were
+	ClipHandle clip = GetClipHandle(clipName);
+	assert(clip != kInvalidClip);
+	if (clip == kInvalidClip)
+		return;
+	GetFinalTransforms(clip, timePos, finalTransforms, keyCursors);
+}
 
-	// Interpolate all the bones of this clip at the given time instance.
-	auto clip = mAnimations.find(clipName);
-	clip->second.Interpolate(timePos, toParentTransforms);
+void SkinnedData::GetFinalTransforms(ClipHandle clip, float timePos, std::vector<XMFLOAT4X4>& finalTransforms, std::vector<UINT>* keyCursors, UINT boneLod)const
+{
+	const BoneLod* lod = (boneLod > 0 && boneLod < mBoneLods.size()) ? &mBoneLods[boneLod] : nullptr;
+	EvaluateFinalTransforms(clip, timePos, finalTransforms, keyCursors, lod);
+}
 
-	//
-	// Traverse the hierarchy and transform all the bones to the root space.
-	//
-	std::vector<XMFLOAT4X4> toRootTransforms(numBones);
+void SkinnedData::GetFinalTransforms(ClipHandle clip, float timePos, std::vector<XMFLOAT4X4>& finalTransforms, std::vector<UINT>* keyCursors, const BoneLod& bones)const
+{
+	EvaluateFinalTransforms(clip, timePos, finalTransforms, keyCursors, &bones);
+}
 
-	// The root bone has index 0.  The root bone has no parent, so its toRootTransform
-	// is just its local bone transform.
-	toRootTransforms[0] = toParentTransforms[0];
+void SkinnedData::EvaluateFinalTransforms(ClipHandle clip, float timePos, std::vector<XMFLOAT4X4>& finalTransforms, std::vector<UINT>* keyCursors, const BoneLod* lod)const
+{
+	UINT numBones = (UINT)mBoneOffsets.size();
+	UINT evaluatedCount = lod != nullptr ? (UINT)lod->Bones.size() : numBones;
 
-	// Now find the toRootTransform of the children.
-	for (UINT i = 1; i < numBones; ++i)
+	// Interpolate all the bones of this clip at the given time instance.
+	// The keys are stored in model space, so the interpolated transforms are
+	// already the toRoot transforms and are finished in place.
+	const PoseEvaluator* evaluator = mPoseEvaluators[clip].get();
+	if (evaluator != nullptr)
 	{
-		XMMATRIX toParent = XMLoadFloat4x4(&toParentTransforms[i]);
+		// All bones share the key times, the first cursor serves the clip.
+		// The palettes are written as the transforms are interpolated.
+		UINT keyCursor = 0;
+		if (keyCursors != nullptr && keyCursors->empty())
+			keyCursors->resize(1, 0);
+		evaluator->Evaluate(timePos, finalTransforms, keyCursors != nullptr ? (*keyCursors)[0] : keyCursor,
+			lod != nullptr ? lod->GroupMask.data() : nullptr, mScaledOffsets.data());
+	}
+	else
+	{
+		mClips[clip].Interpolate(timePos, finalTransforms, keyCursors, lod != nullptr ? &lod->Bones : nullptr);
 
-		int parentIndex = mBoneHierarchy[i];
-		XMMATRIX parentToRoot = XMLoadFloat4x4(&toRootTransforms[parentIndex]);
+		// Premultiply by the bone offset transform to get the final transform.
+		for (UINT k = 0; k < evaluatedCount; ++k)
+		{
+			UINT i = lod != nullptr ? lod->Bones[k] : k;
 
-		XMMATRIX toRoot = XMMatrixMultiply(toParent, parentToRoot);
+			XMMATRIX toRoot = XMLoadFloat4x4(&finalTransforms[i]);
+			StorePalette(mScaledOffsets[i], toRoot, finalTransforms[i]);
+		}
+	}
 
-		XMStoreFloat4x4(&toRootTransforms[i], toRoot);
+	// The bones left out follow their evaluated ancestor rigidly
+	if (lod != nullptr)
+	{
+		for (UINT i = 0; i < numBones; ++i)
+		{
+			if (lod->Source[i] != (int)i)
+				finalTransforms[i] = finalTransforms[lod->Source[i]];
+		}
 	}
+}
 
-	// Premultiply by the bone offset transform to get the final transform.
+void SkinnedData::GetFinalTransforms(const std::vector<BoneTransform>& modelPose, std::vector<XMFLOAT4X4>& finalTransforms)const
+{
+	UINT numBones = (UINT)mBoneOffsets.size();
+	XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
 	for (UINT i = 0; i < numBones; ++i)
 	{
-		XMMATRIX offset = XMLoadFloat4x4(&mBoneOffsets[i]);
-		XMMATRIX toRoot = XMLoadFloat4x4(&toParentTransforms[i]);
-		XMMATRIX finalTransform = XMMatrixMultiply(offset, toRoot);
-		finalTransform *= XMMatrixScaling(0.01f, 0.01f, 0.01f);
-
-		//printMatrix(L"Offset", i, offset);
-		//printMatrix(L"toRoot", i, toRoot);
-		//if(i == 15)
-		//printMatrix(L"final", timePos, finalTransform);
+		XMVECTOR S = XMLoadFloat3(&modelPose[i].Scale);
+		XMVECTOR P = XMLoadFloat3(&modelPose[i].Translation);
+		XMVECTOR Q = XMLoadFloat4(&modelPose[i].RotationQuat);
+		StorePalette(mScaledOffsets[i], XMMatrixAffineTransformation(S, zero, Q, P), finalTransforms[i]);
+	}
+}
 
-		XMStoreFloat4x4(&finalTransforms[i], XMMatrixTranspose(finalTransform));
+void SkinnedData::GetModelPose(ClipHandle clip, float timePos, std::vector<BoneTransform>& modelPose,
+	std::vector<UINT>* keyCursors, const BoneMask* mask)const
+{
+	const PoseEvaluator* evaluator = mPoseEvaluators[clip].get();
+	if (evaluator != nullptr)
+	{
+		UINT keyCursor = 0;
+		if (keyCursors != nullptr && keyCursors->empty())
+			keyCursors->resize(1, 0);
+		evaluator->Sample(timePos, modelPose, keyCursors != nullptr ? (*keyCursors)[0] : keyCursor,
+			mask != nullptr ? mask->GroupMask.data() : nullptr);
+	}
+	else
+	{
+		mClips[clip].Sample(timePos, modelPose, keyCursors, mask != nullptr ? &mask->SampledBones : nullptr);
 	}
 }
 
+void SkinnedData::StorePalette(const XMFLOAT4X4& scaledOffset, FXMMATRIX toRoot, XMFLOAT4X4& outPalette)
+{
+	// Bind pose to bone space, posed, in meters and transposed for the shader.
+	// The w of the last offset row carries the scale to the translation of toRoot
+	// and leaves it in the last palette row, which is (0, 0, 0, 1) for an affine palette.
+	XMMATRIX finalTransform = XMMatrixTranspose(XMMatrixMultiply(XMLoadFloat4x4(&scaledOffset), toRoot));
+	finalTransform.r[3] = g_XMIdentityR3;
+
+	XMStoreFloat4x4(&outPalette, finalTransform);
+}
+
 DirectX::XMFLOAT4X4 SkinnedData::getBoneOffsets(int num) const
 {
 	return mBoneOffsets.at(num);
 }
 
+void SkinnedData::GetAnimatedBounds(const std::vector<XMFLOAT4X4>& finalTransforms, BoundingBox& outBounds)const
+{
+	UINT numBones = (UINT)(std::min)(mBoneBounds.size(), finalTransforms.size());
+
+	XMVECTOR vMin = XMVectorReplicate(MathHelper::Infinity);
+	XMVECTOR vMax = XMVectorReplicate(-MathHelper::Infinity);
+	for (UINT i = 0; i < numBones; ++i)
+	{
+		const BoundingBox& box = mBoneBounds[i];
+		if (box.Extents.x < 0.0f)
+			continue;
+
+		// Bone space to the posed model space
+		XMMATRIX boneToModel = XMLoadFloat4x4(&mBoneToModel[i]);
+		XMMATRIX palette = XMMatrixTranspose(XMLoadFloat4x4(&finalTransforms[i]));
+		XMVECTOR boxMin, boxMax;
+		TransformBox(box, XMMatrixMultiply(boneToModel, palette), boxMin, boxMax);
+
+		vMin = XMVectorMin(vMin, boxMin);
+		vMax = XMVectorMax(vMax, boxMax);
+	}
+
+	if (XMVector3Greater(vMin, vMax))
+	{
+		outBounds = BoundingBox();
+		return;
+	}
+
+	StoreBox(vMin, vMax, outBounds);
+}
+
+void SkinnedData::GetBindPoseBounds(BoundingBox& outBounds)const
+{
+	// In the bind pose every palette matrix is the model scale
+	XMFLOAT4X4 scale;
+	XMStoreFloat4x4(&scale, XMMatrixScaling(kModelScale, kModelScale, kModelScale));
+
+	std::vector<XMFLOAT4X4> bindTransforms(mBoneBounds.size(), scale);
+	GetAnimatedBounds(bindTransforms, outBounds);
+}
+
+bool SkinnedData::SetPaletteFormat(ePaletteFormat format)
+{
+	mPaletteFormat = ePaletteFormat::Affine3x4;
+	if (format == ePaletteFormat::Affine3x4)
+		return true;
+
+	// A dual quaternion holds a rotation and a translation, the model scale is applied apart
+	for (auto& e : mBoneOffsets)
+	{
+		XMMATRIX offset = XMLoadFloat4x4(&e);
+		for (int i = 0; i < 3; ++i)
+		{
+			if (fabsf(XMVectorGetX(XMVector3Length(offset.r[i])) - 1.0f) > kRigidTolerance)
+				return false;
+		}
+		if (XMVectorGetX(XMMatrixDeterminant(offset)) < 0.0f)
+			return false;
+	}
+
+	for (auto& clip : mClips)
+	{
+		for (auto& bone : clip.BoneAnimations)
+		{
+			for (auto& key : bone.Keyframes)
+			{
+				XMVECTOR error = XMVectorAbs(XMVectorSubtract(XMLoadFloat3(&key.Scale), XMVectorSplatOne()));
+				if (XMVector3Greater(error, XMVectorReplicate(kRigidTolerance)))
+					return false;
+			}
+		}
+	}
+
+	mPaletteFormat = format;
+	return true;
+}
+
+float SkinnedData::GetPaletteScale() const
+{
+	return mPaletteFormat == ePaletteFormat::DualQuaternion ? kModelScale : 1.0f;
+}
+
+UINT SkinnedData::GetPaletteRowsPerBone() const
+{
+	return mPaletteFormat == ePaletteFormat::DualQuaternion ? 2 : 3;
+}
+
+UINT SkinnedData::PackPalette(const std::vector<XMFLOAT4X4>& finalTransforms, XMFLOAT4* outRows)const
+{
+	UINT numBones = (UINT)finalTransforms.size();
+	if (mPaletteFormat == ePaletteFormat::Affine3x4)
+	{
+		// The last row of the transposed transform is always (0, 0, 0, 1)
+		for (UINT i = 0; i < numBones; ++i)
+		{
+			const XMFLOAT4X4& M = finalTransforms[i];
+			outRows[i * 3 + 0] = XMFLOAT4(M.m[0]);
+			outRows[i * 3 + 1] = XMFLOAT4(M.m[1]);
+			outRows[i * 3 + 2] = XMFLOAT4(M.m[2]);
+		}
+		return numBones * 3;
+	}
+
+	XMVECTOR invScale = XMVectorReplicate(1.0f / kModelScale);
+	for (UINT i = 0; i < numBones; ++i)
+	{
+		XMMATRIX M = XMMatrixTranspose(XMLoadFloat4x4(&finalTransforms[i]));
+		M.r[0] = XMVectorMultiply(M.r[0], invScale);
+		M.r[1] = XMVectorMultiply(M.r[1], invScale);
+		M.r[2] = XMVectorMultiply(M.r[2], invScale);
+
+		// Blended LOD palettes are not exactly orthonormal, hence the normalize.
+		// Positive w keeps the neighbouring bones in one hemisphere for the blend.
+		XMVECTOR Q = XMQuaternionNormalize(XMQuaternionRotationMatrix(M));
+		if (XMVectorGetW(Q) < 0.0f)
+			Q = XMVectorNegate(Q);
+
+		// dual = 0.5 * t * q, rotating first and translating after
+		XMVECTOR T = XMVectorSetW(M.r[3], 0.0f);
+		XMVECTOR D = XMVectorScale(XMQuaternionMultiply(Q, T), 0.5f);
+
+		XMStoreFloat4(&outRows[i * 2 + 0], Q);
+		XMStoreFloat4(&outRows[i * 2 + 1], D);
+	}
+	return numBones * 2;
+}
+
+void SkinnedData::UnpackPalette(const XMFLOAT4* rows, UINT boneCount, std::vector<XMFLOAT4X4>& outFinalTransforms)const
+{
+	outFinalTransforms.resize(boneCount);
+	if (mPaletteFormat == ePaletteFormat::Affine3x4)
+	{
+		for (UINT i = 0; i < boneCount; ++i)
+		{
+			XMMATRIX M(XMLoadFloat4(&rows[i * 3 + 0]), XMLoadFloat4(&rows[i * 3 + 1]), XMLoadFloat4(&rows[i * 3 + 2]), g_XMIdentityR3);
+			XMStoreFloat4x4(&outFinalTransforms[i], M);
+		}
+		return;
+	}
+
+	XMMATRIX scale = XMMatrixScaling(kModelScale, kModelScale, kModelScale);
+	for (UINT i = 0; i < boneCount; ++i)
+	{
+		XMVECTOR Q = XMLoadFloat4(&rows[i * 2 + 0]);
+		XMVECTOR D = XMLoadFloat4(&rows[i * 2 + 1]);
+
+		// t = 2 * dual * conjugate(q)
+		XMVECTOR T = XMVectorScale(XMQuaternionMultiply(XMQuaternionConjugate(Q), D), 2.0f);
+
+		XMMATRIX M = XMMatrixMultiply(scale, XMMatrixRotationQuaternion(Q));
+		M.r[3] = XMVectorSetW(T, 1.0f);
+		XMStoreFloat4x4(&outFinalTransforms[i], XMMatrixTranspose(M));
+	}
+}
@@ -0,0 +1,190 @@
+#include "RenderItem.h"
+
+using namespace DirectX;
+
+void SkinnedModelInstance::RequestState(int state)
+{
+	const auto& transition = StateMachine->GetTransition(State, state);
+	if (!transition.Allowed)
+		return;
+
+	if (state != State)
+	{
+		Layers.StartCrossfade(StateMachine->GetClip(State), TimePos, StateMachine->IsLooping(State), CrossfadeDuration);
+		FramesToUpdate = 0;
+	}
+	if (transition.Restart)
+		TimePos = 0.0f;
+	State = state;
+}
+
+void SkinnedModelInstance::SetLod(UINT updateInterval, UINT boneLod, bool useBaked)
+{
+	if (updateInterval != UpdateInterval || boneLod != BoneLod || useBaked != UseBaked)
+		FramesToUpdate = 0;
+	UpdateInterval = updateInterval;
+	BoneLod = boneLod;
+	UseBaked = useBaked;
+}
+
+void SkinnedModelInstance::UpdateVisibility(const BoundingFrustum* frustum, const XMMATRIX* worlds, UINT worldCount)
+{
+	bool wasPartial = IsPartial;
+	std::swap(PrevVisibleBones, VisibleBones.Bones);
+
+	// The bounds are those of the state clip played alone on SkinnedInfo
+	ContainmentType visibility = CONTAINS;
+	ClipHandle clip = StateMachine->GetClip(State);
+	if (frustum != nullptr && worldCount > 0 && clip != kInvalidClip && Retarget == nullptr && !Layers.IsActive())
+		visibility = SkinnedInfo->GetVisibleBones(clip, BoneLod, *frustum, worlds, worldCount, VisibleBones);
+
+	IsCulled = visibility == DISJOINT;
+	IsPartial = visibility == INTERSECTS && !UseBaked;
+
+	bool gainsBones = wasPartial && (!IsPartial || !std::includes(PrevVisibleBones.begin(), PrevVisibleBones.end(),
+		VisibleBones.Bones.begin(), VisibleBones.Bones.end()));
+	if (IsCulled || gainsBones)
+	{
+		HasPose = false;
+		FramesToUpdate = 0;
+	}
+}
+
+bool SkinnedModelInstance::RequireClips()
+{
+	if (Residency == nullptr)
+		return true;
+
+	if (Layers.IsCrossfading())
+		Residency->Require(Layers.GetCrossfadeClip());
+	for (UINT i = 0; i < Layers.GetLayerCount(); ++i)
+	{
+		AnimationLayer& layer = Layers.GetLayer(i);
+		if (layer.Weight > 0.0f && !Residency->Require(layer.Clip))
+			layer.Weight = 0.0f;
+	}
+	return Residency->Require(StateMachine->GetClip(State));
+}
+
+bool SkinnedModelInstance::IsClipEnd() const
+{
+	return StateMachine->GetClipEndTime(State) - TimePos < 0.001f;
+}
+
+void SkinnedModelInstance::UpdateSkinnedAnimation(float dt)
+{
+	float prevTime = TimePos;
+	TimePos += dt;
+	Layers.Update(*SkinnedInfo, dt);
+
+	// Loop animation, keeping the time past the end so root motion and the pose carry on
+	float endTime = StateMachine->GetClipEndTime(State);
+	if (TimePos > endTime && StateMachine->IsLooping(State))
+	{
+		TimePos = endTime > 0.0f ? fmodf(TimePos, endTime) : 0.0f;
+	}
+
+	ClipHandle clip = StateMachine->GetClip(State);
+
+	// Culled characters still walk
+	const RootMotionTrack* rootMotion = (clip != kInvalidClip && Retarget == nullptr) ? SkinnedInfo->GetRootMotion(clip) : nullptr;
+	if (rootMotion != nullptr)
+	{
+		XMFLOAT2 delta = rootMotion->GetDelta(prevTime, TimePos);
+		RootMotion.x += delta.x;
+		RootMotion.y += delta.y;
+	}
+
+	if (clip == kInvalidClip || IsCulled)
+		return;
+
+	if (UpdateInterval <= 1 || !HasPose)
+	{
+		EvaluatePose(clip, TimePos, FinalTransforms, Bounds);
+		NextBounds = Bounds;
+		if (UpdateInterval <= 1)
+			return;
+	}
+
+	// Evaluate the pose at the end of the interval and blend toward it
+	if (FramesToUpdate == 0)
+	{
+		float t = TimePos + (UpdateInterval - 1) * dt;
+		if (t > endTime && StateMachine->IsLooping(State))
+			t -= endTime;
+
+		PrevTransforms.assign(FinalTransforms.begin(), FinalTransforms.end());
+		NextTransforms.resize(FinalTransforms.size());
+
+		// The bounds cover both ends of the blend
+		BoundingBox prevBounds = NextBounds;
+		EvaluatePose(clip, t, NextTransforms, NextBounds);
+		BoundingBox::CreateMerged(Bounds, prevBounds, NextBounds);
+
+		FramesToUpdate = UpdateInterval;
+	}
+	--FramesToUpdate;
+
+	float s = (float)(UpdateInterval - FramesToUpdate) / UpdateInterval;
+	for (size_t i = 0; i < FinalTransforms.size(); ++i)
+	{
+		XMMATRIX P = XMLoadFloat4x4(&PrevTransforms[i]);
+		XMMATRIX N = XMLoadFloat4x4(&NextTransforms[i]);
+		XMMATRIX M(
+			XMVectorLerp(P.r[0], N.r[0], s),
+			XMVectorLerp(P.r[1], N.r[1], s),
+			XMVectorLerp(P.r[2], N.r[2], s),
+			XMVectorLerp(P.r[3], N.r[3], s));
+		XMStoreFloat4x4(&FinalTransforms[i], M);
+	}
+}
+
+void SkinnedModelInstance::EvaluatePose(ClipHandle clip, float t, std::vector<XMFLOAT4X4>& outTransforms, BoundingBox& outBounds)
+{
+	HasPose = true;
+
+	// The clip handles are those of the source rig, so no layers, baked palettes or cache
+	if (Retarget != nullptr)
+	{
+		Retarget->GetFinalTransforms(clip, t, RetargetBuffers, outTransforms, &KeyCursors);
+		SkinnedInfo->GetAnimatedBounds(outTransforms, outBounds);
+		return;
+	}
+
+	// Layered poses are evaluated in full and never cached
+	if (Layers.IsActive())
+	{
+		Layers.Evaluate(*SkinnedInfo, clip, t, &KeyCursors, outTransforms);
+		SkinnedInfo->GetAnimatedBounds(outTransforms, outBounds);
+		return;
+	}
+
+	// A copy of the nearest baked frame, falls back to the clip when it is not baked
+	if (UseBaked && Baked != nullptr && Baked->GetFinalTransforms(clip, t, outTransforms, outBounds))
+		return;
+
+	// The cached palettes are full skeletons
+	if (Cache != nullptr && BoneLod == 0)
+	{
+		int frame = Cache->GetFrame(t);
+		if (Cache->Find(SkinnedInfo.get(), clip, frame, outTransforms, outBounds))
+			return;
+
+		SkinnedInfo->GetFinalTransforms(clip, Cache->GetFrameTime(frame), outTransforms, &KeyCursors);
+		SkinnedInfo->GetAnimatedBounds(outTransforms, outBounds);
+		Cache->Store(SkinnedInfo.get(), clip, frame, outTransforms, outBounds);
+		return;
+	}
+
+	// The bones out of view keep their palettes, the bounds of the clip cover them
+	if (IsPartial)
+	{
+		SkinnedInfo->GetFinalTransforms(clip, t, outTransforms, &KeyCursors, VisibleBones);
+		outBounds = SkinnedInfo->GetClipBounds(clip);
+		return;
+	}
+
+	// Compute the final transforms for this time position.
+	SkinnedInfo->GetFinalTransforms(clip, t, outTransforms, &KeyCursors, BoneLod);
+	SkinnedInfo->GetAnimatedBounds(outTransforms, outBounds);
+}
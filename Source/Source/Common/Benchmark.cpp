@@ -0,0 +1,156 @@
+#include "FrameResource.h"
+#include "FbxLoader.h"
+#include "Benchmark.h"
+
+using namespace DirectX;
+
+Benchmark::Benchmark()
+{
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+int Benchmark::Run()
+{
+	mReport.open("Benchmark.txt");
+	mFailureCount = 0;
+
+	RunLodSelection();
+	RunTangentFrames();
+	RunSkinnedBounds();
+	RunMorphTargets();
+	RunKeyframeLookup();
+	RunPoseEvaluation();
+	RunSharedAssets();
+	RunClipHandles();
+	RunParallelAnimation();
+	RunPoseCache();
+	RunAnimationLod();
+	RunLayeredPose();
+	RunCrossfade();
+	RunAnimationPipeline();
+	RunCpuSkinning();
+	RunPaletteFormats();
+	RunBakedPalettes();
+	RunRetargeting();
+	RunConstantTracks();
+	RunFinalTransforms();
+	RunCulledAnimation();
+	RunMotionMatching();
+	RunRootMotion();
+	RunClipResidency();
+
+	// A failed check fails the run, so -benchmark can gate a build
+	Print(std::to_wstring(mFailureCount) + L" checks failed\n");
+	mReport.close();
+	return mFailureCount == 0 ? 0 : 1;
+}
+
+bool Benchmark::LoadPlayer(std::vector<CharacterVertex>& vertices, SkinnedData& skinnedData, std::vector<std::string>& clips)
+{
+	const std::string fileName = "../Resource/FBX/Character/";
+	const std::string clipNames[] =
+	{
+		"playerWalking", "run", "Kick", "Kick2", "FlyingKick", "Hook", "HitReaction", "Death", "WalkingBackward"
+	};
+
+	FbxLoader fbx;
+	std::vector<uint32_t> indices;
+	std::vector<Material> materials;
+	if (FAILED(fbx.LoadFBX(vertices, indices, skinnedData, "Idle", materials, fileName)) || vertices.empty())
+	{
+		PrintFailure(L"No character mesh found\n");
+		return false;
+	}
+
+	clips = { "Idle" };
+	for (auto& clipName : clipNames)
+	{
+		if (SUCCEEDED(fbx.LoadFBX(skinnedData, clipName, fileName)))
+			clips.push_back(clipName);
+	}
+	return true;
+}
+
+bool Benchmark::LoadMonster(UINT monster, std::vector<CharacterVertex>& vertices, SkinnedData& skinnedData, std::vector<std::string>& clips)
+{
+	const std::string fileName = "../Resource/FBX/Monster/Monster" + std::to_string(monster) + "/";
+	const std::string clipNames[] =
+	{
+		"Walking", "MAttack1", "MAttack2", "HitReaction", "Death"
+	};
+
+	FbxLoader fbx;
+	std::vector<uint32_t> indices;
+	std::vector<Material> materials;
+	if (FAILED(fbx.LoadFBX(vertices, indices, skinnedData, "Idle", materials, fileName)) || vertices.empty())
+	{
+		PrintFailure(L"No mesh found for Monster" + std::to_wstring(monster) + L"\n");
+		return false;
+	}
+
+	clips = { "Idle" };
+	for (auto& clipName : clipNames)
+	{
+		if (SUCCEEDED(fbx.LoadFBX(skinnedData, clipName, fileName)))
+			clips.push_back(clipName);
+	}
+	return true;
+}
+
+void Benchmark::Print(const std::wstring& text)
+{
+	::OutputDebugString(text.c_str());
+	if (mReport)
+	{
+		mReport << text;
+		mReport.flush();
+	}
+}
+
+void Benchmark::PrintFailure(const std::wstring& text)
+{
+	Print(Verdict(false) + L" : " + text);
+}
+
+std::wstring Benchmark::Verdict(bool pass)
+{
+	if (!pass)
+		++mFailureCount;
+	return pass ? L"PASS" : L"FAIL";
+}
+
+double Benchmark::ElapsedMs(
+	const std::chrono::high_resolution_clock::time_point& start,
+	const std::chrono::high_resolution_clock::time_point& end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+float Benchmark::MaxDifference(const std::vector<XMFLOAT3>& a, const std::vector<XMFLOAT3>& b)
+{
+	XMVECTOR difference = XMVectorZero();
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		difference = XMVectorMax(difference, XMVectorAbs(XMVectorSubtract(XMLoadFloat3(&a[i]), XMLoadFloat3(&b[i]))));
+	}
+	return (std::max)(XMVectorGetX(difference), (std::max)(XMVectorGetY(difference), XMVectorGetZ(difference)));
+}
+
+float Benchmark::MaxDifference(const std::vector<XMFLOAT4X4>& a, const std::vector<XMFLOAT4X4>& b)
+{
+	float difference = 0.0f;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				difference = (std::max)(difference, fabsf(a[i].m[j][k] - b[i].m[j][k]));
+			}
+		}
+	}
+	return difference;
+}
@@ -0,0 +1,681 @@
+#include <windows.h>
+#include <psapi.h>
+#include "FrameResource.h"
+#include "RenderItem.h"
+#include "FbxLoader.h"
+#include "PoseEvaluator.h"
+#include "AnimationStage.h"
+#include "Benchmark.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// The keyframe search before key cursors, scanning from the first key
+	void LinearScanInterpolate(const BoneAnimation& track, float t, XMFLOAT4X4& M)
+	{
+		// Compacted tracks have nothing to scan
+		if (track.Kind != eTrackKind::Animated)
+		{
+			track.Interpolate(t, M);
+			return;
+		}
+
+		const auto& keys = track.Keyframes;
+		UINT i = 0;
+		if (t <= keys.front().TimePos)
+			i = 0;
+		else if (t >= keys.back().TimePos)
+			i = (UINT)keys.size() - 2;
+		else
+		{
+			while (!(t >= keys[i].TimePos && t <= keys[i + 1].TimePos))
+				++i;
+		}
+
+		float lerpPercent = MathHelper::Clamp((t - keys[i].TimePos) / (keys[i + 1].TimePos - keys[i].TimePos), 0.0f, 1.0f);
+		XMVECTOR S = XMVectorLerp(XMLoadFloat3(&keys[i].Scale), XMLoadFloat3(&keys[i + 1].Scale), lerpPercent);
+		XMVECTOR P = XMVectorLerp(XMLoadFloat3(&keys[i].Translation), XMLoadFloat3(&keys[i + 1].Translation), lerpPercent);
+		XMVECTOR Q = XMQuaternionSlerp(XMLoadFloat4(&keys[i].RotationQuat), XMLoadFloat4(&keys[i + 1].RotationQuat), lerpPercent);
+
+		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+	}
+
+	// Private bytes and working set of the process
+	void GetProcessMemory(SIZE_T& privateBytes, SIZE_T& workingSet)
+	{
+		PROCESS_MEMORY_COUNTERS_EX counters = {};
+		::GetProcessMemoryInfo(::GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters));
+		privateBytes = counters.PrivateUsage;
+		workingSet = counters.WorkingSetSize;
+	}
+
+	// Bytes of the keys of every clip of a rig
+	size_t GetClipMemorySize(const SkinnedData& skinnedData)
+	{
+		size_t size = 0;
+		for (ClipHandle clip = 0; clip < (ClipHandle)skinnedData.GetClipCount(); ++clip)
+		{
+			for (auto& e : skinnedData.GetAnimation(clip).BoneAnimations)
+				size += e.Keyframes.capacity() * sizeof(Keyframe);
+		}
+		return size;
+	}
+}
+
+void Benchmark::RunKeyframeLookup()
+{
+	Print(L"[Keyframe lookup]\n");
+
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips))
+		return;
+
+	// Playback at 60 fps, every clip looped a few times
+	const float dt = 1.0f / 60.0f;
+	const int loopCount = 20;
+	const UINT boneCount = skinnedData.BoneCount();
+
+	for (auto& clipName : clips)
+	{
+		const AnimationClip& clip = skinnedData.GetAnimation(clipName);
+		float endTime = clip.GetClipEndTime();
+
+		// The same keys searched without the uniform sampling shortcut
+		AnimationClip searchedClip = clip;
+		for (auto& e : searchedClip.BoneAnimations)
+		{
+			e.SampleInterval = 0.0f;
+		}
+
+		std::vector<float> times;
+		for (int loop = 0; loop < loopCount; ++loop)
+		{
+			for (float t = 0.0f; t <= endTime; t += dt)
+			{
+				times.push_back(t);
+			}
+		}
+
+		std::vector<XMFLOAT4X4> reference(boneCount);
+		std::vector<XMFLOAT4X4> transforms(boneCount);
+		std::vector<UINT> keyCursors;
+		double linearMs = 0.0, binaryMs = 0.0, cursorMs = 0.0, uniformMs = 0.0, finalMs = 0.0;
+		float maxError = 0.0f;
+		for (float t : times)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (UINT i = 0; i < clip.BoneAnimations.size(); ++i)
+			{
+				LinearScanInterpolate(clip.BoneAnimations[i], t, reference[i]);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			linearMs += ElapsedMs(start, end);
+
+			start = std::chrono::high_resolution_clock::now();
+			searchedClip.Interpolate(t, transforms);
+			end = std::chrono::high_resolution_clock::now();
+			binaryMs += ElapsedMs(start, end);
+			maxError = (std::max)(maxError, MaxDifference(transforms, reference));
+
+			start = std::chrono::high_resolution_clock::now();
+			searchedClip.Interpolate(t, transforms, &keyCursors);
+			end = std::chrono::high_resolution_clock::now();
+			cursorMs += ElapsedMs(start, end);
+			maxError = (std::max)(maxError, MaxDifference(transforms, reference));
+
+			start = std::chrono::high_resolution_clock::now();
+			clip.Interpolate(t, transforms);
+			end = std::chrono::high_resolution_clock::now();
+			uniformMs += ElapsedMs(start, end);
+			maxError = (std::max)(maxError, MaxDifference(transforms, reference));
+
+			start = std::chrono::high_resolution_clock::now();
+			skinnedData.GetFinalTransforms(clipName, t, transforms, &keyCursors);
+			end = std::chrono::high_resolution_clock::now();
+			finalMs += ElapsedMs(start, end);
+		}
+
+		double toUs = 1000.0 / times.size();
+		bool pass = maxError < 1e-4f;
+		Print(std::wstring(clipName.begin(), clipName.end()) + L" : " + Verdict(pass) + L"\n" +
+			L"  " + std::to_wstring(clip.BoneAnimations.size()) + L" bones, " + std::to_wstring(clip.BoneAnimations.front().Keyframes.size()) + L" keys, " +
+			std::to_wstring(times.size()) + L" samples, max difference " + std::to_wstring(maxError) + L"\n" +
+			L"  per character: linear scan " + std::to_wstring(linearMs * toUs) + L" us, binary search " + std::to_wstring(binaryMs * toUs) +
+			L" us, cursor " + std::to_wstring(cursorMs * toUs) + L" us, uniform " + std::to_wstring(uniformMs * toUs) + L" us\n" +
+			L"  GetFinalTransforms " + std::to_wstring(finalMs * toUs) + L" us\n");
+	}
+}
+
+void Benchmark::RunPoseEvaluation()
+{
+	Print(L"[Pose evaluation]\n");
+
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips))
+		return;
+
+	const float dt = 1.0f / 60.0f;
+	const int loopCount = 20;
+	const UINT boneCount = skinnedData.BoneCount();
+
+	for (auto& clipName : clips)
+	{
+		const AnimationClip& clip = skinnedData.GetAnimation(clipName);
+		PoseEvaluator evaluator;
+		if (!evaluator.Build(clip))
+		{
+			Print(std::wstring(clipName.begin(), clipName.end()) + L" : tracks do not share their key times, scalar path only\n");
+			continue;
+		}
+
+		std::vector<XMFLOAT4X4> scalar(boneCount);
+		std::vector<XMFLOAT4X4> simd(boneCount);
+		std::vector<UINT> keyCursors;
+		UINT keyCursor = 0;
+		double scalarMs = 0.0, simdMs = 0.0;
+		float maxRotationError = 0.0f;
+		float maxTranslationError = 0.0f;
+		UINT sampleCount = 0;
+		for (int loop = 0; loop < loopCount; ++loop)
+		{
+			for (float t = 0.0f; t <= clip.GetClipEndTime(); t += dt)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				clip.Interpolate(t, scalar, &keyCursors);
+				auto end = std::chrono::high_resolution_clock::now();
+				scalarMs += ElapsedMs(start, end);
+
+				start = std::chrono::high_resolution_clock::now();
+				evaluator.Evaluate(t, simd, keyCursor);
+				end = std::chrono::high_resolution_clock::now();
+				simdMs += ElapsedMs(start, end);
+
+				// Rotation and scale rows absolute, translations relative to their size
+				for (UINT i = 0; i < boneCount; ++i)
+				{
+					for (int j = 0; j < 3; ++j)
+					{
+						for (int k = 0; k < 3; ++k)
+						{
+							maxRotationError = (std::max)(maxRotationError, fabsf(scalar[i].m[j][k] - simd[i].m[j][k]));
+						}
+						float translation = (std::max)(1.0f, fabsf(scalar[i].m[3][j]));
+						maxTranslationError = (std::max)(maxTranslationError, fabsf(scalar[i].m[3][j] - simd[i].m[3][j]) / translation);
+					}
+				}
+				sampleCount++;
+			}
+		}
+
+		double evaluatedBones = (double)sampleCount * boneCount;
+		bool pass = maxRotationError < 1e-3f && maxTranslationError < 1e-3f;
+		Print(std::wstring(clipName.begin(), clipName.end()) + L" : " + Verdict(pass) + L"\n" +
+			L"  " + std::to_wstring(sampleCount) + L" poses, rotation error " + std::to_wstring(maxRotationError) +
+			L", translation error " + std::to_wstring(maxTranslationError) + L"\n" +
+			L"  scalar " + std::to_wstring(evaluatedBones / (scalarMs * 1000.0)) + L" bones/us, SoA " +
+			std::to_wstring(evaluatedBones / (simdMs * 1000.0)) + L" bones/us\n");
+	}
+}
+
+void Benchmark::RunSharedAssets()
+{
+	Print(L"[Shared skeleton and clips]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*asset, { { "Idle", eClipList::Idle, true, false } });
+
+	const UINT instanceCounts[] = { 1, 100 };
+	for (UINT instanceCount : instanceCounts)
+	{
+		// Before: every instance deep copied the skeleton and the clips
+		// After: every instance points at the one loaded asset
+		for (int shared = 0; shared < 2; ++shared)
+		{
+			SIZE_T privateBefore = 0, workingSetBefore = 0;
+			GetProcessMemory(privateBefore, workingSetBefore);
+
+			std::vector<std::unique_ptr<SkinnedModelInstance>> instances;
+			for (UINT i = 0; i < instanceCount; ++i)
+			{
+				auto instance = std::make_unique<SkinnedModelInstance>();
+				if (shared)
+					instance->SkinnedInfo = asset;
+				else
+					instance->SkinnedInfo = std::make_shared<const SkinnedData>(*asset);
+				instance->StateMachine = stateMachine;
+				instance->FinalTransforms.resize(asset->BoneCount());
+				instance->UpdateSkinnedAnimation(0.0f);
+				instances.push_back(std::move(instance));
+			}
+
+			SIZE_T privateAfter = 0, workingSetAfter = 0;
+			GetProcessMemory(privateAfter, workingSetAfter);
+
+			Print(std::to_wstring(instanceCount) + (shared ? L" shared instances" : L" copied instances") +
+				L" : private " + std::to_wstring(((long long)privateAfter - (long long)privateBefore) / 1024) +
+				L" KB, working set " + std::to_wstring(((long long)workingSetAfter - (long long)workingSetBefore) / 1024) + L" KB\n");
+		}
+	}
+}
+
+void Benchmark::RunBakedPalettes()
+{
+	Print(L"[Baked palettes]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	auto baked = std::make_shared<BakedAnimation>();
+	auto start = std::chrono::high_resolution_clock::now();
+	baked->Bake(*asset, kBakeFrameRate);
+	auto end = std::chrono::high_resolution_clock::now();
+	Print(L"baked " + std::to_wstring(clips.size()) + L" clips at " + std::to_wstring(kBakeFrameRate) +
+		L" frames per second in " + std::to_wstring(ElapsedMs(start, end)) + L" ms\n");
+
+	size_t totalBytes = 0;
+	for (auto& clipName : clips)
+	{
+		ClipHandle clip = asset->GetClipHandle(clipName);
+		size_t bytes = baked->GetMemorySize(clip);
+		totalBytes += bytes;
+		Print(L"  " + std::wstring(clipName.begin(), clipName.end()) + L" : " +
+			std::to_wstring(baked->GetClip(clip)->FrameCount) + L" frames, " + std::to_wstring(bytes / 1024) +
+			L" KB, max palette difference " + std::to_wstring(baked->MeasureError(*asset, clip)) + L" from the live pose\n");
+	}
+	Print(L"  total " + std::to_wstring(totalBytes / 1024) + L" KB\n");
+
+	std::vector<AnimationStateDesc> states;
+	for (auto& clipName : clips)
+	{
+		states.push_back({ clipName, eClipList::Idle, true, false });
+	}
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*asset, states);
+
+	// Single threaded, the baked cost per instance stays flat as the crowd grows
+	const UINT crowdSizes[] = { 100, 1000 };
+	const float dt = 1.0f / 60.0f;
+	const int frameCount = 120;
+	for (UINT crowdSize : crowdSizes)
+	{
+		double liveMs = 0.0, bakedMs = 0.0;
+		for (int useBaked = 0; useBaked < 2; ++useBaked)
+		{
+			std::vector<SkinnedModelInstance> crowd(crowdSize);
+			for (UINT i = 0; i < crowdSize; ++i)
+			{
+				crowd[i].SkinnedInfo = asset;
+				crowd[i].StateMachine = stateMachine;
+				crowd[i].State = i % stateMachine->GetStateCount();
+				crowd[i].TimePos = fmodf(i * 0.37f, stateMachine->GetClipEndTime(crowd[i].State));
+				crowd[i].FinalTransforms.resize(asset->BoneCount());
+				crowd[i].Baked = baked;
+				crowd[i].SetLod(1, 0, useBaked != 0);
+			}
+
+			start = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < frameCount; ++frame)
+			{
+				for (auto& e : crowd)
+					e.UpdateSkinnedAnimation(dt);
+			}
+			end = std::chrono::high_resolution_clock::now();
+			(useBaked ? bakedMs : liveMs) = ElapsedMs(start, end);
+		}
+
+		double instanceFrames = (double)frameCount * crowdSize;
+		Print(std::to_wstring(crowdSize) + L" instances : live " + std::to_wstring(liveMs * 1000.0 / instanceFrames) +
+			L" us/instance/frame, baked " + std::to_wstring(bakedMs * 1000.0 / instanceFrames) +
+			L" us/instance/frame (x" + std::to_wstring(liveMs / bakedMs) + L")\n");
+	}
+}
+
+void Benchmark::RunRetargeting()
+{
+	Print(L"[Retargeting]\n");
+
+	// Monster2 names every bone the other monsters have
+	const UINT sourceMonster = 2;
+	const UINT monsters[] = { 1, 2, 3 };
+	// 1 - |cos| of half the angle between the rotations
+	const float maxRotationError = 1e-5f;
+	const float maxJointError = 0.1f;
+
+	std::shared_ptr<SkinnedData> rigs[_countof(monsters)];
+	std::vector<std::string> rigClips[_countof(monsters)];
+	std::shared_ptr<const SkinnedData> source;
+	std::vector<std::string> clips;
+	for (UINT m = 0; m < _countof(monsters); ++m)
+	{
+		std::vector<CharacterVertex> vertices;
+		rigs[m] = std::make_shared<SkinnedData>();
+		if (!LoadMonster(monsters[m], vertices, *rigs[m], rigClips[m]))
+			return;
+		if (monsters[m] == sourceMonster)
+		{
+			source = rigs[m];
+			clips = rigClips[m];
+		}
+	}
+
+	// Every rig with its own clips, against the clips of the source and a remap table per rig
+	size_t ownedBytes = 0, sharedBytes = GetClipMemorySize(*source);
+	std::vector<XMFLOAT4X4> finalTransforms;
+	std::vector<BoneTransform> reference;
+	std::vector<UINT> keyCursors;
+	RetargetPose pose;
+	const int sampleCount = 64;
+	for (UINT m = 0; m < _countof(monsters); ++m)
+	{
+		ownedBytes += GetClipMemorySize(*rigs[m]);
+
+		SkeletonRetarget retarget;
+		if (!retarget.Build(source, rigs[m]))
+		{
+			Print(L"Monster" + std::to_wstring(monsters[m]) + L" : " + Verdict(false) + L" the root has no source bone\n");
+			continue;
+		}
+		sharedBytes += retarget.GetMemorySize();
+
+		UINT boneCount = rigs[m]->BoneCount();
+		finalTransforms.resize(boneCount);
+		reference.resize(boneCount);
+
+		// The same clips sampled natively on the source rig and remapped onto each rig
+		double nativeMs = 0.0, retargetMs = 0.0;
+		float rotationError = 0.0f, jointError = 0.0f;
+		for (auto& clipName : clips)
+		{
+			ClipHandle clip = source->GetClipHandle(clipName);
+			float endTime = source->GetClipEndTime(clip);
+			std::vector<XMFLOAT4X4> sourceTransforms(source->BoneCount());
+
+			keyCursors.clear();
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int sample = 0; sample < sampleCount; ++sample)
+				source->GetFinalTransforms(clip, endTime * sample / sampleCount, sourceTransforms, &keyCursors);
+			auto end = std::chrono::high_resolution_clock::now();
+			nativeMs += ElapsedMs(start, end);
+
+			keyCursors.clear();
+			start = std::chrono::high_resolution_clock::now();
+			for (int sample = 0; sample < sampleCount; ++sample)
+				retarget.GetFinalTransforms(clip, endTime * sample / sampleCount, pose, finalTransforms, &keyCursors);
+			end = std::chrono::high_resolution_clock::now();
+			retargetMs += ElapsedMs(start, end);
+
+			// Onto its own skeleton the pose comes back unchanged, at the keys.
+			// In between the model space keys are lerped and shorten the bones, the remap keeps their length.
+			if (rigs[m] == source)
+			{
+				for (auto& key : source->GetAnimation(clip).BoneAnimations[0].Keyframes)
+				{
+					float t = key.TimePos;
+					source->GetModelPose(clip, t, reference);
+					retarget.GetModelPose(clip, t, pose);
+					for (UINT i = 0; i < boneCount; ++i)
+					{
+						XMVECTOR cosine = XMVector4Dot(XMLoadFloat4(&reference[i].RotationQuat), XMLoadFloat4(&pose.Target[i].RotationQuat));
+						XMVECTOR joint = XMVectorSubtract(XMLoadFloat3(&reference[i].Translation), XMLoadFloat3(&pose.Target[i].Translation));
+						rotationError = (std::max)(rotationError, 1.0f - fabsf(XMVectorGetX(cosine)));
+						jointError = (std::max)(jointError, XMVectorGetX(XMVector3Length(joint)));
+					}
+				}
+			}
+		}
+
+		double evaluations = (double)clips.size() * sampleCount;
+		Print(L"Monster" + std::to_wstring(sourceMonster) + L" clips on Monster" + std::to_wstring(monsters[m]) + L" : " +
+			std::to_wstring(retarget.GetMatchedCount()) + L" of " + std::to_wstring(boneCount) + L" bones matched, " +
+			std::to_wstring(nativeMs * 1000.0 / evaluations) + L" us native, " +
+			std::to_wstring(retargetMs * 1000.0 / evaluations) + L" us remapped (x" + std::to_wstring(retargetMs / nativeMs) + L")\n");
+		if (rigs[m] == source)
+		{
+			bool pass = rotationError <= maxRotationError && jointError <= maxJointError;
+			Print(L"  " + Verdict(pass) + L" : remapped onto the source rig itself, rotation difference " +
+				std::to_wstring(rotationError) + L", joints " + std::to_wstring(jointError) + L" cm away at the keys\n");
+		}
+	}
+
+	Print(L"clip keys of " + std::to_wstring(_countof(monsters)) + L" rigs : " + std::to_wstring(ownedBytes / 1024) +
+		L" KB with their own clips, " + std::to_wstring(sharedBytes / 1024) + L" KB sharing the source clips (" +
+		std::to_wstring(100 * sharedBytes / ownedBytes) + L"%)\n");
+}
+
+void Benchmark::RunConstantTracks()
+{
+	Print(L"[Constant tracks]\n");
+
+	const float dt = 1.0f / 60.0f;
+	const int loopCount = 20;
+	const std::wstring rigNames[] = { L"Player", L"Monster1", L"Monster2", L"Monster3" };
+
+	for (UINT rig = 0; rig < _countof(rigNames); ++rig)
+	{
+		std::vector<CharacterVertex> vertices;
+		SkinnedData skinnedData;
+		std::vector<std::string> clips;
+		if (!(rig == 0 ? LoadPlayer(vertices, skinnedData, clips) : LoadMonster(rig, vertices, skinnedData, clips)))
+			continue;
+
+		const UINT boneCount = skinnedData.BoneCount();
+		UINT trackCounts[3] = {};
+		size_t keysBefore = 0, keysAfter = 0, soaBefore = 0, soaAfter = 0;
+		UINT scaledClips = 0;
+		double fullMs = 0.0, elidedMs = 0.0;
+		float maxError = 0.0f;
+		UINT sampleCount = 0;
+		for (auto& clipName : clips)
+		{
+			const AnimationClip& clip = skinnedData.GetAnimation(clipName);
+
+			// Every track held as many keys as the longest before compaction
+			size_t trackKeys = 0;
+			for (auto& e : clip.BoneAnimations)
+			{
+				trackCounts[(int)e.Kind]++;
+				trackKeys = (std::max)(trackKeys, e.Keyframes.size());
+			}
+			keysBefore += trackKeys * clip.BoneAnimations.size();
+			keysAfter += clip.GetKeyCount();
+
+			PoseEvaluator full, elided;
+			if (!full.Build(clip, false) || !elided.Build(clip))
+			{
+				Print(std::wstring(clipName.begin(), clipName.end()) + L" : tracks do not share their key times, scalar path only\n");
+				continue;
+			}
+			soaBefore += full.GetMemorySize();
+			soaAfter += elided.GetMemorySize();
+			scaledClips += elided.HasScale() ? 1 : 0;
+
+			std::vector<XMFLOAT4X4> reference(boneCount);
+			std::vector<XMFLOAT4X4> transforms(boneCount);
+			UINT fullCursor = 0, elidedCursor = 0;
+			for (int loop = 0; loop < loopCount; ++loop)
+			{
+				for (float t = 0.0f; t <= clip.GetClipEndTime(); t += dt)
+				{
+					auto start = std::chrono::high_resolution_clock::now();
+					full.Evaluate(t, reference, fullCursor);
+					auto end = std::chrono::high_resolution_clock::now();
+					fullMs += ElapsedMs(start, end);
+
+					start = std::chrono::high_resolution_clock::now();
+					elided.Evaluate(t, transforms, elidedCursor);
+					end = std::chrono::high_resolution_clock::now();
+					elidedMs += ElapsedMs(start, end);
+
+					maxError = (std::max)(maxError, MaxDifference(transforms, reference));
+					++sampleCount;
+				}
+			}
+		}
+
+		if (sampleCount == 0)
+			continue;
+
+		// Both lay out the same keys, only the work skipped differs
+		bool pass = maxError <= 1e-6f;
+		double toUs = 1000.0 / sampleCount;
+		Print(rigNames[rig] + L" : " + Verdict(pass) + L"\n" +
+			L"  tracks of " + std::to_wstring(clips.size()) + L" clips: " + std::to_wstring(trackCounts[(int)eTrackKind::Animated]) + L" animated, " +
+			std::to_wstring(trackCounts[(int)eTrackKind::Constant]) + L" constant, " + std::to_wstring(trackCounts[(int)eTrackKind::Identity]) + L" identity; " +
+			std::to_wstring(scaledClips) + L" clips with a scale channel\n" +
+			L"  keys " + std::to_wstring(keysBefore) + L" -> " + std::to_wstring(keysAfter) +
+			L", SoA keys " + std::to_wstring(soaBefore / 1024) + L" KB -> " + std::to_wstring(soaAfter / 1024) + L" KB\n" +
+			L"  per character: every channel " + std::to_wstring(fullMs * toUs) + L" us, elided " + std::to_wstring(elidedMs * toUs) +
+			L" us (x" + std::to_wstring(fullMs / elidedMs) + L"), max difference " + std::to_wstring(maxError) + L"\n");
+	}
+}
+
+void Benchmark::RunClipResidency()
+{
+	Print(L"[Clip residency]\n");
+
+	// The player rig as the game sets it up: the clips loaded, then the root motion extracted
+	const std::string fileName = "../Resource/FBX/Character/";
+	std::vector<CharacterVertex> vertices;
+	std::vector<std::string> clips;
+	auto loadRig = [&](SkinnedData& skinnedData)
+	{
+		if (!LoadPlayer(vertices, skinnedData, clips))
+			return false;
+		for (const char* clipName : { "playerWalking", "run", "WalkingBackward" })
+			skinnedData.ExtractRootMotion(skinnedData.GetClipHandle(clipName), { "LeftFoot", "RightFoot" });
+		return true;
+	};
+
+	auto eager = std::make_shared<SkinnedData>();
+	if (!loadRig(*eager))
+		return;
+
+	std::vector<AnimationStateDesc> states;
+	for (auto& clipName : clips)
+		states.push_back({ clipName, eClipList::Idle, true, false });
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*eager, states);
+
+	size_t eagerBytes = 0;
+	for (ClipHandle clip = 0; clip < (ClipHandle)eager->GetClipCount(); ++clip)
+		eagerBytes += eager->GetClipMemorySize(clip);
+
+	// Play of the player: mostly locomotion and attacks, now and then a hit, a flying kick
+	// and a death. A duration of 0 plays the clip once.
+	struct Segment
+	{
+		const char* ClipName;
+		float Duration;
+	};
+	const Segment script[] =
+	{
+		{ "Idle", 2.0f }, { "playerWalking", 4.0f }, { "run", 3.0f }, { "Kick", 0.0f },
+		{ "playerWalking", 2.0f }, { "Hook", 0.0f }, { "HitReaction", 0.0f }, { "Idle", 1.0f },
+		{ "Kick2", 0.0f }, { "WalkingBackward", 2.0f }, { "run", 4.0f }, { "FlyingKick", 0.0f },
+		{ "Idle", 3.0f }, { "Death", 0.0f },
+	};
+	const UINT passCount = 2;
+	const size_t budget = 768 * 1024;
+	const float dt = 1.0f / 60.0f;
+	// The frames before a change run at the frame rate, so a prefetch has the time it gets in the game
+	const float prefetchLead = 0.1f;
+
+	JobSystem jobs(1);
+	bool pass = true;
+	UINT64 stalls[2];
+	double stallTimes[2];
+	for (int usePrefetch = 0; usePrefetch < 2; ++usePrefetch)
+	{
+		auto lazy = std::make_shared<SkinnedData>();
+		if (!loadRig(*lazy))
+			return;
+		ClipResidency residency(lazy, budget);
+		for (auto& clipName : clips)
+		{
+			residency.Register(lazy->GetClipHandle(clipName), [fileName, clipName](AnimationClip& outAnimation)
+			{
+				FbxLoader loader;
+				return loader.LoadAnimation(outAnimation, clipName, fileName);
+			});
+		}
+
+		// The same states on both rigs, only the lazy one loses its clips
+		SkinnedModelInstance instances[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			instances[i].SkinnedInfo = i == 0 ? eager : lazy;
+			instances[i].StateMachine = stateMachine;
+			instances[i].FinalTransforms.resize(eager->BoneCount());
+		}
+		instances[1].Residency = &residency;
+
+		AnimationStage stage;
+		size_t peakBytes = 0;
+		float difference = 0.0f;
+		for (UINT p = 0; p < passCount; ++p)
+		{
+			for (UINT s = 0; s < _countof(script); ++s)
+			{
+				int state = (int)(std::find(clips.begin(), clips.end(), script[s].ClipName) - clips.begin());
+				int nextState = (int)(std::find(clips.begin(), clips.end(), script[(s + 1) % _countof(script)].ClipName) - clips.begin());
+				if (state == (int)clips.size() || nextState == (int)clips.size())
+					continue;
+
+				float duration = script[s].Duration > 0.0f ? script[s].Duration : stateMachine->GetClipEndTime(state);
+				for (auto& e : instances)
+				{
+					e.State = state;
+					e.TimePos = 0.0f;
+				}
+
+				for (float t = 0.0f; t < duration; t += dt)
+				{
+					if (t + prefetchLead >= duration)
+					{
+						if (usePrefetch)
+							residency.Prefetch(stateMachine->GetClip(nextState));
+						std::this_thread::sleep_for(std::chrono::microseconds((int)(dt * 1000000.0f)));
+					}
+
+					residency.Update();
+					stage.Begin();
+					stage.Add(&instances[0]);
+					stage.Add(&instances[1]);
+					stage.Run(jobs, dt);
+
+					peakBytes = (std::max)(peakBytes, residency.GetResidentBytes());
+					difference = (std::max)(difference, MaxDifference(instances[0].PresentedTransforms, instances[1].PresentedTransforms));
+				}
+			}
+		}
+
+		stalls[usePrefetch] = residency.GetStalls();
+		stallTimes[usePrefetch] = residency.GetStallTime();
+		Print(std::wstring(usePrefetch ? L"prefetched" : L"on demand") + L" : budget " + std::to_wstring(budget / 1024) +
+			L" KB of " + std::to_wstring(eagerBytes / 1024) + L" KB, peak " + std::to_wstring(peakBytes / 1024) + L" KB, end " +
+			std::to_wstring(residency.GetResidentBytes() / 1024) + L" KB; " + std::to_wstring(residency.GetHits()) + L" hits, " +
+			std::to_wstring(residency.GetMisses()) + L" misses, " + std::to_wstring(stalls[usePrefetch]) + L" stalls (" +
+			std::to_wstring(stallTimes[usePrefetch] * 1000.0) + L" ms), " + std::to_wstring(residency.GetLoads()) + L" loads, " +
+			std::to_wstring(residency.GetEvictions()) + L" evictions; max palette difference " + std::to_wstring(difference) + L"\n");
+
+		pass = pass && difference == 0.0f && residency.GetResidentBytes() <= budget;
+	}
+
+	pass = pass && stallTimes[1] < stallTimes[0];
+	Print(Verdict(pass) + L" : reloaded clips match the resident ones, the budget holds and prefetching cuts the stalls\n");
+}
@@ -0,0 +1,924 @@
+#include <crtdbg.h>
+#include "FrameResource.h"
+#include "RenderItem.h"
+#include "AnimationStage.h"
+#include "Benchmark.h"
+
+using namespace DirectX;
+
+namespace
+{
+#ifdef _DEBUG
+	// Heap allocations made while the hook is installed, the debug heap only
+	long gAllocationCount = 0;
+
+	int __cdecl CountAllocations(int allocType, void*, size_t, int, long, const unsigned char*, int)
+	{
+		if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+			++gAllocationCount;
+		return TRUE;
+	}
+#endif
+
+	// FNV-1a of the presented palettes, equal hashes for bitwise equal frames
+	UINT64 HashPalettes(const std::vector<SkinnedModelInstance>& crowd)
+	{
+		UINT64 hash = 14695981039346656037ull;
+		for (auto& e : crowd)
+		{
+			auto bytes = (const unsigned char*)e.PresentedTransforms.data();
+			for (size_t i = 0; i < e.PresentedTransforms.size() * sizeof(XMFLOAT4X4); ++i)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		}
+		return hash;
+	}
+}
+
+void Benchmark::RunClipHandles()
+{
+	Print(L"[Clip handles and state machine]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	// Every loaded clip as a looping state, alternating groups so requests restart clips
+	std::vector<AnimationStateDesc> states;
+	for (size_t i = 0; i < clips.size(); ++i)
+	{
+		states.push_back({ clips[i], (i % 2) ? eClipList::Walking : eClipList::Idle, true, false });
+	}
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	if (!stateMachine->Compile(*asset, states))
+	{
+		PrintFailure(L"State machine incomplete\n");
+		return;
+	}
+
+	SkinnedModelInstance instance;
+	instance.SkinnedInfo = asset;
+	instance.StateMachine = stateMachine;
+	instance.FinalTransforms.resize(asset->BoneCount());
+
+	// Sizes the key cursors for the scalar and the SoA paths
+	for (UINT state = 0; state < stateMachine->GetStateCount(); ++state)
+	{
+		instance.RequestState(state);
+		instance.UpdateSkinnedAnimation(0.0f);
+	}
+
+	const float dt = 1.0f / 60.0f;
+	const int frameCount = 10000;
+	const int framesPerState = 90;
+
+#ifdef _DEBUG
+	gAllocationCount = 0;
+	_CRT_ALLOC_HOOK previousHook = _CrtSetAllocHook(CountAllocations);
+#endif
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frameCount; ++frame)
+	{
+		if (frame % framesPerState == 0)
+			instance.RequestState((frame / framesPerState) % stateMachine->GetStateCount());
+		instance.UpdateSkinnedAnimation(dt);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	double handleMs = ElapsedMs(start, end);
+
+#ifdef _DEBUG
+	_CrtSetAllocHook(previousHook);
+	long allocationCount = gAllocationCount;
+#endif
+
+	// The same script through the lookups by name
+	std::vector<XMFLOAT4X4> finalTransforms(asset->BoneCount());
+	std::vector<UINT> keyCursors;
+	float timePos = 0.0f;
+	start = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frameCount; ++frame)
+	{
+		const std::string& clipName = clips[(frame / framesPerState) % clips.size()];
+		if (frame % framesPerState == 0)
+			timePos = 0.0f;
+		timePos += dt;
+		if (timePos > asset->GetClipEndTime(clipName))
+			timePos = 0.0f;
+		asset->GetFinalTransforms(clipName, timePos, finalTransforms, &keyCursors);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	double nameMs = ElapsedMs(start, end);
+
+#ifdef _DEBUG
+	Print(Verdict(allocationCount == 0) + L" : " + std::to_wstring(allocationCount) +
+		L" allocations in " + std::to_wstring(frameCount) + L" frames\n");
+#else
+	Print(L"Allocation count needs the debug heap, run a Debug build\n");
+#endif
+	Print(L"No string in the per frame path : UpdateSkinnedAnimation and RequestState take state indices\n");
+	Print(L"by name " + std::to_wstring(nameMs * 1000.0 / frameCount) + L" us/frame, by handle " +
+		std::to_wstring(handleMs * 1000.0 / frameCount) + L" us/frame (handle path includes bounds)\n");
+}
+
+void Benchmark::RunParallelAnimation()
+{
+	Print(L"[Parallel animation]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	std::vector<AnimationStateDesc> states;
+	for (auto& clipName : clips)
+	{
+		states.push_back({ clipName, eClipList::Idle, true, false });
+	}
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*asset, states);
+
+	// Instances spread over the clips and times, as a crowd would be
+	auto makeCrowd = [&](UINT count, std::vector<SkinnedModelInstance>& crowd)
+	{
+		crowd.resize(count);
+		for (UINT i = 0; i < count; ++i)
+		{
+			crowd[i].SkinnedInfo = asset;
+			crowd[i].StateMachine = stateMachine;
+			crowd[i].State = i % stateMachine->GetStateCount();
+			crowd[i].TimePos = fmodf(i * 0.37f, stateMachine->GetClipEndTime(crowd[i].State));
+			crowd[i].FinalTransforms.resize(asset->BoneCount());
+		}
+	};
+
+	const UINT hardwareThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+	std::vector<UINT> threadCounts;
+	for (UINT threadCount = 1; threadCount < hardwareThreads; threadCount *= 2)
+	{
+		threadCounts.push_back(threadCount);
+	}
+	threadCounts.push_back(hardwareThreads);
+
+	const UINT instanceCounts[] = { 1, 10, 100, 1000 };
+	const float dt = 1.0f / 60.0f;
+	const int frameCount = 60;
+
+	for (UINT instanceCount : instanceCounts)
+	{
+		std::wstring line = std::to_wstring(instanceCount) + L" instances :";
+		double serialMs = 0.0;
+		bool isDeterministic = true;
+		for (UINT threadCount : threadCounts)
+		{
+			JobSystem jobs(threadCount);
+			std::vector<SkinnedModelInstance> crowd;
+			makeCrowd(instanceCount, crowd);
+
+			AnimationStage stage;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < frameCount; ++frame)
+			{
+				stage.Begin();
+				for (auto& e : crowd)
+					stage.Add(&e);
+				stage.Run(jobs, dt);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			double frameMs = ElapsedMs(start, end) / frameCount;
+			if (threadCount == 1)
+				serialMs = frameMs;
+
+			// Same palettes as the instances updated one after another
+			std::vector<SkinnedModelInstance> reference;
+			makeCrowd(instanceCount, reference);
+			for (int frame = 0; frame < frameCount; ++frame)
+			{
+				for (auto& e : reference)
+					e.UpdateSkinnedAnimation(dt);
+			}
+			for (UINT i = 0; i < instanceCount; ++i)
+			{
+				if (memcmp(reference[i].FinalTransforms.data(), crowd[i].FinalTransforms.data(),
+					reference[i].FinalTransforms.size() * sizeof(XMFLOAT4X4)) != 0)
+					isDeterministic = false;
+			}
+
+			line += L" " + std::to_wstring(threadCount) + L"T " + std::to_wstring(frameMs) + L" ms (x" +
+				std::to_wstring(serialMs / frameMs) + L")";
+		}
+		Print(line + L", " + Verdict(isDeterministic) + (isDeterministic ? L"\n" : L" palettes differ from the serial update\n"));
+	}
+}
+
+void Benchmark::RunPoseCache()
+{
+	Print(L"[Pose cache]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	// A zone of monsters sharing three looping clips
+	std::vector<AnimationStateDesc> states;
+	for (size_t i = 0; i < (std::min)(clips.size(), (size_t)3); ++i)
+	{
+		states.push_back({ clips[i], eClipList::Idle, true, false });
+	}
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*asset, states);
+
+	const UINT monsterCount = 200;
+	const UINT waveCount = 8;
+	const float dt = 1.0f / 60.0f;
+	const int frameCount = 300;
+
+	// Monsters spawn in waves, the members of a wave a few milliseconds apart
+	auto makeCrowd = [&](PoseCache* cache, std::vector<SkinnedModelInstance>& crowd)
+	{
+		crowd.resize(monsterCount);
+		for (UINT i = 0; i < monsterCount; ++i)
+		{
+			crowd[i].SkinnedInfo = asset;
+			crowd[i].StateMachine = stateMachine;
+			crowd[i].State = i % stateMachine->GetStateCount();
+			crowd[i].TimePos = (i % waveCount) * 0.21f + (i % 5) * 0.002f;
+			crowd[i].FinalTransforms.resize(asset->BoneCount());
+			crowd[i].Cache = cache;
+		}
+	};
+
+	JobSystem jobs;
+	PoseCache cache(256, dt);
+	std::vector<SkinnedModelInstance> uncached, cached;
+	makeCrowd(nullptr, uncached);
+	makeCrowd(&cache, cached);
+
+	AnimationStage stage;
+	double uncachedMs = 0.0, cachedMs = 0.0;
+	float maxError = 0.0f;
+	for (int frame = 0; frame < frameCount; ++frame)
+	{
+		stage.Begin();
+		for (auto& e : uncached)
+			stage.Add(&e);
+		auto start = std::chrono::high_resolution_clock::now();
+		stage.Run(jobs, dt);
+		auto end = std::chrono::high_resolution_clock::now();
+		uncachedMs += ElapsedMs(start, end);
+
+		stage.Begin();
+		for (auto& e : cached)
+			stage.Add(&e);
+		start = std::chrono::high_resolution_clock::now();
+		stage.Run(jobs, dt);
+		end = std::chrono::high_resolution_clock::now();
+		cachedMs += ElapsedMs(start, end);
+
+		for (UINT i = 0; i < monsterCount; ++i)
+		{
+			maxError = (std::max)(maxError, MaxDifference(uncached[i].FinalTransforms, cached[i].FinalTransforms));
+		}
+	}
+
+	UINT64 lookups = cache.GetHits() + cache.GetMisses();
+	Print(std::to_wstring(monsterCount) + L" monsters, " + std::to_wstring(jobs.GetThreadCount()) + L" threads\n" +
+		L"  off " + std::to_wstring(uncachedMs / frameCount) + L" ms/frame, on " + std::to_wstring(cachedMs / frameCount) + L" ms/frame\n" +
+		L"  hit rate " + std::to_wstring(lookups ? 100.0 * cache.GetHits() / lookups : 0.0) + L"%, " +
+		std::to_wstring(cache.GetEvictions()) + L" evictions, " + std::to_wstring(cache.GetSize()) + L" palettes, " +
+		std::to_wstring(cache.GetMemorySize() / 1024) + L" KB\n" +
+		L"  max palette difference from the exact time " + std::to_wstring(maxError) + L"\n");
+}
+
+void Benchmark::RunAnimationLod()
+{
+	Print(L"[Animation LOD]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	for (UINT lod = 0; lod < asset->GetBoneLodCount(); ++lod)
+	{
+		Print(L"bone LOD " + std::to_wstring(lod) + L" : " + std::to_wstring(asset->GetBoneLod(lod).Bones.size()) +
+			L" of " + std::to_wstring(asset->BoneCount()) + L" bones evaluated\n");
+	}
+
+	std::vector<AnimationStateDesc> states;
+	for (auto& clipName : clips)
+	{
+		states.push_back({ clipName, eClipList::Idle, true, false });
+	}
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*asset, states);
+
+	const UINT crowdSize = 500;
+	const float dt = 1.0f / 60.0f;
+	const int frameCount = 240;
+
+	// For the tiers that play baked palettes
+	auto baked = std::make_shared<BakedAnimation>();
+	baked->Bake(*asset, kBakeFrameRate);
+
+	auto makeCrowd = [&](std::vector<SkinnedModelInstance>& crowd)
+	{
+		crowd.resize(crowdSize);
+		for (UINT i = 0; i < crowdSize; ++i)
+		{
+			crowd[i].SkinnedInfo = asset;
+			crowd[i].StateMachine = stateMachine;
+			crowd[i].State = i % stateMachine->GetStateCount();
+			crowd[i].TimePos = fmodf(i * 0.37f, stateMachine->GetClipEndTime(crowd[i].State));
+			crowd[i].FinalTransforms.resize(asset->BoneCount());
+			crowd[i].Baked = baked;
+		}
+	};
+
+	// Single threaded, so the cost is per instance and not per core
+	std::vector<SkinnedModelInstance> reference;
+	makeCrowd(reference);
+	double referenceMs = 0.0;
+	for (UINT tier = 0; tier < AnimationStage::GetLodTierCount(); ++tier)
+	{
+		const AnimationLodTier& lodTier = AnimationStage::GetLodTier(tier);
+
+		std::vector<SkinnedModelInstance> crowd;
+		makeCrowd(crowd);
+		makeCrowd(reference);
+		for (auto& e : crowd)
+			e.SetLod(lodTier.UpdateInterval, lodTier.BoneLod, lodTier.UseBaked);
+
+		double tierMs = 0.0;
+		float maxError = 0.0f;
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (auto& e : crowd)
+				e.UpdateSkinnedAnimation(dt);
+			auto end = std::chrono::high_resolution_clock::now();
+			tierMs += ElapsedMs(start, end);
+
+			for (UINT i = 0; i < crowdSize; ++i)
+			{
+				reference[i].UpdateSkinnedAnimation(dt);
+				maxError = (std::max)(maxError, MaxDifference(reference[i].FinalTransforms, crowd[i].FinalTransforms));
+			}
+		}
+		if (tier == 0)
+			referenceMs = tierMs;
+
+		Print(L"tier " + std::to_wstring(tier) + L" (from " + std::to_wstring(lodTier.MinDistance) + L", every " +
+			std::to_wstring(lodTier.UpdateInterval) + L" frames, bone LOD " + std::to_wstring(lodTier.BoneLod) +
+			(lodTier.UseBaked ? L", baked) : " : L") : ") +
+			std::to_wstring(tierMs * 1000.0 / ((double)frameCount * crowdSize)) + L" us/instance/frame (x" +
+			std::to_wstring(referenceMs / tierMs) + L"), max palette difference " + std::to_wstring(maxError) + L"\n");
+	}
+}
+
+void Benchmark::RunLayeredPose()
+{
+	Print(L"[Layered poses]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	ClipHandle walk = asset->GetClipHandle("playerWalking");
+	ClipHandle hook = asset->GetClipHandle("Hook");
+	ClipHandle kick = asset->GetClipHandle("Kick");
+	auto upperBody = std::make_shared<BoneMask>();
+	auto wholeBody = std::make_shared<BoneMask>();
+	if (walk == kInvalidClip || hook == kInvalidClip || kick == kInvalidClip ||
+		!asset->BuildBoneMask("Spine", *upperBody) || !asset->BuildBoneMask("Hips", *wholeBody))
+	{
+		PrintFailure(L"Clips or bones missing\n");
+		return;
+	}
+
+	const UINT boneCount = asset->BoneCount();
+	Print(L"upper body mask : " + std::to_wstring(upperBody->Bones.size()) + L" of " + std::to_wstring(boneCount) + L" bones\n");
+
+	// Walk, hook over the upper body, and a kick layer faded out to zero
+	LayeredPose layered;
+	layered.Initialize(boneCount, 2);
+	AnimationLayer& hookLayer = layered.GetLayer(0);
+	hookLayer.Clip = hook;
+	hookLayer.Mask = upperBody;
+	hookLayer.Loop = true;
+	AnimationLayer& kickLayer = layered.GetLayer(1);
+	kickLayer.Clip = kick;
+	kickLayer.Mask = wholeBody;
+	kickLayer.Loop = true;
+	kickLayer.Weight = 0.0f;
+
+	std::vector<float> upperBodyWeights(boneCount, 0.0f);
+	for (UINT i : upperBody->Bones)
+	{
+		upperBodyWeights[i] = 1.0f;
+	}
+
+	// Every layer evaluated in full, the palettes blended bone by bone with the mask weights
+	std::vector<XMFLOAT4X4> basePalette(boneCount), hookPalette(boneCount), kickPalette(boneCount);
+	std::vector<UINT> baseCursors, hookCursors, kickCursors;
+	auto blendFullPoses = [&](float t, float weight, std::vector<XMFLOAT4X4>& finalTransforms)
+	{
+		asset->GetFinalTransforms(walk, t, basePalette, &baseCursors);
+		asset->GetFinalTransforms(hook, t, hookPalette, &hookCursors);
+		asset->GetFinalTransforms(kick, t, kickPalette, &kickCursors);
+
+		for (UINT i = 0; i < boneCount; ++i)
+		{
+			XMMATRIX B = XMLoadFloat4x4(&basePalette[i]);
+			XMMATRIX H = XMLoadFloat4x4(&hookPalette[i]);
+			XMMATRIX K = XMLoadFloat4x4(&kickPalette[i]);
+			float s = weight * upperBodyWeights[i];
+			for (int r = 0; r < 4; ++r)
+			{
+				B.r[r] = XMVectorLerp(B.r[r], H.r[r], s);
+				// Faded out, but blended all the same
+				B.r[r] = XMVectorLerp(B.r[r], K.r[r], kickLayer.Weight);
+			}
+			XMStoreFloat4x4(&finalTransforms[i], B);
+		}
+	};
+
+	const float weights[] = { 0.0f, 0.5f, 1.0f };
+	const int frameCount = 10000;
+	const float dt = 1.0f / 60.0f;
+	std::vector<XMFLOAT4X4> finalTransforms(boneCount);
+	for (float weight : weights)
+	{
+		hookLayer.Weight = weight;
+
+		float t = 0.0f;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			t = fmodf(t + dt, asset->GetClipEndTime(walk));
+			blendFullPoses(t, weight, finalTransforms);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double fullMs = ElapsedMs(start, end);
+
+#ifdef _DEBUG
+		gAllocationCount = 0;
+		_CRT_ALLOC_HOOK previousHook = _CrtSetAllocHook(CountAllocations);
+#endif
+
+		t = 0.0f;
+		start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			t = fmodf(t + dt, asset->GetClipEndTime(walk));
+			hookLayer.TimePos = fmodf(t, asset->GetClipEndTime(hook));
+			layered.Evaluate(*asset, walk, t, &baseCursors, finalTransforms);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		double layeredMs = ElapsedMs(start, end);
+
+#ifdef _DEBUG
+		_CrtSetAllocHook(previousHook);
+		Print(Verdict(gAllocationCount == 0) + L" : " + std::to_wstring(gAllocationCount) +
+			L" allocations in " + std::to_wstring(frameCount) + L" layered poses\n");
+#endif
+
+		Print(L"hook weight " + std::to_wstring(weight) + L" : full poses blended " +
+			std::to_wstring(fullMs * 1000.0 / frameCount) + L" us/pose, masked layers " +
+			std::to_wstring(layeredMs * 1000.0 / frameCount) + L" us/pose (x" + std::to_wstring(fullMs / layeredMs) + L")\n");
+	}
+	Print(L"The blended palettes blend in model space, the layers in parent space, so the poses differ\n");
+}
+
+void Benchmark::RunCrossfade()
+{
+	Print(L"[Crossfade]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	// Looping and one shot states, the groups alternate so some requests restart the clip
+	std::vector<AnimationStateDesc> states;
+	for (size_t i = 0; i < clips.size(); ++i)
+	{
+		states.push_back({ clips[i], (i % 2) ? eClipList::Walking : eClipList::Idle, i % 3 != 2, false });
+	}
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*asset, states);
+
+	const float crossfadeDuration = 0.25f;
+	const float dt = 1.0f / 60.0f;
+	const int frameCount = 10000;
+	// Shorter than some fades, so crossfades also start during others
+	const int framesPerState[] = { 40, 9, 23 };
+
+	auto makeInstance = [&](SkinnedModelInstance& instance, float duration)
+	{
+		instance.SkinnedInfo = asset;
+		instance.StateMachine = stateMachine;
+		instance.FinalTransforms.resize(asset->BoneCount());
+		instance.Layers.Initialize(asset->BoneCount(), 0);
+		instance.CrossfadeDuration = duration;
+
+		// Sizes the key cursors for the scalar and the SoA paths
+		for (UINT state = 0; state < stateMachine->GetStateCount(); ++state)
+		{
+			instance.RequestState(state);
+			instance.UpdateSkinnedAnimation(dt);
+		}
+
+		// Settles in the first state, past the last crossfade
+		instance.RequestState(0);
+		for (float t = 0.0f; t <= duration; t += dt)
+			instance.UpdateSkinnedAnimation(dt);
+		instance.UpdateSkinnedAnimation(dt);
+	};
+
+	// Largest change of a palette entry from one frame to the next,
+	// at a state change and during steady playback
+	std::vector<XMFLOAT4X4> previous(asset->BoneCount());
+	auto runScript = [&](SkinnedModelInstance& instance, float& outSwitchJump, float& outPlayJump)
+	{
+		std::copy(instance.FinalTransforms.begin(), instance.FinalTransforms.end(), previous.begin());
+		outSwitchJump = 0.0f;
+		outPlayJump = 0.0f;
+
+		int nextSwitch = framesPerState[0];
+		int step = 1;
+		UINT state = 0;
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			bool isSwitch = frame == nextSwitch;
+			if (isSwitch)
+			{
+				state = (state + 1) % stateMachine->GetStateCount();
+				instance.RequestState(state);
+				nextSwitch += framesPerState[step++ % _countof(framesPerState)];
+			}
+			instance.UpdateSkinnedAnimation(dt);
+
+			float jump = MaxDifference(previous, instance.FinalTransforms);
+			std::copy(instance.FinalTransforms.begin(), instance.FinalTransforms.end(), previous.begin());
+			if (isSwitch)
+				outSwitchJump = (std::max)(outSwitchJump, jump);
+			else
+				outPlayJump = (std::max)(outPlayJump, jump);
+		}
+	};
+
+	SkinnedModelInstance snap, crossfade;
+	makeInstance(snap, 0.0f);
+	makeInstance(crossfade, crossfadeDuration);
+
+	float snapSwitch, snapPlay;
+	runScript(snap, snapSwitch, snapPlay);
+
+#ifdef _DEBUG
+	gAllocationCount = 0;
+	_CRT_ALLOC_HOOK previousHook = _CrtSetAllocHook(CountAllocations);
+#endif
+
+	float fadeSwitch, fadePlay;
+	auto start = std::chrono::high_resolution_clock::now();
+	runScript(crossfade, fadeSwitch, fadePlay);
+	auto end = std::chrono::high_resolution_clock::now();
+
+#ifdef _DEBUG
+	_CrtSetAllocHook(previousHook);
+	Print(Verdict(gAllocationCount == 0) + L" : " + std::to_wstring(gAllocationCount) +
+		L" allocations in " + std::to_wstring(frameCount) + L" frames of scripted transitions\n");
+#else
+	Print(L"Allocation count needs the debug heap, run a Debug build\n");
+#endif
+	Print(L"largest palette jump at a state change : " + std::to_wstring(snapSwitch) + L" switching, " +
+		std::to_wstring(fadeSwitch) + L" with a " + std::to_wstring(crossfadeDuration) + L" s crossfade\n");
+	Print(L"largest palette jump while playing : " + std::to_wstring(snapPlay) + L" switching, " +
+		std::to_wstring(fadePlay) + L" crossfading\n");
+	Print(std::to_wstring(ElapsedMs(start, end) * 1000.0 / frameCount) + L" us/frame with crossfades\n");
+}
+
+void Benchmark::RunAnimationPipeline()
+{
+	Print(L"[Animation pipeline]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	std::vector<AnimationStateDesc> states;
+	for (size_t i = 0; i < clips.size(); ++i)
+	{
+		states.push_back({ clips[i], (i % 2) ? eClipList::Walking : eClipList::Idle, i % 3 != 2, false });
+	}
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*asset, states);
+
+	const UINT instanceCount = 300;
+	const float dt = 1.0f / 60.0f;
+	const int frameCount = 300;
+	// Stands for recording and submitting the command lists of a frame
+	const double drawMs = 2.0;
+
+	auto makeCrowd = [&](std::vector<SkinnedModelInstance>& crowd)
+	{
+		crowd.resize(instanceCount);
+		for (UINT i = 0; i < instanceCount; ++i)
+		{
+			crowd[i].SkinnedInfo = asset;
+			crowd[i].StateMachine = stateMachine;
+			crowd[i].State = i % stateMachine->GetStateCount();
+			crowd[i].TimePos = fmodf(i * 0.37f, stateMachine->GetClipEndTime(crowd[i].State));
+			crowd[i].FinalTransforms.resize(asset->BoneCount());
+			crowd[i].Layers.Initialize(asset->BoneCount(), 0);
+			crowd[i].CrossfadeDuration = 0.2f;
+		}
+	};
+
+	// Game logic of frame f, the same requests in both runs
+	auto script = [&](std::vector<SkinnedModelInstance>& crowd, int frame)
+	{
+		for (UINT i = frame % 7; i < instanceCount; i += 7)
+		{
+			crowd[i].RequestState((crowd[i].State + 1 + frame % 3) % stateMachine->GetStateCount());
+		}
+	};
+
+	// Copies the palettes as the constant buffer update does, then waits out the rest
+	std::vector<XMFLOAT4X4> constants(instanceCount * asset->BoneCount());
+	auto draw = [&](const std::vector<SkinnedModelInstance>& crowd)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		XMFLOAT4X4* dest = constants.data();
+		for (auto& e : crowd)
+			dest = std::copy(e.PresentedTransforms.begin(), e.PresentedTransforms.end(), dest);
+		while (ElapsedMs(start, std::chrono::high_resolution_clock::now()) < drawMs)
+			std::this_thread::yield();
+	};
+
+	// One hardware thread is left to the main thread while the pipeline runs
+	const UINT threadCount = (std::max)(std::thread::hardware_concurrency(), 2u) - 1;
+
+	std::vector<UINT64> serialHashes(frameCount);
+	double serialMs;
+	{
+		JobSystem jobs(threadCount);
+		std::vector<SkinnedModelInstance> crowd;
+		makeCrowd(crowd);
+
+		AnimationStage stage;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			script(crowd, frame);
+			stage.Begin();
+			for (auto& e : crowd)
+				stage.Add(&e);
+			stage.Run(jobs, dt);
+
+			draw(crowd);
+			serialHashes[frame] = HashPalettes(crowd);
+		}
+		serialMs = ElapsedMs(start, std::chrono::high_resolution_clock::now()) / frameCount;
+	}
+
+	// The pipelined frame f draws the poses of frame f - 1
+	std::vector<UINT64> pipelinedHashes(frameCount);
+	double pipelinedMs;
+	{
+		JobSystem jobs(threadCount);
+		std::vector<SkinnedModelInstance> crowd;
+		makeCrowd(crowd);
+
+		AnimationStage stage;
+		stage.StartPipeline(jobs);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			stage.Present();
+			if (frame > 0)
+				pipelinedHashes[frame - 1] = HashPalettes(crowd);
+
+			script(crowd, frame);
+			stage.Begin();
+			for (auto& e : crowd)
+				stage.Add(&e);
+			stage.Submit(dt);
+
+			draw(crowd);
+		}
+		pipelinedMs = ElapsedMs(start, std::chrono::high_resolution_clock::now()) / frameCount;
+
+		stage.StopPipeline();
+		pipelinedHashes[frameCount - 1] = HashPalettes(crowd);
+	}
+
+	bool isDeterministic = serialHashes == pipelinedHashes;
+	Print(std::to_wstring(instanceCount) + L" instances, " + std::to_wstring(threadCount) + L" job threads, " +
+		std::to_wstring(drawMs) + L" ms of draw work\n" +
+		L"  serial " + std::to_wstring(serialMs) + L" ms/frame, pipelined " + std::to_wstring(pipelinedMs) +
+		L" ms/frame (x" + std::to_wstring(serialMs / pipelinedMs) + L")\n" +
+		L"  " + Verdict(isDeterministic) + L" : pipelined palettes match the serial ones one frame later\n");
+}
+
+void Benchmark::RunCulledAnimation()
+{
+	Print(L"[Culled animation]\n");
+
+	std::vector<CharacterVertex> vertices;
+	auto asset = std::make_shared<SkinnedData>();
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, *asset, clips))
+		return;
+
+	std::vector<AnimationStateDesc> states;
+	for (auto& clipName : clips)
+	{
+		states.push_back({ clipName, eClipList::Idle, true, false });
+	}
+	auto stateMachine = std::make_shared<AnimationStateMachine>();
+	stateMachine->Compile(*asset, states);
+
+	const UINT crowdSize = 1000;
+	const float dt = 1.0f / 60.0f;
+	const int frameCount = 240;
+
+	// The camera at the origin looking down +z
+	const float fovY = 0.25f * MathHelper::Pi;
+	const float aspect = 16.0f / 9.0f;
+	BoundingFrustum frustum;
+	BoundingFrustum::CreateFromMatrix(frustum, XMMatrixPerspectiveFovLH(fovY, aspect, 1.0f, 1000.0f));
+	const float edgeSlope = tanf(0.5f * fovY) * aspect;
+
+	auto makeCrowd = [&](std::vector<SkinnedModelInstance>& crowd)
+	{
+		crowd.resize(crowdSize);
+		for (UINT i = 0; i < crowdSize; ++i)
+		{
+			crowd[i].SkinnedInfo = asset;
+			crowd[i].StateMachine = stateMachine;
+			crowd[i].State = i % stateMachine->GetStateCount();
+			crowd[i].TimePos = fmodf(i * 0.37f, stateMachine->GetClipEndTime(crowd[i].State));
+			crowd[i].FinalTransforms.resize(asset->BoneCount());
+		}
+	};
+
+	// In view, behind the camera, or centered on the left side of the frustum
+	auto place = [&](UINT i, bool isBehind, bool isAtEdge)
+	{
+		float z = 20.0f + (i % 50) * 2.0f;
+		XMFLOAT4X4 world;
+		XMStoreFloat4x4(&world, XMMatrixTranslation(isAtEdge ? -z * edgeSlope : 0.0f, 0.0f, isBehind ? -z : z));
+		return world;
+	};
+
+	// Single threaded, so the cost is per instance and not per core
+	JobSystem jobs(1);
+	auto runCrowd = [&](std::vector<SkinnedModelInstance>& crowd, const std::vector<XMFLOAT4X4>& worlds, const BoundingFrustum* cullFrustum)
+	{
+		AnimationStage stage;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			stage.Begin(cullFrustum);
+			for (UINT i = 0; i < crowdSize; ++i)
+			{
+				XMMATRIX world = XMLoadFloat4x4(&worlds[i]);
+				stage.Add(&crowd[i], 0.0f, &world, 1);
+			}
+			stage.Run(jobs, dt);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		return ElapsedMs(start, end) / frameCount;
+	};
+
+	// Every instance evaluated, the poses the culled runs are compared with
+	std::vector<SkinnedModelInstance> reference;
+	makeCrowd(reference);
+	std::vector<XMFLOAT4X4> worlds(crowdSize);
+	for (UINT i = 0; i < crowdSize; ++i)
+		worlds[i] = place(i, false, false);
+	double referenceMs = runCrowd(reference, worlds, nullptr);
+	Print(std::to_wstring(crowdSize) + L" instances without culling : " + std::to_wstring(referenceMs) + L" ms/frame\n");
+
+	bool pass = true;
+	const UINT offScreenPercents[] = { 0, 50, 90 };
+	for (UINT percent : offScreenPercents)
+	{
+		for (UINT i = 0; i < crowdSize; ++i)
+			worlds[i] = place(i, i % 100 < percent, false);
+
+		std::vector<SkinnedModelInstance> crowd;
+		makeCrowd(crowd);
+		double frameMs = runCrowd(crowd, worlds, &frustum);
+
+		UINT culledCount = 0;
+		float maxError = 0.0f;
+		for (UINT i = 0; i < crowdSize; ++i)
+		{
+			if (crowd[i].IsCulled)
+				++culledCount;
+			else
+				maxError = (std::max)(maxError, MaxDifference(reference[i].PresentedTransforms, crowd[i].PresentedTransforms));
+		}
+		pass = pass && maxError == 0.0f;
+
+		Print(std::to_wstring(percent) + L"% off screen : " + std::to_wstring(culledCount) + L" culled, " +
+			std::to_wstring(frameMs) + L" ms/frame (x" + std::to_wstring(referenceMs / frameMs) +
+			L"), max palette difference in view " + std::to_wstring(maxError) + L"\n");
+	}
+
+	// Half in view, only the bones whose clip bounds reach the frustum are evaluated
+	{
+		for (UINT i = 0; i < crowdSize; ++i)
+			worlds[i] = place(i, false, true);
+
+		std::vector<SkinnedModelInstance> crowd;
+		makeCrowd(crowd);
+		double frameMs = runCrowd(crowd, worlds, &frustum);
+
+		UINT partialCount = 0;
+		size_t evaluatedCount = 0;
+		float maxError = 0.0f;
+		for (UINT i = 0; i < crowdSize; ++i)
+		{
+			if (!crowd[i].IsPartial)
+				continue;
+
+			++partialCount;
+			evaluatedCount += crowd[i].VisibleBones.Bones.size();
+			for (UINT bone : crowd[i].VisibleBones.Bones)
+			{
+				const XMFLOAT4X4& a = reference[i].PresentedTransforms[bone];
+				const XMFLOAT4X4& b = crowd[i].PresentedTransforms[bone];
+				for (int j = 0; j < 4; ++j)
+				{
+					for (int k = 0; k < 4; ++k)
+						maxError = (std::max)(maxError, fabsf(a.m[j][k] - b.m[j][k]));
+				}
+			}
+		}
+		pass = pass && maxError == 0.0f;
+
+		Print(L"across the frustum side : " + std::to_wstring(partialCount) + L" partly visible, " +
+			std::to_wstring(partialCount > 0 ? (double)evaluatedCount / partialCount : 0.0) + L" of " +
+			std::to_wstring(asset->BoneCount()) + L" bones evaluated, " + std::to_wstring(frameMs) + L" ms/frame (x" +
+			std::to_wstring(referenceMs / frameMs) + L"), max difference of the evaluated bones " + std::to_wstring(maxError) + L"\n");
+	}
+
+	// Behind the camera for half the frames, then in view. The pose presented
+	// by Add on the way back must be the one of the instances never culled.
+	{
+		std::vector<SkinnedModelInstance> returning, lockstep;
+		makeCrowd(returning);
+		makeCrowd(lockstep);
+		AnimationStage cullStage, referenceStage;
+		float returnError = 0.0f;
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			bool isBehind = frame < frameCount / 2;
+			cullStage.Begin(&frustum);
+			referenceStage.Begin();
+			for (UINT i = 0; i < crowdSize; ++i)
+			{
+				XMFLOAT4X4 placed = place(i, isBehind, false);
+				XMMATRIX world = XMLoadFloat4x4(&placed);
+				cullStage.Add(&returning[i], 0.0f, &world, 1);
+				referenceStage.Add(&lockstep[i]);
+			}
+
+			if (frame == frameCount / 2)
+			{
+				for (UINT i = 0; i < crowdSize; ++i)
+					returnError = (std::max)(returnError, MaxDifference(lockstep[i].PresentedTransforms, returning[i].PresentedTransforms));
+			}
+
+			cullStage.Run(jobs, dt);
+			referenceStage.Run(jobs, dt);
+		}
+
+		float endError = 0.0f;
+		for (UINT i = 0; i < crowdSize; ++i)
+			endError = (std::max)(endError, MaxDifference(lockstep[i].PresentedTransforms, returning[i].PresentedTransforms));
+		pass = pass && returnError == 0.0f && endError == 0.0f;
+
+		Print(L"back in view after " + std::to_wstring(frameCount / 2) + L" culled frames : max palette difference " +
+			std::to_wstring(returnError) + L" on the first frame, " + std::to_wstring(endError) + L" " +
+			std::to_wstring(frameCount / 2) + L" frames later\n");
+	}
+
+	Print(Verdict(pass) + L" : culled and partial poses match the evaluated ones\n");
+}
@@ -0,0 +1,333 @@
+#include "FrameResource.h"
+#include "RenderItem.h"
+#include "MotionDatabase.h"
+#include "Benchmark.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Search without SIMD or blocks, frame by frame over the normalized features
+	UINT LinearSearch(const std::vector<float>& frameFeatures, const float* query, float& outCost)
+	{
+		const UINT featureCount = MotionDatabase::kFeatureCount;
+		UINT best = kInvalidMotionFrame;
+		outCost = FLT_MAX;
+		for (UINT frame = 0; frame < frameFeatures.size() / featureCount; ++frame)
+		{
+			const float* features = &frameFeatures[frame * featureCount];
+			float cost = 0.0f;
+			for (UINT f = 0; f < featureCount; ++f)
+			{
+				float d = features[f] - query[f];
+				cost += d * d;
+			}
+			if (cost < outCost)
+			{
+				outCost = cost;
+				best = frame;
+			}
+		}
+		return best;
+	}
+}
+
+void Benchmark::RunMotionMatching()
+{
+	Print(L"[Motion matching]\n");
+
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips))
+		return;
+
+	// The locomotion clips of the player, looping as in its state table
+	const std::string locomotionClips[] = { "Idle", "playerWalking", "run", "WalkingBackward" };
+	std::vector<AnimationStateDesc> states;
+	for (auto& clipName : locomotionClips)
+	{
+		if (std::find(clips.begin(), clips.end(), clipName) != clips.end())
+			states.push_back({ clipName, eClipList::Walking, true, false });
+	}
+	AnimationStateMachine stateMachine;
+	stateMachine.Compile(skinnedData, states);
+
+	std::vector<int> stateIndices;
+	for (int state = 0; state < (int)states.size(); ++state)
+		stateIndices.push_back(state);
+
+	MotionDatabase database;
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!database.Build(skinnedData, stateMachine, stateIndices))
+	{
+		PrintFailure(L"No hips or feet in the player skeleton\n");
+		return;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	const UINT frameCount = database.GetFrameCount();
+	Print(std::to_wstring(states.size()) + L" clips, " + std::to_wstring(frameCount) + L" frames of " +
+		std::to_wstring(MotionDatabase::kFeatureCount) + L" features, " + std::to_wstring(database.GetMemorySize() / 1024) +
+		L" KB, built in " + std::to_wstring(ElapsedMs(start, end)) + L" ms\n");
+	for (int state = 0; state < (int)states.size(); ++state)
+	{
+		XMFLOAT2 velocity = database.GetGroundVelocity(state);
+		Print(L"  " + std::wstring(states[state].ClipName.begin(), states[state].ClipName.end()) + L" : ground velocity (" +
+			std::to_wstring(velocity.x) + L", " + std::to_wstring(velocity.y) + L") m/s\n");
+	}
+
+	// Every frame is the nearest to its own features
+	UINT selfMisses = 0;
+	for (UINT frame = 0; frame < frameCount; ++frame)
+	{
+		float cost;
+		database.Search(database.GetFeatures(frame), &cost);
+		selfMisses += cost > 1e-6f ? 1 : 0;
+	}
+
+	// Queries as the player makes them: the pose playing with the trajectory of a gait
+	const UINT queryCount = 20000;
+	std::vector<MotionFeatures> queries(queryCount);
+	for (UINT i = 0; i < queryCount; ++i)
+	{
+		queries[i] = database.GetFeatures((i * 7919) % frameCount);
+		MotionDatabase::SetTrajectory(database.GetGroundVelocity(i % states.size()), queries[i]);
+	}
+
+	std::vector<float> frameFeatures(frameCount * MotionDatabase::kFeatureCount);
+	std::vector<float> normalizedQueries(queryCount * MotionDatabase::kFeatureCount);
+	for (UINT frame = 0; frame < frameCount; ++frame)
+		database.Normalize(database.GetFeatures(frame), &frameFeatures[frame * MotionDatabase::kFeatureCount]);
+	for (UINT i = 0; i < queryCount; ++i)
+		database.Normalize(queries[i], &normalizedQueries[i * MotionDatabase::kFeatureCount]);
+
+	std::vector<UINT> linearFrames(queryCount), searchFrames(queryCount);
+	std::vector<float> linearCosts(queryCount), searchCosts(queryCount);
+	start = std::chrono::high_resolution_clock::now();
+	for (UINT i = 0; i < queryCount; ++i)
+		linearFrames[i] = LinearSearch(frameFeatures, &normalizedQueries[i * MotionDatabase::kFeatureCount], linearCosts[i]);
+	end = std::chrono::high_resolution_clock::now();
+	double linearMs = ElapsedMs(start, end);
+
+	start = std::chrono::high_resolution_clock::now();
+	for (UINT i = 0; i < queryCount; ++i)
+		searchFrames[i] = database.Search(queries[i], &searchCosts[i]);
+	end = std::chrono::high_resolution_clock::now();
+	double searchMs = ElapsedMs(start, end);
+
+	// A different frame is only a tie within rounding
+	UINT mismatches = 0;
+	for (UINT i = 0; i < queryCount; ++i)
+	{
+		if (searchFrames[i] != linearFrames[i] && fabsf(searchCosts[i] - linearCosts[i]) > 1e-4f * (1.0f + linearCosts[i]))
+			++mismatches;
+	}
+
+	const UINT characterCount = 64;
+	double searchUs = searchMs * 1000.0 / queryCount;
+	double linearUs = linearMs * 1000.0 / queryCount;
+	Print(L"per query: linear " + std::to_wstring(linearUs) + L" us, SIMD " + std::to_wstring(searchUs) + L" us (x" +
+		std::to_wstring(linearMs / searchMs) + L"), " + std::to_wstring((UINT64)(queryCount / (searchMs / 1000.0))) + L" queries/s\n" +
+		std::to_wstring(characterCount) + L" characters searching every frame: " + std::to_wstring(searchUs * characterCount) + L" us per frame\n");
+
+	bool pass = selfMisses == 0 && mismatches == 0;
+	Print(Verdict(pass) + L" : " + std::to_wstring(selfMisses) + L" frames missed themselves, " +
+		std::to_wstring(mismatches) + L" of " + std::to_wstring(queryCount) + L" queries differ from the linear search\n");
+}
+
+void Benchmark::RunRootMotion()
+{
+	Print(L"[Root motion]\n");
+
+	// The clips as loaded and the same clips with their root motion extracted
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData, extracted;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips) || !LoadPlayer(vertices, extracted, clips))
+		return;
+
+	const std::vector<std::string> contactBones = { "LeftFoot", "RightFoot" };
+	const auto& boneNames = skinnedData.GetBoneName();
+	int feet[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		feet[i] = (int)(std::find(boneNames.begin(), boneNames.end(), contactBones[i]) - boneNames.begin());
+		if (feet[i] == (int)boneNames.size())
+		{
+			PrintFailure(L"No feet in the player skeleton\n");
+			return;
+		}
+	}
+
+	const float frameTime = 1.0f / 60.0f;
+	const UINT repeatCount = 200;
+	const UINT boneCount = skinnedData.BoneCount();
+	std::vector<BoneTransform> plainPose(boneCount), extractedPose(boneCount), hipsPose(boneCount);
+	std::vector<XMFLOAT4X4> finalTransforms(boneCount);
+	bool pass = true;
+	for (const char* clipName : { "playerWalking", "run", "WalkingBackward" })
+	{
+		ClipHandle clip = skinnedData.GetClipHandle(clipName);
+		if (clip == kInvalidClip)
+			continue;
+
+		UINT plainKeys = skinnedData.GetAnimation(clip).GetKeyCount();
+		if (!extracted.ExtractRootMotion(clip, contactBones))
+		{
+			Print(std::wstring(clipName, clipName + strlen(clipName)) + L" : no root motion extracted\n");
+			pass = false;
+			continue;
+		}
+		const RootMotionTrack& track = *extracted.GetRootMotion(clip);
+		float duration = skinnedData.GetClipEndTime(clip);
+		UINT frameCount = (UINT)(duration / frameTime) + 1;
+		XMFLOAT2 travel = track.Displacements.back();
+		XMFLOAT2 velocity(travel.x / duration, travel.y / duration);
+
+		Print(std::wstring(clipName, clipName + strlen(clipName)) + L" : track " + std::to_wstring(track.Times.size()) + L" keys, " +
+			std::to_wstring(track.GetMemorySize()) + L" bytes, travel (" + std::to_wstring(travel.x) + L", " +
+			std::to_wstring(travel.y) + L") m per loop, pose keys " + std::to_wstring(plainKeys) + L" -> " +
+			std::to_wstring(extracted.GetAnimation(clip).GetKeyCount()) + L"\n");
+
+		// Reading the motion per frame: the track, or the hips of a sampled pose at run time
+		XMFLOAT2 sum(0.0f, 0.0f);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (UINT r = 0; r < repeatCount; ++r)
+		{
+			for (UINT f = 1; f < frameCount; ++f)
+			{
+				XMFLOAT2 delta = track.GetDelta((f - 1) * frameTime, f * frameTime);
+				sum.x += delta.x;
+				sum.y += delta.y;
+			}
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double deltaUs = ElapsedMs(start, end) * 1000.0 / (repeatCount * (frameCount - 1));
+
+		std::vector<UINT> keyCursors;
+		start = std::chrono::high_resolution_clock::now();
+		for (UINT r = 0; r < repeatCount; ++r)
+		{
+			for (UINT f = 0; f < frameCount; ++f)
+			{
+				skinnedData.GetModelPose(clip, f * frameTime, hipsPose, &keyCursors);
+				sum.x += hipsPose[0].Translation.x;
+			}
+		}
+		end = std::chrono::high_resolution_clock::now();
+		double hipsUs = ElapsedMs(start, end) * 1000.0 / (repeatCount * frameCount);
+
+		// The pose of the extracted clip holds every constant track as keys
+		double poseUs[2];
+		const SkinnedData* rigs[2] = { &skinnedData, &extracted };
+		for (int i = 0; i < 2; ++i)
+		{
+			keyCursors.clear();
+			start = std::chrono::high_resolution_clock::now();
+			for (UINT r = 0; r < repeatCount; ++r)
+			{
+				for (UINT f = 0; f < frameCount; ++f)
+					rigs[i]->GetFinalTransforms(clip, f * frameTime, finalTransforms, &keyCursors);
+			}
+			end = std::chrono::high_resolution_clock::now();
+			poseUs[i] = ElapsedMs(start, end) * 1000.0 / (repeatCount * frameCount);
+		}
+
+		Print(L"  per frame: root motion delta " + std::to_wstring(deltaUs) + L" us, hips of a sampled pose " +
+			std::to_wstring(hipsUs) + L" us; pose " + std::to_wstring(poseUs[0]) + L" us in place, " +
+			std::to_wstring(poseUs[1]) + L" us extracted\n");
+
+		// The extracted pose is the clip moved back by the horizontal travel of the hips
+		skinnedData.GetModelPose(clip, 0.0f, hipsPose);
+		float groundHeight = MathHelper::Infinity;
+		float poseError = 0.0f;
+		for (UINT f = 0; f < frameCount; ++f)
+		{
+			skinnedData.GetModelPose(clip, f * frameTime, plainPose);
+			extracted.GetModelPose(clip, f * frameTime, extractedPose);
+			XMFLOAT3 hips = plainPose[0].Translation;
+			for (UINT i = 0; i < boneCount; ++i)
+			{
+				const BoneTransform& a = plainPose[i];
+				const BoneTransform& b = extractedPose[i];
+				poseError = (std::max)(poseError, fabsf(a.Translation.x - (hips.x - hipsPose[0].Translation.x) - b.Translation.x));
+				poseError = (std::max)(poseError, fabsf(a.Translation.y - b.Translation.y));
+				poseError = (std::max)(poseError, fabsf(a.Translation.z - (hips.z - hipsPose[0].Translation.z) - b.Translation.z));
+				XMVECTOR q = XMQuaternionDot(XMLoadFloat4(&a.RotationQuat), XMLoadFloat4(&b.RotationQuat));
+				poseError = (std::max)(poseError, 1.0f - fabsf(XMVectorGetX(q)));
+			}
+			for (int foot : feet)
+				groundHeight = (std::min)(groundHeight, plainPose[foot].Translation.y);
+		}
+
+		// Slide of the planted foot in the world, cm per second of contact: the clip played
+		// in place under a character at the mean speed, and played by its root motion
+		float slides[2] = {};
+		float plantedTime = 0.0f;
+		XMFLOAT2 position[2] = {};
+		XMFLOAT3 prevFeet[2][2];
+		for (UINT f = 0; f < frameCount; ++f)
+		{
+			float t = f * frameTime;
+			skinnedData.GetModelPose(clip, t, plainPose);
+			extracted.GetModelPose(clip, t, extractedPose);
+			if (f > 0)
+			{
+				position[0] = XMFLOAT2(velocity.x * t, velocity.y * t);
+				XMFLOAT2 delta = track.GetDelta(t - frameTime, t);
+				position[1].x += delta.x;
+				position[1].y += delta.y;
+			}
+
+			XMFLOAT3 footPositions[2][2];
+			for (int i = 0; i < 2; ++i)
+			{
+				const std::vector<BoneTransform>& pose = i == 0 ? plainPose : extractedPose;
+				for (int j = 0; j < 2; ++j)
+				{
+					const XMFLOAT3& foot = pose[feet[j]].Translation;
+					footPositions[i][j] = XMFLOAT3(position[i].x + foot.x * kModelScale, foot.y, position[i].y + foot.z * kModelScale);
+				}
+			}
+
+			// The lowest foot near the ground over the frame is planted
+			if (f > 0)
+			{
+				int planted = -1;
+				float plantedHeight = groundHeight + 5.0f;
+				for (int j = 0; j < 2; ++j)
+				{
+					float height = 0.5f * (prevFeet[0][j].y + footPositions[0][j].y);
+					if (height <= plantedHeight)
+					{
+						planted = j;
+						plantedHeight = height;
+					}
+				}
+				if (planted >= 0)
+				{
+					plantedTime += frameTime;
+					for (int i = 0; i < 2; ++i)
+					{
+						float dx = footPositions[i][planted].x - prevFeet[i][planted].x;
+						float dz = footPositions[i][planted].z - prevFeet[i][planted].z;
+						slides[i] += sqrtf(dx * dx + dz * dz);
+					}
+				}
+			}
+			memcpy(prevFeet, footPositions, sizeof(prevFeet));
+		}
+
+		float slideSpeeds[2];
+		for (int i = 0; i < 2; ++i)
+			slideSpeeds[i] = plantedTime > 0.0f ? slides[i] * 100.0f / plantedTime : 0.0f;
+		Print(L"  planted foot slide: constant speed " + std::to_wstring(slideSpeeds[0]) + L" cm/s, root motion " +
+			std::to_wstring(slideSpeeds[1]) + L" cm/s over " + std::to_wstring(plantedTime) + L" s of contact; pose error " +
+			std::to_wstring(poseError) + L"\n");
+
+		pass = pass && poseError < 1e-3f && slideSpeeds[1] < slideSpeeds[0];
+	}
+
+	Print(Verdict(pass) + L" : extracted poses match the clips moved back by the hips, root motion slides less\n");
+}
@@ -0,0 +1,315 @@
+#include "FrameResource.h"
+#include "RenderItem.h"
+#include "Camera.h"
+#include "FbxLoader.h"
+#include "LodSelector.h"
+#include "TangentGenerator.h"
+#include "Benchmark.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Half a cylinder around the y axis whose texture is mirrored at angle 0:
+	// u = |angle| / pi and v = 1 - y / height. The tangent dP/du runs along the
+	// circle away from the seam on both sides, and the two sides have opposite
+	// handedness, so the vertices on the seam must be split.
+	void BuildMirroredCylinder(UINT slices, UINT stacks, float radius, float height,
+		std::vector<XMFLOAT3>& outPositions, std::vector<XMFLOAT3>& outNormals,
+		std::vector<XMFLOAT2>& outTexC, std::vector<uint32_t>& outIndices)
+	{
+		for (UINT i = 0; i <= stacks; ++i)
+		{
+			float y = height * i / stacks;
+			for (UINT j = 0; j <= slices; ++j)
+			{
+				float angle = XM_PI * ((float)j / slices - 0.5f);
+				outPositions.push_back(XMFLOAT3(radius * sinf(angle), y, radius * cosf(angle)));
+				outNormals.push_back(XMFLOAT3(sinf(angle), 0.0f, cosf(angle)));
+				outTexC.push_back(XMFLOAT2(fabsf(angle) / XM_PI, 1.0f - y / height));
+			}
+		}
+
+		for (UINT i = 0; i < stacks; ++i)
+		{
+			for (UINT j = 0; j < slices; ++j)
+			{
+				uint32_t v0 = i * (slices + 1) + j;
+				uint32_t v1 = v0 + slices + 1;
+				outIndices.insert(outIndices.end(), { v0, v1, v1 + 1, v0, v1 + 1, v0 + 1 });
+			}
+		}
+	}
+}
+
+void Benchmark::RunLodSelection()
+{
+	Print(L"[LOD selection]\n");
+
+	const std::string fileNames[] =
+	{
+		"../Resource/FBX/Architecture/Canyon/Canyon0",
+		"../Resource/FBX/Architecture/Rocks/RockCluster/RockCluster",
+		"../Resource/FBX/Architecture/Tree/Tree",
+		"../Resource/FBX/Architecture/houseA/house"
+	};
+
+	std::vector<std::vector<SubmeshLod>> meshLods;
+	std::vector<BoundingBox> meshBounds;
+	for (auto& fileName : fileNames)
+	{
+		FbxLoader fbx;
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<Material> materials;
+		std::vector<SubmeshLod> lods;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		if (FAILED(fbx.LoadFBX(vertices, indices, materials, fileName, &lods)) || vertices.empty())
+			continue;
+		auto end = std::chrono::high_resolution_clock::now();
+
+		BoundingBox box;
+		BoundingBox::CreateFromPoints(box, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
+		meshLods.push_back(lods);
+		meshBounds.push_back(box);
+
+		std::wstring text = std::wstring(fileName.begin(), fileName.end()) + L" (" + std::to_wstring(ElapsedMs(start, end)) + L" ms)\n";
+		for (size_t i = 0; i < lods.size(); ++i)
+		{
+			text += L"  LOD " + std::to_wstring(i) + L" : " + std::to_wstring(lods[i].IndexCount / 3) +
+				L" triangles, error " + std::to_wstring(lods[i].GeometricError) + L"\n";
+		}
+		Print(text);
+	}
+
+	if (meshLods.empty())
+	{
+		PrintFailure(L"No architecture mesh found\n");
+		return;
+	}
+
+	// A field of instances, every mesh scaled to about 20 units
+	const int gridSize = 16;
+	const float spacing = 30.0f;
+	std::vector<std::unique_ptr<RenderItem>> ritems;
+	std::vector<BoundingBox> bounds;
+	for (int z = 0; z < gridSize; ++z)
+	{
+		for (int x = 0; x < gridSize; ++x)
+		{
+			size_t mesh = (x + z * gridSize) % meshLods.size();
+			const BoundingBox& box = meshBounds[mesh];
+			float extent = (std::max)(box.Extents.x, (std::max)(box.Extents.y, box.Extents.z));
+
+			auto ritem = std::make_unique<RenderItem>();
+			XMMATRIX world = XMMatrixScaling(10.0f / extent, 10.0f / extent, 10.0f / extent) *
+				XMMatrixTranslation(x * spacing, 0.0f, z * spacing);
+			XMStoreFloat4x4(&ritem->World, world);
+			ritem->Lods = meshLods[mesh];
+
+			BoundingBox worldBox;
+			box.Transform(worldBox, world);
+			bounds.push_back(worldBox);
+			ritems.push_back(std::move(ritem));
+		}
+	}
+
+	// Scripted path: fly in low over the field, then climb out
+	Camera camera;
+	camera.SetProj(0.25f * MathHelper::Pi, 16.0f / 9.0f, 1.0f, 1000.0f);
+	const float viewportHeight = 720.0f;
+	const int frameCount = 1200;
+	const float fieldSize = gridSize * spacing;
+
+	const float hysteresis[] = { 1.0f, 0.75f };
+	for (float h : hysteresis)
+	{
+		LodSelector selector;
+		selector.SetHysteresis(h);
+		for (size_t i = 0; i < ritems.size(); ++i)
+		{
+			selector.AddRenderItem(ritems[i].get(), bounds[i]);
+		}
+
+		std::vector<UINT> prevLevel(ritems.size(), 0);
+		double totalTriangles = 0.0;
+		UINT peakTriangles = 0;
+		UINT levelSwitches = 0;
+		double selectMs = 0.0;
+
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			float t = (float)frame / (frameCount - 1);
+			float height = 5.0f + 150.0f * t * t;
+			camera.SetEyePosition(XMVectorSet(-50.0f + t * (fieldSize + 100.0f), height, fieldSize * 0.5f + 40.0f * sinf(t * 6.0f), 1.0f));
+
+			auto start = std::chrono::high_resolution_clock::now();
+			UINT triangles = selector.Select(camera, viewportHeight);
+			auto end = std::chrono::high_resolution_clock::now();
+			selectMs += ElapsedMs(start, end);
+
+			totalTriangles += triangles;
+			peakTriangles = (std::max)(peakTriangles, triangles);
+
+			for (size_t i = 0; i < ritems.size(); ++i)
+			{
+				if (frame > 0 && ritems[i]->LodIndex != prevLevel[i])
+					levelSwitches++;
+				prevLevel[i] = ritems[i]->LodIndex;
+			}
+		}
+
+		Print(L"Hysteresis " + std::to_wstring(h) + L", " + std::to_wstring(ritems.size()) + L" items, " + std::to_wstring(frameCount) + L" frames\n" +
+			L"  full detail " + std::to_wstring(selector.GetFullDetailTriangles()) + L" triangles/frame\n" +
+			L"  submitted avg " + std::to_wstring((UINT)(totalTriangles / frameCount)) + L", peak " + std::to_wstring(peakTriangles) + L" triangles/frame\n" +
+			L"  level switches " + std::to_wstring(levelSwitches) + L"\n" +
+			L"  selection " + std::to_wstring(selectMs * 1000.0 / frameCount) + L" us/frame\n");
+	}
+}
+
+void Benchmark::RunTangentFrames()
+{
+	Print(L"[Tangent frames]\n");
+
+	const std::string fileNames[] =
+	{
+		"../Resource/FBX/Architecture/Canyon/Canyon0",
+		"../Resource/FBX/Architecture/Rocks/RockCluster/RockCluster",
+		"../Resource/FBX/Architecture/Tree/Tree",
+		"../Resource/FBX/Architecture/houseA/house"
+	};
+
+	// Quantization alone stays well under this
+	const float maxAngleError = 0.01f;
+
+	// Against the analytic frames of a mirrored seam, not against another run of the same code.
+	// Big enough for Generate to split the work across threads.
+	{
+		const UINT slices = 256;
+		const UINT stacks = 64;
+		const float height = 4.0f;
+		std::vector<XMFLOAT3> positions;
+		std::vector<XMFLOAT3> normals;
+		std::vector<XMFLOAT2> texC;
+		std::vector<uint32_t> indices;
+		BuildMirroredCylinder(slices, stacks, 1.0f, height, positions, normals, texC, indices);
+
+		TangentGenerator generator;
+		std::vector<XMFLOAT4> tangents;
+		std::vector<uint32_t> split;
+		generator.Generate(positions, normals, texC, indices, tangents, split);
+
+		// Every corner must reach a frame for the side of the seam its triangle lies on
+		UINT signMismatches = 0;
+		float maxTangentError = 0.0f;
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			size_t t = i - i % 3;
+			float side = positions[indices[t]].x + positions[indices[t + 1]].x + positions[indices[t + 2]].x < 0.0f ? -1.0f : 1.0f;
+
+			uint32_t v = indices[i];
+			uint32_t source = v < positions.size() ? v : split[v - positions.size()];
+			XMVECTOR n = XMLoadFloat3(&normals[source]);
+			XMVECTOR expected = XMVectorScale(XMVectorSet(XMVectorGetZ(n), 0.0f, -XMVectorGetX(n), 0.0f), side);
+			// bitangent = w * cross(normal, tangent) follows dP/dv, down the y axis
+			float w = XMVectorGetY(XMVector3Cross(n, expected)) < 0.0f ? 1.0f : -1.0f;
+
+			maxTangentError = (std::max)(maxTangentError, XMVectorGetX(XMVector3AngleBetweenNormals(XMLoadFloat4(&tangents[v]), expected)));
+			if (tangents[v].w != w)
+				signMismatches++;
+		}
+
+		bool pass = split.size() == stacks + 1 && signMismatches == 0 && maxTangentError < maxAngleError;
+		Print(L"Mirrored cylinder : " + Verdict(pass) + L"\n" +
+			L"  " + std::to_wstring(positions.size()) + L" vertices, " + std::to_wstring(split.size()) + L" new splits, " +
+			std::to_wstring(stacks + 1) + L" on the seam\n" +
+			L"  against analytic frames: tangent error " + std::to_wstring(maxTangentError) + L" rad, handedness mismatches " +
+			std::to_wstring(signMismatches) + L"\n");
+	}
+
+	for (auto& fileName : fileNames)
+	{
+		FbxLoader fbx;
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<Material> materials;
+		if (FAILED(fbx.LoadFBX(vertices, indices, materials, fileName)) || vertices.empty())
+		{
+			PrintFailure(L"No mesh found at " + std::wstring(fileName.begin(), fileName.end()) + L"\n");
+			continue;
+		}
+
+		// The cache only keeps the packed frames, the normals come back out of them
+		std::vector<XMFLOAT3> positions(vertices.size());
+		std::vector<XMFLOAT3> normals(vertices.size());
+		std::vector<XMFLOAT2> texC(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			XMFLOAT4 tangent;
+			TangentGenerator::UnpackQTangent(vertices[i].QTangent, normals[i], tangent);
+			positions[i] = vertices[i].Pos;
+			texC[i] = vertices[i].TexC;
+		}
+
+		TangentGenerator generator;
+		std::vector<uint32_t> indicesParallel = indices;
+		std::vector<XMFLOAT4> tangentsParallel;
+		std::vector<uint32_t> splitParallel;
+		auto start = std::chrono::high_resolution_clock::now();
+		generator.Generate(positions, normals, texC, indicesParallel, tangentsParallel, splitParallel);
+		auto end = std::chrono::high_resolution_clock::now();
+		double parallelMs = ElapsedMs(start, end);
+
+		std::vector<uint32_t> indicesReference = indices;
+		std::vector<XMFLOAT4> tangentsReference;
+		std::vector<uint32_t> splitReference;
+		start = std::chrono::high_resolution_clock::now();
+		TangentGenerator::GenerateReference(positions, normals, texC, indicesReference, tangentsReference, splitReference);
+		end = std::chrono::high_resolution_clock::now();
+		double referenceMs = ElapsedMs(start, end);
+
+		// Against the reference: same splits, same handedness, tangents within the angle error
+		bool sameTopology = indicesParallel == indicesReference && splitParallel == splitReference;
+		UINT signMismatches = 0;
+		float maxTangentError = 0.0f;
+		for (size_t i = 0; i < tangentsParallel.size() && i < tangentsReference.size(); ++i)
+		{
+			XMVECTOR a = XMLoadFloat4(&tangentsParallel[i]);
+			XMVECTOR b = XMLoadFloat4(&tangentsReference[i]);
+			maxTangentError = (std::max)(maxTangentError, XMVectorGetX(XMVector3AngleBetweenNormals(a, b)));
+			if (tangentsParallel[i].w != tangentsReference[i].w)
+				signMismatches++;
+		}
+
+		// Packing round trip
+		float maxNormalPackError = 0.0f;
+		float maxTangentPackError = 0.0f;
+		UINT packSignMismatches = 0;
+		for (size_t i = 0; i < tangentsParallel.size(); ++i)
+		{
+			size_t source = i < vertices.size() ? i : splitParallel[i - vertices.size()];
+			XMFLOAT3 normal;
+			XMFLOAT4 tangent;
+			TangentGenerator::UnpackQTangent(TangentGenerator::PackQTangent(normals[source], tangentsParallel[i]), normal, tangent);
+
+			XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&normals[source]));
+			XMVECTOR t = XMLoadFloat4(&tangentsParallel[i]);
+			maxNormalPackError = (std::max)(maxNormalPackError, XMVectorGetX(XMVector3AngleBetweenNormals(n, XMLoadFloat3(&normal))));
+			maxTangentPackError = (std::max)(maxTangentPackError, XMVectorGetX(XMVector3AngleBetweenNormals(t, XMLoadFloat4(&tangent))));
+			if (tangent.w != tangentsParallel[i].w)
+				packSignMismatches++;
+		}
+
+		bool pass = sameTopology && signMismatches == 0 && packSignMismatches == 0 &&
+			maxTangentError < maxAngleError && maxNormalPackError < maxAngleError && maxTangentPackError < maxAngleError;
+
+		Print(std::wstring(fileName.begin(), fileName.end()) + L" : " + Verdict(pass) + L"\n" +
+			L"  " + std::to_wstring(vertices.size()) + L" vertices, " + std::to_wstring(splitParallel.size()) + L" new splits\n" +
+			L"  parallel " + std::to_wstring(parallelMs) + L" ms, reference " + std::to_wstring(referenceMs) + L" ms\n" +
+			L"  against reference: tangent error " + std::to_wstring(maxTangentError) + L" rad, handedness mismatches " + std::to_wstring(signMismatches) +
+			(sameTopology ? L"\n" : L", split mismatch\n") +
+			L"  packed: normal error " + std::to_wstring(maxNormalPackError) + L" rad, tangent error " + std::to_wstring(maxTangentPackError) +
+			L" rad, handedness mismatches " + std::to_wstring(packSignMismatches) + L"\n");
+	}
+}
@@ -0,0 +1,528 @@
+#include "FrameResource.h"
+#include "RenderItem.h"
+#include "TangentGenerator.h"
+#include "MorphBlender.h"
+#include "PoseEvaluator.h"
+#include "JobSystem.h"
+#include "CpuSkinner.h"
+#include "Benchmark.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// GetFinalTransforms before the palettes were written by the evaluator: the
+	// transforms first, then each multiplied by its offset and the model scale and transposed
+	void TwoPassFinalTransforms(const SkinnedData& skinnedData, const PoseEvaluator& evaluator, float t,
+		std::vector<XMFLOAT4X4>& finalTransforms, UINT& keyCursor)
+	{
+		evaluator.Evaluate(t, finalTransforms, keyCursor);
+
+		const auto& offsets = skinnedData.GetBoneOffsets();
+		for (UINT i = 0; i < offsets.size(); ++i)
+		{
+			XMMATRIX finalTransform = XMMatrixMultiply(XMLoadFloat4x4(&offsets[i]), XMLoadFloat4x4(&finalTransforms[i]));
+			finalTransform *= XMMatrixScaling(kModelScale, kModelScale, kModelScale);
+			XMStoreFloat4x4(&finalTransforms[i], XMMatrixTranspose(finalTransform));
+		}
+	}
+
+	// The SKINNED vertex shader in scalar code, every vertex with its four weights
+	void SkinReference(const std::vector<CharacterVertex>& vertices, const std::vector<XMFLOAT4X4>& finalTransforms,
+		std::vector<XMFLOAT3>& outPositions, std::vector<XMFLOAT3>& outNormals)
+	{
+		outPositions.resize(vertices.size());
+		outNormals.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const CharacterVertex& v = vertices[i];
+			XMFLOAT3 normal;
+			XMFLOAT4 tangent;
+			TangentGenerator::UnpackQTangent(v.QTangent, normal, tangent);
+
+			float weights[4] = { v.BoneWeights.x, v.BoneWeights.y, v.BoneWeights.z, 0.0f };
+			weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+
+			float p[3] = {}, n[3] = {};
+			for (int j = 0; j < 4; ++j)
+			{
+				// The uploaded palette is transposed, row k holds the k-th output of mul(v, M)
+				const XMFLOAT4X4& M = finalTransforms[v.BoneIndices[j]];
+				for (int k = 0; k < 3; ++k)
+				{
+					p[k] += weights[j] * (v.Pos.x * M.m[k][0] + v.Pos.y * M.m[k][1] + v.Pos.z * M.m[k][2] + M.m[k][3]);
+					n[k] += weights[j] * (normal.x * M.m[k][0] + normal.y * M.m[k][1] + normal.z * M.m[k][2]);
+				}
+			}
+
+			float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			outPositions[i] = XMFLOAT3(p[0], p[1], p[2]);
+			outNormals[i] = XMFLOAT3(n[0] / length, n[1] / length, n[2] / length);
+		}
+	}
+
+	// SkinVertex of Common.hlsl on the packed palette, positions only
+	void SkinPackedReference(const std::vector<CharacterVertex>& vertices, ePaletteFormat format, float paletteScale,
+		const XMFLOAT4* rows, std::vector<XMFLOAT3>& outPositions)
+	{
+		outPositions.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const CharacterVertex& v = vertices[i];
+			float weights[4] = { v.BoneWeights.x, v.BoneWeights.y, v.BoneWeights.z, 0.0f };
+			weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+			XMVECTOR pos = XMLoadFloat3(&v.Pos);
+
+			if (format == ePaletteFormat::DualQuaternion)
+			{
+				XMVECTOR pivot = XMLoadFloat4(&rows[v.BoneIndices[0] * 2]);
+				XMVECTOR real = XMVectorZero();
+				XMVECTOR dual = XMVectorZero();
+				for (int j = 0; j < 4; ++j)
+				{
+					XMVECTOR boneReal = XMLoadFloat4(&rows[v.BoneIndices[j] * 2]);
+					float weight = XMVectorGetX(XMVector4Dot(boneReal, pivot)) < 0.0f ? -weights[j] : weights[j];
+					real = XMVectorMultiplyAdd(XMVectorReplicate(weight), boneReal, real);
+					dual = XMVectorMultiplyAdd(XMVectorReplicate(weight), XMLoadFloat4(&rows[v.BoneIndices[j] * 2 + 1]), dual);
+				}
+				XMVECTOR invLength = XMVectorReciprocal(XMVector4Length(real));
+				real = XMVectorMultiply(real, invLength);
+				dual = XMVectorMultiply(dual, invLength);
+
+				XMVECTOR translation = XMVectorScale(XMQuaternionMultiply(XMQuaternionConjugate(real), dual), 2.0f);
+				XMStoreFloat3(&outPositions[i], XMVectorAdd(XMVector3Rotate(XMVectorScale(pos, paletteScale), real), translation));
+			}
+			else
+			{
+				float p[3] = {};
+				for (int j = 0; j < 4; ++j)
+				{
+					const XMFLOAT4* M = &rows[v.BoneIndices[j] * 3];
+					p[0] += weights[j] * (v.Pos.x * M[0].x + v.Pos.y * M[0].y + v.Pos.z * M[0].z + M[0].w);
+					p[1] += weights[j] * (v.Pos.x * M[1].x + v.Pos.y * M[1].y + v.Pos.z * M[1].z + M[1].w);
+					p[2] += weights[j] * (v.Pos.x * M[2].x + v.Pos.y * M[2].y + v.Pos.z * M[2].z + M[2].w);
+				}
+				outPositions[i] = XMFLOAT3(p[0], p[1], p[2]);
+			}
+		}
+	}
+}
+
+void Benchmark::RunSkinnedBounds()
+{
+	Print(L"[Skinned bounds]\n");
+
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips))
+		return;
+
+	const int sampleCount = 64;
+	std::vector<XMFLOAT4X4> finalTransforms(skinnedData.BoneCount());
+	for (auto& clipName : clips)
+	{
+		float startTime = skinnedData.GetClipStartTime(clipName);
+		float endTime = skinnedData.GetClipEndTime(clipName);
+
+		UINT escapedSamples = 0;
+		float maxEscape = 0.0f;
+		double volumeRatio = 0.0;
+		double boundsMs = 0.0;
+		for (int sample = 0; sample < sampleCount; ++sample)
+		{
+			float t = startTime + (endTime - startTime) * sample / (sampleCount - 1);
+			skinnedData.GetFinalTransforms(clipName, t, finalTransforms);
+
+			BoundingBox bounds;
+			auto start = std::chrono::high_resolution_clock::now();
+			skinnedData.GetAnimatedBounds(finalTransforms, bounds);
+			auto end = std::chrono::high_resolution_clock::now();
+			boundsMs += ElapsedMs(start, end);
+
+			// Brute force: skin every vertex like the vertex shader does
+			XMVECTOR vMin = XMVectorReplicate(MathHelper::Infinity);
+			XMVECTOR vMax = XMVectorReplicate(-MathHelper::Infinity);
+			for (auto& v : vertices)
+			{
+				float weights[4] = { v.BoneWeights.x, v.BoneWeights.y, v.BoneWeights.z, 0.0f };
+				weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+
+				XMVECTOR pos = XMLoadFloat3(&v.Pos);
+				XMVECTOR skinned = XMVectorZero();
+				for (int i = 0; i < 4; ++i)
+				{
+					XMMATRIX palette = XMMatrixTranspose(XMLoadFloat4x4(&finalTransforms[v.BoneIndices[i]]));
+					skinned = XMVectorMultiplyAdd(XMVectorReplicate(weights[i]), XMVector3TransformCoord(pos, palette), skinned);
+				}
+				vMin = XMVectorMin(vMin, skinned);
+				vMax = XMVectorMax(vMax, skinned);
+			}
+
+			// Skinned vertices blend points inside the bone boxes, so they can not leave the union
+			XMVECTOR boundsMin = XMVectorSubtract(XMLoadFloat3(&bounds.Center), XMLoadFloat3(&bounds.Extents));
+			XMVECTOR boundsMax = XMVectorAdd(XMLoadFloat3(&bounds.Center), XMLoadFloat3(&bounds.Extents));
+			XMVECTOR escape = XMVectorMax(XMVectorSubtract(boundsMin, vMin), XMVectorSubtract(vMax, boundsMax));
+			float sampleEscape = (std::max)(XMVectorGetX(escape), (std::max)(XMVectorGetY(escape), XMVectorGetZ(escape)));
+			if (sampleEscape > 1e-3f)
+				escapedSamples++;
+			maxEscape = (std::max)(maxEscape, sampleEscape);
+
+			XMFLOAT3 tight;
+			XMStoreFloat3(&tight, XMVectorSubtract(vMax, vMin));
+			volumeRatio += (8.0 * bounds.Extents.x * bounds.Extents.y * bounds.Extents.z) / ((double)tight.x * tight.y * tight.z);
+		}
+
+		Print(std::wstring(clipName.begin(), clipName.end()) + L" : " + Verdict(escapedSamples == 0) + L"\n" +
+			L"  " + std::to_wstring(sampleCount) + L" poses, " + std::to_wstring(escapedSamples) + L" not contained, max escape " + std::to_wstring(maxEscape) + L"\n" +
+			L"  volume against the skinned vertices " + std::to_wstring(volumeRatio / sampleCount) + L"x\n" +
+			L"  bounds " + std::to_wstring(boundsMs * 1000.0 / sampleCount) + L" us/pose, " + std::to_wstring(skinnedData.BoneCount()) + L" bones\n");
+	}
+}
+
+void Benchmark::RunMorphTargets()
+{
+	Print(L"[Morph targets]\n");
+
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips))
+		return;
+
+	std::vector<XMFLOAT3> basePositions(vertices.size());
+	std::vector<XMFLOAT3> baseNormals(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		XMFLOAT4 tangent;
+		TangentGenerator::UnpackQTangent(vertices[i].QTangent, baseNormals[i], tangent);
+		basePositions[i] = vertices[i].Pos;
+	}
+
+	BoundingBox box;
+	BoundingBox::CreateFromPoints(box, basePositions.size(), &basePositions[0], sizeof(XMFLOAT3));
+	float size = (std::max)(box.Extents.x, (std::max)(box.Extents.y, box.Extents.z));
+
+	// The character has no blend shapes: every channel bulges a patch around a
+	// seed vertex along the normals, like a facial or corrective shape would
+	const UINT maxChannels = 32;
+	const float radius = 0.1f * size;
+	std::vector<std::vector<uint32_t>> channelIndices(maxChannels);
+	std::vector<std::vector<XMFLOAT3>> channelPositions(maxChannels);
+	std::vector<std::vector<XMFLOAT3>> channelNormals(maxChannels);
+	std::vector<MorphTarget> targets;
+	for (UINT t = 0; t < maxChannels; ++t)
+	{
+		XMVECTOR seed = XMLoadFloat3(&basePositions[(t * 7919) % basePositions.size()]);
+		XMVECTOR bend = XMVector3Normalize(XMVectorSet(cosf(t * 1.3f), sinf(t * 0.7f), sinf(t * 1.9f), 0.0f));
+		float amplitude = 0.05f * size * (1.0f + 0.5f * sinf(t * 2.3f));
+
+		for (uint32_t i = 0; i < basePositions.size(); ++i)
+		{
+			float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&basePositions[i]), seed)));
+			if (distance >= radius)
+				continue;
+
+			float falloff = 1.0f - distance / radius;
+			falloff *= falloff;
+
+			XMVECTOR n = XMLoadFloat3(&baseNormals[i]);
+			XMVECTOR bentNormal = XMVector3Normalize(XMVectorMultiplyAdd(bend, XMVectorReplicate(0.5f * falloff), n));
+
+			XMFLOAT3 positionDelta, normalDelta;
+			XMStoreFloat3(&positionDelta, XMVectorScale(n, amplitude * falloff));
+			XMStoreFloat3(&normalDelta, XMVectorSubtract(bentNormal, n));
+
+			channelIndices[t].push_back(i);
+			channelPositions[t].push_back(positionDelta);
+			channelNormals[t].push_back(normalDelta);
+		}
+		targets.push_back(MorphBlender::BuildTarget("Channel" + std::to_string(t), channelIndices[t], channelPositions[t], channelNormals[t]));
+	}
+
+	const UINT channelCounts[] = { 1, 4, 16, 32 };
+	const int iterationCount = 200;
+	for (UINT channelCount : channelCounts)
+	{
+		MorphBlender blender;
+		blender.Set(std::vector<MorphTarget>(targets.begin(), targets.begin() + channelCount));
+
+		std::vector<float> weights(channelCount);
+		for (UINT t = 0; t < channelCount; ++t)
+		{
+			weights[t] = 0.25f + 0.75f * (t % 4) / 3.0f;
+		}
+
+		std::vector<XMFLOAT3> positions = basePositions;
+		std::vector<XMFLOAT3> normals = baseNormals;
+		UINT applied = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterationCount; ++i)
+		{
+			applied = blender.Apply(weights.data(), basePositions, baseNormals, positions, normals);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double applyMs = ElapsedMs(start, end) / iterationCount;
+
+		// Against the float deltas applied densely
+		std::vector<XMFLOAT3> referencePositions = basePositions;
+		std::vector<XMFLOAT3> referenceNormals = baseNormals;
+		for (UINT t = 0; t < channelCount; ++t)
+		{
+			for (size_t k = 0; k < channelIndices[t].size(); ++k)
+			{
+				uint32_t v = channelIndices[t][k];
+				XMStoreFloat3(&referencePositions[v], XMVectorMultiplyAdd(XMLoadFloat3(&channelPositions[t][k]), XMVectorReplicate(weights[t]), XMLoadFloat3(&referencePositions[v])));
+				XMStoreFloat3(&referenceNormals[v], XMVectorMultiplyAdd(XMLoadFloat3(&channelNormals[t][k]), XMVectorReplicate(weights[t]), XMLoadFloat3(&referenceNormals[v])));
+			}
+		}
+
+		float maxPositionError = 0.0f;
+		float maxNormalError = 0.0f;
+		for (size_t i = 0; i < positions.size(); ++i)
+		{
+			XMVECTOR difference = XMVectorSubtract(XMLoadFloat3(&positions[i]), XMLoadFloat3(&referencePositions[i]));
+			XMVECTOR referenceNormal = XMVector3Normalize(XMLoadFloat3(&referenceNormals[i]));
+			maxPositionError = (std::max)(maxPositionError, XMVectorGetX(XMVector3Length(difference)));
+			maxNormalError = (std::max)(maxNormalError, XMVectorGetX(XMVector3AngleBetweenNormals(XMLoadFloat3(&normals[i]), referenceNormal)));
+		}
+
+		// 16 bit positions and 8 bit normals
+		bool pass = maxPositionError < 1e-3f * size && maxNormalError < 0.02f;
+
+		size_t storedBytes = 0;
+		for (UINT t = 0; t < channelCount; ++t)
+		{
+			storedBytes += targets[t].Indices.size() * (sizeof(uint32_t) + sizeof(PackedVector::XMSHORTN4) + sizeof(PackedVector::XMBYTEN4));
+		}
+
+		Print(std::to_wstring(channelCount) + L" channels" + L" : " + Verdict(pass) + L"\n" +
+			L"  " + std::to_wstring(applied) + L" deltas over " + std::to_wstring(blender.GetTouchedCount()) + L" of " + std::to_wstring(vertices.size()) + L" vertices, " +
+			std::to_wstring(storedBytes / 1024) + L" KB\n" +
+			L"  apply " + std::to_wstring(applyMs * 1000.0) + L" us, " + std::to_wstring(applied / applyMs) + L" deltas/ms, " +
+			std::to_wstring(blender.GetTouchedCount() / applyMs) + L" vertices/ms\n" +
+			L"  against float deltas: position error " + std::to_wstring(maxPositionError) + L", normal error " + std::to_wstring(maxNormalError) + L" rad\n");
+	}
+}
+
+void Benchmark::RunCpuSkinning()
+{
+	Print(L"[CPU skinning]\n");
+
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips))
+		return;
+
+	CpuSkinner skinner;
+	skinner.Set(vertices);
+
+	JobSystem jobs;
+	const int sampleCount = 16;
+	const int repeatCount = 20;
+	// Meters after the model scale, finer than a ray pick resolves
+	const float maxPositionError = 1e-3f;
+	const float maxNormalError = 1e-4f;
+
+	std::vector<XMFLOAT4X4> finalTransforms(skinnedData.BoneCount());
+	std::vector<XMFLOAT3> referencePositions, referenceNormals, positions, normals;
+	double referenceMs = 0.0, serialMs = 0.0, parallelMs = 0.0;
+	float positionError = 0.0f, normalError = 0.0f;
+	for (auto& clipName : clips)
+	{
+		float startTime = skinnedData.GetClipStartTime(clipName);
+		float endTime = skinnedData.GetClipEndTime(clipName);
+		for (int sample = 0; sample < sampleCount; ++sample)
+		{
+			float t = startTime + (endTime - startTime) * sample / (sampleCount - 1);
+			skinnedData.GetFinalTransforms(clipName, t, finalTransforms);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			SkinReference(vertices, finalTransforms, referencePositions, referenceNormals);
+			auto end = std::chrono::high_resolution_clock::now();
+			referenceMs += ElapsedMs(start, end);
+
+			start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < repeatCount; ++i)
+				skinner.Skin(finalTransforms, positions, normals);
+			end = std::chrono::high_resolution_clock::now();
+			serialMs += ElapsedMs(start, end) / repeatCount;
+			positionError = (std::max)(positionError, MaxDifference(referencePositions, positions));
+			normalError = (std::max)(normalError, MaxDifference(referenceNormals, normals));
+
+			start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < repeatCount; ++i)
+				skinner.Skin(finalTransforms, positions, normals, &jobs);
+			end = std::chrono::high_resolution_clock::now();
+			parallelMs += ElapsedMs(start, end) / repeatCount;
+			positionError = (std::max)(positionError, MaxDifference(referencePositions, positions));
+			normalError = (std::max)(normalError, MaxDifference(referenceNormals, normals));
+		}
+	}
+
+	// Millions of vertices per second
+	double skinnedVertices = (double)vertices.size() * clips.size() * sampleCount;
+	auto rate = [skinnedVertices](double ms) { return std::to_wstring(skinnedVertices / ms / 1000.0); };
+
+	bool pass = positionError <= maxPositionError && normalError <= maxNormalError;
+	Print(std::to_wstring(vertices.size()) + L" vertices, " +
+		std::to_wstring(skinner.GetInfluenceCount(1)) + L"/" + std::to_wstring(skinner.GetInfluenceCount(2)) + L"/" +
+		std::to_wstring(skinner.GetInfluenceCount(3)) + L"/" + std::to_wstring(skinner.GetInfluenceCount(4)) +
+		L" with 1/2/3/4 influences\n" +
+		L"  scalar reference " + rate(referenceMs) + L" Mvertices/s\n" +
+		L"  SIMD 1 thread " + rate(serialMs) + L" Mvertices/s (x" + std::to_wstring(referenceMs / serialMs) + L")\n" +
+		L"  SIMD " + std::to_wstring(jobs.GetThreadCount()) + L" threads " + rate(parallelMs) + L" Mvertices/s (x" +
+		std::to_wstring(referenceMs / parallelMs) + L")\n" +
+		L"  " + Verdict(pass) + L" : position error " + std::to_wstring(positionError) +
+		L", normal error " + std::to_wstring(normalError) + L" against the reference\n");
+}
+
+void Benchmark::RunPaletteFormats()
+{
+	Print(L"[Palette formats]\n");
+
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips))
+		return;
+
+	const int sampleCount = 16;
+	// Meters after the model scale, like the CPU skinning check
+	const float maxPositionError = 1e-3f;
+	const float maxPaletteError = 1e-4f;
+	const UINT boneCount = skinnedData.BoneCount();
+
+	// Before the packing every render item uploaded the whole 4x4 palette
+	CharacterConstants constants;
+	UINT matrixBytes = (UINT)(sizeof(ObjectConstants) + 96 * sizeof(XMFLOAT4X4));
+	Print(L"4x4 matrices : " + std::to_wstring(matrixBytes) + L" bytes per render item and frame\n");
+
+	const ePaletteFormat formats[] = { ePaletteFormat::Affine3x4, ePaletteFormat::DualQuaternion };
+	const wchar_t* formatNames[] = { L"3x4 matrices", L"dual quaternions" };
+	for (int f = 0; f < _countof(formats); ++f)
+	{
+		if (!skinnedData.SetPaletteFormat(formats[f]))
+		{
+			Print(std::wstring(formatNames[f]) + L" : " + Verdict(false) + L" the skeleton is not rigid\n");
+			continue;
+		}
+
+		std::vector<XMFLOAT4X4> finalTransforms(boneCount), decoded;
+		std::vector<XMFLOAT3> reference, referenceNormals, positions;
+		float paletteError = 0.0f, positionError = 0.0f, rigidError = 0.0f;
+		double packMs = 0.0;
+		UINT rows = 0;
+		for (auto& clipName : clips)
+		{
+			float startTime = skinnedData.GetClipStartTime(clipName);
+			float endTime = skinnedData.GetClipEndTime(clipName);
+			for (int sample = 0; sample < sampleCount; ++sample)
+			{
+				float t = startTime + (endTime - startTime) * sample / (sampleCount - 1);
+				skinnedData.GetFinalTransforms(clipName, t, finalTransforms);
+
+				auto start = std::chrono::high_resolution_clock::now();
+				rows = skinnedData.PackPalette(finalTransforms, constants.BonePalette);
+				auto end = std::chrono::high_resolution_clock::now();
+				packMs += ElapsedMs(start, end);
+
+				skinnedData.UnpackPalette(constants.BonePalette, boneCount, decoded);
+				paletteError = (std::max)(paletteError, MaxDifference(finalTransforms, decoded));
+
+				// Dual quaternions blend differently from matrices, they agree on the single bone vertices
+				SkinReference(vertices, finalTransforms, reference, referenceNormals);
+				SkinPackedReference(vertices, formats[f], skinnedData.GetPaletteScale(), constants.BonePalette, positions);
+				for (size_t i = 0; i < vertices.size(); ++i)
+				{
+					const XMFLOAT3& w = vertices[i].BoneWeights;
+					float error = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&reference[i]), XMLoadFloat3(&positions[i]))));
+					if (formats[f] == ePaletteFormat::Affine3x4 || (w.x == 1.0f && w.y == 0.0f && w.z == 0.0f))
+						rigidError = (std::max)(rigidError, error);
+					positionError = (std::max)(positionError, error);
+				}
+			}
+		}
+
+		UINT uploadBytes = (UINT)((BYTE*)&constants.BonePalette[rows] - (BYTE*)&constants);
+		bool pass = paletteError <= maxPaletteError && rigidError <= maxPositionError;
+		Print(std::wstring(formatNames[f]) + L" : " + std::to_wstring(uploadBytes) + L" bytes per render item and frame (" +
+			std::to_wstring(100 * uploadBytes / matrixBytes) + L"%), " +
+			std::to_wstring(packMs * 1000.0 / (clips.size() * sampleCount)) + L" us to pack\n" +
+			L"  " + Verdict(pass) + L" : decoded palette error " + std::to_wstring(paletteError) +
+			L", skinned position error " + std::to_wstring(rigidError) +
+			(formats[f] == ePaletteFormat::DualQuaternion ? L" on single bone vertices, " + std::to_wstring(positionError) + L" from matrix blending\n" : L"\n"));
+	}
+}
+
+void Benchmark::RunFinalTransforms()
+{
+	Print(L"[Final transforms]\n");
+
+	std::vector<CharacterVertex> vertices;
+	SkinnedData skinnedData;
+	std::vector<std::string> clips;
+	if (!LoadPlayer(vertices, skinnedData, clips))
+		return;
+
+	const float dt = 1.0f / 60.0f;
+	const int loopCount = 20;
+	const UINT boneCount = skinnedData.BoneCount();
+
+	std::vector<XMFLOAT4X4> reference(boneCount);
+	std::vector<XMFLOAT4X4> fused(boneCount);
+	std::vector<UINT> keyCursors;
+	double twoPassMs = 0.0, fusedMs = 0.0;
+	float maxError = 0.0f;
+	UINT sampleCount = 0;
+	for (auto& clipName : clips)
+	{
+		ClipHandle clip = skinnedData.GetClipHandle(clipName);
+		PoseEvaluator evaluator;
+		if (!evaluator.Build(skinnedData.GetAnimation(clip)))
+			continue;
+
+		UINT keyCursor = 0;
+		keyCursors.clear();
+		for (int loop = 0; loop < loopCount; ++loop)
+		{
+			for (float t = 0.0f; t <= skinnedData.GetClipEndTime(clip); t += dt)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				TwoPassFinalTransforms(skinnedData, evaluator, t, reference, keyCursor);
+				auto end = std::chrono::high_resolution_clock::now();
+				twoPassMs += ElapsedMs(start, end);
+
+				start = std::chrono::high_resolution_clock::now();
+				skinnedData.GetFinalTransforms(clip, t, fused, &keyCursors);
+				end = std::chrono::high_resolution_clock::now();
+				fusedMs += ElapsedMs(start, end);
+
+				// The three rows the shader reads
+				for (UINT i = 0; i < boneCount; ++i)
+				{
+					for (int j = 0; j < 3; ++j)
+					{
+						for (int k = 0; k < 4; ++k)
+							maxError = (std::max)(maxError, fabsf(fused[i].m[j][k] - reference[i].m[j][k]));
+					}
+				}
+				++sampleCount;
+			}
+		}
+	}
+
+	if (sampleCount == 0)
+	{
+		PrintFailure(L"No clip to sample\n");
+		return;
+	}
+
+	bool pass = maxError < 1e-5f;
+	double toUs = 1000.0 / sampleCount;
+	Print(Verdict(pass) + L" : " + std::to_wstring(boneCount) + L" bones, " + std::to_wstring(sampleCount) +
+		L" samples, max difference " + std::to_wstring(maxError) + L"\n" +
+		L"  per character: two passes " + std::to_wstring(twoPassMs * toUs) + L" us, fused with prescaled offsets " +
+		std::to_wstring(fusedMs * toUs) + L" us (x" + std::to_wstring(twoPassMs / fusedMs) + L")\n");
+}
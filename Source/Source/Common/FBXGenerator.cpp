@@ -4,6 +4,13 @@
 #include "FbxLoader.h"
 #include "FBXGenerator.h"
 
+namespace
+{
+	// Keys and SIMD layouts the player keeps: the locomotion and the attacks,
+	// while Death and FlyingKick are loaded when they play
+	const size_t kPlayerClipBudget = 768 * 1024;
+}
+
 FBXGenerator::FBXGenerator()
 	:mInBeginEndPair(false)
 {
@@ -102,23 +109,67 @@ void FBXGenerator::LoadFBXPlayer(Player& mPlayer, Textures& mTextures, Textures&
 	std::vector<CharacterVertex> outSkinnedVertices;
 	std::vector<std::uint32_t> outIndices;
 	std::vector<Material> outMaterial;
-	SkinnedData outSkinnedInfo;
+	// Loaded once, then shared read only by the instances of the rig.
+	// The clip residency below keeps the one writable reference, see ClipResidency.
+	auto outSkinnedInfo = std::make_shared<SkinnedData>();
 
 	// Player
 	std::string FileName = "../Resource/FBX/Character/";
-	fbx.LoadFBX(outSkinnedVertices, outIndices, outSkinnedInfo, "Idle", outMaterial, FileName);
+	const std::string clipNames[] =
+	{
+		"Idle", "playerWalking", "run", "Kick", "Kick2", "FlyingKick",
+		"Hook", "HitReaction", "Death", "WalkingBackward"
+	};
+	fbx.LoadFBX(outSkinnedVertices, outIndices, *outSkinnedInfo, clipNames[0], outMaterial, FileName);
+
+	for (UINT i = 1; i < _countof(clipNames); ++i)
+	{
+		fbx.LoadFBX(*outSkinnedInfo, clipNames[i], FileName);
+	}
+
+	// The locomotion clips move the player, the hips stay over the origin of the pose
+	const std::vector<std::string> contactBones = { "LeftFoot", "RightFoot" };
+	for (const char* clipName : { "playerWalking", "run", "WalkingBackward" })
+	{
+		outSkinnedInfo->ExtractRootMotion(outSkinnedInfo->GetClipHandle(clipName), contactBones);
+	}
 
-	fbx.LoadFBX(outSkinnedInfo, "playerWalking", FileName);
-	fbx.LoadFBX(outSkinnedInfo, "run", FileName);
-	fbx.LoadFBX(outSkinnedInfo, "Kick", FileName);
-	fbx.LoadFBX(outSkinnedInfo, "Kick2", FileName);
-	fbx.LoadFBX(outSkinnedInfo, "FlyingKick", FileName);
-	fbx.LoadFBX(outSkinnedInfo, "Hook", FileName);
-	fbx.LoadFBX(outSkinnedInfo, "HitReaction", FileName);
-	fbx.LoadFBX(outSkinnedInfo, "Death", FileName);
-	fbx.LoadFBX(outSkinnedInfo, "WalkingBackward", FileName);
+	// The Mixamo rig is rigid, half the palette of 3x4 matrices.
+	// A scaled bone or key keeps the 3x4 matrices, which the shader reads as well.
+	if (!outSkinnedInfo->SetPaletteFormat(ePaletteFormat::DualQuaternion))
+	{
+		::OutputDebugString(L"Player rig is not rigid, palettes stay 3x4 matrices\n");
+	}
+
+	// Palettes of the far LOD tier, baked once and cached next to the clips
+	auto baked = std::make_shared<BakedAnimation>();
+	for (auto& clipName : clipNames)
+	{
+		if (fbx.LoadBakedAnimation(*baked, *outSkinnedInfo, clipName, FileName, kBakeFrameRate))
+			continue;
+
+		ClipHandle clip = outSkinnedInfo->GetClipHandle(clipName);
+		if (clip == kInvalidClip)
+			continue;
+		baked->Bake(*outSkinnedInfo, clip, kBakeFrameRate);
+		fbx.ExportBakedAnimation(*baked, *outSkinnedInfo, FileName, clipName);
+	}
 
 	mPlayer.BuildGeometry(mDevice, mCommandList, outSkinnedVertices, outIndices, outSkinnedInfo, "playerGeo");
+	mPlayer.SetBakedAnimation(baked);
+
+	// Every clip was cooked above, from now on the keys are evicted under the budget and
+	// read back from the .anim cache written by the first load
+	auto residency = std::make_shared<ClipResidency>(outSkinnedInfo, kPlayerClipBudget);
+	for (auto& clipName : clipNames)
+	{
+		residency->Register(outSkinnedInfo->GetClipHandle(clipName), [FileName, clipName](AnimationClip& outAnimation)
+		{
+			FbxLoader loader;
+			return loader.LoadAnimation(outAnimation, clipName, FileName);
+		});
+	}
+	mPlayer.SetClipResidency(residency);
 
 	BuildFBXTexture(outMaterial, "playerTex", "playerMat", mTextures, mTexturesNormal, mMaterials);
 }
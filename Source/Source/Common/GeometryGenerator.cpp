@@ -3,6 +3,7 @@
 //***************************************************************************************
 
 #include "GeometryGenerator.h"
+#include "TangentGenerator.h"
 #include <algorithm>
 
 using namespace DirectX;
@@ -632,6 +633,9 @@ void GeometryGenerator::CreateGrid(
 	float du = 1.0f / (n - 1);
 	float dv = 1.0f / (m - 1);
 
+	// Normal up, tangent along +x
+	PackedVector::XMSHORTN4 qTangent = TangentGenerator::PackQTangent(XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f));
+
 	for (uint32 i = 0; i < m; ++i)
 	{
 		float z = halfDepth - i * dz;
@@ -641,7 +645,7 @@ void GeometryGenerator::CreateGrid(
 
 			UIVertex U;
 			U.Pos = XMFLOAT3(x, 0.0f, z);
-			U.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			U.QTangent = qTangent;
 			U.Row = static_cast<float>(i); // row index
 
 			U.TexC.x = j * du;
@@ -0,0 +1,126 @@
+#include "JobSystem.h"
+
+JobSystem::JobSystem(UINT threadCount)
+	: mQueuedJobs(0)
+{
+	if (threadCount == 0)
+		threadCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+
+	for (UINT i = 0; i < threadCount; ++i)
+	{
+		mQueues.push_back(std::make_unique<JobQueue>());
+	}
+
+	// Queue 0 belongs to the thread calling ParallelFor
+	for (UINT i = 1; i < threadCount; ++i)
+	{
+		mWorkers.emplace_back(&JobSystem::WorkerMain, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+
+	for (auto& e : mWorkers)
+		e.join();
+}
+
+void JobSystem::ParallelFor(UINT count, UINT batchSize, const std::function<void(UINT, UINT)>& function)
+{
+	if (count == 0)
+		return;
+
+	batchSize = (std::max)(batchSize, 1u);
+	if (mWorkers.empty() || count <= batchSize)
+	{
+		function(0, count);
+		return;
+	}
+
+	UINT batchCount = (count + batchSize - 1) / batchSize;
+	std::atomic<UINT> remaining(batchCount);
+
+	UINT queueCount = (UINT)mQueues.size();
+	for (UINT batch = 0; batch < batchCount; ++batch)
+	{
+		Job job = { &function, batch * batchSize, (std::min)((batch + 1) * batchSize, count), &remaining };
+
+		JobQueue& queue = *mQueues[batch % queueCount];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		queue.Jobs.push_back(job);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mQueuedJobs += batchCount;
+	}
+	mWake.notify_all();
+
+	// Help until the last batch, including those running on the workers, is done
+	Job job;
+	while (remaining.load() > 0)
+	{
+		if (PopJob(0, job))
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WorkerMain(UINT queueIndex)
+{
+	Job job;
+	while (true)
+	{
+		if (PopJob(queueIndex, job))
+		{
+			Execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mWakeMutex);
+		mWake.wait(lock, [this] { return mStop || mQueuedJobs.load() > 0; });
+		if (mStop)
+			return;
+	}
+}
+
+bool JobSystem::PopJob(UINT queueIndex, Job& outJob)
+{
+	UINT queueCount = (UINT)mQueues.size();
+	for (UINT i = 0; i < queueCount; ++i)
+	{
+		UINT victim = (queueIndex + i) % queueCount;
+		JobQueue& queue = *mQueues[victim];
+
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Jobs.empty())
+			continue;
+
+		// The owner works from the back, thieves take from the front
+		if (i == 0)
+		{
+			outJob = queue.Jobs.back();
+			queue.Jobs.pop_back();
+		}
+		else
+		{
+			outJob = queue.Jobs.front();
+			queue.Jobs.pop_front();
+		}
+		--mQueuedJobs;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::Execute(const Job& job)
+{
+	(*job.Function)(job.Begin, job.End);
+	--(*job.Remaining);
+}
@@ -0,0 +1,144 @@
+#include "Camera.h"
+#include "RenderItem.h"
+#include "LodSelector.h"
+
+using namespace DirectX;
+
+LodSelector::LodSelector()
+	: mThreshold(1.0f),
+	mHysteresis(0.75f)
+{
+}
+
+LodSelector::~LodSelector()
+{
+}
+
+void LodSelector::Clear()
+{
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mRadius.clear();
+
+	mLods.clear();
+	mLodOffset.clear();
+	mLodCount.clear();
+	mLodIndex.clear();
+
+	mRitems.clear();
+	mDistance.clear();
+}
+
+void LodSelector::AddRenderItem(RenderItem* ritem, const BoundingBox& bounds)
+{
+	if (ritem->Lods.empty())
+		return;
+
+	// Remove the padding of the last group of four
+	size_t count = mRitems.size();
+	mCenterX.resize(count);
+	mCenterY.resize(count);
+	mCenterZ.resize(count);
+	mRadius.resize(count);
+
+	BoundingSphere sphere;
+	BoundingSphere::CreateFromBoundingBox(sphere, bounds);
+	mCenterX.push_back(sphere.Center.x);
+	mCenterY.push_back(sphere.Center.y);
+	mCenterZ.push_back(sphere.Center.z);
+	mRadius.push_back(sphere.Radius);
+
+	// The errors are in object space, scale them like the world matrix does
+	XMMATRIX world = XMLoadFloat4x4(&ritem->World);
+	float scale = XMVectorGetX(XMVectorMax(XMVector3Length(world.r[0]),
+		XMVectorMax(XMVector3Length(world.r[1]), XMVector3Length(world.r[2]))));
+
+	mLodOffset.push_back((UINT)mLods.size());
+	mLodCount.push_back((UINT)ritem->Lods.size());
+	mLodIndex.push_back(0);
+	for (auto& e : ritem->Lods)
+	{
+		SubmeshLod lod = e;
+		lod.GeometricError *= scale;
+		mLods.push_back(lod);
+	}
+
+	mRitems.push_back(ritem);
+
+	// Far away padding never changes the result
+	size_t padded = (mRitems.size() + 3) & ~3;
+	mCenterX.resize(padded, 0.0f);
+	mCenterY.resize(padded, 0.0f);
+	mCenterZ.resize(padded, 0.0f);
+	mRadius.resize(padded, 0.0f);
+	mDistance.resize(padded, 0.0f);
+}
+
+UINT LodSelector::Select(const Camera& camera, float viewportHeight)
+{
+	// Pixels covered by one unit at distance one
+	XMMATRIX proj = camera.GetProj();
+	float projScale = XMVectorGetY(proj.r[1]) * viewportHeight * 0.5f;
+
+	XMFLOAT3 eye = camera.GetEyePosition3f();
+	XMVECTOR eyeX = XMVectorReplicate(eye.x);
+	XMVECTOR eyeY = XMVectorReplicate(eye.y);
+	XMVECTOR eyeZ = XMVectorReplicate(eye.z);
+	XMVECTOR minDistance = XMVectorReplicate(0.001f);
+
+	// Distance from the eye to the bounding spheres, four items at once
+	for (size_t i = 0; i < mDistance.size(); i += 4)
+	{
+		XMVECTOR dx = XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterX[i])), eyeX);
+		XMVECTOR dy = XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterY[i])), eyeY);
+		XMVECTOR dz = XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterZ[i])), eyeZ);
+		XMVECTOR r = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mRadius[i]));
+
+		XMVECTOR lengthSq = XMVectorMultiplyAdd(dz, dz, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dx, dx)));
+		XMVECTOR distance = XMVectorMax(XMVectorSubtract(XMVectorSqrt(lengthSq), r), minDistance);
+
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&mDistance[i]), distance);
+	}
+
+	UINT triangles = 0;
+	for (size_t i = 0; i < mRitems.size(); ++i)
+	{
+		const SubmeshLod* lods = &mLods[mLodOffset[i]];
+		float pixelsPerUnit = projScale / mDistance[i];
+
+		// Refine while the current level is visibly wrong,
+		// coarsen only when the next level is well under the threshold
+		UINT level = mLodIndex[i];
+		while (level > 0 && lods[level].GeometricError * pixelsPerUnit > mThreshold)
+			--level;
+		while (level + 1 < mLodCount[i] && lods[level + 1].GeometricError * pixelsPerUnit <= mThreshold * mHysteresis)
+			++level;
+
+		mLodIndex[i] = level;
+
+		RenderItem* ri = mRitems[i];
+		ri->LodIndex = level;
+		ri->IndexCount = lods[level].IndexCount;
+		ri->StartIndexLocation = lods[level].StartIndexLocation;
+
+		triangles += lods[level].IndexCount / 3;
+	}
+
+	return triangles;
+}
+
+UINT LodSelector::GetFullDetailTriangles() const
+{
+	UINT triangles = 0;
+	for (size_t i = 0; i < mRitems.size(); ++i)
+	{
+		triangles += mLods[mLodOffset[i]].IndexCount / 3;
+	}
+	return triangles;
+}
+
+UINT LodSelector::GetSize() const
+{
+	return (UINT)mRitems.size();
+}
@@ -4,6 +4,9 @@
 #include "FrameResource.h"
 #include "vertexHash.h"
 #include "FbxLoader.h"
+#include "MeshSimplifier.h"
+#include "TangentGenerator.h"
+#include "MorphBlender.h"
 
 using namespace fbxsdk;
 
@@ -18,19 +21,165 @@ FbxLoader::~FbxLoader()
 
 FbxManager * gFbxManager = nullptr;
 
+// Callers that do not draw by LOD only get the full resolution indices
+static void SelectLods(
+	std::vector<uint32_t>& outIndexVector,
+	const std::vector<SubmeshLod>& lods,
+	std::vector<SubmeshLod>* outLods)
+{
+	if (outLods != nullptr)
+		*outLods = lods;
+	else if (!lods.empty())
+		outIndexVector.resize(lods[0].IndexCount);
+}
+
+// Packs the normals with generated tangents into the QTangent of every vertex.
+// Vertices on mirrored UV seams are duplicated and their indices rewritten.
+template <typename T>
+static void BuildTangentFrames(
+	std::vector<T>& outVertexVector,
+	std::vector<uint32_t>& outIndexVector,
+	std::vector<DirectX::XMFLOAT3>& normals,
+	std::vector<uint32_t>* outSplitSource = nullptr)
+{
+	std::vector<DirectX::XMFLOAT3> positions(outVertexVector.size());
+	std::vector<DirectX::XMFLOAT2> texC(outVertexVector.size());
+	for (size_t i = 0; i < outVertexVector.size(); ++i)
+	{
+		positions[i] = outVertexVector[i].Pos;
+		texC[i] = outVertexVector[i].TexC;
+	}
+
+	TangentGenerator generator;
+	std::vector<DirectX::XMFLOAT4> tangents;
+	std::vector<uint32_t> splitSource;
+	generator.Generate(positions, normals, texC, outIndexVector, tangents, splitSource);
+
+	outVertexVector.reserve(outVertexVector.size() + splitSource.size());
+	normals.reserve(normals.size() + splitSource.size());
+	for (auto e : splitSource)
+	{
+		outVertexVector.push_back(outVertexVector[e]);
+		normals.push_back(normals[e]);
+	}
+
+	for (size_t i = 0; i < outVertexVector.size(); ++i)
+	{
+		outVertexVector[i].QTangent = TangentGenerator::PackQTangent(normals[i], tangents[i]);
+	}
+
+	if (outSplitSource != nullptr)
+		*outSplitSource = splitSource;
+}
+
+// Normal of a layer element at a control point / polygon vertex
+static FbxVector4 GetElementNormal(FbxGeometryElementNormal* pNormals, int controlPointIndex, int polygonVertexIndex)
+{
+	int index = pNormals->GetMappingMode() == FbxGeometryElement::eByControlPoint ? controlPointIndex : polygonVertexIndex;
+	if (pNormals->GetReferenceMode() == FbxGeometryElement::eIndexToDirect)
+		index = pNormals->GetIndexArray().GetAt(index);
+
+	return pNormals->GetDirectArray().GetAt(index);
+}
+
+// Reads the "QTangent" line of a cached vertex, or the "Normal" line of older exports
+static void ReadQTangent(std::ifstream& fileIn, Vertex& vertex, std::vector<DirectX::XMFLOAT3>& normals)
+{
+	std::string name;
+	fileIn >> name;
+	if (name == "Normal")
+	{
+		DirectX::XMFLOAT3 normal;
+		fileIn >> normal.x >> normal.y >> normal.z;
+		normals.push_back(normal);
+	}
+	else
+	{
+		int temp[4];
+		fileIn >> temp[0] >> temp[1] >> temp[2] >> temp[3];
+		vertex.QTangent = DirectX::PackedVector::XMSHORTN4(
+			static_cast<int16_t>(temp[0]), static_cast<int16_t>(temp[1]),
+			static_cast<int16_t>(temp[2]), static_cast<int16_t>(temp[3]));
+	}
+}
+
+// Bone space box of the vertices influenced by each bone
+static void BuildBoneBounds(const std::vector<CharacterVertex>& vertices, SkinnedData& skinnedData)
+{
+	using namespace DirectX;
+
+	UINT boneCount = skinnedData.BoneCount();
+	const std::vector<XMFLOAT4X4>& boneOffsets = skinnedData.GetBoneOffsets();
+
+	std::vector<XMFLOAT3> boneMin(boneCount, XMFLOAT3(MathHelper::Infinity, MathHelper::Infinity, MathHelper::Infinity));
+	std::vector<XMFLOAT3> boneMax(boneCount, XMFLOAT3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity));
+	for (auto& v : vertices)
+	{
+		float weights[4] = { v.BoneWeights.x, v.BoneWeights.y, v.BoneWeights.z, 0.0f };
+		weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+
+		XMVECTOR pos = XMLoadFloat3(&v.Pos);
+		for (int i = 0; i < 4; ++i)
+		{
+			UINT bone = v.BoneIndices[i];
+			if (weights[i] <= 1e-4f || bone >= boneCount)
+				continue;
+
+			XMVECTOR bonePos = XMVector3TransformCoord(pos, XMLoadFloat4x4(&boneOffsets[bone]));
+			XMStoreFloat3(&boneMin[bone], XMVectorMin(XMLoadFloat3(&boneMin[bone]), bonePos));
+			XMStoreFloat3(&boneMax[bone], XMVectorMax(XMLoadFloat3(&boneMax[bone]), bonePos));
+		}
+	}
+
+	std::vector<BoundingBox> boneBounds(boneCount);
+	for (UINT i = 0; i < boneCount; ++i)
+	{
+		if (boneMin[i].x > boneMax[i].x)
+		{
+			boneBounds[i].Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			boneBounds[i].Extents = XMFLOAT3(-1.0f, -1.0f, -1.0f);
+			continue;
+		}
+
+		XMVECTOR vMin = XMLoadFloat3(&boneMin[i]);
+		XMVECTOR vMax = XMLoadFloat3(&boneMax[i]);
+		XMStoreFloat3(&boneBounds[i].Center, XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f));
+		XMStoreFloat3(&boneBounds[i].Extents, XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f));
+	}
+
+	skinnedData.SetBoneBounds(boneBounds);
+}
+
 HRESULT FbxLoader::LoadFBX(
 	std::vector<CharacterVertex>& outVertexVector,
 	std::vector<uint32_t>& outIndexVector,
 	SkinnedData& outSkinnedData,
 	const std::string& clipName,
 	std::vector<Material>& outMaterial,
-	std::string fileName)
+	std::string fileName,
+	std::vector<MorphTarget>* outMorphTargets)
 {
+	std::vector<MorphTarget> morphTargets;
+
 	// if exported animation exist
-	if (LoadMesh(fileName + clipName, outVertexVector, outIndexVector, &outMaterial) &&
+	if (LoadMesh(fileName + clipName, outVertexVector, outIndexVector, &outMaterial, &morphTargets) &&
 		LoadAnimation(outSkinnedData, clipName, fileName) &&
 		LoadSkeleton(outSkinnedData, clipName, fileName))
+	{
+		if (mMeshUpgraded)
+			ExportMesh(outVertexVector, outIndexVector, outMaterial, fileName + clipName, &morphTargets);
+
+		// Skeletons exported before the bone bounds existed
+		if (outSkinnedData.GetBoneBounds().empty())
+		{
+			BuildBoneBounds(outVertexVector, outSkinnedData);
+			ExportSkeleton(outSkinnedData, clipName, fileName);
+		}
+
+		if (outMorphTargets != nullptr)
+			*outMorphTargets = morphTargets;
 		return S_OK;
+	}
 
 	if (gFbxManager == nullptr)
 	{
@@ -104,7 +253,8 @@ HRESULT FbxLoader::LoadFBX(
 				//outSkinnedData.SetAnimationName(outAnimationName);
 
 				// Get Vertices and indices info
-				GetVerticesAndIndice(pMesh, outVertexVector, outIndexVector, &outSkinnedData);
+				morphTargets.clear();
+				GetVerticesAndIndice(pMesh, outVertexVector, outIndexVector, &outSkinnedData, morphTargets);
 
 				GetMaterials(pFbxChildNode, outMaterial);
 
@@ -112,13 +262,18 @@ HRESULT FbxLoader::LoadFBX(
 			}
 		}
 		
-		outSkinnedData.Set(mBoneHierarchy, mBoneOffsets, &mAnimations);
+		if (!outSkinnedData.Set(mBoneHierarchy, mBoneOffsets, &mAnimations))
+			return E_FAIL;
+		BuildBoneBounds(outVertexVector, outSkinnedData);
 	}
 
-	ExportMesh(outVertexVector, outIndexVector, outMaterial, fileName + clipName);
+	ExportMesh(outVertexVector, outIndexVector, outMaterial, fileName + clipName, &morphTargets);
 	ExportSkeleton(outSkinnedData, clipName, fileName);
 	ExportAnimation(mAnimations[clipName], fileName, clipName);
 
+	if (outMorphTargets != nullptr)
+		*outMorphTargets = morphTargets;
+
 	return S_OK;
 }
 
@@ -126,10 +281,23 @@ HRESULT FbxLoader::LoadFBX(
 	std::vector<Vertex>& outVertexVector,
 	std::vector<uint32_t>& outIndexVector,
 	std::vector<Material>& outMaterial,
-	std::string fileName)
+	std::string fileName,
+	std::vector<SubmeshLod>* outLods)
 {
 	// if exported animation exist
-	if (LoadMesh(fileName, outVertexVector, outIndexVector, &outMaterial)) return S_OK;
+	std::vector<SubmeshLod> lods;
+	if (LoadMesh(fileName, outVertexVector, outIndexVector, &outMaterial, &lods))
+	{
+		// Mesh exported before the LOD chain or the tangent frames existed
+		if (lods.empty())
+		{
+			MeshSimplifier simplifier(outVertexVector);
+			simplifier.BuildLodChain(outIndexVector, lods, fileName);
+			ExportMesh(outVertexVector, outIndexVector, outMaterial, fileName, &lods);
+		}
+		SelectLods(outIndexVector, lods, outLods);
+		return S_OK;
+	}
 	if (LoadMesh(fileName, outVertexVector, outIndexVector)) return S_OK;
 
 	if (gFbxManager == nullptr)
@@ -186,7 +354,11 @@ HRESULT FbxLoader::LoadFBX(
 		}
 	}
 
-	ExportMesh(outVertexVector, outIndexVector, outMaterial, fileName);
+	MeshSimplifier simplifier(outVertexVector);
+	simplifier.BuildLodChain(outIndexVector, lods, fileName);
+
+	ExportMesh(outVertexVector, outIndexVector, outMaterial, fileName, &lods);
+	SelectLods(outIndexVector, lods, outLods);
 
 	return S_OK;
 }
@@ -314,11 +486,21 @@ bool FbxLoader::LoadSkeleton(
 			outSkinnedData.SetSubmeshOffset(tempBoneSubmeshOffset);
 		}
 
-		outSkinnedData.Set(
+		// Bone Bounds, missing in older files
+		if (fileIn >> ignore && ignore == "BoneBounds")
+		{
+			std::vector<DirectX::BoundingBox> boneBounds(boneSize);
+			for (auto& e : boneBounds)
+			{
+				fileIn >> e.Center.x >> e.Center.y >> e.Center.z;
+				fileIn >> e.Extents.x >> e.Extents.y >> e.Extents.z;
+			}
+			outSkinnedData.SetBoneBounds(boneBounds);
+		}
+
+		return outSkinnedData.Set(
 			boneHierarchy,
 			boneOffsets);
-
-		return true;
 	}
 
 	return false;
@@ -328,7 +510,8 @@ bool FbxLoader::LoadMesh(
 	std::string fileName,
 	std::vector<Vertex>& outVertexVector,
 	std::vector<uint32_t>& outIndexVector,
-	std::vector<Material>* outMaterial)
+	std::vector<Material>* outMaterial,
+	std::vector<SubmeshLod>* outLods)
 {
 	fileName = fileName + ".mesh";
 	std::ifstream fileIn(fileName);
@@ -371,11 +554,12 @@ bool FbxLoader::LoadMesh(
 		}
 
 		// Vertex Data
+		std::vector<DirectX::XMFLOAT3> normals;
 		for (uint32_t i = 0; i < vertexSize; ++i)
 		{
 			Vertex vertex;
 			fileIn >> ignore >> vertex.Pos.x >> vertex.Pos.y >> vertex.Pos.z;
-			fileIn >> ignore >> vertex.Normal.x >> vertex.Normal.y >> vertex.Normal.z;
+			ReadQTangent(fileIn, vertex, normals);
 			fileIn >> ignore >> vertex.TexC.x >> vertex.TexC.y;
 
 			// push_back
@@ -390,6 +574,30 @@ bool FbxLoader::LoadMesh(
 			fileIn >> index;
 			outIndexVector.push_back(index);
 		}
+
+		// LOD Data, older exports end after the indices
+		uint32_t lodSize;
+		if (outLods != nullptr && fileIn >> ignore >> lodSize)
+		{
+			for (uint32_t i = 0; i < lodSize; ++i)
+			{
+				SubmeshLod lod;
+				fileIn >> ignore >> lod.StartIndexLocation >> lod.IndexCount >> lod.GeometricError;
+				outLods->push_back(lod);
+			}
+		}
+
+		// Older exports only have normals, the LOD chain is built again from the new vertices
+		mMeshUpgraded = !normals.empty();
+		if (mMeshUpgraded)
+		{
+			if (outLods != nullptr && !outLods->empty())
+			{
+				outIndexVector.resize((*outLods)[0].IndexCount);
+				outLods->clear();
+			}
+			BuildTangentFrames(outVertexVector, outIndexVector, normals);
+		}
 		
 		return true;
 	}
@@ -401,7 +609,8 @@ bool FbxLoader::LoadMesh(
 	std::string fileName,
 	std::vector<CharacterVertex>& outVertexVector,
 	std::vector<uint32_t>& outIndexVector,
-	std::vector<Material>* outMaterial)
+	std::vector<Material>* outMaterial,
+	std::vector<MorphTarget>* outMorphTargets)
 {
 	fileName = fileName + ".cmesh";
 	std::ifstream fileIn(fileName);
@@ -447,12 +656,13 @@ bool FbxLoader::LoadMesh(
 		}
 		
 		// Vertex Data
+		std::vector<DirectX::XMFLOAT3> normals;
 		for (uint32_t i = 0; i < vertexSize; ++i)
 		{
 			CharacterVertex vertex;
 			int temp[4];
 			fileIn >> ignore >> vertex.Pos.x >> vertex.Pos.y >> vertex.Pos.z;
-			fileIn >> ignore >> vertex.Normal.x >> vertex.Normal.y >> vertex.Normal.z;
+			ReadQTangent(fileIn, vertex, normals);
 			fileIn >> ignore >> vertex.TexC.x >> vertex.TexC.y;
 			fileIn >> ignore >> vertex.BoneWeights.x >> vertex.BoneWeights.y >> vertex.BoneWeights.z;
 			fileIn >> ignore >> temp[0] >> temp[1] >> temp[2] >> temp[3];
@@ -474,6 +684,42 @@ bool FbxLoader::LoadMesh(
 			outIndexVector.push_back(index);
 		}
 
+		// Morph Target Data, missing in older files
+		uint32_t morphTargetSize;
+		if (fileIn >> ignore >> morphTargetSize && ignore == "MorphTargetSize")
+		{
+			for (uint32_t i = 0; i < morphTargetSize; ++i)
+			{
+				MorphTarget target;
+				uint32_t deltaSize;
+				fileIn >> ignore >> target.Name;
+				fileIn >> ignore >> target.PositionScale;
+				fileIn >> ignore >> target.NormalScale;
+				fileIn >> ignore >> deltaSize;
+
+				target.Indices.resize(deltaSize);
+				target.PositionDeltas.resize(deltaSize);
+				target.NormalDeltas.resize(deltaSize);
+				for (uint32_t j = 0; j < deltaSize; ++j)
+				{
+					int p[3], n[3];
+					fileIn >> target.Indices[j] >> p[0] >> p[1] >> p[2] >> n[0] >> n[1] >> n[2];
+					target.PositionDeltas[j] = DirectX::PackedVector::XMSHORTN4(
+						static_cast<int16_t>(p[0]), static_cast<int16_t>(p[1]), static_cast<int16_t>(p[2]), 0);
+					target.NormalDeltas[j] = DirectX::PackedVector::XMBYTEN4(
+						static_cast<int8_t>(n[0]), static_cast<int8_t>(n[1]), static_cast<int8_t>(n[2]), 0);
+				}
+
+				if (outMorphTargets != nullptr)
+					outMorphTargets->push_back(target);
+			}
+		}
+
+		// Older exports only have normals
+		mMeshUpgraded = !normals.empty();
+		if (mMeshUpgraded)
+			BuildTangentFrames(outVertexVector, outIndexVector, normals);
+
 		return true;
 	}
 
@@ -484,6 +730,19 @@ bool FbxLoader::LoadAnimation(
 	SkinnedData& outSkinnedData,
 	const std::string& clipName, 
 	std::string fileName)
+{
+	AnimationClip animation;
+	if (!LoadAnimation(animation, clipName, fileName))
+		return false;
+
+	outSkinnedData.SetAnimation(animation, clipName);
+	return true;
+}
+
+bool FbxLoader::LoadAnimation(
+	AnimationClip& outAnimation,
+	const std::string& clipName,
+	std::string fileName)
 {
 	fileName = fileName + clipName + ".anim";
 	std::ifstream fileIn(fileName);
@@ -499,8 +758,14 @@ bool FbxLoader::LoadAnimation(
 
 		for (uint32_t i = 0; i < boneAnimationSize; ++i)
 		{
+			// Compacted tracks give their own key count, older exports keep every key
+			uint32_t trackKeyCount = keyframeSize;
+			fileIn >> std::ws;
+			if (fileIn.peek() == 'K')
+				fileIn >> ignore >> trackKeyCount;
+
 			BoneAnimation boneAnim;
-			for (uint32_t j = 0; j < keyframeSize; ++j)
+			for (uint32_t j = 0; j < trackKeyCount; ++j)
 			{
 				Keyframe key;
 				fileIn >> key.TimePos;
@@ -512,7 +777,78 @@ bool FbxLoader::LoadAnimation(
 			animation.BoneAnimations.push_back(boneAnim);
 		}
 
-		outSkinnedData.SetAnimation(animation, clipName);
+		if (!fileIn)
+			return false;
+
+		outAnimation = std::move(animation);
+		return true;
+	}
+
+	return false;
+}
+
+bool FbxLoader::LoadBakedAnimation(
+	BakedAnimation& outBaked,
+	const SkinnedData& skinnedData,
+	const std::string& clipName,
+	std::string fileName,
+	float frameRate)
+{
+	ClipHandle clip = skinnedData.GetClipHandle(clipName);
+	if (clip == kInvalidClip)
+		return false;
+
+	fileName = fileName + clipName + ".bake";
+	std::ifstream fileIn(fileName);
+
+	BakedClip baked;
+	uint32_t boneSize;
+
+	std::string ignore;
+	if (fileIn)
+	{
+		fileIn >> ignore >> boneSize;
+		fileIn >> ignore >> baked.FrameRate;
+		fileIn >> ignore >> baked.FrameCount;
+		fileIn >> ignore >> baked.StartTime;
+
+		if (!fileIn || boneSize != skinnedData.BoneCount() || baked.FrameRate != frameRate)
+			return false;
+
+		baked.Rows.resize(baked.FrameCount * boneSize * 3);
+		baked.Bounds.resize(baked.FrameCount);
+		for (uint32_t i = 0; i < baked.FrameCount; ++i)
+		{
+			auto& bounds = baked.Bounds[i];
+			fileIn >> bounds.Center.x >> bounds.Center.y >> bounds.Center.z;
+			fileIn >> bounds.Extents.x >> bounds.Extents.y >> bounds.Extents.z;
+
+			for (uint32_t j = 0; j < boneSize * 3; ++j)
+			{
+				auto& row = baked.Rows[i * boneSize * 3 + j];
+				fileIn >> row.x >> row.y >> row.z >> row.w;
+			}
+		}
+
+		if (!fileIn || baked.FrameCount == 0)
+			return false;
+
+		// A cache baked before the clip changed, e.g. before its root motion was
+		// extracted, is baked again. The middle frame moves the most.
+		uint32_t frame = baked.FrameCount / 2;
+		float duration = skinnedData.GetClipEndTime(clip) - baked.StartTime;
+		std::vector<DirectX::XMFLOAT4X4> finalTransforms(boneSize);
+		skinnedData.GetFinalTransforms(clip, baked.StartTime + (std::min)(frame / frameRate, duration), finalTransforms);
+		for (uint32_t i = 0; i < boneSize * 3; ++i)
+		{
+			const DirectX::XMFLOAT4& row = baked.Rows[frame * boneSize * 3 + i];
+			const float* fresh = finalTransforms[i / 3].m[i % 3];
+			if (fabsf(row.x - fresh[0]) > 1e-3f || fabsf(row.y - fresh[1]) > 1e-3f ||
+				fabsf(row.z - fresh[2]) > 1e-3f || fabsf(row.w - fresh[3]) > 1e-3f)
+				return false;
+		}
+
+		outBaked.SetClip(clip, boneSize, std::move(baked));
 		return true;
 	}
 
@@ -725,11 +1061,14 @@ void FbxLoader::GetVerticesAndIndice(
 	FbxMesh * pMesh, 
 	std::vector<CharacterVertex> & outVertexVector, 
 	std::vector<uint32_t> & outIndexVector,
-	SkinnedData* outSkinnedData)
+	SkinnedData* outSkinnedData,
+	std::vector<MorphTarget>& outMorphTargets)
 {
 	// Vertex and Index
 	std::unordered_map<std::string, std::vector<uint32_t>> IndexVector;
-	std::unordered_map<Vertex, uint32_t> IndexMapping;
+	std::unordered_map<ImportVertex, uint32_t> IndexMapping;
+	std::vector<DirectX::XMFLOAT3> Normals;
+	std::vector<int> PolygonVertices;
 	uint32_t VertexIndex = 0;
 	uint32_t tCount = pMesh->GetPolygonCount(); // Triangle
 
@@ -765,7 +1104,7 @@ void FbxLoader::GetVerticesAndIndice(
 				MessageBox(0, L"UV not found", 0, 0);
 			}
 
-			Vertex Temp;
+			ImportVertex Temp;
 			// Position
 			Temp.Pos.x = CurrCtrlPoint->mPosition.x;
 			Temp.Pos.y = CurrCtrlPoint->mPosition.y;
@@ -797,8 +1136,9 @@ void FbxLoader::GetVerticesAndIndice(
 				// Vertex
 				CharacterVertex SkinnedVertexInfo;
 				SkinnedVertexInfo.Pos = Temp.Pos;
-				SkinnedVertexInfo.Normal = Temp.Normal;
 				SkinnedVertexInfo.TexC = Temp.TexC;
+				Normals.push_back(Temp.Normal);
+				PolygonVertices.push_back(pMesh->GetPolygonVertexIndex(i) + j);
 
 				CurrCtrlPoint->SortBlendingInfoByWeight();
 
@@ -839,6 +1179,96 @@ void FbxLoader::GetVerticesAndIndice(
 
 		outIndexVector.insert(outIndexVector.end(), CurrIndexVector.begin(), CurrIndexVector.end());
 	}
+
+	// Splitting vertices keeps the index order, the submesh offsets stay valid
+	std::vector<uint32_t> SplitSource;
+	BuildTangentFrames(outVertexVector, outIndexVector, Normals, &SplitSource);
+
+	// The split copies move with the vertex they came from
+	for (auto e : SplitSource)
+	{
+		PolygonVertices.push_back(PolygonVertices[e]);
+	}
+	GetMorphTargets(pMesh, PolygonVertices, outMorphTargets);
+}
+
+void FbxLoader::GetMorphTargets(
+	FbxMesh * pMesh,
+	const std::vector<int>& vertexPolygonVertices,
+	std::vector<MorphTarget>& outMorphTargets)
+{
+	// Deltas under this are import noise
+	const float epsilon = 1e-5f;
+
+	const int* pPolygonVertices = pMesh->GetPolygonVertices();
+	FbxVector4* pMeshPoints = pMesh->GetControlPoints();
+
+	int blendShapeCount = pMesh->GetDeformerCount(FbxDeformer::eBlendShape);
+	for (int i = 0; i < blendShapeCount; ++i)
+	{
+		FbxBlendShape* pBlendShape = (FbxBlendShape*)pMesh->GetDeformer(i, FbxDeformer::eBlendShape);
+		for (int j = 0; j < pBlendShape->GetBlendShapeChannelCount(); ++j)
+		{
+			FbxBlendShapeChannel* pChannel = pBlendShape->GetBlendShapeChannel(j);
+
+			// In-between shapes are dropped, the last one is the shape at full weight
+			int shapeCount = pChannel->GetTargetShapeCount();
+			if (shapeCount == 0)
+				continue;
+
+			FbxShape* pShape = pChannel->GetTargetShape(shapeCount - 1);
+			FbxVector4* pShapePoints = pShape->GetControlPoints();
+			FbxGeometryElementNormal* pShapeNormals = pShape->GetElementNormal();
+
+			std::vector<uint32_t> indices;
+			std::vector<DirectX::XMFLOAT3> positionDeltas;
+			std::vector<DirectX::XMFLOAT3> normalDeltas;
+			for (uint32_t v = 0; v < vertexPolygonVertices.size(); ++v)
+			{
+				int polygonVertex = vertexPolygonVertices[v];
+				int controlPoint = pPolygonVertices[polygonVertex];
+
+				FbxVector4 positionDelta = pShapePoints[controlPoint] - pMeshPoints[controlPoint];
+
+				// Shapes without normals only move the positions
+				FbxVector4 normalDelta(0.0, 0.0, 0.0, 0.0);
+				if (pShapeNormals != nullptr)
+				{
+					FbxVector4 meshNormal;
+					pMesh->GetPolygonVertexNormal(polygonVertex / 3, polygonVertex % 3, meshNormal);
+					normalDelta = GetElementNormal(pShapeNormals, controlPoint, polygonVertex) - meshNormal;
+				}
+
+				bool moved = false;
+				for (int k = 0; k < 3; ++k)
+				{
+					if (fabs(positionDelta.mData[k]) > epsilon || fabs(normalDelta.mData[k]) > epsilon)
+						moved = true;
+				}
+				if (!moved)
+					continue;
+
+				indices.push_back(v);
+				positionDeltas.push_back(DirectX::XMFLOAT3(
+					static_cast<float>(positionDelta.mData[0]),
+					static_cast<float>(positionDelta.mData[1]),
+					static_cast<float>(positionDelta.mData[2])));
+				normalDeltas.push_back(DirectX::XMFLOAT3(
+					static_cast<float>(normalDelta.mData[0]),
+					static_cast<float>(normalDelta.mData[1]),
+					static_cast<float>(normalDelta.mData[2])));
+			}
+
+			if (indices.empty())
+				continue;
+
+			// The cache reads names word by word
+			std::string name = pChannel->GetName();
+			std::replace(name.begin(), name.end(), ' ', '_');
+
+			outMorphTargets.push_back(MorphBlender::BuildTarget(name, indices, positionDeltas, normalDeltas));
+		}
+	}
 }
 
 void FbxLoader::GetVerticesAndIndice(
@@ -847,7 +1277,8 @@ void FbxLoader::GetVerticesAndIndice(
 	std::vector<uint32_t> & outIndexVector)
 {
 	// Vertex and Index
-	std::unordered_map<Vertex, uint32_t> IndexMapping;
+	std::unordered_map<ImportVertex, uint32_t> IndexMapping;
+	std::vector<DirectX::XMFLOAT3> Normals;
 	uint32_t VertexIndex = 0;
 	int tCount = pMesh->GetPolygonCount(); // Triangle
 
@@ -880,7 +1311,7 @@ void FbxLoader::GetVerticesAndIndice(
 				MessageBox(0, L"UV not found", 0, 0);
 			}
 
-			Vertex Temp;
+			ImportVertex Temp;
 			// Position
 			Temp.Pos.x = CurrCtrlPoint->mPosition.x;
 			Temp.Pos.y = CurrCtrlPoint->mPosition.y;
@@ -909,10 +1340,16 @@ void FbxLoader::GetVerticesAndIndice(
 				IndexMapping[Temp] = VertexIndex;
 
 				VertexIndex++;
-				outVertexVector.push_back(Temp);
+				Vertex vertex;
+				vertex.Pos = Temp.Pos;
+				vertex.TexC = Temp.TexC;
+				outVertexVector.push_back(vertex);
+				Normals.push_back(Temp.Normal);
 			}
 		}
 	}
+
+	BuildTangentFrames(outVertexVector, outIndexVector, Normals);
 }
 
 void FbxLoader::GetMaterials(FbxNode* pNode, std::vector<Material>& outMaterial)
@@ -1080,18 +1517,27 @@ void FbxLoader::ExportAnimation(
 	fileName = fileName + clipName + ".anim";
 	std::ofstream fileOut(fileName);
 
-	if (animation.BoneAnimations[0].Keyframes.size() == 0)
+	// Constant tracks are written with one key and identity tracks with none
+	AnimationClip compacted = animation;
+	compacted.Compact();
+
+	uint32_t keyframeSize = 0;
+	for (auto& e : compacted.BoneAnimations)
+	{
+		keyframeSize = (std::max)(keyframeSize, (uint32_t)e.Keyframes.size());
+	}
+	if (keyframeSize == 0)
 		return;
 
 	if (fileOut)
 	{
-		uint32_t boneSize = animation.BoneAnimations.size();
-		uint32_t keyframeSize = animation.BoneAnimations[0].Keyframes.size();
+		uint32_t boneSize = compacted.BoneAnimations.size();
 		fileOut << "Bone " << boneSize << "\n";
 		fileOut << "KeframeSize " << keyframeSize << "\n";
 
-		for (auto& e : animation.BoneAnimations)
+		for (auto& e : compacted.BoneAnimations)
 		{
+			fileOut << "Keys " << e.Keyframes.size() << "\n";
 			for (auto& o : e.Keyframes)
 			{
 				fileOut << o.TimePos << "\n";
@@ -1103,6 +1549,45 @@ void FbxLoader::ExportAnimation(
 	}
 }
 
+void FbxLoader::ExportBakedAnimation(
+	const BakedAnimation& baked,
+	const SkinnedData& skinnedData,
+	std::string fileName,
+	const std::string& clipName)
+{
+	const BakedClip* bakedClip = baked.GetClip(skinnedData.GetClipHandle(clipName));
+	if (bakedClip == nullptr)
+		return;
+
+	fileName = fileName + clipName + ".bake";
+	std::ofstream fileOut(fileName);
+
+	if (fileOut)
+	{
+		// The frames are compared against the live evaluation, keep every digit of the floats
+		fileOut.precision(9);
+
+		uint32_t boneSize = baked.GetBoneCount();
+		fileOut << "Bone " << boneSize << "\n";
+		fileOut << "FrameRate " << bakedClip->FrameRate << "\n";
+		fileOut << "FrameCount " << bakedClip->FrameCount << "\n";
+		fileOut << "StartTime " << bakedClip->StartTime << "\n";
+
+		for (uint32_t i = 0; i < bakedClip->FrameCount; ++i)
+		{
+			auto& bounds = bakedClip->Bounds[i];
+			fileOut << bounds.Center.x << " " << bounds.Center.y << " " << bounds.Center.z << " ";
+			fileOut << bounds.Extents.x << " " << bounds.Extents.y << " " << bounds.Extents.z << "\n";
+
+			for (uint32_t j = 0; j < boneSize * 3; ++j)
+			{
+				auto& row = bakedClip->Rows[i * boneSize * 3 + j];
+				fileOut << row.x << " " << row.y << " " << row.z << " " << row.w << "\n";
+			}
+		}
+	}
+}
+
 void FbxLoader::ExportSkeleton(
 	SkinnedData& outSkinnedData, 
 	const std::string& clipName, 
@@ -1154,6 +1639,17 @@ void FbxLoader::ExportSkeleton(
 			skeletonFileOut << e[i] << " ";
 		}
 		skeletonFileOut << "\n";
+
+		const auto& boneBounds = outSkinnedData.GetBoneBounds();
+		if (boneBounds.size() == boneSize)
+		{
+			skeletonFileOut << "BoneBounds " << "\n";
+			for (auto& e : boneBounds)
+			{
+				skeletonFileOut << e.Center.x << " " << e.Center.y << " " << e.Center.z << " ";
+				skeletonFileOut << e.Extents.x << " " << e.Extents.y << " " << e.Extents.z << "\n";
+			}
+		}
 	}
 }
 
@@ -1161,7 +1657,8 @@ void FbxLoader::ExportMesh(
 	std::vector<Vertex>& outVertexVector,
 	std::vector<uint32_t>& outIndexVector,
 	std::vector<Material>& outMaterial,
-	std::string fileName)
+	std::string fileName,
+	const std::vector<SubmeshLod>* lods)
 {
 	std::ofstream fileOut(fileName + ".mesh");
 
@@ -1202,7 +1699,7 @@ void FbxLoader::ExportMesh(
 		for (auto& e : outVertexVector)
 		{
 			fileOut << "Pos " << e.Pos.x << " " << e.Pos.y << " " << e.Pos.z << "\n";
-			fileOut << "Normal " << e.Normal.x << " " << e.Normal.y << " " << e.Normal.z << "\n";
+			fileOut << "QTangent " << e.QTangent.x << " " << e.QTangent.y << " " << e.QTangent.z << " " << e.QTangent.w << "\n";
 			fileOut << "TexC " << e.TexC.x << " " << e.TexC.y << "\n";
 		}
 
@@ -1211,6 +1708,16 @@ void FbxLoader::ExportMesh(
 		{
 			fileOut << outIndexVector[3 * i] << " " << outIndexVector[3 * i + 1] << " " << outIndexVector[3 * i + 2] << "\n";
 		}
+
+		// Every level is a range of the indices above
+		if (lods != nullptr)
+		{
+			fileOut << "LodSize " << lods->size() << "\n";
+			for (auto& e : *lods)
+			{
+				fileOut << "Lod " << e.StartIndexLocation << " " << e.IndexCount << " " << e.GeometricError << "\n";
+			}
+		}
 	}
 }
 
@@ -1218,7 +1725,8 @@ void FbxLoader::ExportMesh(
 	std::vector<CharacterVertex>& outVertexVector,
 	std::vector<uint32_t>& outIndexVector,
 	std::vector<Material>& outMaterial,
-	std::string fileName)
+	std::string fileName,
+	const std::vector<MorphTarget>* morphTargets)
 {
 	std::ofstream fileOut(fileName + ".cmesh");
 
@@ -1260,7 +1768,7 @@ void FbxLoader::ExportMesh(
 		for (auto& e : outVertexVector)
 		{
 			fileOut << "Pos " << e.Pos.x << " " << e.Pos.y << " " << e.Pos.z << "\n";
-			fileOut << "Normal " << e.Normal.x << " " << e.Normal.y << " " << e.Normal.z << "\n";
+			fileOut << "QTangent " << e.QTangent.x << " " << e.QTangent.y << " " << e.QTangent.z << " " << e.QTangent.w << "\n";
 			fileOut << "TexC " << e.TexC.x << " " << e.TexC.y << "\n";
 
 			fileOut << "BoneWeight " << e.BoneWeights.x << " " << e.BoneWeights.y << " " << e.BoneWeights.z << "\n";
@@ -1273,6 +1781,25 @@ void FbxLoader::ExportMesh(
 		{
 			fileOut << outIndexVector[3 * i] << " " << outIndexVector[3 * i + 1] << " " << outIndexVector[3 * i + 2] << "\n";
 		}
+
+		// Quantized deltas as stored in memory
+		if (morphTargets != nullptr && !morphTargets->empty())
+		{
+			fileOut << "MorphTargetSize " << morphTargets->size() << "\n";
+			for (auto& e : *morphTargets)
+			{
+				fileOut << "Name " << e.Name << "\n";
+				fileOut << "PositionScale " << e.PositionScale << "\n";
+				fileOut << "NormalScale " << e.NormalScale << "\n";
+				fileOut << "DeltaSize " << e.Indices.size() << "\n";
+				for (size_t i = 0; i < e.Indices.size(); ++i)
+				{
+					auto& p = e.PositionDeltas[i];
+					auto& n = e.NormalDeltas[i];
+					fileOut << e.Indices[i] << " " << p.x << " " << p.y << " " << p.z << " " << (int)n.x << " " << (int)n.y << " " << (int)n.z << "\n";
+				}
+			}
+		}
 	}
 }
 
@@ -0,0 +1,643 @@
+#include <chrono>
+#include <cfloat>
+#include <unordered_set>
+#include "MeshSimplifier.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// A collapse of v0 into v1 is allowed for kCanCollapse[kind v0][kind v1]
+	const bool kCanCollapse[4][4] =
+	{
+		{ true, true, true, true },		// Manifold
+		{ false, true, false, false },	// Border
+		{ false, false, true, false },	// Seam
+		{ false, false, false, false }	// Locked
+	};
+
+	// Edges between these kinds show up in both directions in the index buffer
+	const bool kHasOpposite[4][4] =
+	{
+		{ true, true, true, true },
+		{ true, false, true, false },
+		{ true, true, true, true },
+		{ true, false, true, false }
+	};
+
+	// Border edges are held in place by planes perpendicular to the surface
+	const double kBorderWeight = 10.0;
+
+	// Faces may not turn more than about 75 degrees in a single collapse
+	const float kMinNormalDot = 0.25f;
+
+	// No level is generated below this many triangles
+	const size_t kMinTriangles = 64;
+
+	struct PositionHash
+	{
+		std::size_t operator()(const XMFLOAT3& k) const
+		{
+			return ((std::hash<float>()(k.x)
+				^ (std::hash<float>()(k.y) << 1)) >> 1)
+				^ (std::hash<float>()(k.z) << 1);
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()(const XMFLOAT3& lhs, const XMFLOAT3& rhs) const
+		{
+			return lhs.x == rhs.x && lhs.y == rhs.y && lhs.z == rhs.z;
+		}
+	};
+
+	inline uint64_t EdgeKey(uint32_t a, uint32_t b)
+	{
+		return (uint64_t(a) << 32) | b;
+	}
+
+	inline XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	inline float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+}
+
+MeshSimplifier::MeshSimplifier(const std::vector<Vertex>& vertices)
+	: mVertices(vertices),
+	mAdjacencyIndices(nullptr),
+	mResultError(0.0f)
+{
+	BuildPositionRemap();
+}
+
+MeshSimplifier::~MeshSimplifier()
+{
+}
+
+void MeshSimplifier::BuildLodChain(
+	std::vector<uint32_t>& indices,
+	std::vector<SubmeshLod>& outLods,
+	const std::string& meshName,
+	uint32_t maxLevels)
+{
+	outLods.clear();
+
+	SubmeshLod baseLod;
+	baseLod.IndexCount = (UINT)indices.size();
+	baseLod.StartIndexLocation = 0;
+	baseLod.GeometricError = 0.0f;
+	outLods.push_back(baseLod);
+
+	ClassifyVertices(indices);
+	BuildQuadrics(indices);
+	mResultError = 0.0f;
+
+	std::wstring name(meshName.begin(), meshName.end());
+	std::wstring text = L"***LOD " + name + L" 0 : " + std::to_wstring(indices.size() / 3) + L" triangles\n";
+	::OutputDebugString(text.c_str());
+
+	// Every level continues from the previous one so the quadrics keep the
+	// accumulated error and the reported error grows monotonically.
+	std::vector<uint32_t> current(indices);
+	for (uint32_t level = 1; level <= maxLevels; ++level)
+	{
+		size_t prevIndexCount = current.size();
+		if (prevIndexCount / 3 < kMinTriangles * 2)
+			break;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		float error = Simplify(current, prevIndexCount / 6 * 3);
+		auto end = std::chrono::high_resolution_clock::now();
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+		// Less than 10% reduction, the mesh is as coarse as it can get
+		if (current.size() * 10 > prevIndexCount * 9)
+			break;
+
+		SubmeshLod lod;
+		lod.IndexCount = (UINT)current.size();
+		lod.StartIndexLocation = (UINT)indices.size();
+		lod.GeometricError = error;
+		outLods.push_back(lod);
+
+		indices.insert(indices.end(), current.begin(), current.end());
+
+		text = L"***LOD " + name + L" " + std::to_wstring(level) + L" : " +
+			std::to_wstring(current.size() / 3) + L" triangles, error " +
+			std::to_wstring(error) + L", " + std::to_wstring(ms) + L" ms\n";
+		::OutputDebugString(text.c_str());
+	}
+}
+
+float MeshSimplifier::Simplify(std::vector<uint32_t>& indices, size_t targetIndexCount)
+{
+	while (indices.size() > targetIndexCount)
+	{
+		BuildAdjacency(indices);
+
+		PickEdgeCollapses(indices);
+		if (mCollapses.empty())
+			break;
+
+		RankEdgeCollapses();
+
+		size_t triangleCollapseGoal = (indices.size() - targetIndexCount) / 3;
+		if (triangleCollapseGoal == 0)
+			break;
+
+		if (PerformEdgeCollapses(triangleCollapseGoal) == 0)
+			break;
+
+		RemapEdgeLoops();
+		RemapIndexBuffer(indices);
+	}
+
+	return sqrtf(mResultError);
+}
+
+void MeshSimplifier::BuildPositionRemap()
+{
+	size_t vertexCount = mVertices.size();
+	mRemap.resize(vertexCount);
+	mWedge.resize(vertexCount);
+
+	std::unordered_map<XMFLOAT3, uint32_t, PositionHash, PositionEqual> positionMapping;
+	positionMapping.reserve(vertexCount);
+
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		auto lookup = positionMapping.find(mVertices[i].Pos);
+		if (lookup != positionMapping.end())
+		{
+			mRemap[i] = lookup->second;
+		}
+		else
+		{
+			mRemap[i] = i;
+			positionMapping[mVertices[i].Pos] = i;
+		}
+		mWedge[i] = i;
+	}
+
+	// Link the vertices sharing a position in a ring
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		uint32_t r = mRemap[i];
+		if (r != i)
+		{
+			mWedge[i] = mWedge[r];
+			mWedge[r] = i;
+		}
+	}
+}
+
+void MeshSimplifier::ClassifyVertices(const std::vector<uint32_t>& indices)
+{
+	size_t vertexCount = mVertices.size();
+
+	std::unordered_set<uint64_t> edges;
+	std::unordered_set<uint64_t> positionEdges;
+	edges.reserve(indices.size());
+	positionEdges.reserve(indices.size());
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int e = 0; e < 3; ++e)
+		{
+			uint32_t a = indices[i + e];
+			uint32_t b = indices[i + (e + 1) % 3];
+			edges.insert(EdgeKey(a, b));
+			positionEdges.insert(EdgeKey(mRemap[a], mRemap[b]));
+		}
+	}
+
+	// Open edges are the ones without an opposite half edge on the same wedges
+	std::vector<uint32_t> openCount(vertexCount, 0);
+	std::vector<uint32_t> openBackCount(vertexCount, 0);
+	mLoop.assign(vertexCount, UINT32_MAX);
+	mLoopBack.assign(vertexCount, UINT32_MAX);
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int e = 0; e < 3; ++e)
+		{
+			uint32_t a = indices[i + e];
+			uint32_t b = indices[i + (e + 1) % 3];
+			if (edges.find(EdgeKey(b, a)) == edges.end())
+			{
+				mLoop[a] = b;
+				mLoopBack[b] = a;
+				openCount[a]++;
+				openBackCount[b]++;
+			}
+		}
+	}
+
+	mKind.assign(vertexCount, Locked);
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		if (mRemap[i] != i)
+			continue;
+
+		eVertexKind kind = Locked;
+		if (mWedge[i] == i)
+		{
+			if (openCount[i] == 0 && openBackCount[i] == 0)
+				kind = Manifold;
+			else if (openCount[i] == 1 && openBackCount[i] == 1)
+				kind = Border;
+		}
+		else if (mWedge[mWedge[i]] == i)
+		{
+			// Two wedges whose open edges run along the same positions in opposite
+			// directions, and the surface is closed across them
+			uint32_t w = mWedge[i];
+			if (openCount[i] == 1 && openBackCount[i] == 1 &&
+				openCount[w] == 1 && openBackCount[w] == 1 &&
+				mRemap[mLoop[i]] == mRemap[mLoopBack[w]] &&
+				mRemap[mLoop[w]] == mRemap[mLoopBack[i]] &&
+				positionEdges.count(EdgeKey(mRemap[mLoop[i]], i)) &&
+				positionEdges.count(EdgeKey(mRemap[mLoop[w]], i)))
+			{
+				kind = Seam;
+			}
+		}
+
+		mKind[i] = kind;
+	}
+
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		mKind[i] = mKind[mRemap[i]];
+	}
+}
+
+void MeshSimplifier::BuildQuadrics(const std::vector<uint32_t>& indices)
+{
+	Quadric zero = {};
+	mQuadrics.assign(mVertices.size(), zero);
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		uint32_t tri[3] = { indices[i], indices[i + 1], indices[i + 2] };
+		const XMFLOAT3& p0 = mVertices[tri[0]].Pos;
+		const XMFLOAT3& p1 = mVertices[tri[1]].Pos;
+		const XMFLOAT3& p2 = mVertices[tri[2]].Pos;
+
+		XMFLOAT3 n = Cross(Sub(p1, p0), Sub(p2, p0));
+		double length = sqrt(double(n.x) * n.x + double(n.y) * n.y + double(n.z) * n.z);
+		if (length == 0.0)
+			continue;
+
+		double nx = n.x / length, ny = n.y / length, nz = n.z / length;
+		double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+
+		// Area weighted so the error does not depend on the tessellation
+		Quadric Q;
+		QuadricFromPlane(Q, nx, ny, nz, d, length * 0.5);
+		for (int k = 0; k < 3; ++k)
+		{
+			QuadricAdd(mQuadrics[mRemap[tri[k]]], Q);
+		}
+
+		for (int e = 0; e < 3; ++e)
+		{
+			uint32_t a = tri[e];
+			uint32_t b = tri[(e + 1) % 3];
+			if (mLoop[a] != b)
+				continue;
+
+			// Plane through the open edge, perpendicular to the face
+			const XMFLOAT3& pa = mVertices[a].Pos;
+			XMFLOAT3 edge = Sub(mVertices[b].Pos, pa);
+			double ex = double(edge.y) * nz - double(edge.z) * ny;
+			double ey = double(edge.z) * nx - double(edge.x) * nz;
+			double ez = double(edge.x) * ny - double(edge.y) * nx;
+			double edgeLength = sqrt(ex * ex + ey * ey + ez * ez);
+			if (edgeLength == 0.0)
+				continue;
+
+			ex /= edgeLength; ey /= edgeLength; ez /= edgeLength;
+			double ed = -(ex * pa.x + ey * pa.y + ez * pa.z);
+
+			// Seams only need to stay on the surface, borders must hold the silhouette
+			double weight = (mKind[a] == Border ? kBorderWeight : 1.0) * edgeLength * edgeLength;
+
+			Quadric E;
+			QuadricFromPlane(E, ex, ey, ez, ed, weight);
+			E.w = 0.0;
+			QuadricAdd(mQuadrics[mRemap[a]], E);
+			QuadricAdd(mQuadrics[mRemap[b]], E);
+		}
+	}
+}
+
+void MeshSimplifier::BuildAdjacency(const std::vector<uint32_t>& indices)
+{
+	size_t vertexCount = mVertices.size();
+	mAdjacencyOffsets.assign(vertexCount + 1, 0);
+
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		mAdjacencyOffsets[mRemap[indices[i]] + 1]++;
+	}
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		mAdjacencyOffsets[i + 1] += mAdjacencyOffsets[i];
+	}
+
+	mAdjacencyTriangles.resize(indices.size());
+	std::vector<uint32_t> fill(mAdjacencyOffsets.begin(), mAdjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		mAdjacencyTriangles[fill[mRemap[indices[i]]]++] = (uint32_t)(i / 3);
+	}
+
+	mAdjacencyIndices = &indices;
+}
+
+void MeshSimplifier::PickEdgeCollapses(const std::vector<uint32_t>& indices)
+{
+	mCollapses.clear();
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int e = 0; e < 3; ++e)
+		{
+			uint32_t i0 = indices[i + e];
+			uint32_t i1 = indices[i + (e + 1) % 3];
+
+			uint32_t r0 = mRemap[i0];
+			uint32_t r1 = mRemap[i1];
+			if (r0 == r1)
+				continue;
+
+			uint8_t k0 = mKind[i0];
+			uint8_t k1 = mKind[i1];
+			if (!kCanCollapse[k0][k1] && !kCanCollapse[k1][k0])
+				continue;
+
+			// Edges seen from both sides are only picked once
+			if (kHasOpposite[k0][k1] && r1 > r0)
+				continue;
+
+			// Two border or seam vertices must be joined by the border itself
+			if (k0 == k1 && (k0 == Border || k0 == Seam) && mLoop[i0] != i1)
+				continue;
+
+			Collapse c;
+			if (kCanCollapse[k0][k1] && kCanCollapse[k1][k0])
+			{
+				c.v0 = i0;
+				c.v1 = i1;
+				c.bidirectional = true;
+			}
+			else
+			{
+				c.v0 = kCanCollapse[k0][k1] ? i0 : i1;
+				c.v1 = kCanCollapse[k0][k1] ? i1 : i0;
+				c.bidirectional = false;
+			}
+			c.error = 0.0f;
+
+			mCollapses.push_back(c);
+		}
+	}
+}
+
+void MeshSimplifier::RankEdgeCollapses()
+{
+	for (auto& c : mCollapses)
+	{
+		double ei = QuadricError(mQuadrics[mRemap[c.v0]], mVertices[c.v1].Pos);
+		double ej = c.bidirectional ? QuadricError(mQuadrics[mRemap[c.v1]], mVertices[c.v0].Pos) : DBL_MAX;
+
+		if (ej < ei)
+		{
+			std::swap(c.v0, c.v1);
+			ei = ej;
+		}
+		c.error = (float)ei;
+	}
+
+	mCollapseOrder.resize(mCollapses.size());
+	for (uint32_t i = 0; i < mCollapseOrder.size(); ++i)
+	{
+		mCollapseOrder[i] = i;
+	}
+	std::sort(mCollapseOrder.begin(), mCollapseOrder.end(), [this](uint32_t lhs, uint32_t rhs)
+	{
+		return mCollapses[lhs].error < mCollapses[rhs].error;
+	});
+}
+
+size_t MeshSimplifier::PerformEdgeCollapses(size_t triangleCollapseGoal)
+{
+	size_t vertexCount = mVertices.size();
+	mCollapseRemap.resize(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		mCollapseRemap[i] = i;
+	}
+	mCollapseLocked.assign(vertexCount, 0);
+
+	size_t edgeCollapses = 0;
+	size_t triangleCollapses = 0;
+
+	for (auto order : mCollapseOrder)
+	{
+		const Collapse& c = mCollapses[order];
+		if (triangleCollapses >= triangleCollapseGoal)
+			break;
+
+		uint32_t i0 = c.v0;
+		uint32_t i1 = c.v1;
+		uint32_t r0 = mRemap[i0];
+		uint32_t r1 = mRemap[i1];
+
+		// A vertex takes part in one collapse per pass so the ranking stays valid
+		if (mCollapseLocked[r0] || mCollapseLocked[r1])
+			continue;
+
+		if (HasTriangleFlips(r0, r1))
+			continue;
+
+		QuadricAdd(mQuadrics[r1], mQuadrics[r0]);
+
+		if (mKind[i0] == Seam)
+		{
+			// The other side of the seam follows along the same edge
+			uint32_t s0 = mWedge[i0];
+			uint32_t s1 = (mLoop[i0] == i1) ? mLoopBack[s0] : mLoop[s0];
+
+			mCollapseRemap[i0] = i1;
+			mCollapseRemap[s0] = s1;
+		}
+		else
+		{
+			mCollapseRemap[i0] = i1;
+		}
+
+		mCollapseLocked[r0] = 1;
+		mCollapseLocked[r1] = 1;
+
+		triangleCollapses += (mKind[i0] == Border) ? 1 : 2;
+		edgeCollapses++;
+
+		mResultError = (std::max)(mResultError, c.error);
+	}
+
+	return edgeCollapses;
+}
+
+void MeshSimplifier::RemapEdgeLoops()
+{
+	for (uint32_t i = 0; i < mVertices.size(); ++i)
+	{
+		if (mLoop[i] != UINT32_MAX)
+		{
+			uint32_t l = mLoop[i];
+			uint32_t r = mCollapseRemap[l];
+
+			// The seam edge was collapsed against the direction of the loop
+			mLoop[i] = (i == r) ? mLoop[l] : r;
+		}
+
+		if (mLoopBack[i] != UINT32_MAX)
+		{
+			uint32_t l = mLoopBack[i];
+			uint32_t r = mCollapseRemap[l];
+
+			mLoopBack[i] = (i == r) ? mLoopBack[l] : r;
+		}
+	}
+}
+
+void MeshSimplifier::RemapIndexBuffer(std::vector<uint32_t>& indices)
+{
+	size_t write = 0;
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		uint32_t v0 = mCollapseRemap[indices[i]];
+		uint32_t v1 = mCollapseRemap[indices[i + 1]];
+		uint32_t v2 = mCollapseRemap[indices[i + 2]];
+
+		if (mRemap[v0] == mRemap[v1] || mRemap[v1] == mRemap[v2] || mRemap[v2] == mRemap[v0])
+			continue;
+
+		indices[write + 0] = v0;
+		indices[write + 1] = v1;
+		indices[write + 2] = v2;
+		write += 3;
+	}
+
+	indices.resize(write);
+}
+
+bool MeshSimplifier::HasTriangleFlips(uint32_t r0, uint32_t r1) const
+{
+	const std::vector<uint32_t>& indices = *mAdjacencyIndices;
+	const XMFLOAT3& target = mVertices[r1].Pos;
+
+	for (uint32_t t = mAdjacencyOffsets[r0]; t < mAdjacencyOffsets[r0 + 1]; ++t)
+	{
+		size_t triangle = mAdjacencyTriangles[t] * 3;
+
+		// Rotate the triangle so that r0 comes first
+		uint32_t corner[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			corner[k] = mCollapseRemap[indices[triangle + k]];
+		}
+		while (mRemap[corner[0]] != r0)
+		{
+			std::swap(corner[0], corner[1]);
+			std::swap(corner[1], corner[2]);
+		}
+
+		uint32_t a = mRemap[corner[1]];
+		uint32_t b = mRemap[corner[2]];
+
+		// Triangles on the collapsed edge disappear
+		if (a == r1 || b == r1)
+			continue;
+
+		const XMFLOAT3& p0 = mVertices[r0].Pos;
+		const XMFLOAT3& pa = mVertices[a].Pos;
+		const XMFLOAT3& pb = mVertices[b].Pos;
+
+		XMFLOAT3 before = Cross(Sub(pa, p0), Sub(pb, p0));
+		XMFLOAT3 after = Cross(Sub(pa, target), Sub(pb, target));
+
+		float beforeLength = Dot(before, before);
+		float afterLength = Dot(after, after);
+		if (beforeLength == 0.0f)
+			continue;
+		if (afterLength == 0.0f)
+			return true;
+
+		// Keep the shading normal close to the original surface
+		float d = Dot(before, after);
+		if (d <= 0.0f || d * d < kMinNormalDot * kMinNormalDot * beforeLength * afterLength)
+			return true;
+	}
+
+	return false;
+}
+
+void MeshSimplifier::QuadricFromPlane(Quadric& Q, double a, double b, double c, double d, double w)
+{
+	Q.a00 = a * a * w;
+	Q.a11 = b * b * w;
+	Q.a22 = c * c * w;
+	Q.a10 = a * b * w;
+	Q.a20 = a * c * w;
+	Q.a21 = b * c * w;
+	Q.b0 = a * d * w;
+	Q.b1 = b * d * w;
+	Q.b2 = c * d * w;
+	Q.c = d * d * w;
+	Q.w = w;
+}
+
+void MeshSimplifier::QuadricAdd(Quadric& Q, const Quadric& R)
+{
+	Q.a00 += R.a00;
+	Q.a11 += R.a11;
+	Q.a22 += R.a22;
+	Q.a10 += R.a10;
+	Q.a20 += R.a20;
+	Q.a21 += R.a21;
+	Q.b0 += R.b0;
+	Q.b1 += R.b1;
+	Q.b2 += R.b2;
+	Q.c += R.c;
+	Q.w += R.w;
+}
+
+double MeshSimplifier::QuadricError(const Quadric& Q, const XMFLOAT3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+
+	double ax = Q.a00 * x + Q.a10 * y + Q.a20 * z;
+	double ay = Q.a10 * x + Q.a11 * y + Q.a21 * z;
+	double az = Q.a20 * x + Q.a21 * y + Q.a22 * z;
+
+	// v^T A v + 2 b^T v + c, area weighted squared distance to the planes
+	double r = ax * x + ay * y + az * z + 2.0 * (Q.b0 * x + Q.b1 * y + Q.b2 * z) + Q.c;
+
+	r = fabs(r);
+	return Q.w > 0.0 ? r / Q.w : r;
+}
@@ -0,0 +1,345 @@
+#include <thread>
+#include "TangentGenerator.h"
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	// Triangles flatter than about 0.05 degrees have no reliable tangent
+	const float kMinSinAngleSq = 1e-6f;
+
+	// Any unit vector perpendicular to the normal, for vertices without usable UVs
+	XMVECTOR PerpendicularTangent(FXMVECTOR normal)
+	{
+		XMVECTOR axis = fabsf(XMVectorGetX(normal)) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+		return XMVector3Normalize(XMVector3Cross(XMVector3Cross(normal, axis), normal));
+	}
+
+	XMVECTOR NormalizeTangent(FXMVECTOR sum, FXMVECTOR normal)
+	{
+		if (XMVectorGetX(XMVector3LengthSq(sum)) < 1e-12f)
+			return PerpendicularTangent(normal);
+		return XMVector3Normalize(sum);
+	}
+}
+
+TangentGenerator::TangentGenerator(UINT threadCount)
+	: mThreadCount(threadCount)
+{
+	if (mThreadCount == 0)
+		mThreadCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+}
+
+TangentGenerator::~TangentGenerator()
+{
+}
+
+template <typename Function>
+void TangentGenerator::ParallelFor(size_t count, Function function)
+{
+	// Small meshes are not worth the threads
+	const size_t minBatch = 4096;
+	size_t threadCount = (std::min)((size_t)mThreadCount, (count + minBatch - 1) / minBatch);
+	if (threadCount <= 1)
+	{
+		function(0, count);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	size_t batch = (count + threadCount - 1) / threadCount;
+	for (size_t begin = batch; begin < count; begin += batch)
+	{
+		threads.emplace_back(function, begin, (std::min)(begin + batch, count));
+	}
+	function(0, (std::min)(batch, count));
+
+	for (auto& e : threads)
+		e.join();
+}
+
+void TangentGenerator::Generate(
+	const std::vector<XMFLOAT3>& positions,
+	const std::vector<XMFLOAT3>& normals,
+	const std::vector<XMFLOAT2>& texC,
+	std::vector<uint32_t>& indices,
+	std::vector<XMFLOAT4>& outTangents,
+	std::vector<uint32_t>& outSplitSource)
+{
+	size_t vertexCount = positions.size();
+	size_t cornerCount = indices.size() - indices.size() % 3;
+
+	mCornerTangents.resize(cornerCount);
+	mCornerWeights.resize(cornerCount);
+
+	// Face tangent of every triangle, projected on the normal of each corner
+	ParallelFor(cornerCount / 3, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; ++t)
+		{
+			uint32_t v[3] = { indices[3 * t], indices[3 * t + 1], indices[3 * t + 2] };
+
+			XMVECTOR p0 = XMLoadFloat3(&positions[v[0]]);
+			XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&positions[v[1]]), p0);
+			XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&positions[v[2]]), p0);
+
+			float du1 = texC[v[1]].x - texC[v[0]].x;
+			float dv1 = texC[v[1]].y - texC[v[0]].y;
+			float du2 = texC[v[2]].x - texC[v[0]].x;
+			float dv2 = texC[v[2]].y - texC[v[0]].y;
+			float det = du1 * dv2 - du2 * dv1;
+
+			// cross(dP/du, dP/dv) = cross(e1, e2) / det, mirrored when it faces away from the normal
+			XMVECTOR faceN = XMVector3Cross(e1, e2);
+
+			// dP/du, slivers and degenerate UVs contribute nothing
+			XMVECTOR faceT = XMVectorZero();
+			float sinAngleSq = XMVectorGetX(XMVector3LengthSq(faceN)) / (XMVectorGetX(XMVector3LengthSq(e1)) * XMVectorGetX(XMVector3LengthSq(e2)));
+			if (fabsf(det) > 1e-20f && sinAngleSq > kMinSinAngleSq)
+				faceT = XMVectorScale(XMVectorSubtract(XMVectorScale(e1, dv2), XMVectorScale(e2, dv1)), 1.0f / det);
+
+			for (int c = 0; c < 3; ++c)
+			{
+				// Corner angle between the edges projected on the tangent plane of the vertex
+				XMVECTOR n = XMLoadFloat3(&normals[v[c]]);
+				XMVECTOR p = XMLoadFloat3(&positions[v[c]]);
+				XMVECTOR a = XMVectorSubtract(XMLoadFloat3(&positions[v[(c + 1) % 3]]), p);
+				XMVECTOR b = XMVectorSubtract(XMLoadFloat3(&positions[v[(c + 2) % 3]]), p);
+				a = XMVector3Normalize(XMVectorSubtract(a, XMVectorScale(n, XMVectorGetX(XMVector3Dot(n, a)))));
+				b = XMVector3Normalize(XMVectorSubtract(b, XMVectorScale(n, XMVectorGetX(XMVector3Dot(n, b)))));
+				float angle = acosf((std::max)(-1.0f, (std::min)(1.0f, XMVectorGetX(XMVector3Dot(a, b)))));
+
+				XMVECTOR tangent = XMVector3Normalize(XMVectorSubtract(faceT, XMVectorScale(n, XMVectorGetX(XMVector3Dot(n, faceT)))));
+				float sign = XMVectorGetX(XMVector3Dot(n, faceN)) * det < 0.0f ? -1.0f : 1.0f;
+				if (XMVectorGetX(XMVector3LengthSq(tangent)) == 0.0f)
+					angle = 0.0f;
+
+				// Signed weight, zero corners do not vote and stay on the original vertex
+				XMStoreFloat3(&mCornerTangents[3 * t + c], XMVectorScale(tangent, angle));
+				mCornerWeights[3 * t + c] = sign * angle;
+			}
+		}
+	});
+
+	// Corners around each vertex, in triangle order
+	mCornerOffsets.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < cornerCount; ++i)
+		mCornerOffsets[indices[i] + 1]++;
+	for (size_t i = 0; i < vertexCount; ++i)
+		mCornerOffsets[i + 1] += mCornerOffsets[i];
+
+	mCorners.resize(cornerCount);
+	std::vector<uint32_t> fill(mCornerOffsets.begin(), mCornerOffsets.end() - 1);
+	for (size_t i = 0; i < cornerCount; ++i)
+		mCorners[fill[indices[i]]++] = (uint32_t)i;
+
+	// Sum the corners of each handedness, the heavier side keeps the vertex
+	outTangents.resize(vertexCount);
+	mMinorTangents.resize(vertexCount);
+	mSplit.assign(vertexCount, 0);
+	ParallelFor(vertexCount, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; ++v)
+		{
+			XMVECTOR sum[2] = { XMVectorZero(), XMVectorZero() };
+			float weight[2] = { 0.0f, 0.0f };
+			for (uint32_t i = mCornerOffsets[v]; i < mCornerOffsets[v + 1]; ++i)
+			{
+				uint32_t corner = mCorners[i];
+				int side = mCornerWeights[corner] < 0.0f ? 1 : 0;
+				sum[side] = XMVectorAdd(sum[side], XMLoadFloat3(&mCornerTangents[corner]));
+				weight[side] += fabsf(mCornerWeights[corner]);
+			}
+
+			// Ties, like both sides of a symmetric seam, go to the unmirrored side
+			int major = weight[1] > weight[0] * 1.0001f ? 1 : 0;
+			XMVECTOR n = XMLoadFloat3(&normals[v]);
+			XMStoreFloat4(&outTangents[v], XMVectorSetW(NormalizeTangent(sum[major], n), major == 0 ? 1.0f : -1.0f));
+
+			mSplit[v] = (weight[0] > 0.0f && weight[1] > 0.0f) ? 1 : 0;
+			if (mSplit[v])
+				XMStoreFloat3(&mMinorTangents[v], NormalizeTangent(sum[1 - major], n));
+		}
+	});
+
+	// Mirrored UV seams: the lighter side moves to a copy of the vertex
+	outSplitSource.clear();
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (!mSplit[v])
+			continue;
+
+		uint32_t copy = (uint32_t)(vertexCount + outSplitSource.size());
+		outSplitSource.push_back((uint32_t)v);
+
+		float minorSign = -outTangents[v].w;
+		const XMFLOAT3& t = mMinorTangents[v];
+		outTangents.push_back(XMFLOAT4(t.x, t.y, t.z, minorSign));
+
+		for (uint32_t i = mCornerOffsets[v]; i < mCornerOffsets[v + 1]; ++i)
+		{
+			uint32_t corner = mCorners[i];
+			if (mCornerWeights[corner] * minorSign > 0.0f)
+				indices[corner] = copy;
+		}
+	}
+}
+
+void TangentGenerator::GenerateReference(
+	const std::vector<XMFLOAT3>& positions,
+	const std::vector<XMFLOAT3>& normals,
+	const std::vector<XMFLOAT2>& texC,
+	std::vector<uint32_t>& indices,
+	std::vector<XMFLOAT4>& outTangents,
+	std::vector<uint32_t>& outSplitSource)
+{
+	auto sub = [](const XMFLOAT3& a, const XMFLOAT3& b) { return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z); };
+	auto dot = [](const XMFLOAT3& a, const XMFLOAT3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; };
+	auto cross = [](const XMFLOAT3& a, const XMFLOAT3& b) { return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); };
+	auto normalize = [&](const XMFLOAT3& a)
+	{
+		float length = sqrtf(dot(a, a));
+		return length > 0.0f ? XMFLOAT3(a.x / length, a.y / length, a.z / length) : XMFLOAT3(0.0f, 0.0f, 0.0f);
+	};
+
+	size_t vertexCount = positions.size();
+	size_t cornerCount = indices.size() - indices.size() % 3;
+
+	// [vertex][side] weighted tangent sums, side 1 is the mirrored one
+	std::vector<XMFLOAT3> sum(vertexCount * 2, XMFLOAT3(0.0f, 0.0f, 0.0f));
+	std::vector<float> weight(vertexCount * 2, 0.0f);
+	std::vector<float> cornerSigns(cornerCount);
+
+	for (size_t t = 0; t < cornerCount / 3; ++t)
+	{
+		uint32_t v[3] = { indices[3 * t], indices[3 * t + 1], indices[3 * t + 2] };
+		XMFLOAT3 e1 = sub(positions[v[1]], positions[v[0]]);
+		XMFLOAT3 e2 = sub(positions[v[2]], positions[v[0]]);
+		float du1 = texC[v[1]].x - texC[v[0]].x;
+		float dv1 = texC[v[1]].y - texC[v[0]].y;
+		float du2 = texC[v[2]].x - texC[v[0]].x;
+		float dv2 = texC[v[2]].y - texC[v[0]].y;
+		float det = du1 * dv2 - du2 * dv1;
+
+		XMFLOAT3 faceN = cross(e1, e2);
+		XMFLOAT3 faceT(0.0f, 0.0f, 0.0f);
+		if (fabsf(det) > 1e-20f && dot(faceN, faceN) / (dot(e1, e1) * dot(e2, e2)) > kMinSinAngleSq)
+		{
+			float r = 1.0f / det;
+			faceT = XMFLOAT3((e1.x * dv2 - e2.x * dv1) * r, (e1.y * dv2 - e2.y * dv1) * r, (e1.z * dv2 - e2.z * dv1) * r);
+		}
+
+		for (int c = 0; c < 3; ++c)
+		{
+			const XMFLOAT3& n = normals[v[c]];
+			XMFLOAT3 a = sub(positions[v[(c + 1) % 3]], positions[v[c]]);
+			XMFLOAT3 b = sub(positions[v[(c + 2) % 3]], positions[v[c]]);
+			float da = dot(n, a);
+			float db = dot(n, b);
+			a = normalize(XMFLOAT3(a.x - n.x * da, a.y - n.y * da, a.z - n.z * da));
+			b = normalize(XMFLOAT3(b.x - n.x * db, b.y - n.y * db, b.z - n.z * db));
+			float angle = acosf((std::max)(-1.0f, (std::min)(1.0f, dot(a, b))));
+
+			float d = dot(n, faceT);
+			XMFLOAT3 tangent = normalize(XMFLOAT3(faceT.x - n.x * d, faceT.y - n.y * d, faceT.z - n.z * d));
+			float sign = dot(n, faceN) * det < 0.0f ? -1.0f : 1.0f;
+			if (dot(tangent, tangent) == 0.0f)
+				angle = 0.0f;
+			cornerSigns[3 * t + c] = angle > 0.0f ? sign : 0.0f;
+
+			int side = sign < 0.0f ? 1 : 0;
+			XMFLOAT3& s = sum[2 * v[c] + side];
+			s.x += tangent.x * angle;
+			s.y += tangent.y * angle;
+			s.z += tangent.z * angle;
+			weight[2 * v[c] + side] += angle;
+		}
+	}
+
+	outTangents.resize(vertexCount);
+	std::vector<XMFLOAT4> minorTangents(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		XMFLOAT3 side[2];
+		for (int s = 0; s < 2; ++s)
+		{
+			side[s] = normalize(sum[2 * v + s]);
+			if (dot(sum[2 * v + s], sum[2 * v + s]) < 1e-12f)
+			{
+				// Same fallback as Generate
+				const XMFLOAT3& n = normals[v];
+				XMFLOAT3 axis = fabsf(n.x) < 0.9f ? XMFLOAT3(1.0f, 0.0f, 0.0f) : XMFLOAT3(0.0f, 1.0f, 0.0f);
+				side[s] = normalize(cross(cross(n, axis), n));
+			}
+		}
+
+		int major = weight[2 * v + 1] > weight[2 * v] * 1.0001f ? 1 : 0;
+		outTangents[v] = XMFLOAT4(side[major].x, side[major].y, side[major].z, major == 0 ? 1.0f : -1.0f);
+		minorTangents[v] = XMFLOAT4(side[1 - major].x, side[1 - major].y, side[1 - major].z, major == 0 ? -1.0f : 1.0f);
+	}
+
+	outSplitSource.clear();
+	std::vector<uint32_t> copies(vertexCount, UINT32_MAX);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (weight[2 * v] > 0.0f && weight[2 * v + 1] > 0.0f)
+		{
+			copies[v] = (uint32_t)(vertexCount + outSplitSource.size());
+			outSplitSource.push_back((uint32_t)v);
+			outTangents.push_back(minorTangents[v]);
+		}
+	}
+	for (size_t i = 0; i < cornerCount; ++i)
+	{
+		uint32_t v = indices[i];
+		if (copies[v] != UINT32_MAX && cornerSigns[i] == minorTangents[v].w)
+			indices[i] = copies[v];
+	}
+}
+
+XMSHORTN4 TangentGenerator::PackQTangent(const XMFLOAT3& normal, const XMFLOAT4& tangent)
+{
+	XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&normal));
+	XMVECTOR t = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&tangent));
+	t = XMVector3Normalize(XMVectorSubtract(t, XMVectorScale(n, XMVectorGetX(XMVector3Dot(n, t)))));
+	if (XMVectorGetX(XMVector3LengthSq(t)) < 0.5f)
+		t = PerpendicularTangent(n);
+
+	// Rows are where the rotation takes the x, y and z axes
+	XMMATRIX frame;
+	frame.r[0] = t;
+	frame.r[1] = XMVector3Cross(n, t);
+	frame.r[2] = n;
+	frame.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	XMVECTOR q = XMQuaternionNormalize(XMQuaternionRotationMatrix(frame));
+
+	// q and -q are the same rotation, so the sign of w is free to store the handedness.
+	// w must stay away from zero after quantization or its sign is lost.
+	if (XMVectorGetW(q) < 0.0f)
+		q = XMVectorNegate(q);
+
+	const float bias = 1.0f / 32767.0f;
+	if (XMVectorGetW(q) < bias)
+	{
+		float scale = sqrtf(1.0f - bias * bias);
+		q = XMVectorSetW(XMVectorScale(q, scale), bias);
+	}
+
+	if (tangent.w < 0.0f)
+		q = XMVectorNegate(q);
+
+	XMSHORTN4 packed;
+	XMStoreShortN4(&packed, q);
+	return packed;
+}
+
+void TangentGenerator::UnpackQTangent(const XMSHORTN4& qTangent, XMFLOAT3& outNormal, XMFLOAT4& outTangent)
+{
+	XMVECTOR q = XMQuaternionNormalize(XMLoadShortN4(&qTangent));
+
+	XMStoreFloat3(&outNormal, XMVector3Rotate(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), q));
+	XMStoreFloat4(&outTangent, XMVectorSetW(
+		XMVector3Rotate(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), q),
+		XMVectorGetW(q) < 0.0f ? -1.0f : 1.0f));
+}